@@ -24,6 +24,7 @@
 #include <boilerplate/list.h>
 #include <copperplate/threadobj.h>
 #include <alchemy/timer.h>
+#include <alchemy/event.h>
 #include <alchemy/compat.h>
 
 /**
@@ -127,6 +128,9 @@ CURRENT_DECL(int, rt_task_set_periodic(RT_TASK *task,
 
 int rt_task_wait_period(unsigned long *overruns_r);
 
+int rt_task_set_budget(RT_TASK *task, RTIME budget,
+		       RT_EVENT *event, unsigned int mask);
+
 int rt_task_sleep(RTIME delay);
 
 int rt_task_sleep_until(RTIME date);
@@ -199,6 +203,28 @@ int rt_task_receive(RT_TASK_MCB *mcb_r, RTIME timeout)
 int rt_task_reply(int flowid,
 		  RT_TASK_MCB *mcb_s);
 
+int rt_task_reply_receive_timed(int flowid, RT_TASK_MCB *mcb_s,
+				RT_TASK_MCB *mcb_r,
+				const struct timespec *abs_timeout);
+
+static inline
+int rt_task_reply_receive_until(int flowid, RT_TASK_MCB *mcb_s,
+				RT_TASK_MCB *mcb_r, RTIME timeout)
+{
+	struct timespec ts;
+	return rt_task_reply_receive_timed(flowid, mcb_s, mcb_r,
+					   alchemy_abs_timeout(timeout, &ts));
+}
+
+static inline
+int rt_task_reply_receive(int flowid, RT_TASK_MCB *mcb_s,
+			  RT_TASK_MCB *mcb_r, RTIME timeout)
+{
+	struct timespec ts;
+	return rt_task_reply_receive_timed(flowid, mcb_s, mcb_r,
+					   alchemy_rel_timeout(timeout, &ts));
+}
+
 int rt_task_bind(RT_TASK *task,
 		 const char *name, RTIME timeout);
 
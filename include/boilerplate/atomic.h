@@ -62,6 +62,16 @@ static inline void atomic_set(atomic_t *ptr, long v)
 	__sync_add_and_fetch(&(__ptr)->v, __n)
 #endif
 
+#ifndef atomic_fetch_or
+#define atomic_fetch_or(__ptr, __n)	\
+	__sync_fetch_and_or(&(__ptr)->v, __n)
+#endif
+
+#ifndef atomic_fetch_and
+#define atomic_fetch_and(__ptr, __n)	\
+	__sync_fetch_and_and(&(__ptr)->v, __n)
+#endif
+
 #ifdef CONFIG_SMP
 #ifndef smp_mb
 #define smp_mb()	__sync_synchronize()
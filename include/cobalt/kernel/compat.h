@@ -64,6 +64,7 @@ struct compat_sched_tp_window {
 struct __compat_sched_config_tp {
 	int op;
 	int nr_windows;
+	int slot;
 	struct compat_sched_tp_window windows[0];
 };
 
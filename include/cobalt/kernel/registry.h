@@ -130,6 +130,22 @@ struct xnpnode_link {
 
 extern struct xnobject *registry_obj_slots;
 
+/*
+ * Removal generations, hashed on the handle index. A cached handle
+ * lookup remains valid as long as the generation of its bucket did
+ * not change, removing an object only invalidates the lookups
+ * sharing its bucket. nklock-protected.
+ */
+#define XNREGISTRY_GEN_BUCKETS  64
+
+extern unsigned long registry_obj_gen[XNREGISTRY_GEN_BUCKETS];
+
+static inline unsigned long xnregistry_gen(xnhandle_t handle)
+{
+	return registry_obj_gen[xnhandle_get_index(handle) &
+				(XNREGISTRY_GEN_BUCKETS - 1)];
+}
+
 static inline struct xnobject *xnregistry_validate(xnhandle_t handle)
 {
 	struct xnobject *object;
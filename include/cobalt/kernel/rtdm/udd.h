@@ -70,6 +70,13 @@
  * events by calling the udd_notify_event() service.
  */
 #define UDD_IRQ_CUSTOM   (-1)
+/**
+ * Device-specific status which the ->interrupt() handler may or into
+ * its return value, for logging into the @ref udd_event_ring "event
+ * ring". The UDD core strips it before returning to the interrupt
+ * layer.
+ */
+#define UDD_IRQ_STATUS(__s)  ((__s) << 16)
 /** @} */
 
 /**
@@ -303,10 +310,21 @@ struct udd_device {
 	 * @ref udd_memory_region "UDD memory regions".
 	 */
 	struct udd_memregion mem_regions[UDD_NR_MAPS];
+	/**
+	 * Number of entries in the @ref udd_event_ring "event ring",
+	 * which must be a power of two. Zero disables the ring, in
+	 * which case read(2) only returns the count of IRQ events.
+	 */
+	int nr_events;
 	/** Reserved to the UDD core. */
 	struct udd_reserved {
 		rtdm_irq_t irqh;
 		atomic_t event;
+		struct udd_event_ring *ring;
+		size_t ring_len;
+		u32 ring_mask;
+		u32 ring_head;
+		rtdm_lock_t ring_lock;
 		struct udd_signotify signfy;
 		struct rtdm_event pulse;
 		struct rtdm_driver driver;
@@ -315,7 +333,7 @@ struct udd_device {
 		struct udd_mapper {
 			struct udd_device *udd;
 			struct rtdm_device dev;
-		} mapdev[UDD_NR_MAPS];
+		} mapdev[UDD_NR_MAPS + 1]; /* Last one maps the ring. */
 		char *mapper_name;
 		int nr_maps;
 	} __reserved;
@@ -329,6 +347,8 @@ struct udd_device *udd_get_device(struct rtdm_fd *fd);
 
 void udd_notify_event(struct udd_device *udd);
 
+void udd_notify_event_status(struct udd_device *udd, u32 status);
+
 void udd_enable_irq(struct udd_device *udd,
 		    rtdm_event_t *done);
 
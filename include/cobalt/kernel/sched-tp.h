@@ -39,11 +39,24 @@ extern struct xnsched_class xnsched_class_tp;
 
 struct xnsched_tp_window {
 	xnticks_t w_offset;
+	/** Offset of the window end, i.e. of the next window. */
+	xnticks_t w_end;
 	int w_part;
+	/** Count of window activations */
+	unsigned long w_count;
+	/** Count of windows closed with the partition still busy */
+	unsigned long w_overruns;
+	/** Shortest and accumulated idle time left by the partition */
+	xnticks_t w_slack_min;
+	xnticks_t w_slack_sum;
+	/** Worst delay in starting the window */
+	xnticks_t w_jitter_max;
 };
 
 struct xnsched_tp_schedule {
 	int pwin_nr;
+	/** Slot the schedule was loaded into. */
+	int slot;
 	xnticks_t tf_duration;
 	atomic_t refcount;
 	struct xnsched_tp_window pwins[0];
@@ -60,12 +73,20 @@ struct xnsched_tp {
 	struct xnsched_tpslot *tps;
 	/** Time frame timer */
 	struct xntimer tf_timer;
+	/** Preloaded partition schedules */
+	struct xnsched_tp_schedule *schedules[CONFIG_XENO_OPT_SCHED_TP_NRSCHED];
 	/** Global partition schedule */
 	struct xnsched_tp_schedule *gps;
-	/** Window index of next partition */
-	int wnext;
-	/** Start of next time frame */
+	/** Schedule to switch to at the next time frame boundary */
+	struct xnsched_tp_schedule *pending;
+	/** Window index of current partition */
+	int wcur;
+	/** Start of current time frame */
 	xnticks_t tf_start;
+	/** Start of idle time in current window, zero if busy */
+	xnticks_t slack_start;
+	/** Idle time accumulated in current window */
+	xnticks_t slack;
 	/** Assigned thread queue */
 	struct list_head threads;
 };
@@ -81,6 +102,12 @@ struct xnsched_tp_schedule *
 xnsched_tp_set_schedule(struct xnsched *sched,
 			struct xnsched_tp_schedule *gps);
 
+struct xnsched_tp_schedule *
+xnsched_tp_load_schedule(struct xnsched *sched, int slot,
+			 struct xnsched_tp_schedule *gps);
+
+int xnsched_tp_switch_schedule(struct xnsched *sched, int slot);
+
 void xnsched_tp_start_schedule(struct xnsched *sched);
 
 void xnsched_tp_stop_schedule(struct xnsched *sched);
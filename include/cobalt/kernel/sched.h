@@ -122,7 +122,7 @@ extern struct list_head nkthreadq;
 extern int cobalt_nrthreads;
 
 #ifdef CONFIG_XENO_OPT_VFILE
-extern struct xnvfile_rev_tag nkthreadlist_tag;
+extern struct xnvfile_list nkthreadlist;
 #endif
 
 union xnsched_policy_param;
@@ -40,6 +40,13 @@ struct xnselector {
 	} fds [XNSELECT_MAX_TYPES];
 	struct list_head destroy_link;
 	struct list_head bindings; /* only used by xnselector_destroy */
+	struct list_head ready;	/* bindings with a pending bit set */
+	unsigned int nr_ready;
+	/* Sets the sleeper waits for, NULL unless sleeping. */
+	fd_set **wait_fds;
+	unsigned int wait_nfds;
+	/* A binding was dropped since the last lookup. */
+	int stale;
 };
 
 #define __NFDBITS__	(8 * sizeof(unsigned long))
@@ -94,6 +101,7 @@ struct xnselect_binding {
 	unsigned int bit_index;
 	struct list_head link;  /* link in selected fds list. */
 	struct list_head slink; /* link in selector list */
+	struct list_head rlink; /* link in selector ready list */
 };
 
 void xnselect_init(struct xnselect *select_block);
@@ -49,6 +49,7 @@
 
 struct xnthread;
 struct xnsynch;
+struct xnsynch_prioq;
 
 struct xnsynch {
 	/** wait (weighted) prio in thread->boosters */
@@ -64,6 +65,10 @@ struct xnsynch {
 	unsigned long status;
 	/** Pending threads */
 	struct list_head pendq;
+#ifdef CONFIG_XENO_OPT_SCALABLE_SYNCH
+	/** Priority index of pendq, built when it grows long */
+	struct xnsynch_prioq *prioq;
+#endif
 	/** Thread which owns the resource */
 	struct xnthread *owner;
 	 /** Pointer to fast lock word */
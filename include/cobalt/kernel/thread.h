@@ -85,6 +85,42 @@ struct xnthread_personality {
 	struct module *module;
 };
 
+/*
+ * CPU time budget a thread may consume in primary mode over each
+ * replenishment period. The handler is called from the depletion
+ * timer context with nklock held, the first time the budget runs
+ * out within a period.
+ */
+struct xnthread_budget {
+	struct xnthread *thread;
+	struct xntimer dtimer;	/* Depletion timer */
+	struct xntimer rtimer;	/* Replenishment timer */
+	xnticks_t quantum;	/* Budget per period (ns) */
+	xnticks_t left;		/* Budget left in current period (ns) */
+	xnticks_t resume_date;	/* Date of last switch in */
+	unsigned long overruns;	/* Periods in which budget ran out */
+	void (*handler)(struct xnthread_budget *budget);
+};
+
+/*
+ * Release group: periodic threads whose periods are multiples of a
+ * common base period share a single timer ticking at that base
+ * period, instead of running one timer each. A single shot readies
+ * every member due at this point, in priority order.
+ */
+struct xnrgroup {
+	struct xntimer timer;	/* Group timer, ticking at base period */
+	xnticks_t base;		/* Base period (ns), zero if unused */
+	struct list_head members; /* Members, by decreasing priority */
+	int nmembers;
+	unsigned long long expiries; /* Group timer shots */
+	unsigned long long releases; /* Threads readied by those shots */
+	unsigned long long nsamples; /* Release lateness samples */
+	xnsticks_t jitter_min;	/* Release lateness seen by members (ns) */
+	xnsticks_t jitter_max;
+	xnsticks_t jitter_sum;
+};
+
 struct xnthread {
 	struct xnarchtcb tcb;	/* Architecture-dependent block */
 
@@ -134,6 +170,10 @@ struct xnthread {
 	 * thread->cprio + scheduling class weight.
 	 */
 	struct list_head plink;
+#ifdef CONFIG_XENO_OPT_SCALABLE_SYNCH
+	/** Weighted priority plink was queued with. */
+	int pwprio;
+#endif
 
 	/** Thread holder in global queue. */
 	struct list_head glink;
@@ -164,6 +204,14 @@ struct xnthread {
 
 	xnticks_t rrperiod;		/* Allotted round-robin period (ns) */
 
+	struct xnthread_budget *budget;	/* Active CPU time budget, if any */
+
+	struct xnrgroup *rgroup;	/* Release group, if any */
+	struct list_head rglink;	/* Link in release group */
+	unsigned long rgmult;		/* Period, in group ticks */
+	xnticks_t rgnext;		/* Group tick of next expected release */
+	xnticks_t rgdue;		/* Group tick of next wakeup */
+
   	struct xnthread_wait_context *wcontext;	/* Active wait context. */
 
 	struct {
@@ -474,8 +522,46 @@ int xnthread_set_periodic(struct xnthread *thread,
 			  xntmode_t timeout_mode,
 			  xnticks_t period);
 
+int xnthread_set_periodic_group(struct xnthread *thread,
+				xnticks_t idate,
+				xntmode_t timeout_mode,
+				xnticks_t period,
+				xnticks_t base);
+
 int xnthread_wait_period(unsigned long *overruns_r);
 
+#ifdef CONFIG_XENO_OPT_VFILE
+void xnthread_init_proc(void);
+void xnthread_cleanup_proc(void);
+#else /* !CONFIG_XENO_OPT_VFILE */
+static inline void xnthread_init_proc(void) { }
+static inline void xnthread_cleanup_proc(void) { }
+#endif /* !CONFIG_XENO_OPT_VFILE */
+
+void xnthread_init_budget(struct xnthread_budget *budget,
+			  struct xnthread *thread,
+			  void (*handler)(struct xnthread_budget *budget));
+
+int xnthread_start_budget(struct xnthread_budget *budget,
+			  xnticks_t quantum,
+			  xnticks_t idate,
+			  xntmode_t timeout_mode,
+			  xnticks_t period);
+
+void xnthread_stop_budget(struct xnthread_budget *budget);
+
+void xnthread_destroy_budget(struct xnthread_budget *budget);
+
+void __xnthread_switch_budget(struct xnthread *prev,
+			      struct xnthread *next);
+
+static inline void xnthread_switch_budget(struct xnthread *prev,
+					  struct xnthread *next)
+{
+	if (unlikely(prev->budget || next->budget))
+		__xnthread_switch_budget(prev, next);
+}
+
 int xnthread_set_slice(struct xnthread *thread,
 		       xnticks_t quantum);
 
@@ -408,7 +408,11 @@ struct xnvfile_snapshot_ops {
 	 * data collection phase succeeds whenever all records can be
 	 * fetched via the @ref snapshot_next "next() handler", while
 	 * the revision tag remains unchanged, which indicates that a
-	 * consistent snapshot of the object state was taken.
+	 * consistent snapshot of the object state was taken. Vfiles
+	 * scanning an @ref snapshot_list "object list" have no
+	 * revision tag; the handler is called up to
+	 * VFILE_SNAPSHOT_CHUNK times per lock section instead, and
+	 * each record is consistent on its own.
 	 */
 	int (*next)(struct xnvfile_snapshot_iterator *it, void *data);
 	/**
@@ -484,6 +488,30 @@ struct xnvfile_rev_tag {
 	int rev;
 };
 
+/**
+ * @brief Snapshot object list
+ * @anchor snapshot_list
+ *
+ * This structure describes a list of objects scanned by @ref
+ * snapshot_vfile "snapshot-driven vfiles" in chunks, with the vfile
+ * lock released in between. Each snapshot being collected keeps a
+ * cursor on the list, which xnvfile_list_del() moves past the object
+ * being unlinked. The list and the cursors are protected by nklock,
+ * which the vfile lock must hold.
+ */
+struct xnvfile_list {
+	/** Head of the object list. */
+	struct list_head *head;
+	/** Cursors of the snapshots being collected. */
+	struct list_head cursors;
+};
+
+#define XNVFILE_LIST_INITIALIZER(__name, __head)			\
+	{								\
+		.head = (__head),					\
+		.cursors = LIST_HEAD_INIT((__name).cursors),		\
+	}
+
 struct xnvfile_snapshot_template {
 	size_t privsz;
 	size_t datasz;
@@ -508,6 +536,7 @@ struct xnvfile_snapshot {
 	size_t privsz;
 	size_t datasz;
 	struct xnvfile_rev_tag *tag;
+	struct xnvfile_list *list;
 	struct xnvfile_snapshot_ops *ops;
 };
 
@@ -528,6 +557,10 @@ struct xnvfile_snapshot_iterator {
 	struct xnvfile_snapshot *vfile;
 	/** Buffer release handler. */
 	void (*endfn)(struct xnvfile_snapshot_iterator *it, void *buf);
+	/** Next object to collect from vfile->list. */
+	struct list_head *pos;
+	/** Link into the cursor list of vfile->list. */
+	struct list_head cursor;
 	/**
 	 * Start of private area. Use xnvfile_iterator_priv() to
 	 * address it.
@@ -550,6 +583,9 @@ struct xnvfile_link {
 /* vfile.next/show()=> */
 #define VFILE_SEQ_SKIP			2
 
+/* Max. number of records collected per lock section from a list. */
+#define VFILE_SNAPSHOT_CHUNK		8
+
 #define xnvfile_printf(it, args...)	seq_printf((it)->seq, ##args)
 #define xnvfile_write(it, data, len)	seq_write((it)->seq, (data),(len))
 #define xnvfile_puts(it, s)		seq_puts((it)->seq, (s))
@@ -565,6 +601,34 @@ static inline void xnvfile_touch(struct xnvfile_snapshot *vfile)
 	xnvfile_touch_tag(vfile->tag);
 }
 
+/* nklock held, irqs off */
+static inline void xnvfile_list_del(struct xnvfile_list *list,
+				    struct list_head *item)
+{
+	struct xnvfile_snapshot_iterator *it;
+
+	list_for_each_entry(it, &list->cursors, cursor) {
+		if (it->pos == item)
+			it->pos = item->next;
+	}
+
+	list_del(item);
+}
+
+/* vfile lock held */
+static inline
+struct list_head *xnvfile_list_next(struct xnvfile_snapshot_iterator *it)
+{
+	struct list_head *pos = it->pos;
+
+	if (pos == it->vfile->list->head)
+		return NULL;
+
+	it->pos = pos->next;
+
+	return pos;
+}
+
 #define xnvfile_noentry			\
 	{				\
 		.pde = NULL,		\
@@ -660,6 +724,8 @@ void xnvfile_destroy_link(struct xnvfile_link *vlink)
 
 #define xnvfile_touch(vfile)	do { } while (0)
 
+#define xnvfile_list_del(list, item)	list_del(item)
+
 #endif /* !CONFIG_XENO_OPT_VFILE */
 
 /** @} */
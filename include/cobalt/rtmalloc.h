@@ -0,0 +1,60 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COBALT_RTMALLOC_H
+#define _COBALT_RTMALLOC_H
+
+#include <sys/types.h>
+#include <pthread.h>
+
+/*
+ * Statistics of the real-time malloc layer (librtmalloc), per
+ * Cobalt thread. Blocks are accounted to the thread which allocated
+ * them, regardless of the thread releasing them.
+ */
+struct rtmalloc_stats {
+	pthread_t thread;
+	int alive;
+	unsigned long nr_allocs;
+	unsigned long nr_frees;
+	/* Requests the arena could not satisfy in primary mode. */
+	unsigned long nr_failures;
+	/* Bytes currently allocated, and high-water mark. */
+	size_t in_use;
+	size_t peak;
+};
+
+struct rtmalloc_arena_stats {
+	size_t size;
+	size_t used;
+	size_t peak;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int rtmalloc_get_stats(struct rtmalloc_stats *stats);
+
+int rtmalloc_walk_stats(int (*walk)(const struct rtmalloc_stats *stats,
+				    void *arg), void *arg);
+
+int rtmalloc_get_arena_stats(struct rtmalloc_arena_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _COBALT_RTMALLOC_H */
@@ -58,6 +58,20 @@ int cobalt_corectl(int request, void *buf, size_t bufsz);
 int cobalt_thread_stat(pid_t pid,
 		       struct cobalt_threadstat *stat);
 
+int cobalt_thread_setbudget(pid_t pid,
+			    const struct cobalt_budget_config *config);
+
+int cobalt_thread_getbudget(pid_t pid,
+			    struct cobalt_budget_info *info);
+
+int cobalt_thread_setperiodic(pid_t pid,
+			      const struct cobalt_period_config *config);
+
+int cobalt_thread_waitperiod(unsigned long *overruns_r);
+
+int cobalt_thread_getperiodic(pid_t pid,
+			      struct cobalt_period_info *info);
+
 int cobalt_serial_debug(const char *fmt, ...);
 
 void __cobalt_commit_memory(void *p, size_t len);
@@ -0,0 +1,74 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COBALT_UAPI_MQUEUE_H
+#define _COBALT_UAPI_MQUEUE_H
+
+#include <cobalt/uapi/kernel/types.h>
+
+/*
+ * Creation flag (mq_attr.mq_flags): back the queue with a ring
+ * living in the shared memory heap, which openers map. Messages of
+ * priority zero are exchanged through the ring from userland,
+ * entering the kernel only to block or wake up a peer. Messages of
+ * higher priority still go through the kernel queue, and are
+ * received first.
+ */
+#define MQ_SHRING	0x40000000
+
+/* Ring status flags, only written by the kernel. */
+#define COBALT_MQ_RING_NOTIFY	0x1	/* mq_notify() armed. */
+#define COBALT_MQ_RING_SELECT	0x2	/* select() binding exists. */
+
+/* Wait requests (sc_cobalt_mq_ringwait). */
+#define COBALT_MQ_WAIT_RECV	0
+#define COBALT_MQ_WAIT_SEND	1
+
+/*
+ * Bounded MPMC ring: a slot at position pos may be filled when its
+ * sequence is pos, and consumed when it is pos + 1. Consumers
+ * release it to the next lap by setting it to pos + nslots.
+ */
+struct cobalt_mq_slot {
+	atomic_t seq;
+	__u32 len;
+	char data[0];
+};
+
+struct cobalt_mq_ring {
+	__u32 nslots;		/* Power of 2, >= maxmsg. */
+	__u32 maxmsg;
+	__u32 msgsize;
+	__u32 stride;		/* Distance between slots. */
+	atomic_t flags;
+	/* Threads sleeping in the kernel, waiting for a peer. */
+	atomic_t rwaiters;
+	atomic_t swaiters;
+	/* Messages held by the kernel queue. */
+	atomic_t kqueued;
+	atomic_t head;
+	__u32 __pad1[15];
+	atomic_t tail;
+	__u32 __pad2[15];
+};
+
+static inline struct cobalt_mq_slot *
+cobalt_mq_ring_slot(struct cobalt_mq_ring *ring, unsigned int pos)
+{
+	return (struct cobalt_mq_slot *)
+		((char *)(ring + 1) + (pos & (ring->nslots - 1)) * ring->stride);
+}
+
+#endif /* !_COBALT_UAPI_MQUEUE_H */
@@ -65,11 +65,14 @@ enum {
 	sched_tp_uninstall,
 	sched_tp_start,
 	sched_tp_stop,
+	sched_tp_load,
+	sched_tp_switch,
 };
 	
 struct __sched_config_tp {
 	int op;
 	int nr_windows;
+	int slot;
 	struct sched_tp_window windows[0];
 };
 
@@ -121,6 +121,14 @@
 #define sc_cobalt_recvmmsg			98
 #define sc_cobalt_sendmmsg			99
 #define sc_cobalt_clock_adjtime			100
+#define sc_cobalt_thread_setbudget		101
+#define sc_cobalt_thread_getbudget		102
+#define sc_cobalt_mq_ringinfo			103
+#define sc_cobalt_mq_ringwait			104
+#define sc_cobalt_mq_ringkick			105
+#define sc_cobalt_thread_setperiodic		106
+#define sc_cobalt_thread_waitperiod		107
+#define sc_cobalt_thread_getperiodic		108
 
 #define __NR_COBALT_SYSCALLS			128 /* Power of 2 */
 
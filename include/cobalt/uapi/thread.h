@@ -52,4 +52,41 @@ struct cobalt_threadstat {
 	char personality[XNOBJECT_NAME_LEN];
 };
 
+struct cobalt_budget_config {
+	__u64 quantum;		/* CPU time per period (ns), zero disables. */
+	__u64 idate;		/* First replenishment (ns), zero for now + period. */
+	__u64 period;		/* Replenishment period (ns). */
+	__s32 clock;		/* Clock idate refers to. */
+	__s32 signo;		/* Signal queued upon overrun, or zero. */
+	xnhandle_t event;	/* Event flag group posted upon overrun. */
+	__u32 evbits;		/* Flags posted to the event group. */
+};
+
+struct cobalt_budget_info {
+	__u64 quantum;
+	__u64 left;
+	__u32 overruns;
+	__u32 __pad;
+};
+
+struct cobalt_period_config {
+	__u64 idate;		/* First release (ns), zero for now + period. */
+	__u64 period;		/* Release period (ns), zero stops. */
+	__u64 base;		/* Release group base period (ns), or zero. */
+	__s32 clock;		/* Clock idate refers to. */
+	__u32 __pad;
+};
+
+struct cobalt_period_info {
+	__u64 period;
+	__u64 base;		/* Zero unless in a release group. */
+	__u64 expiries;		/* Group timer shots. */
+	__u64 releases;		/* Threads readied by those shots. */
+	__s64 jitter_min;	/* Release lateness of members (ns). */
+	__s64 jitter_avg;
+	__s64 jitter_max;
+	__u32 members;
+	__u32 __pad;
+};
+
 #endif /* !_COBALT_UAPI_THREAD_H */
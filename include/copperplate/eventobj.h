@@ -50,7 +50,8 @@ struct eventobj_wait_struct {
 
 struct eventobj_corespec {
 	struct syncobj sobj;
-	unsigned int value;
+	atomic_t value;
+	atomic_t waiters;
 	int flags;
 };
 
@@ -0,0 +1,240 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#ifndef _COPPERPLATE_METRICOBJ_H
+#define _COPPERPLATE_METRICOBJ_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <boilerplate/atomic.h>
+#include <copperplate/registry.h>
+
+/*
+ * A metric channel is a named shared memory region holding typed
+ * metrics, which real-time threads update with plain memory
+ * operations, and Linux processes sample by mapping the region
+ * read-only. The layout below is the contract between both sides;
+ * it only refers to its own contents by offset, so that readers may
+ * map it anywhere.
+ */
+
+#define METRICOBJ_MAGIC		0x4d657472
+#define METRICOBJ_VERSION	1
+#define METRICOBJ_NAMELEN	32
+
+#define METRIC_COUNTER		1
+#define METRIC_GAUGE		2
+#define METRIC_HISTOGRAM	3
+
+struct metricobj_desc {
+	char name[METRICOBJ_NAMELEN];
+	uint32_t type;
+	/* Offset of the data block from the region start. */
+	uint32_t offset;
+};
+
+struct metricobj_header {
+	uint32_t magic;
+	uint32_t version;
+	char name[METRICOBJ_NAMELEN];
+	pid_t pid;
+	uint32_t size;
+	uint32_t max_metrics;
+	/* Descriptors published so far, only grows. */
+	uint32_t nr_metrics;
+	/* Offset of the free data space. */
+	uint32_t brk;
+	struct metricobj_desc desc[0];
+};
+
+/* Any number of writers. */
+struct metric_counter {
+	uint64_t value;
+};
+
+/* Any number of writers, the last update wins. */
+struct metric_gauge {
+	int64_t value;
+};
+
+/*
+ * Single writer. Samples below base are counted in buckets[0],
+ * samples at or above base + width * nr_buckets in the last one.
+ */
+struct metric_histogram {
+	uint32_t seq;
+	uint32_t nr_buckets;
+	int64_t base;
+	int64_t width;
+	uint64_t count;
+	int64_t sum;
+	int64_t min;
+	int64_t max;
+	uint64_t buckets[0];
+};
+
+#define metric_wmb()	do { compiler_barrier(); smp_wmb(); } while (0)
+#define metric_rmb()	do { compiler_barrier(); smp_rmb(); } while (0)
+
+/*
+ * Counters and gauges are read with no sequence count, so their
+ * values must be accessed as a whole: a plain 64-bit access may be
+ * split in two on 32-bit architectures, e.g. ldrd/strd on ARMv7
+ * without LPAE. The loads must not store either, since readers map
+ * the channel read-only.
+ */
+#define metric_load64(__p)		__atomic_load_n(__p, __ATOMIC_RELAXED)
+#define metric_store64(__p, __v)	__atomic_store_n(__p, __v, __ATOMIC_RELAXED)
+
+static inline void metric_counter_add(struct metric_counter *c, uint64_t n)
+{
+	__sync_fetch_and_add(&c->value, n);
+}
+
+static inline void metric_counter_inc(struct metric_counter *c)
+{
+	metric_counter_add(c, 1);
+}
+
+static inline void metric_gauge_set(struct metric_gauge *g, int64_t value)
+{
+	metric_store64(&g->value, value);
+}
+
+static inline void metric_histogram_add(struct metric_histogram *h,
+					int64_t value)
+{
+	uint64_t slot;
+
+	if (value < h->base)
+		slot = 0;
+	else {
+		slot = (uint64_t)(value - h->base) / (uint64_t)h->width + 1;
+		if (slot > h->nr_buckets)
+			slot = h->nr_buckets + 1;
+	}
+
+	ACCESS_ONCE(h->seq) = h->seq + 1;
+	metric_wmb();
+	h->buckets[slot]++;
+	if (h->count == 0 || value < h->min)
+		h->min = value;
+	if (h->count == 0 || value > h->max)
+		h->max = value;
+	h->count++;
+	h->sum += value;
+	metric_wmb();
+	ACCESS_ONCE(h->seq) = h->seq + 1;
+}
+
+/*
+ * Readers copy a histogram between metric_histogram_read_begin()
+ * and metric_histogram_read_retry(), until the latter returns zero.
+ */
+static inline uint32_t
+metric_histogram_read_begin(const struct metric_histogram *h)
+{
+	uint32_t seq = ACCESS_ONCE(h->seq);
+
+	metric_rmb();
+
+	return seq;
+}
+
+static inline int
+metric_histogram_read_retry(const struct metric_histogram *h, uint32_t seq)
+{
+	metric_rmb();
+
+	return (seq & 1) || ACCESS_ONCE(h->seq) != seq;
+}
+
+/* Writer side, in the real-time process. */
+struct metricobj {
+	struct metricobj_header *hdr;
+	size_t len;
+	char fsname[64];
+	pthread_mutex_t lock;
+	struct fsobj fsobj;
+};
+
+/* Reader side, in any Linux process. */
+struct metricobj_reader {
+	const struct metricobj_header *hdr;
+	size_t len;
+};
+
+struct metric_sample {
+	const char *name;
+	int type;
+	/* Counter value, or histogram sample count. */
+	uint64_t count;
+	/* Gauge value. */
+	int64_t value;
+	/* Histogram data. */
+	int64_t sum;
+	int64_t min;
+	int64_t max;
+	int64_t base;
+	int64_t width;
+	/*
+	 * On entry, capacity of @buckets; on return, number of
+	 * histogram buckets including underflow and overflow.
+	 */
+	unsigned int nr_buckets;
+	uint64_t *buckets;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int metricobj_init(struct metricobj *mobj, const char *name,
+		   unsigned int max_metrics, size_t datasz);
+
+void metricobj_destroy(struct metricobj *mobj);
+
+int metricobj_add_counter(struct metricobj *mobj, const char *name,
+			  struct metric_counter **counter_r);
+
+int metricobj_add_gauge(struct metricobj *mobj, const char *name,
+			struct metric_gauge **gauge_r);
+
+int metricobj_add_histogram(struct metricobj *mobj, const char *name,
+			    int64_t base, int64_t width,
+			    unsigned int nr_buckets,
+			    struct metric_histogram **histogram_r);
+
+int metricobj_attach(struct metricobj_reader *reader,
+		     const char *session, const char *name);
+
+void metricobj_detach(struct metricobj_reader *reader);
+
+int metricobj_count(const struct metricobj_reader *reader);
+
+int metricobj_sample(const struct metricobj_reader *reader,
+		     int index, struct metric_sample *sample);
+
+int __metricobj_sample(const struct metricobj_header *hdr,
+		       int index, struct metric_sample *sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _COPPERPLATE_METRICOBJ_H */
@@ -42,7 +42,7 @@ struct semobj_corespec {
 struct semobj_corespec {
 	struct syncobj sobj;
 	int flags;
-	int value;
+	atomic_t value;
 };
 
 #endif /* CONFIG_XENO_MERCURY */
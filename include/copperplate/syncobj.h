@@ -21,8 +21,10 @@
 
 #include <pthread.h>
 #include <time.h>
+#include <errno.h>
 #include <boilerplate/list.h>
 #include <boilerplate/lock.h>
+#include <boilerplate/atomic.h>
 #include <copperplate/reference.h>
 
 /* syncobj->flags */
@@ -45,7 +47,6 @@ struct syncstate {
 
 #ifdef CONFIG_XENO_COBALT
 
-#include <boilerplate/atomic.h>
 #include <cobalt/uapi/monitor.h>
 
 struct syncobj_corespec {
@@ -226,6 +227,53 @@ static inline int syncobj_flush(struct syncobj *sobj)
 	return sobj->wait_count;
 }
 
+/*
+ * Lockless fast paths for counting objects built over a syncobj,
+ * e.g. semaphores. The count is kept in an atomic word which drops
+ * below zero when threads wait for the resource, so that the monitor
+ * needs to be entered only when a thread has to sleep or be woken
+ * up:
+ *
+ * - syncobj_fast_take() consumes a unit from a positive count.
+ *
+ * - syncobj_fast_give() releases a unit to a count lower than @max,
+ * unless threads are waiting.
+ *
+ * Both return -EAGAIN when the caller should run the regular
+ * protocol under syncobj_lock() instead, which must update the count
+ * atomically as well. Since waiters are only queued and granted
+ * under lock while the count is negative, a negative count can only
+ * change under lock.
+ */
+static inline int syncobj_fast_take(struct syncobj *sobj, atomic_t *count)
+{
+	int old, val = atomic_read(count);
+
+	while (val > 0 && sobj->magic == SYNCOBJ_MAGIC) {
+		old = atomic_cmpxchg(count, val, val - 1);
+		if (old == val)
+			return 0;
+		val = old;
+	}
+
+	return -EAGAIN;
+}
+
+static inline int syncobj_fast_give(struct syncobj *sobj, atomic_t *count,
+				    int max)
+{
+	int old, val = atomic_read(count);
+
+	while (val >= 0 && val < max && sobj->magic == SYNCOBJ_MAGIC) {
+		old = atomic_cmpxchg(count, val, val + 1);
+		if (old == val)
+			return 0;
+		val = old;
+	}
+
+	return -EAGAIN;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -63,6 +63,8 @@ struct threadobj_stat {
 	unsigned int status;
 	/** Number of page faults. */
 	uint32_t pf;
+	/** Number of periods the CPU budget was exceeded in. */
+	uint32_t budget_overruns;
 };
 
 #define SCHED_CORE  SCHED_COBALT
@@ -108,6 +110,13 @@ struct threadobj_corespec {
 	timer_t rr_timer;
 	/** Timeout reported by sysregd. */
 	struct timespec timeout;
+	/** CPU budget enforcement. */
+	timer_t budget_timer;
+	struct timespec budget;
+	struct eventobj *budget_evobj;
+	unsigned int budget_bits;
+	int budget_signo;
+	unsigned int budget_overruns;
 #ifdef CONFIG_XENO_WORKAROUND_CONDVAR_PI
 	int policy_unboosted;
 	struct sched_param_ex schedparam_unboosted;
@@ -123,6 +132,8 @@ struct threadobj_stat {
 	int schedlock;
 	/** Mercury thread status bits. */
 	unsigned int status;
+	/** Number of periods the CPU budget was exceeded in. */
+	uint32_t budget_overruns;
 };
 
 #define SCHED_CORE  SCHED_FIFO
@@ -148,6 +159,7 @@ void threadobj_save_timeout(struct threadobj_corespec *corespec,
 #define __THREAD_S_SUSPENDED	(1 << 5)	/* Suspended via threadobj_suspend(). */
 #define __THREAD_S_SAFE		(1 << 6)	/* TCB release deferred. */
 #define __THREAD_S_PERIODIC	(1 << 7)	/* Periodic timer set. */
+#define __THREAD_S_BUDGET	(1 << 8)	/* CPU budget enforced. */
 #define __THREAD_S_DEBUG	(1 << 31)	/* Debug mode enabled. */
 /*
  * threadobj->run_state, locklessly updated by "current", merged
@@ -177,6 +189,7 @@ void threadobj_save_timeout(struct threadobj_corespec *corespec,
 
 struct traceobj;
 struct syncobj;
+struct eventobj;
 
 struct threadobj {
 	unsigned int magic;	/* Must be first. */
@@ -363,6 +376,11 @@ int threadobj_set_periodic(struct threadobj *thobj,
 
 int threadobj_wait_period(unsigned long *overruns_r) __must_check;
 
+int threadobj_set_budget(struct threadobj *thobj,
+			 const struct timespec *quantum,
+			 struct eventobj *evobj,
+			 unsigned int bits, int signo);
+
 void threadobj_spin(ticks_t ns);
 
 int threadobj_stat(struct threadobj *thobj,
@@ -252,6 +252,18 @@ void a4l_math_stddev(double *pstddev,
 void a4l_math_stddev_of_mean(double *pstddevm,
 	                     double mean, double *val, unsigned nr);
 
+void a4l_math_sine(double *dst, unsigned int first, unsigned int nr,
+		   double ratio, double amplitude, double offset);
+
+void a4l_math_square(double *dst, unsigned int first, unsigned int nr,
+		     double ratio, double amplitude, double offset);
+
+void a4l_math_triangle(double *dst, unsigned int first, unsigned int nr,
+		       double ratio, double amplitude, double offset);
+
+void a4l_math_sawtooth(double *dst, unsigned int first, unsigned int nr,
+		       double ratio, double amplitude, double offset);
+
 
 
 
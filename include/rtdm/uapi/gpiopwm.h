@@ -35,6 +35,30 @@ struct gpiopwm {
 	unsigned int gpio;
 };
 
+#define GPIOPWM_NR_GROUPS	8
+/* Join any group running at the same period, or a free one. */
+#define GPIOPWM_GROUP_AUTO	(-1)
+
+/*
+ * Sequencer channel setup, all times in nanoseconds. Channels from
+ * the same group share a single timer and period start, @phase is
+ * the offset of the rising edge from the latter.
+ */
+struct gpiopwm_seq {
+	__u64 period;
+	__u64 duty;
+	__u64 phase;
+	__u32 gpio;
+	__s32 group;
+};
+
+/* Edge logged by the recording backend (CONFIG_XENO_DRIVERS_GPIOPWM_RECORD). */
+struct gpiopwm_edge_record {
+	__u64 timestamp;
+	__u32 value;
+	__u32 __pad;
+};
+
 #define RTIOC_TYPE_PWM		RTDM_CLASS_PWM
 
 #define GPIOPWM_RTIOC_SET_CONFIG \
@@ -52,5 +76,11 @@ struct gpiopwm {
 #define GPIOPWM_RTIOC_CHANGE_DUTY_CYCLE \
 	_IOW(RTIOC_TYPE_PWM, 0x40, unsigned int)
 
+#define GPIOPWM_RTIOC_SET_SEQ \
+	_IOW(RTIOC_TYPE_PWM, 0x50, struct gpiopwm_seq)
+
+#define GPIOPWM_RTIOC_CHANGE_DUTY_NS \
+	_IOW(RTIOC_TYPE_PWM, 0x60, __u64)
+
 
 #endif /* !_RTDM_UAPI_TESTING_H */
@@ -56,6 +56,61 @@
  * Use RTNET_RTIOC_TIMEOUT with any negative timeout value instead. */
 #define RTNET_RTIOC_EXTPOOL     _IOW(RTIOC_TYPE_NETWORK, 0x14, unsigned int)
 #define RTNET_RTIOC_SHRPOOL     _IOW(RTIOC_TYPE_NETWORK, 0x15, unsigned int)
+#define RTNET_RTIOC_PACKET_RING _IOW(RTIOC_TYPE_NETWORK, 0x16, \
+				     struct rtnet_packet_ring_req)
+
+/*
+ * Memory-mapped packet rings (PF_PACKET sockets).
+ *
+ * RTNET_RTIOC_PACKET_RING sets up a RX and/or TX ring of fixed-size
+ * frames, which is then mapped by mmap() at offset 0: the RX frames
+ * come first, followed by the TX frames. Each frame starts with a
+ * struct rtnet_packet_frame header, the payload follows at
+ * RTNET_PACKET_FRAME_HDRLEN.
+ *
+ * RX: the stack fills frames owned by the kernel, then hands them
+ * over by setting RTNET_PACKET_STATUS_USER. Userland gives them back
+ * by resetting the status to RTNET_PACKET_STATUS_KERNEL. recvmsg()
+ * blocks until frames were delivered and returns their count.
+ *
+ * TX: userland builds frames in place, marks them with
+ * RTNET_PACKET_STATUS_SEND_REQUEST, then issues a sendmsg() with an
+ * empty I/O vector to transmit all pending frames at once. The stack
+ * resets the status of each frame sent to
+ * RTNET_PACKET_STATUS_AVAILABLE.
+ */
+struct rtnet_packet_ring_req {
+	unsigned int frame_size;	/* multiple of RTNET_PACKET_FRAME_ALIGN */
+	unsigned int rx_frames;
+	unsigned int tx_frames;
+};
+
+struct rtnet_packet_frame {
+	uint32_t status;
+	uint32_t len;		/* RX: length on the wire, TX: length to send */
+	uint32_t snaplen;	/* RX: length stored in the frame */
+	uint16_t protocol;	/* RX: protocol in network order */
+	uint16_t pkttype;	/* RX: PACKET_xxx */
+	int32_t  ifindex;	/* RX: receiving interface */
+	uint32_t __reserved;
+	uint64_t timestamp;	/* RX: arrival time in ns */
+};
+
+#define RTNET_PACKET_FRAME_ALIGN	16
+#define RTNET_PACKET_FRAME_HDRLEN	\
+	((sizeof(struct rtnet_packet_frame) + RTNET_PACKET_FRAME_ALIGN - 1) & \
+	 ~(RTNET_PACKET_FRAME_ALIGN - 1))
+
+/* RX frame status */
+#define RTNET_PACKET_STATUS_KERNEL		0x0
+#define RTNET_PACKET_STATUS_USER		0x1
+#define RTNET_PACKET_STATUS_TRUNC		0x2 /* frame exceeded snaplen */
+#define RTNET_PACKET_STATUS_LOSING		0x4 /* frames dropped before */
+
+/* TX frame status */
+#define RTNET_PACKET_STATUS_AVAILABLE		0x0
+#define RTNET_PACKET_STATUS_SEND_REQUEST	0x1
+#define RTNET_PACKET_STATUS_WRONG_FORMAT	0x4
 
 /* socket transmission priorities */
 #define SOCK_MAX_PRIO           0
@@ -33,9 +33,42 @@ struct rtdm_spi_iobufs {
 	__u32 map_len;
 };
 
+/*
+ * Transfer list segment, exchanging len bytes with a slave. Data is
+ * sent from the output area of the I/O buffers, and received into
+ * the input area, at the given offsets. Chip select remains asserted
+ * across consecutive segments talking to the same slave, unless
+ * SPI_SEG_CS_CHANGE is set, and where the controller allows it.
+ */
+struct rtdm_spi_segment {
+	__u32 i_offset;
+	__u32 o_offset;
+	__u32 len;
+	__u16 delay_us;		/* Delay after segment, before CS changes. */
+	__u8 chip_select;	/* Slave to talk to, with SPI_SEG_SLAVE. */
+	__u8 flags;
+};
+
+/* Deassert chip select once the segment is done. */
+#define SPI_SEG_CS_CHANGE	0x1
+/* Talk to the slave on chip_select, instead of the device's own. */
+#define SPI_SEG_SLAVE		0x2
+
+struct rtdm_spi_xfer_list {
+	__u64 segments;		/* Address of the segment array. */
+	__u32 nr_segments;
+	__u32 __pad;
+};
+
+#define SPI_XFER_LIST_MAX	64
+
+/* Software loopback master, for testing. */
+#define RTDM_SUBCLASS_SPI_LOOPBACK	3
+
 #define SPI_RTIOC_SET_CONFIG		_IOW(RTDM_CLASS_SPI, 0, struct rtdm_spi_config)
 #define SPI_RTIOC_GET_CONFIG		_IOR(RTDM_CLASS_SPI, 1, struct rtdm_spi_config)
 #define SPI_RTIOC_SET_IOBUFS		_IOR(RTDM_CLASS_SPI, 2, struct rtdm_spi_iobufs)
 #define SPI_RTIOC_TRANSFER		_IO(RTDM_CLASS_SPI, 3)
+#define SPI_RTIOC_TRANSFER_LIST		_IOW(RTDM_CLASS_SPI, 4, struct rtdm_spi_xfer_list)
 
 #endif /* !_RTDM_UAPI_SPI_H */
@@ -113,6 +113,11 @@ struct rttst_heap_stats {
 	int flags;
 };
 
+struct rttst_udd_burst {
+	__u32 count;
+	__u32 period_ns;
+};
+
 struct rttst_heap_stathdr {
 	int nrstats;
 	struct rttst_heap_stats *buf;
@@ -133,6 +138,8 @@ struct rttst_heap_stathdr {
 #define RTDM_SUBCLASS_RTDMTEST		3
 /** subclase name: "heapcheck" */
 #define RTDM_SUBCLASS_HEAPCHECK		4
+/** subclase name: "uddtest" */
+#define RTDM_SUBCLASS_UDDTEST		5
 /** @} */
 
 /*!
@@ -193,6 +200,9 @@ struct rttst_heap_stathdr {
 #define RTTST_RTIOC_HEAP_STAT_COLLECT \
 	_IOR(RTIOC_TYPE_TESTING, 0x45, int)
 
+#define RTTST_RTIOC_UDD_BURST \
+	_IOW(RTIOC_TYPE_TESTING, 0x50, struct rttst_udd_burst)
+
 /** @} */
 
 #endif /* !_RTDM_UAPI_TESTING_H */
@@ -21,6 +21,8 @@
 #ifndef _RTDM_UAPI_UDD_H
 #define _RTDM_UAPI_UDD_H
 
+#include <linux/types.h>
+
 /**
  * @addtogroup rtdm_udd
  *
@@ -56,6 +58,60 @@ struct udd_signotify {
 	int sig;
 };
 
+/**
+ * @anchor udd_event_ring
+ * @brief UDD event ring entry
+ *
+ * When the mini-driver enables it (see udd_device.nr_events), the UDD
+ * core logs every IRQ event into a ring, which userland may either
+ * map from the mapper device of minor #UDD_RING_MAP, or drain by
+ * batches using read(2) with a buffer size multiple of this
+ * structure.
+ */
+struct udd_event {
+	/** Time of receipt, from the monotonic clock (ns). */
+	__u64 timestamp;
+	/**
+	 * Sequence number, starting from 1. This is the count of
+	 * interrupts received so far, gaps denote lost events.
+	 */
+	__u32 seq;
+	/**
+	 * Status word returned by the ->interrupt() handler of the
+	 * mini-driver, or passed to udd_notify_event_status().
+	 */
+	__u32 status;
+};
+
+/**
+ * @brief UDD event ring, as mapped to userland (read-only)
+ *
+ * The entry for event of sequence number @a seq lives at index (@a
+ * seq & @a mask). An entry is valid once its @a seq field matches,
+ * @a head tells the sequence number of the last event posted.
+ */
+struct udd_event_ring {
+	__u32 head;
+	__u32 mask;
+	__u32 __pad[14];
+	struct udd_event entries[0];
+};
+
+/** Mapper minor exposing the event ring. */
+#define UDD_RING_MAP	5
+
+/**
+ * @brief UDD event ring status, per file descriptor
+ */
+struct udd_event_stat {
+	/** Sequence number of the last event read. */
+	__u32 seq;
+	/** Sequence number of the last event posted. */
+	__u32 head;
+	/** Events overwritten before this file descriptor read them. */
+	__u32 lost;
+};
+
 /**
  * @anchor udd_ioctl_codes @name UDD_IOCTL
  * IOCTL requests
@@ -91,6 +147,12 @@ struct udd_signotify {
  * receives -EIO from the UDD core.
  */
 #define UDD_RTIOC_IRQSIG	_IOW(RTDM_CLASS_UDD, 2, struct udd_signotify)
+/**
+ * Retrieve the event ring status for the file descriptor, as a @ref
+ * udd_event_stat "status descriptor". This request receives -ENXIO if
+ * the device has no event ring.
+ */
+#define UDD_RTIOC_EVSTAT	_IOR(RTDM_CLASS_UDD, 3, struct udd_event_stat)
 
 /** @} */
 /** @} */
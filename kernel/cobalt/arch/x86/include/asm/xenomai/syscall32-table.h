@@ -45,6 +45,7 @@ __COBALT_CALL32emu_THUNK(mq_timedreceive)
 __COBALT_CALL32x_pure_THUNK(mq_timedreceive)
 __COBALT_CALL32emu_THUNK(mq_notify)
 __COBALT_CALL32x_THUNK(mq_notify)
+__COBALT_CALL32emu_THUNK(mq_ringwait)
 __COBALT_CALL32emu_THUNK(sched_weightprio)
 __COBALT_CALL32emu_THUNK(sched_setconfig_np)
 __COBALT_CALL32emu_THUNK(sched_getconfig_np)
@@ -38,6 +38,20 @@
  *   symbol, so that obsolete wrappers can be spotted.
  */
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,14,0)
+#define cobalt_kernel_read(__file, __buf, __count, __pos)		\
+	({								\
+		ssize_t __ret = kernel_read(__file, *(__pos),		\
+					    (char *)(__buf), __count);	\
+		if (__ret > 0)						\
+			*(__pos) += __ret;				\
+		__ret;							\
+	})
+#else
+#define cobalt_kernel_read(__file, __buf, __count, __pos)	\
+	kernel_read(__file, __buf, __count, __pos)
+#endif
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4,11,0)
 #define raw_copy_to_user(__to, __from, __n)	__copy_to_user_inatomic(__to, __from, __n)
 #define raw_copy_from_user(__to, __from, __n)	__copy_from_user_inatomic(__to, __from, __n)
@@ -55,6 +69,11 @@
 #define cobalt_gpiochip_dev(__gc)	((__gc)->parent)
 #endif
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,2,0)
+#define napi_alloc_skb(__napi, __len)	\
+	netdev_alloc_skb_ip_align((__napi)->dev, __len)
+#endif
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4,0,0)
 #define cobalt_get_restart_block(p)	(&task_thread_info(p)->restart_block)
 #else
@@ -63,6 +82,9 @@
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,19,0)
 #define user_msghdr msghdr
+#define READ_ONCE(__x)			ACCESS_ONCE(__x)
+#define WRITE_ONCE(__x, __val)		(ACCESS_ONCE(__x) = (__val))
+#define napi_complete_done(__napi, __work)	napi_complete(__napi)
 #endif
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,17,0)
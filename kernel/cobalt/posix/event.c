@@ -134,7 +134,7 @@ int __cobalt_event_wait(struct cobalt_event_shadow __user *u_event,
 
 	xnlock_get_irqsave(&nklock, s);
 
-	event = xnregistry_lookup(handle, NULL);
+	event = cobalt_lookup_handle(handle);
 	if (event == NULL || event->magic != COBALT_EVENT_MAGIC) {
 		ret = -EINVAL;
 		goto out;
@@ -208,15 +208,60 @@ COBALT_SYSCALL(event_wait, primary,
 	return __cobalt_event_wait(u_event, bits, u_bits_r, mode, tsp);
 }
 
-COBALT_SYSCALL(event_sync, current,
-	       (struct cobalt_event_shadow __user *u_event))
-{
+static void event_sync(struct cobalt_event *event)
+{				/* nklocked, IRQs off */
 	unsigned int bits, waitval, testval;
 	struct xnthread_wait_context *wc;
 	struct cobalt_event_state *state;
 	struct event_wait_context *ewc;
-	struct cobalt_event *event;
 	struct xnthread *p, *tmp;
+
+	state = event->state;
+	bits = state->value;
+
+	xnsynch_for_each_sleeper_safe(p, tmp, &event->synch) {
+		wc = xnthread_get_wait_context(p);
+		ewc = container_of(wc, struct event_wait_context, wc);
+		waitval = ewc->value & bits;
+		testval = ewc->mode & COBALT_EVENT_ANY ? waitval : ewc->value;
+		if (waitval && waitval == testval) {
+			state->nwaiters--;
+			ewc->value = waitval;
+			xnsynch_wakeup_this_sleeper(&event->synch, p);
+		}
+	}
+}
+
+/*
+ * Post event flags from kernel space, e.g. from a timer handler. The
+ * caller should reschedule once it drops the nklock, unless running
+ * from interrupt context.
+ */
+int cobalt_event_post_bits(xnhandle_t handle, unsigned int bits)
+{				/* nklocked, IRQs off */
+	struct cobalt_event_state *state;
+	struct cobalt_event *event;
+	unsigned int old;
+
+	event = xnregistry_lookup(handle, NULL);
+	if (event == NULL || event->magic != COBALT_EVENT_MAGIC)
+		return -EINVAL;
+
+	/* Userland may be updating the value concurrently. */
+	state = event->state;
+	do
+		old = state->value;
+	while (cmpxchg(&state->value, old, old | bits) != old);
+
+	event_sync(event);
+
+	return 0;
+}
+
+COBALT_SYSCALL(event_sync, current,
+	       (struct cobalt_event_shadow __user *u_event))
+{
+	struct cobalt_event *event;
 	xnhandle_t handle;
 	int ret = 0;
 	spl_t s;
@@ -225,7 +270,7 @@ COBALT_SYSCALL(event_sync, current,
 
 	xnlock_get_irqsave(&nklock, s);
 
-	event = xnregistry_lookup(handle, NULL);
+	event = cobalt_lookup_handle(handle);
 	if (event == NULL || event->magic != COBALT_EVENT_MAGIC) {
 		ret = -EINVAL;
 		goto out;
@@ -236,20 +281,7 @@ COBALT_SYSCALL(event_sync, current,
 	 * wake up any thread which could be satisfied by its current
 	 * value.
 	 */
-	state = event->state;
-	bits = state->value;
-
-	xnsynch_for_each_sleeper_safe(p, tmp, &event->synch) {
-		wc = xnthread_get_wait_context(p);
-		ewc = container_of(wc, struct event_wait_context, wc);
-		waitval = ewc->value & bits;
-		testval = ewc->mode & COBALT_EVENT_ANY ? waitval : ewc->value;
-		if (waitval && waitval == testval) {
-			state->nwaiters--;
-			ewc->value = waitval;
-			xnsynch_wakeup_this_sleeper(&event->synch, p);
-		}
-	}
+	event_sync(event);
 
 	xnsched_run();
 out:
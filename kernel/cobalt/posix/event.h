@@ -65,6 +65,8 @@ COBALT_SYSCALL_DECL(event_inquire,
 		     pid_t __user *u_waitlist,
 		     size_t waitsz));
 
+int cobalt_event_post_bits(xnhandle_t handle, unsigned int bits);
+
 void cobalt_event_reclaim(struct cobalt_resnode *node,
 			  spl_t s);
 
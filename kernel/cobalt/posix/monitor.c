@@ -111,7 +111,7 @@ static int monitor_enter(xnhandle_t handle, struct xnthread *curr)
 	struct cobalt_monitor *mon;
 	int info;
 
-	mon = xnregistry_lookup(handle, NULL); /* (Re)validate. */
+	mon = cobalt_lookup_handle(handle); /* (Re)validate. */
 	if (mon == NULL || mon->magic != COBALT_MONITOR_MAGIC)
 		return -EINVAL;
 
@@ -223,7 +223,7 @@ int __cobalt_monitor_wait(struct cobalt_monitor_shadow __user *u_mon,
 
 	xnlock_get_irqsave(&nklock, s);
 
-	mon = xnregistry_lookup(handle, NULL);
+	mon = cobalt_lookup_handle(handle);
 	if (mon == NULL || mon->magic != COBALT_MONITOR_MAGIC) {
 		ret = -EINVAL;
 		goto out;
@@ -321,7 +321,7 @@ COBALT_SYSCALL(monitor_sync, nonrestartable,
 
 	xnlock_get_irqsave(&nklock, s);
 
-	mon = xnregistry_lookup(handle, NULL);
+	mon = cobalt_lookup_handle(handle);
 	if (mon == NULL || mon->magic != COBALT_MONITOR_MAGIC)
 		ret = -EINVAL;
 	else if (mon->state->flags & COBALT_MONITOR_SIGNALED) {
@@ -350,7 +350,7 @@ COBALT_SYSCALL(monitor_exit, primary,
 
 	xnlock_get_irqsave(&nklock, s);
 
-	mon = xnregistry_lookup(handle, NULL);
+	mon = cobalt_lookup_handle(handle);
 	if (mon == NULL || mon->magic != COBALT_MONITOR_MAGIC)
 		ret = -EINVAL;
 	else {
@@ -20,6 +20,7 @@
 #include <linux/slab.h>
 #include <linux/mm.h>
 #include <linux/sched.h>
+#include <linux/log2.h>
 #include <cobalt/kernel/select.h>
 #include <rtdm/fd.h>
 #include "internal.h"
@@ -60,6 +61,15 @@ struct cobalt_mq {
 
 	DECLARE_XNSELECT(read_select);
 	DECLARE_XNSELECT(write_select);
+
+	/* MQ_SHRING mode, NULL otherwise. */
+	struct cobalt_mq_ring *ring;
+	/* Ring geometry, never read back from shared memory. */
+	unsigned int ring_nslots;
+	unsigned int ring_stride;
+	unsigned int ring_maxmsg;
+	struct xnsynch ring_receivers;
+	struct xnsynch ring_senders;
 };
 
 struct cobalt_mqd {
@@ -99,6 +109,111 @@ static inline void mq_msg_free(struct cobalt_mq *mq, struct cobalt_msg * msg)
 	list_add(&msg->link, &mq->avail); /* For earliest re-use of the block. */
 }
 
+/*
+ * Userland moves messages through the ring locklessly; the helpers
+ * below only sample its state, to decide whether a thread has to
+ * sleep, or which sleeper may proceed. Only the kernel updates the
+ * ring flags and the kernel queue count, under nklock.
+ *
+ * Since any process may scribble over the shared heap, the kernel
+ * only reads the head, tail and sequence words from the ring, and
+ * indexes slots with the geometry it recorded at creation.
+ */
+static inline struct cobalt_mq_slot *
+mq_ring_slot(struct cobalt_mq *mq, unsigned int pos)
+{
+	return (struct cobalt_mq_slot *)
+		((char *)(mq->ring + 1) +
+		 (pos & (mq->ring_nslots - 1)) * mq->ring_stride);
+}
+
+static inline int mq_ring_readable(struct cobalt_mq *mq)
+{
+	unsigned int pos = atomic_read(&mq->ring->tail);
+
+	return (unsigned int)atomic_read(&mq_ring_slot(mq, pos)->seq)
+		== pos + 1;
+}
+
+static inline int mq_ring_writable(struct cobalt_mq *mq)
+{
+	unsigned int tail, pos;
+
+	tail = atomic_read(&mq->ring->tail);
+	smp_rmb();
+	pos = atomic_read(&mq->ring->head);
+
+	return pos - tail < mq->ring_maxmsg &&
+		(unsigned int)atomic_read(&mq_ring_slot(mq, pos)->seq)
+		== pos;
+}
+
+static inline unsigned int mq_ring_count(struct cobalt_mq *mq)
+{
+	unsigned int tail, count;
+
+	tail = atomic_read(&mq->ring->tail);
+	smp_rmb();
+	count = atomic_read(&mq->ring->head) - tail;
+
+	return count > mq->ring_maxmsg ? mq->ring_maxmsg : count;
+}
+
+static inline void mq_ring_setflags(struct cobalt_mq_ring *ring, int bits)
+{
+	atomic_set(&ring->flags, atomic_read(&ring->flags) | bits);
+	smp_mb();
+}
+
+static inline void mq_ring_clrflags(struct cobalt_mq_ring *ring, int bits)
+{
+	atomic_set(&ring->flags, atomic_read(&ring->flags) & ~bits);
+	smp_mb();
+}
+
+static inline int mq_readable(struct cobalt_mq *mq)
+{
+	return !list_empty(&mq->queued) ||
+		(mq->ring && mq_ring_readable(mq));
+}
+
+static inline void mq_update_kqueued(struct cobalt_mq *mq)
+{
+	if (mq->ring)
+		atomic_set(&mq->ring->kqueued, mq->nrqueued);
+}
+
+static int mq_ring_init(struct cobalt_mq *mq, const struct mq_attr *attr)
+{
+	struct cobalt_mq_ring *ring;
+	unsigned int nslots, stride, n;
+	u64 size;
+
+	nslots = roundup_pow_of_two(attr->mq_maxmsg);
+	stride = ALIGN(sizeof(struct cobalt_mq_slot) + attr->mq_msgsize,
+		       sizeof(u64));
+	size = sizeof(*ring) + (u64)nslots * stride;
+	if (size > UINT_MAX)
+		return -ENOSPC;
+
+	ring = cobalt_umm_zalloc(&cobalt_kernel_ppd.umm, (u32)size);
+	if (ring == NULL)
+		return -ENOSPC;
+
+	ring->nslots = nslots;
+	ring->maxmsg = attr->mq_maxmsg;
+	ring->msgsize = attr->mq_msgsize;
+	ring->stride = stride;
+	mq->ring = ring;
+	mq->ring_nslots = nslots;
+	mq->ring_stride = stride;
+	mq->ring_maxmsg = attr->mq_maxmsg;
+	for (n = 0; n < nslots; n++)
+		atomic_set(&mq_ring_slot(mq, n)->seq, n);
+
+	return 0;
+}
+
 static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 {
 	unsigned i, msgsize, memsize;
@@ -145,6 +260,17 @@ static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 		mq_msg_free(mq, msg);
 	}
 
+	/*
+	 * The ring lives in the shared heap, which may be too small
+	 * for it; the queue then works the regular way, which
+	 * mq_getattr() tells.
+	 */
+	mq->ring = NULL;
+	xnsynch_init(&mq->ring_receivers, XNSYNCH_PRIO, NULL);
+	xnsynch_init(&mq->ring_senders, XNSYNCH_PRIO, NULL);
+	if (attr->mq_flags & MQ_SHRING)
+		mq_ring_init(mq, attr);
+
 	mq->attr = *attr;
 	mq->target = NULL;
 	xnselect_init(&mq->read_select);
@@ -164,12 +290,16 @@ static inline void mq_destroy(struct cobalt_mq *mq)
 	xnlock_get_irqsave(&nklock, s);
 	resched = (xnsynch_destroy(&mq->receivers) == XNSYNCH_RESCHED);
 	resched = (xnsynch_destroy(&mq->senders) == XNSYNCH_RESCHED) || resched;
+	resched = (xnsynch_destroy(&mq->ring_receivers) == XNSYNCH_RESCHED) || resched;
+	resched = (xnsynch_destroy(&mq->ring_senders) == XNSYNCH_RESCHED) || resched;
 	list_del(&mq->link);
 	xnlock_put_irqrestore(&nklock, s);
 	xnselect_destroy(&mq->read_select);
 	xnselect_destroy(&mq->write_select);
 	xnregistry_remove(mq->handle);
 	xnheap_vfree(mq->mem);
+	if (mq->ring)
+		cobalt_umm_free(&cobalt_kernel_ppd.umm, mq->ring);
 	kfree(mq);
 
 	if (resched)
@@ -234,7 +364,7 @@ mqd_select(struct rtdm_fd *fd, struct xnselector *selector,
 
 		err = xnselect_bind(&mq->read_select, binding,
 				selector, type, index,
-				!list_empty(&mq->queued));
+				mq_readable(mq));
 		if (err)
 			goto unlock_and_error;
 		break;
@@ -246,11 +376,15 @@ mqd_select(struct rtdm_fd *fd, struct xnselector *selector,
 
 		err = xnselect_bind(&mq->write_select, binding,
 				selector, type, index,
+				mq->ring ? mq_ring_writable(mq) :
 				!list_empty(&mq->avail));
 		if (err)
 			goto unlock_and_error;
 		break;
 	}
+	/* Have userland report the ring transitions. */
+	if (mq->ring)
+		mq_ring_setflags(mq->ring, COBALT_MQ_RING_SELECT);
 	xnlock_put_irqrestore(&nklock, s);
 	return 0;
 
@@ -434,7 +568,8 @@ mq_trysend(struct cobalt_mqd *mqd, size_t len)
 	if (msg == NULL)
 		return ERR_PTR(-EAGAIN);
 
-	if (list_empty(&mq->avail))
+	/* In ring mode, writability refers to the ring. */
+	if (list_empty(&mq->avail) && mq->ring == NULL)
 		xnselect_signal(&mq->write_select, 0);
 
 	return msg;
@@ -461,8 +596,9 @@ mq_tryrcv(struct cobalt_mqd *mqd, size_t len)
 
 	msg = list_get_entry(&mq->queued, struct cobalt_msg, link);
 	mq->nrqueued--;
+	mq_update_kqueued(mq);
 
-	if (list_empty(&mq->queued))
+	if (!mq_readable(mq))
 		xnselect_signal(&mq->read_select, 0);
 
 	return msg;
@@ -543,17 +679,31 @@ static void mq_release_msg(struct cobalt_mq *mq, struct cobalt_msg *msg)
 		xnthread_complete_wait(wc);
 	} else {
 		mq_msg_free(mq, msg);
-		if (list_is_singular(&mq->avail))
+		if (list_is_singular(&mq->avail) && mq->ring == NULL)
 			xnselect_signal(&mq->write_select, 1);
 	}
 }
 
+static void mq_notify_target(struct cobalt_mq *mq)
+{
+	struct cobalt_sigpending *sigp;
+
+	sigp = cobalt_signal_alloc();
+	if (sigp) {
+		cobalt_copy_siginfo(SI_MESGQ, &sigp->si, &mq->si);
+		if (cobalt_signal_send(mq->target, sigp, 0) <= 0)
+			cobalt_signal_free(sigp);
+	}
+	mq->target = NULL;
+	if (mq->ring)
+		mq_ring_clrflags(mq->ring, COBALT_MQ_RING_NOTIFY);
+}
+
 static int
 mq_finish_send(struct cobalt_mqd *mqd, struct cobalt_msg *msg)
 {
 	struct cobalt_mqwait_context *mwc;
 	struct xnthread_wait_context *wc;
-	struct cobalt_sigpending *sigp;
 	struct xnthread *thread;
 	struct cobalt_mq *mq;
 	spl_t s;
@@ -572,22 +722,23 @@ mq_finish_send(struct cobalt_mqd *mqd, struct cobalt_msg *msg)
 		/* Nope, have to go through the queue. */
 		list_add_priff(msg, &mq->queued, prio, link);
 		mq->nrqueued++;
+		mq_update_kqueued(mq);
 
+		/*
+		 * In ring mode, readers wait in mq_ringwait(), then
+		 * pick the message from the kernel queue.
+		 */
+		if (mq->ring && xnsynch_pended_p(&mq->ring_receivers))
+			xnsynch_wakeup_one_sleeper(&mq->ring_receivers);
 		/*
 		 * If first message and no pending reader, send a
 		 * signal if notification was enabled via mq_notify().
 		 */
-		if (list_is_singular(&mq->queued)) {
+		else if (list_is_singular(&mq->queued) &&
+			 !(mq->ring && mq_ring_readable(mq))) {
 			xnselect_signal(&mq->read_select, 1);
-			if (mq->target) {
-				sigp = cobalt_signal_alloc();
-				if (sigp) {
-					cobalt_copy_siginfo(SI_MESGQ, &sigp->si, &mq->si);
-					if (cobalt_signal_send(mq->target, sigp, 0) <= 0)
-						cobalt_signal_free(sigp);
-				}
-				mq->target = NULL;
-			}
+			if (mq->target)
+				mq_notify_target(mq);
 		}
 	}
 	xnsched_run();
@@ -620,7 +771,8 @@ redo:
 	if (msg != ERR_PTR(-EAGAIN))
 		goto out;
 
-	if (rtdm_fd_flags(&mqd->fd) & O_NONBLOCK)
+	/* Ring mode readers wait in mq_ringwait(). */
+	if ((rtdm_fd_flags(&mqd->fd) & O_NONBLOCK) || mqd->mq->ring)
 		goto out;
 
 	if (fetch_timeout) {
@@ -676,6 +828,10 @@ static inline int mq_getattr(struct cobalt_mqd *mqd, struct mq_attr *attr)
 	xnlock_get_irqsave(&nklock, s);
 	attr->mq_flags = rtdm_fd_flags(&mqd->fd);
 	attr->mq_curmsgs = mq->nrqueued;
+	if (mq->ring) {
+		attr->mq_flags |= MQ_SHRING;
+		attr->mq_curmsgs += mq_ring_count(mq);
+	}
 	xnlock_put_irqrestore(&nklock, s);
 
 	return 0;
@@ -724,6 +880,13 @@ mq_notify(struct cobalt_mqd *mqd, unsigned index, const struct sigevent *evp)
 		mq->si.si_uid = get_current_uuid();
 	}
 
+	if (mq->ring) {
+		if (mq->target)
+			mq_ring_setflags(mq->ring, COBALT_MQ_RING_NOTIFY);
+		else
+			mq_ring_clrflags(mq->ring, COBALT_MQ_RING_NOTIFY);
+	}
+
 	xnlock_put_irqrestore(&nklock, s);
 	return 0;
 
@@ -1011,3 +1174,194 @@ COBALT_SYSCALL(mq_timedreceive, primary,
 
 	return ret ?: cobalt_copy_to_user(u_len, &len, sizeof(*u_len));
 }
+
+static inline int mq_ring_ready(struct cobalt_mq *mq, int op)
+{
+	if (op == COBALT_MQ_WAIT_RECV)
+		return mq->nrqueued > 0 || mq_ring_readable(mq);
+
+	return mq_ring_writable(mq);
+}
+
+static int mq_ringwait(struct cobalt_mqd *mqd, int op,
+		       const void __user *u_ts,
+		       int (*fetch_timeout)(struct timespec *ts,
+					    const void __user *u_ts))
+{
+	struct cobalt_mq *mq = mqd->mq;
+	unsigned int flags, denied;
+	struct xnsynch *synch;
+	struct timespec ts;
+	atomic_t *waiters;
+	xntmode_t tmode;
+	xnticks_t to;
+	int ret, info;
+	spl_t s;
+
+	if (mq->ring == NULL)
+		return -EINVAL;
+
+	flags = rtdm_fd_flags(&mqd->fd) & COBALT_PERMS_MASK;
+
+	switch (op) {
+	case COBALT_MQ_WAIT_RECV:
+		denied = O_WRONLY;
+		synch = &mq->ring_receivers;
+		waiters = &mq->ring->rwaiters;
+		break;
+	case COBALT_MQ_WAIT_SEND:
+		denied = O_RDONLY;
+		synch = &mq->ring_senders;
+		waiters = &mq->ring->swaiters;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (flags == denied)
+		return -EBADF;
+
+	to = XN_INFINITE;
+	tmode = XN_RELATIVE;
+redo:
+	xnlock_get_irqsave(&nklock, s);
+
+	ret = 0;
+	if (mq_ring_ready(mq, op))
+		goto out;
+
+	ret = -EAGAIN;
+	if (rtdm_fd_flags(&mqd->fd) & O_NONBLOCK)
+		goto out;
+
+	if (fetch_timeout) {
+		xnlock_put_irqrestore(&nklock, s);
+		ret = fetch_timeout(&ts, u_ts);
+		if (ret)
+			return ret;
+		if ((unsigned long)ts.tv_nsec >= ONE_BILLION)
+			return -EINVAL;
+		to = ts2ns(&ts) + 1;
+		tmode = XN_REALTIME;
+		fetch_timeout = NULL;
+		goto redo;
+	}
+
+	/*
+	 * Pairs with the full barrier userland issues between
+	 * updating the ring and sampling the waiter count: either
+	 * the peer sees us waiting and kicks us, or we see its
+	 * update here.
+	 */
+	atomic_inc(waiters);
+	smp_mb();
+	ret = 0;
+	if (!mq_ring_ready(mq, op)) {
+		info = xnsynch_sleep_on(synch, to, tmode);
+		if (info & XNRMID)
+			ret = -EBADF;
+		else if (info & XNTIMEO)
+			ret = -ETIMEDOUT;
+		else if (info & XNBREAK)
+			ret = -EINTR;
+	}
+	atomic_dec(waiters);
+out:
+	xnlock_put_irqrestore(&nklock, s);
+
+	/* The caller retries the ring on success. */
+	return ret;
+}
+
+static int mq_ringkick(struct cobalt_mqd *mqd)
+{
+	struct cobalt_mq *mq = mqd->mq;
+	spl_t s;
+
+	if (mq->ring == NULL)
+		return -EINVAL;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if (mq_readable(mq)) {
+		if (xnsynch_pended_p(&mq->ring_receivers))
+			xnsynch_wakeup_one_sleeper(&mq->ring_receivers);
+		else if (mq->target)
+			mq_notify_target(mq);
+		xnselect_signal(&mq->read_select, 1);
+	} else
+		xnselect_signal(&mq->read_select, 0);
+
+	if (mq_ring_writable(mq)) {
+		if (xnsynch_pended_p(&mq->ring_senders))
+			xnsynch_wakeup_one_sleeper(&mq->ring_senders);
+		xnselect_signal(&mq->write_select, 1);
+	} else
+		xnselect_signal(&mq->write_select, 0);
+
+	xnsched_run();
+	xnlock_put_irqrestore(&nklock, s);
+
+	return 0;
+}
+
+COBALT_SYSCALL(mq_ringinfo, current,
+	       (mqd_t uqd, __u32 __user *u_offset))
+{
+	struct cobalt_mqd *mqd;
+	__u32 offset = 0;
+	int ret = 0;
+
+	mqd = cobalt_mqd_get(uqd);
+	if (IS_ERR(mqd))
+		return PTR_ERR(mqd);
+
+	if (mqd->mq->ring)
+		offset = cobalt_umm_offset(&cobalt_kernel_ppd.umm,
+					   mqd->mq->ring);
+	else
+		ret = -ENOENT;
+
+	cobalt_mqd_put(mqd);
+
+	return ret ?: cobalt_copy_to_user(u_offset, &offset, sizeof(offset));
+}
+
+int __cobalt_mq_ringwait(mqd_t uqd, int op, const void __user *u_ts,
+			 int (*fetch_timeout)(struct timespec *ts,
+					      const void __user *u_ts))
+{
+	struct cobalt_mqd *mqd;
+	int ret;
+
+	mqd = cobalt_mqd_get(uqd);
+	if (IS_ERR(mqd))
+		return PTR_ERR(mqd);
+
+	ret = mq_ringwait(mqd, op, u_ts, fetch_timeout);
+	cobalt_mqd_put(mqd);
+
+	return ret;
+}
+
+COBALT_SYSCALL(mq_ringwait, primary,
+	       (mqd_t uqd, int op, const struct timespec __user *u_ts))
+{
+	return __cobalt_mq_ringwait(uqd, op, u_ts,
+				    u_ts ? mq_fetch_timeout : NULL);
+}
+
+COBALT_SYSCALL(mq_ringkick, current, (mqd_t uqd))
+{
+	struct cobalt_mqd *mqd;
+	int ret;
+
+	mqd = cobalt_mqd_get(uqd);
+	if (IS_ERR(mqd))
+		return PTR_ERR(mqd);
+
+	ret = mq_ringkick(mqd);
+	cobalt_mqd_put(mqd);
+
+	return ret;
+}
@@ -22,6 +22,7 @@
 #include <linux/types.h>
 #include <linux/fcntl.h>
 #include <xenomai/posix/syscall.h>
+#include <cobalt/uapi/mqueue.h>
 
 struct mq_attr {
 	long mq_flags;
@@ -71,4 +72,15 @@ COBALT_SYSCALL_DECL(mq_timedreceive,
 COBALT_SYSCALL_DECL(mq_notify,
 		    (mqd_t fd, const struct sigevent *__user evp));
 
+int __cobalt_mq_ringwait(mqd_t uqd, int op, const void __user *u_ts,
+			 int (*fetch_timeout)(struct timespec *ts,
+					      const void __user *u_ts));
+
+COBALT_SYSCALL_DECL(mq_ringinfo, (mqd_t uqd, __u32 __user *u_offset));
+
+COBALT_SYSCALL_DECL(mq_ringwait,
+		    (mqd_t uqd, int op, const struct timespec __user *u_ts));
+
+COBALT_SYSCALL_DECL(mq_ringkick, (mqd_t uqd));
+
 #endif /* !_COBALT_POSIX_MQUEUE_H */
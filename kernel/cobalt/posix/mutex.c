@@ -153,7 +153,7 @@ int __cobalt_mutex_timedlock_break(struct cobalt_mutex_shadow __user *u_mx,
 redo:
 	xnlock_get_irqsave(&nklock, s);
 
-	mutex = xnregistry_lookup(handle, NULL);
+	mutex = cobalt_lookup_handle(handle);
 	if (!cobalt_obj_active(mutex, COBALT_MUTEX_MAGIC, struct cobalt_mutex)) {
 		ret = -EINVAL;
 		goto out;
@@ -326,7 +326,7 @@ COBALT_SYSCALL(mutex_trylock, primary,
 
 	xnlock_get_irqsave(&nklock, s);
 
-	mutex = xnregistry_lookup(handle, NULL);
+	mutex = cobalt_lookup_handle(handle);
 	if (!cobalt_obj_active(mutex, COBALT_MUTEX_MAGIC, typeof(*mutex))) {
 		ret = -EINVAL;
 		goto out;
@@ -376,7 +376,7 @@ COBALT_SYSCALL(mutex_unlock, nonrestartable,
 
 	xnlock_get_irqsave(&nklock, s);
 
-	mutex = xnregistry_lookup(handle, NULL);
+	mutex = cobalt_lookup_handle(handle);
 	ret = cobalt_mutex_release(curr, mutex);
 	if (ret > 0) {
 		xnsched_run();
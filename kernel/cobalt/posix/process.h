@@ -21,6 +21,7 @@
 #include <linux/list.h>
 #include <linux/bitmap.h>
 #include <cobalt/kernel/ppd.h>
+#include <cobalt/kernel/registry.h>
 
 #define KEVENT_PROPAGATE   0
 #define KEVENT_STOP        1
@@ -43,6 +44,15 @@ struct cobalt_resources {
 	struct list_head schedq;
 };
 
+/* One slot per generation bucket of the registry. */
+#define COBALT_HCACHE_SLOTS  XNREGISTRY_GEN_BUCKETS
+
+struct cobalt_handle_slot {
+	xnhandle_t handle;
+	unsigned long gen;
+	void *objaddr;
+};
+
 struct cobalt_process {
 	struct mm_struct *mm;
 	struct hlist_node hlink;
@@ -55,6 +65,7 @@ struct cobalt_process {
 	struct cobalt_timer *timers[CONFIG_XENO_OPT_NRTIMERS];
 	void *priv[NR_PERSONALITIES];
 	int ufeatures;
+	struct cobalt_handle_slot hcache[COBALT_HCACHE_SLOTS];
 };
 
 struct cobalt_resnode {
@@ -117,6 +128,38 @@ static inline struct cobalt_ppd *cobalt_ppd_get(int global)
 	return &process->sys_ppd;
 }
 
+/*
+ * Resolve a handle received from userland, through a direct-mapped
+ * cache of the objects the current process used lately. A cached
+ * entry is only trusted as long as no object hashing to the same
+ * generation bucket was removed from the registry since it was
+ * filled, which rules out stale handles. nklock held, irqs off.
+ */
+static inline void *cobalt_lookup_handle(xnhandle_t handle)
+{
+	struct cobalt_process *process = cobalt_current_process();
+	struct cobalt_handle_slot *slot;
+	void *objaddr;
+
+	if (process == NULL)
+		return xnregistry_lookup(handle, NULL);
+
+	slot = process->hcache +
+		(xnhandle_get_index(handle) & (COBALT_HCACHE_SLOTS - 1));
+	if (likely(slot->handle == handle &&
+		   slot->gen == xnregistry_gen(handle)))
+		return slot->objaddr;
+
+	objaddr = xnregistry_lookup(handle, NULL);
+	if (objaddr) {
+		slot->handle = handle;
+		slot->gen = xnregistry_gen(handle);
+		slot->objaddr = objaddr;
+	}
+
+	return objaddr;
+}
+
 static inline struct cobalt_resources *cobalt_current_resources(int pshared)
 {
 	struct cobalt_process *process;
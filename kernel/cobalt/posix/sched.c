@@ -228,49 +228,23 @@ COBALT_SYSCALL(sched_yield, primary, (void))
 
 #ifdef CONFIG_XENO_OPT_SCHED_TP
 
-static inline
-int set_tp_config(int cpu, union sched_config *config, size_t len)
+static struct xnsched_tp_schedule *
+build_tp_schedule(union sched_config *config, size_t len)
 {
 	xnticks_t offset, duration, next_offset;
-	struct xnsched_tp_schedule *gps, *ogps;
+	struct xnsched_tp_schedule *gps;
 	struct xnsched_tp_window *w;
 	struct sched_tp_window *p;
-	struct xnsched *sched;
-	spl_t s;
 	int n;
 
-	if (len < sizeof(config->tp))
-		return -EINVAL;
-
-	sched = xnsched_struct(cpu);
-
-	switch (config->tp.op) {
-	case sched_tp_install:
-		if (config->tp.nr_windows > 0)
-			break;
-		/* Fallback wanted. */
-	case sched_tp_uninstall:
-		gps = NULL;
-		goto set_schedule;
-	case sched_tp_start:
-		xnlock_get_irqsave(&nklock, s);
-		xnsched_tp_start_schedule(sched);
-		xnlock_put_irqrestore(&nklock, s);
-		return 0;
-	case sched_tp_stop:
-		xnlock_get_irqsave(&nklock, s);
-		xnsched_tp_stop_schedule(sched);
-		xnlock_put_irqrestore(&nklock, s);
-		return 0;
-	default:
-		return -EINVAL;
-	}
-
-	/* Install a new TP schedule on CPU. */
+	if (len < sched_tp_confsz(config->tp.nr_windows))
+		return ERR_PTR(-EINVAL);
 
 	gps = xnmalloc(sizeof(*gps) + config->tp.nr_windows * sizeof(*w));
 	if (gps == NULL)
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
+
+	memset(gps->pwins, 0, config->tp.nr_windows * sizeof(*w));
 
 	for (n = 0, p = config->tp.windows, w = gps->pwins, next_offset = 0;
 	     n < config->tp.nr_windows; n++, p++, w++) {
@@ -294,11 +268,85 @@ int set_tp_config(int cpu, union sched_config *config, size_t len)
 		w->w_offset = next_offset;
 		w->w_part = p->ptid;
 		next_offset += duration;
+		w->w_end = next_offset;
 	}
 
 	atomic_set(&gps->refcount, 1);
 	gps->pwin_nr = n;
+	gps->slot = 0;
 	gps->tf_duration = next_offset;
+
+	return gps;
+
+cleanup_and_fail:
+	xnfree(gps);
+
+	return ERR_PTR(-EINVAL);
+}
+
+static inline
+int set_tp_config(int cpu, union sched_config *config, size_t len)
+{
+	struct xnsched_tp_schedule *gps, *ogps;
+	struct xnsched *sched;
+	spl_t s;
+	int ret, n;
+
+	if (len < sizeof(config->tp))
+		return -EINVAL;
+
+	sched = xnsched_struct(cpu);
+
+	switch (config->tp.op) {
+	case sched_tp_install:
+		if (config->tp.nr_windows > 0)
+			break;
+		/* Fallback wanted. */
+	case sched_tp_uninstall:
+		gps = NULL;
+		goto set_schedule;
+	case sched_tp_start:
+		xnlock_get_irqsave(&nklock, s);
+		xnsched_tp_start_schedule(sched);
+		xnlock_put_irqrestore(&nklock, s);
+		return 0;
+	case sched_tp_stop:
+		xnlock_get_irqsave(&nklock, s);
+		xnsched_tp_stop_schedule(sched);
+		xnlock_put_irqrestore(&nklock, s);
+		return 0;
+	case sched_tp_load:
+		gps = NULL;
+		if (config->tp.nr_windows > 0) {
+			gps = build_tp_schedule(config, len);
+			if (IS_ERR(gps))
+				return PTR_ERR(gps);
+		}
+		xnlock_get_irqsave(&nklock, s);
+		ogps = xnsched_tp_load_schedule(sched, config->tp.slot, gps);
+		xnlock_put_irqrestore(&nklock, s);
+		if (IS_ERR(ogps)) {
+			if (gps)
+				xnsched_tp_put_schedule(gps);
+			return PTR_ERR(ogps);
+		}
+		if (ogps)
+			xnsched_tp_put_schedule(ogps);
+		return 0;
+	case sched_tp_switch:
+		xnlock_get_irqsave(&nklock, s);
+		ret = xnsched_tp_switch_schedule(sched, config->tp.slot);
+		xnlock_put_irqrestore(&nklock, s);
+		return ret;
+	default:
+		return -EINVAL;
+	}
+
+	/* Install a new TP schedule on CPU. */
+
+	gps = build_tp_schedule(config, len);
+	if (IS_ERR(gps))
+		return PTR_ERR(gps);
 set_schedule:
 	xnlock_get_irqsave(&nklock, s);
 	ogps = xnsched_tp_set_schedule(sched, gps);
@@ -307,12 +355,19 @@ set_schedule:
 	if (ogps)
 		xnsched_tp_put_schedule(ogps);
 
-	return 0;
+	if (gps)
+		return 0;
 
-cleanup_and_fail:
-	xnfree(gps);
+	/* Uninstalling drops the preloaded schedules as well. */
+	for (n = 1; n < CONFIG_XENO_OPT_SCHED_TP_NRSCHED; n++) {
+		xnlock_get_irqsave(&nklock, s);
+		ogps = xnsched_tp_load_schedule(sched, n, NULL);
+		xnlock_put_irqrestore(&nklock, s);
+		if (!IS_ERR_OR_NULL(ogps))
+			xnsched_tp_put_schedule(ogps);
+	}
 
-	return -EINVAL;
+	return 0;
 }
 
 static inline
@@ -354,6 +409,7 @@ ssize_t get_tp_config(int cpu, void __user *u_config, size_t len,
 
 	config->tp.op = sched_tp_install;
 	config->tp.nr_windows = gps->pwin_nr;
+	config->tp.slot = gps->slot;
 	for (n = 0, pp = p = config->tp.windows, pw = w = gps->pwins;
 	     n < gps->pwin_nr; pp = p, p++, pw = w, w++, n++) {
 		ns2ts(&p->offset, w->w_offset);
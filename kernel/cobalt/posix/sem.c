@@ -249,7 +249,7 @@ static int sem_wait(xnhandle_t handle)
 
 	xnlock_get_irqsave(&nklock, s);
 
-	sem = xnregistry_lookup(handle, NULL);
+	sem = cobalt_lookup_handle(handle);
 	ret = do_trywait(sem);
 	if (ret != -EAGAIN)
 		goto out;
@@ -293,7 +293,7 @@ int __cobalt_sem_timedwait(struct cobalt_sem_shadow __user *u_sem,
 	xnlock_get_irqsave(&nklock, s);
 
 	for (;;) {
-		sem = xnregistry_lookup(handle, NULL);
+		sem = cobalt_lookup_handle(handle);
 		ret = do_trywait(sem);
 		if (ret != -EAGAIN)
 			break;
@@ -345,7 +345,7 @@ static int sem_post(xnhandle_t handle)
 
 	xnlock_get_irqsave(&nklock, s);
 
-	sem = xnregistry_lookup(handle, NULL);
+	sem = cobalt_lookup_handle(handle);
 	ret = sem_check(sem);
 	if (ret)
 		goto out;
@@ -374,7 +374,7 @@ static int sem_getvalue(xnhandle_t handle, int *value)
 
 	xnlock_get_irqsave(&nklock, s);
 
-	sem = xnregistry_lookup(handle, NULL);
+	sem = cobalt_lookup_handle(handle);
 	ret = sem_check(sem);
 	if (ret) {
 		xnlock_put_irqrestore(&nklock, s);
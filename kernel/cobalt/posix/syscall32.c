@@ -288,6 +288,14 @@ static inline int mq_fetch_timeout(struct timespec *ts,
 
 }
 
+COBALT_SYSCALL32emu(mq_ringwait, primary,
+		    (mqd_t uqd, int op,
+		     const struct compat_timespec __user *u_ts))
+{
+	return __cobalt_mq_ringwait(uqd, op, u_ts,
+				    u_ts ? sys32_fetch_timeout : NULL);
+}
+
 COBALT_SYSCALL32emu(mq_notify, primary,
 		    (mqd_t fd, const struct compat_sigevent *__user u_cev))
 {
@@ -342,6 +350,11 @@ sys32_fetch_config(int policy, const void __user *u_config, size_t *len)
 
 	switch (policy) {
 	case SCHED_TP:
+		if (*len < sizeof(cbuf->tp) ||
+		    *len < compat_sched_tp_confsz(cbuf->tp.nr_windows)) {
+			buf = ERR_PTR(-EINVAL);
+			goto out;
+		}
 		*len = sched_tp_confsz(cbuf->tp.nr_windows);
 		break;
 	case SCHED_QUOTA:
@@ -362,6 +375,7 @@ sys32_fetch_config(int policy, const void __user *u_config, size_t *len)
 	else {
 		buf->tp.op = cbuf->tp.op;
 		buf->tp.nr_windows = cbuf->tp.nr_windows;
+		buf->tp.slot = cbuf->tp.slot;
 		for (n = 0; n < buf->tp.nr_windows; n++) {
 			buf->tp.windows[n].ptid = cbuf->tp.windows[n].ptid;
 			buf->tp.windows[n].offset.tv_sec = cbuf->tp.windows[n].offset.tv_sec;
@@ -414,6 +428,7 @@ static ssize_t sys32_put_config(int policy,
 
 	__xn_put_user(config->tp.op, &u_p->tp.op);
 	__xn_put_user(config->tp.nr_windows, &u_p->tp.nr_windows);
+	__xn_put_user(config->tp.slot, &u_p->tp.slot);
 
 	for (n = 0, ret = 0; n < config->tp.nr_windows; n++) {
 		ret |= __xn_put_user(config->tp.windows[n].ptid,
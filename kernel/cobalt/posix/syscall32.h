@@ -101,6 +101,10 @@ COBALT_SYSCALL32x_DECL(mq_timedreceive,
 			unsigned int __user *u_prio,
 			const struct timespec __user *u_ts));
 
+COBALT_SYSCALL32emu_DECL(mq_ringwait,
+			 (mqd_t uqd, int op,
+			  const struct compat_timespec __user *u_ts));
+
 COBALT_SYSCALL32emu_DECL(mq_notify,
 			 (mqd_t fd, const struct compat_sigevent *__user u_cev));
 
@@ -22,6 +22,7 @@
 #include <linux/signal.h>
 #include <linux/jiffies.h>
 #include <linux/err.h>
+#include <cobalt/uapi/kernel/urw.h>
 #include "internal.h"
 #include "thread.h"
 #include "sched.h"
@@ -29,150 +30,291 @@
 #include "timer.h"
 #include "clock.h"
 #include "sem.h"
+#include "event.h"
 #define CREATE_TRACE_POINTS
 #include <trace/events/cobalt-posix.h>
 
 xnticks_t cobalt_time_slice = CONFIG_XENO_OPT_RR_QUANTUM * 1000;
 
-#define PTHREAD_HSLOTS (1 << 8)	/* Must be a power of 2 */
+#define PTHREAD_HSLOTS (1 << 8)	/* Initial size, must be a power of 2 */
+#define PTHREAD_HSLOTS_MAX (1 << 16)
 
-/* Process-local index, pthread_t x mm_struct (cobalt_local_hkey). */
-struct local_thread_hash {
-	pid_t pid;
+struct cobalt_thread_budget {
+	struct xnthread_budget base;
+	struct cobalt_sigpending sigp;
+	xnhandle_t event;
+	unsigned int evbits;
+};
+
+/*
+ * Threads are indexed twice: per process on pthread_t x mm_struct
+ * (cobalt_local_hkey), and system-wide on task_pid_nr(). Lookups do
+ * not lock; they walk the chains in an unsynced read block, which
+ * restarts if the indexes changed meanwhile. Updates are serialized
+ * by index_lock with hard IRQs off.
+ *
+ * A reader may still be walking through any slot or bucket array
+ * the writer drops, so neither is ever freed. Unhashed slots go to a
+ * free list for reuse, and the old bucket arrays are kept when the
+ * indexes grow. Their total size stays below the size of the live
+ * arrays.
+ */
+struct thread_slot {
 	struct cobalt_thread *thread;
 	struct cobalt_local_hkey hkey;
-	struct local_thread_hash *next;
+	pid_t pid;
+	u32 lhash;
+	u32 ghash;
+	struct thread_slot *lnext;
+	struct thread_slot *gnext;
 };
 
-/* System-wide index on task_pid_nr(). */
-struct global_thread_hash {
-	pid_t pid;
-	struct cobalt_thread *thread;
-	struct global_thread_hash *next;
+struct thread_buckets {
+	unsigned int mask;
+	struct thread_slot *heads[0];
 };
 
-static struct local_thread_hash *local_index[PTHREAD_HSLOTS];
+static struct thread_buckets *local_index, *global_index;
+
+static struct thread_slot *free_slots;
+
+static unsigned int nr_slots, nr_hashed;
+
+static DEFINE_URW(index_seq);
+
+static IPIPE_DEFINE_SPINLOCK(index_lock);
+
+static inline u32 local_hash(const struct cobalt_local_hkey *hkey)
+{
+	return jhash2((u32 *)hkey, sizeof(*hkey) / sizeof(u32), 0);
+}
+
+static inline u32 global_hash(pid_t pid)
+{
+	return jhash2((u32 *)&pid, sizeof(pid) / sizeof(u32), 0);
+}
+
+static struct thread_buckets *alloc_buckets(unsigned int size)
+{
+	struct thread_buckets *b;
+
+	b = xnheap_vmalloc(sizeof(*b) + size * sizeof(b->heads[0]));
+	if (b == NULL)
+		return NULL;
+
+	memset(b->heads, 0, size * sizeof(b->heads[0]));
+	b->mask = size - 1;
+
+	return b;
+}
+
+/* Linux domain only. */
+static void grow_index(void)
+{
+	struct thread_buckets *old, *lb, *gb;
+	struct thread_slot *slot, *next;
+	unsigned long flags;
+	unsigned int size, n;
+	urwstate_t tmp;
+
+	old = ACCESS_ONCE(local_index);
+	size = old ? (old->mask + 1) * 2 : PTHREAD_HSLOTS;
+	lb = alloc_buckets(size);
+	gb = alloc_buckets(size);
+	if (lb == NULL || gb == NULL)
+		goto fail;
+
+	raw_spin_lock_irqsave(&index_lock, flags);
 
-static struct global_thread_hash *global_index[PTHREAD_HSLOTS];
+	if (local_index != old) {
+		/* Somebody else did it. */
+		raw_spin_unlock_irqrestore(&index_lock, flags);
+		goto fail;
+	}
 
-static inline struct local_thread_hash *
+	/*
+	 * Slots carry their hash values, so rehashing only relinks
+	 * them, which keeps the time spent with IRQs off short.
+	 */
+	unsynced_write_block(&tmp, &index_seq) {
+		for (n = 0; old && n <= old->mask; n++) {
+			for (slot = local_index->heads[n]; slot; slot = next) {
+				next = slot->lnext;
+				slot->lnext = lb->heads[slot->lhash & lb->mask];
+				lb->heads[slot->lhash & lb->mask] = slot;
+			}
+			for (slot = global_index->heads[n]; slot; slot = next) {
+				next = slot->gnext;
+				slot->gnext = gb->heads[slot->ghash & gb->mask];
+				gb->heads[slot->ghash & gb->mask] = slot;
+			}
+		}
+		local_index = lb;
+		global_index = gb;
+	}
+
+	raw_spin_unlock_irqrestore(&index_lock, flags);
+
+	return;
+fail:
+	if (lb)
+		xnheap_vfree(lb);
+	if (gb)
+		xnheap_vfree(gb);
+}
+
+static inline struct thread_slot *
 thread_hash(const struct cobalt_local_hkey *hkey,
 	    struct cobalt_thread *thread, pid_t pid)
 {
-	struct global_thread_hash **ghead, *gslot;
-	struct local_thread_hash **lhead, *lslot;
-	u32 hash;
-	void *p;
-	spl_t s;
+	struct thread_buckets *b;
+	struct thread_slot *slot;
+	unsigned long flags;
+	urwstate_t tmp;
+
+	b = ACCESS_ONCE(local_index);
+	if (b == NULL ||
+	    (nr_hashed > b->mask && b->mask + 1 < PTHREAD_HSLOTS_MAX))
+		grow_index();
 
-	p = xnmalloc(sizeof(*lslot) + sizeof(*gslot));
-	if (p == NULL)
+	if (local_index == NULL)
 		return NULL;
 
-	lslot = p;
-	lslot->hkey = *hkey;
-	lslot->thread = thread;
-	lslot->pid = pid;
-	hash = jhash2((u32 *)&lslot->hkey,
-		      sizeof(lslot->hkey) / sizeof(u32), 0);
-	lhead = &local_index[hash & (PTHREAD_HSLOTS - 1)];
+	raw_spin_lock_irqsave(&index_lock, flags);
+
+	slot = free_slots;
+	if (slot == NULL) {
+		raw_spin_unlock_irqrestore(&index_lock, flags);
+		slot = xnmalloc(sizeof(*slot));
+		if (slot == NULL)
+			return NULL;
+		raw_spin_lock_irqsave(&index_lock, flags);
+		nr_slots++;
+	} else
+		free_slots = slot->lnext;
+
+	unsynced_write_block(&tmp, &index_seq) {
+		slot->thread = thread;
+		slot->hkey = *hkey;
+		slot->pid = pid;
+		slot->lhash = local_hash(hkey);
+		slot->ghash = global_hash(pid);
+		slot->lnext = local_index->heads[slot->lhash & local_index->mask];
+		local_index->heads[slot->lhash & local_index->mask] = slot;
+		slot->gnext = global_index->heads[slot->ghash & global_index->mask];
+		global_index->heads[slot->ghash & global_index->mask] = slot;
+		nr_hashed++;
+	}
 
-	gslot = p + sizeof(*lslot);
-	gslot->pid = pid;
-	gslot->thread = thread;
-	hash = jhash2((u32 *)&pid, sizeof(pid) / sizeof(u32), 0);
-	ghead = &global_index[hash & (PTHREAD_HSLOTS - 1)];
+	raw_spin_unlock_irqrestore(&index_lock, flags);
 
-	xnlock_get_irqsave(&nklock, s);
-	lslot->next = *lhead;
-	*lhead = lslot;
-	gslot->next = *ghead;
-	*ghead = gslot;
-	xnlock_put_irqrestore(&nklock, s);
-
-	return lslot;
+	return slot;
 }
 
 static inline void thread_unhash(const struct cobalt_local_hkey *hkey)
 {
-	struct global_thread_hash **gtail, *gslot;
-	struct local_thread_hash **ltail, *lslot;
-	pid_t pid;
+	struct thread_slot **ltail, **gtail, *slot;
+	unsigned long flags;
+	urwstate_t tmp;
 	u32 hash;
-	spl_t s;
-
-	hash = jhash2((u32 *) hkey, sizeof(*hkey) / sizeof(u32), 0);
-	ltail = &local_index[hash & (PTHREAD_HSLOTS - 1)];
 
-	xnlock_get_irqsave(&nklock, s);
+	hash = local_hash(hkey);
 
-	lslot = *ltail;
-	while (lslot &&
-	       (lslot->hkey.u_pth != hkey->u_pth ||
-		lslot->hkey.mm != hkey->mm)) {
-		ltail = &lslot->next;
-		lslot = *ltail;
-	}
+	raw_spin_lock_irqsave(&index_lock, flags);
 
-	if (lslot == NULL) {
-		xnlock_put_irqrestore(&nklock, s);
-		return;
-	}
+	if (local_index == NULL)
+		goto out;
 
-	*ltail = lslot->next;
-	pid = lslot->pid;
-	hash = jhash2((u32 *)&pid, sizeof(pid) / sizeof(u32), 0);
-	gtail = &global_index[hash & (PTHREAD_HSLOTS - 1)];
-	gslot = *gtail;
-	while (gslot && gslot->pid != pid) {
-		gtail = &gslot->next;
-		gslot = *gtail;
+	ltail = &local_index->heads[hash & local_index->mask];
+	slot = *ltail;
+	while (slot &&
+	       (slot->hkey.u_pth != hkey->u_pth ||
+		slot->hkey.mm != hkey->mm)) {
+		ltail = &slot->lnext;
+		slot = *ltail;
 	}
-	/* gslot must be found here. */
-	XENO_BUG_ON(COBALT, !(gslot && gtail));
-	*gtail = gslot->next;
 
-	xnlock_put_irqrestore(&nklock, s);
+	if (slot == NULL)
+		goto out;
 
-	xnfree(lslot);
+	gtail = &global_index->heads[slot->ghash & global_index->mask];
+	while (*gtail && *gtail != slot)
+		gtail = &(*gtail)->gnext;
+	/* slot must be found here. */
+	XENO_BUG_ON(COBALT, *gtail == NULL);
+
+	unsynced_write_block(&tmp, &index_seq) {
+		*ltail = slot->lnext;
+		*gtail = slot->gnext;
+		slot->lnext = free_slots;
+		free_slots = slot;
+		nr_hashed--;
+	}
+out:
+	raw_spin_unlock_irqrestore(&index_lock, flags);
 }
 
 static struct cobalt_thread *
 thread_lookup(const struct cobalt_local_hkey *hkey)
 {
-	struct local_thread_hash *lslot;
 	struct cobalt_thread *thread;
+	struct thread_buckets *b;
+	struct thread_slot *slot;
+	unsigned int n, max;
+	urwstate_t tmp;
 	u32 hash;
-	spl_t s;
-
-	hash = jhash2((u32 *)hkey, sizeof(*hkey) / sizeof(u32), 0);
-	lslot = local_index[hash & (PTHREAD_HSLOTS - 1)];
-
-	xnlock_get_irqsave(&nklock, s);
 
-	while (lslot != NULL &&
-	       (lslot->hkey.u_pth != hkey->u_pth || lslot->hkey.mm != hkey->mm))
-		lslot = lslot->next;
+	hash = local_hash(hkey);
 
-	thread = lslot ? lslot->thread : NULL;
-
-	xnlock_put_irqrestore(&nklock, s);
+	/*
+	 * A chain may only look longer than the number of slots if it
+	 * was changed under our feet, in which case the read block
+	 * will be restarted anyway.
+	 */
+	unsynced_read_block(&tmp, &index_seq) {
+		thread = NULL;
+		max = ACCESS_ONCE(nr_slots);
+		b = ACCESS_ONCE(local_index);
+		slot = b ? ACCESS_ONCE(b->heads[hash & b->mask]) : NULL;
+		for (n = 0; slot && n < max; n++) {
+			if (slot->hkey.u_pth == hkey->u_pth &&
+			    slot->hkey.mm == hkey->mm) {
+				thread = ACCESS_ONCE(slot->thread);
+				break;
+			}
+			slot = ACCESS_ONCE(slot->lnext);
+		}
+	}
 
 	return thread;
 }
 
 struct cobalt_thread *cobalt_thread_find(pid_t pid) /* nklocked, IRQs off */
 {
-	struct global_thread_hash *gslot;
+	struct cobalt_thread *thread;
+	struct thread_buckets *b;
+	struct thread_slot *slot;
+	unsigned int n, max;
+	urwstate_t tmp;
 	u32 hash;
 
-	hash = jhash2((u32 *)&pid, sizeof(pid) / sizeof(u32), 0);
-
-	gslot = global_index[hash & (PTHREAD_HSLOTS - 1)];
-	while (gslot && gslot->pid != pid)
-		gslot = gslot->next;
+	hash = global_hash(pid);
+
+	unsynced_read_block(&tmp, &index_seq) {
+		thread = NULL;
+		max = ACCESS_ONCE(nr_slots);
+		b = ACCESS_ONCE(global_index);
+		slot = b ? ACCESS_ONCE(b->heads[hash & b->mask]) : NULL;
+		for (n = 0; slot && n < max; n++) {
+			if (slot->pid == pid) {
+				thread = ACCESS_ONCE(slot->thread);
+				break;
+			}
+			slot = ACCESS_ONCE(slot->gnext);
+		}
+	}
 
-	return gslot ? gslot->thread : NULL;
+	return thread;
 }
 EXPORT_SYMBOL_GPL(cobalt_thread_find);
 
@@ -222,9 +364,16 @@ struct xnthread_personality *cobalt_thread_exit(struct xnthread *curr)
 	cobalt_mark_deleted(thread);
 	list_del(&thread->next);
 	xnlock_put_irqrestore(&nklock, s);
+	/* Prevent further overrun notifications before flushing. */
+	if (thread->budget)
+		xnthread_stop_budget(&thread->budget->base);
 	cobalt_signal_flush(thread);
 	xnsynch_destroy(&thread->monitor_synch);
 	xnsynch_destroy(&thread->sigwait);
+	if (thread->budget) {
+		xnthread_destroy_budget(&thread->budget->base);
+		xnfree(thread->budget);
+	}
 
 	return NULL;
 }
@@ -390,6 +539,7 @@ static int pthread_create(struct cobalt_thread **thread_p,
 	}
 
 	thread->magic = COBALT_THREAD_MAGIC;
+	thread->budget = NULL;
 	xnsynch_init(&thread->monitor_synch, XNSYNCH_FIFO, NULL);
 
 	xnsynch_init(&thread->sigwait, XNSYNCH_FIFO, NULL);
@@ -833,6 +983,262 @@ COBALT_SYSCALL(thread_getstat, current,
 	return cobalt_copy_to_user(u_stat, &stat, sizeof(stat));
 }
 
+static void budget_overrun_handler(struct xnthread_budget *base)
+{				/* nklocked, IRQs off */
+	struct cobalt_thread_budget *budget;
+	struct cobalt_thread *thread;
+
+	budget = container_of(base, struct cobalt_thread_budget, base);
+	thread = container_of(base->thread, struct cobalt_thread, threadbase);
+
+	if (budget->sigp.si.si_signo) {
+		budget->sigp.si.si_int = (int)base->overruns;
+		cobalt_signal_send(thread, &budget->sigp, 0);
+	}
+
+	if (budget->event != XN_NO_HANDLE)
+		cobalt_event_post_bits(budget->event, budget->evbits);
+}
+
+static struct cobalt_thread *find_target_thread(pid_t pid)
+{				/* nklocked, IRQs off */
+	if (pid == 0)
+		return cobalt_current_thread();
+
+	return cobalt_thread_find(pid);
+}
+
+COBALT_SYSCALL(thread_setbudget, current,
+	       (pid_t pid, const struct cobalt_budget_config __user *u_config))
+{
+	struct cobalt_thread_budget *budget, *new = NULL;
+	struct cobalt_budget_config config;
+	xntmode_t mode = XN_ABSOLUTE;
+	xnticks_t idate = XN_INFINITE;
+	struct cobalt_thread *thread;
+	spl_t s;
+	int ret;
+
+	ret = cobalt_copy_from_user(&config, u_config, sizeof(config));
+	if (ret)
+		return ret;
+
+	trace_cobalt_pthread_setbudget(pid, &config);
+
+	if (config.quantum) {
+		if (config.signo < 0 || config.signo > _NSIG)
+			return -EINVAL;
+		if (config.idate) {
+			if (config.clock != CLOCK_MONOTONIC &&
+			    config.clock != CLOCK_REALTIME)
+				return -EINVAL;
+			mode = clock_flag(TIMER_ABSTIME, config.clock);
+			idate = config.idate;
+		}
+		new = xnmalloc(sizeof(*new));
+		if (new == NULL)
+			return -ENOMEM;
+	}
+
+	xnlock_get_irqsave(&nklock, s);
+
+	thread = find_target_thread(pid);
+	if (thread == NULL) {
+		ret = pid ? -ESRCH : -EPERM;
+		goto out;
+	}
+
+	budget = thread->budget;
+	if (config.quantum == 0) {
+		if (budget)
+			xnthread_stop_budget(&budget->base);
+		goto out;
+	}
+
+	if (budget == NULL) {
+		budget = new;
+		new = NULL;
+		xnthread_init_budget(&budget->base, &thread->threadbase,
+				     budget_overrun_handler);
+		budget->sigp.si.si_signo = 0;
+		INIT_LIST_HEAD(&budget->sigp.next);
+		thread->budget = budget;
+	} else
+		xnthread_stop_budget(&budget->base);
+
+	/* A notification might still be pending from the former setup. */
+	if (!list_empty(&budget->sigp.next)) {
+		list_del_init(&budget->sigp.next);
+		if (list_empty(thread->sigqueues + budget->sigp.si.si_signo - 1))
+			sigdelset(&thread->sigpending, budget->sigp.si.si_signo);
+	}
+
+	budget->sigp.si.si_signo = config.signo;
+	budget->sigp.si.si_errno = 0;
+	budget->sigp.si.si_code = SI_QUEUE;
+	budget->sigp.si.si_pid = xnthread_host_pid(&thread->threadbase);
+	budget->sigp.si.si_uid = 0;
+	budget->sigp.si.si_int = 0;
+	budget->event = config.event;
+	budget->evbits = config.evbits;
+	budget->base.overruns = 0;
+
+	ret = xnthread_start_budget(&budget->base, config.quantum,
+				    idate, mode, config.period);
+out:
+	xnlock_put_irqrestore(&nklock, s);
+
+	if (new)
+		xnfree(new);
+
+	return ret;
+}
+
+COBALT_SYSCALL(thread_getbudget, current,
+	       (pid_t pid, struct cobalt_budget_info __user *u_info))
+{
+	struct cobalt_thread_budget *budget;
+	struct cobalt_budget_info info;
+	struct cobalt_thread *thread;
+	struct xnthread *base;
+	xnticks_t consumed;
+	spl_t s;
+
+	trace_cobalt_pthread_getbudget(pid);
+
+	memset(&info, 0, sizeof(info));
+
+	xnlock_get_irqsave(&nklock, s);
+
+	thread = find_target_thread(pid);
+	if (thread == NULL) {
+		xnlock_put_irqrestore(&nklock, s);
+		return pid ? -ESRCH : -EPERM;
+	}
+
+	base = &thread->threadbase;
+	budget = thread->budget;
+	if (budget) {
+		info.overruns = budget->base.overruns;
+		if (base->budget == &budget->base) {
+			info.quantum = budget->base.quantum;
+			info.left = budget->base.left;
+			if (base->sched->curr == base && info.left > 0) {
+				consumed = xnclock_read_monotonic(&nkclock) -
+					budget->base.resume_date;
+				info.left = consumed < info.left ?
+					info.left - consumed : 0;
+			}
+		}
+	}
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	return cobalt_copy_to_user(u_info, &info, sizeof(info));
+}
+
+COBALT_SYSCALL(thread_setperiodic, current,
+	       (pid_t pid, const struct cobalt_period_config __user *u_config))
+{
+	struct cobalt_period_config config;
+	xntmode_t mode = XN_ABSOLUTE;
+	xnticks_t idate = XN_INFINITE;
+	xnticks_t period = XN_INFINITE;
+	struct cobalt_thread *thread;
+	spl_t s;
+	int ret;
+
+	ret = cobalt_copy_from_user(&config, u_config, sizeof(config));
+	if (ret)
+		return ret;
+
+	trace_cobalt_pthread_setperiodic(pid, &config);
+
+	if (config.period) {
+		if (config.idate) {
+			if (config.clock != CLOCK_MONOTONIC &&
+			    config.clock != CLOCK_REALTIME)
+				return -EINVAL;
+			mode = clock_flag(TIMER_ABSTIME, config.clock);
+			idate = config.idate;
+		}
+		period = config.period;
+	}
+
+	xnlock_get_irqsave(&nklock, s);
+
+	thread = find_target_thread(pid);
+	if (thread == NULL)
+		ret = pid ? -ESRCH : -EPERM;
+	else
+		ret = xnthread_set_periodic_group(&thread->threadbase,
+						  idate, mode, period,
+						  config.base);
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	return ret;
+}
+
+COBALT_SYSCALL(thread_waitperiod, primary,
+	       (__u32 __user *u_overruns))
+{
+	unsigned long overruns = 0;
+	__u32 count;
+	int ret;
+
+	ret = xnthread_wait_period(&overruns);
+	if (u_overruns && (ret == 0 || ret == -ETIMEDOUT)) {
+		count = overruns;
+		if (cobalt_copy_to_user(u_overruns, &count, sizeof(count)))
+			ret = -EFAULT;
+	}
+
+	return ret;
+}
+
+COBALT_SYSCALL(thread_getperiodic, current,
+	       (pid_t pid, struct cobalt_period_info __user *u_info))
+{
+	struct cobalt_period_info info;
+	struct cobalt_thread *thread;
+	struct xnthread *base;
+	struct xnrgroup *rg;
+	spl_t s;
+
+	trace_cobalt_pthread_getperiodic(pid);
+
+	memset(&info, 0, sizeof(info));
+
+	xnlock_get_irqsave(&nklock, s);
+
+	thread = find_target_thread(pid);
+	if (thread == NULL) {
+		xnlock_put_irqrestore(&nklock, s);
+		return pid ? -ESRCH : -EPERM;
+	}
+
+	base = &thread->threadbase;
+	rg = base->rgroup;
+	if (rg) {
+		info.period = base->rgmult * rg->base;
+		info.base = rg->base;
+		info.members = rg->nmembers;
+		info.expiries = rg->expiries;
+		info.releases = rg->releases;
+		info.jitter_min = rg->jitter_min;
+		info.jitter_max = rg->jitter_max;
+		if (rg->nsamples)
+			info.jitter_avg = div64_s64(rg->jitter_sum,
+						    rg->nsamples);
+	} else if (xntimer_running_p(&base->ptimer))
+		info.period = xntimer_interval(&base->ptimer);
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	return cobalt_copy_to_user(u_info, &info, sizeof(info));
+}
+
 #ifdef CONFIG_XENO_OPT_COBALT_EXTENSION
 
 int cobalt_thread_extend(struct cobalt_extension *ext,
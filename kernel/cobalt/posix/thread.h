@@ -45,6 +45,7 @@
 
 struct cobalt_thread;
 struct cobalt_threadstat;
+struct cobalt_thread_budget;
 
 /*
  * pthread_mutexattr_t and pthread_condattr_t fit on 32 bits, for
@@ -103,6 +104,9 @@ struct cobalt_thread {
 	struct xnsynch monitor_synch;
 	struct list_head monitor_link;
 
+	/** CPU time budget, allocated on first use. */
+	struct cobalt_thread_budget *budget;
+
 	struct cobalt_local_hkey hkey;
 };
 
@@ -169,6 +173,23 @@ COBALT_SYSCALL_DECL(thread_getpid, (unsigned long pth));
 COBALT_SYSCALL_DECL(thread_getstat,
 		    (pid_t pid, struct cobalt_threadstat __user *u_stat));
 
+COBALT_SYSCALL_DECL(thread_setbudget,
+		    (pid_t pid,
+		     const struct cobalt_budget_config __user *u_config));
+
+COBALT_SYSCALL_DECL(thread_getbudget,
+		    (pid_t pid, struct cobalt_budget_info __user *u_info));
+
+COBALT_SYSCALL_DECL(thread_setperiodic,
+		    (pid_t pid,
+		     const struct cobalt_period_config __user *u_config));
+
+COBALT_SYSCALL_DECL(thread_waitperiod,
+		    (__u32 __user *u_overruns));
+
+COBALT_SYSCALL_DECL(thread_getperiodic,
+		    (pid_t pid, struct cobalt_period_info __user *u_info));
+
 COBALT_SYSCALL_DECL(thread_setschedparam_ex,
 		    (unsigned long pth,
 		     int policy,
@@ -225,6 +225,7 @@ void xnprocfs_cleanup_tree(void)
 	xnvfile_destroy_regular(&faults_vfile);
 	xnvfile_destroy_regular(&version_vfile);
 	xnvfile_destroy_regular(&latency_vfile);
+	xnthread_cleanup_proc();
 	xnintr_cleanup_proc();
 	xnheap_cleanup_proc();
 	xnclock_cleanup_proc();
@@ -247,6 +248,7 @@ int __init xnprocfs_init_tree(void)
 	xnclock_init_proc();
 	xnheap_init_proc();
 	xnintr_init_proc();
+	xnthread_init_proc();
 	xnvfile_init_regular("latency", &latency_vfile, &cobalt_vfroot);
 	xnvfile_init_regular("version", &version_vfile, &cobalt_vfroot);
 	xnvfile_init_regular("faults", &faults_vfile, &cobalt_vfroot);
@@ -42,6 +42,9 @@
 struct xnobject *registry_obj_slots;
 EXPORT_SYMBOL_GPL(registry_obj_slots);
 
+unsigned long registry_obj_gen[XNREGISTRY_GEN_BUCKETS];
+EXPORT_SYMBOL_GPL(registry_obj_gen);
+
 static LIST_HEAD(free_object_list); /* Free objects. */
 
 static LIST_HEAD(busy_object_list); /* Active and exported objects. */
@@ -831,6 +834,8 @@ int xnregistry_remove(xnhandle_t handle)
 
 	object->objaddr = NULL;
 	object->cstamp = 0;
+	registry_obj_gen[xnhandle_get_index(handle) &
+			 (XNREGISTRY_GEN_BUCKETS - 1)]++;
 
 	if (object->key) {
 		registry_hash_remove(object);
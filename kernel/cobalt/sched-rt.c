@@ -118,10 +118,6 @@ static void xnsched_rt_protectprio(struct xnthread *thread, int prio)
 
 struct xnvfile_directory sched_rt_vfroot;
 
-struct vfile_sched_rt_priv {
-	struct xnthread *curr;
-};
-
 struct vfile_sched_rt_data {
 	int cpu;
 	pid_t pid;
@@ -133,40 +129,33 @@ struct vfile_sched_rt_data {
 static struct xnvfile_snapshot_ops vfile_sched_rt_ops;
 
 static struct xnvfile_snapshot vfile_sched_rt = {
-	.privsz = sizeof(struct vfile_sched_rt_priv),
 	.datasz = sizeof(struct vfile_sched_rt_data),
-	.tag = &nkthreadlist_tag,
+	.list = &nkthreadlist,
 	.ops = &vfile_sched_rt_ops,
 };
 
 static int vfile_sched_rt_rewind(struct xnvfile_snapshot_iterator *it)
 {
-	struct vfile_sched_rt_priv *priv = xnvfile_iterator_priv(it);
 	int nrthreads = xnsched_class_rt.nthreads;
 
 	if (nrthreads == 0)
 		return -ESRCH;
 
-	priv->curr = list_first_entry(&nkthreadq, struct xnthread, glink);
-
 	return nrthreads;
 }
 
 static int vfile_sched_rt_next(struct xnvfile_snapshot_iterator *it,
 			       void *data)
 {
-	struct vfile_sched_rt_priv *priv = xnvfile_iterator_priv(it);
 	struct vfile_sched_rt_data *p = data;
 	struct xnthread *thread;
+	struct list_head *pos;
 
-	if (priv->curr == NULL)
+	pos = xnvfile_list_next(it);
+	if (pos == NULL)
 		return 0;	/* All done. */
 
-	thread = priv->curr;
-	if (list_is_last(&thread->glink, &nkthreadq))
-		priv->curr = NULL;
-	else
-		priv->curr = list_next_entry(thread, glink);
+	thread = list_entry(pos, struct xnthread, glink);
 
 	if (thread->base_class != &xnsched_class_rt ||
 	    xnthread_test_state(thread, XNWEAK))
@@ -20,32 +20,87 @@
 #include <cobalt/kernel/heap.h>
 #include <cobalt/uapi/sched.h>
 
-static void tp_schedule_next(struct xnsched_tp *tp)
+static void tp_switch_frame(struct xnsched_tp *tp)
+{
+	tp->wcur = 0;
+	/*
+	 * Pending schedule changes take effect on time frame
+	 * boundaries only, so that no partition ever sees its
+	 * current window cut short by a mode change.
+	 */
+	if (tp->pending) {
+		tp->gps = tp->pending;
+		tp->pending = NULL;
+	}
+}
+
+static inline void tp_advance(struct xnsched_tp *tp)
+{
+	if (++tp->wcur < tp->gps->pwin_nr)
+		return;
+
+	tp->tf_start += tp->gps->tf_duration;
+	tp_switch_frame(tp);
+}
+
+static void tp_open_window(struct xnsched_tp *tp, xnticks_t now)
+{
+	struct xnsched_tp_window *w = &tp->gps->pwins[tp->wcur];
+	xnticks_t start = tp->tf_start + w->w_offset;
+
+	tp->tps = w->w_part < 0 ? &tp->idle : &tp->partitions[w->w_part];
+	tp->slack_start = 0;
+	tp->slack = 0;
+
+	w->w_count++;
+	if (now > start && now - start > w->w_jitter_max)
+		w->w_jitter_max = now - start;
+}
+
+static void tp_close_window(struct xnsched_tp *tp, xnticks_t now)
+{
+	struct xnsched_tp_window *w = &tp->gps->pwins[tp->wcur];
+	struct xnsched *sched = container_of(tp, struct xnsched, tp);
+	struct xnthread *curr = sched->curr;
+	xnticks_t slack;
+
+	if (w->w_part < 0)
+		return;
+
+	slack = tp->slack;
+	if (tp->slack_start)
+		slack += now - tp->slack_start;
+	else if (!xnsched_emptyq_p(&tp->tps->runnable) ||
+		 (curr->sched_class == &xnsched_class_tp &&
+		  curr->tps == tp->tps))
+		w->w_overruns++;
+
+	if (w->w_count == 1 || slack < w->w_slack_min)
+		w->w_slack_min = slack;
+	w->w_slack_sum += slack;
+}
+
+static void tp_schedule_next(struct xnsched_tp *tp, xnticks_t now)
 {
 	struct xnsched_tp_window *w;
 	struct xnsched *sched;
-	int p_next, ret;
 	xnticks_t t;
+	int ret;
 
 	for (;;) {
 		/*
-		 * Switch to the next partition. Time holes in a
-		 * global time frame are defined as partition windows
-		 * assigned to part# -1, in which case the (always
-		 * empty) idle queue will be polled for runnable
-		 * threads.  Therefore, we may assume that a window
-		 * begins immediately after the previous one ends,
-		 * which simplifies the implementation a lot.
+		 * Time holes in a global time frame are defined as
+		 * partition windows assigned to part# -1, in which
+		 * case the (always empty) idle queue will be polled
+		 * for runnable threads.  Therefore, we may assume
+		 * that a window begins immediately after the
+		 * previous one ends, which simplifies the
+		 * implementation a lot.
 		 */
-		w = &tp->gps->pwins[tp->wnext];
-		p_next = w->w_part;
-		tp->tps = p_next < 0 ? &tp->idle : &tp->partitions[p_next];
+		w = &tp->gps->pwins[tp->wcur];
+		t = tp->tf_start + w->w_end;
 
 		/* Schedule tick to advance to the next window. */
-		tp->wnext = (tp->wnext + 1) % tp->gps->pwin_nr;
-		w = &tp->gps->pwins[tp->wnext];
-		t = tp->tf_start + w->w_offset;
-
 		ret = xntimer_start(&tp->tf_timer, t, XN_INFINITE, XN_ABSOLUTE);
 		if (ret != -ETIMEDOUT)
 			break;
@@ -55,16 +110,19 @@ static void tp_schedule_next(struct xnsched_tp *tp)
 		 * window. Otherwise, fix up by advancing to the next
 		 * time frame immediately.
 		 */
+		tp_advance(tp);
 		for (;;) {
 			t = tp->tf_start + tp->gps->tf_duration;
 			if (xnclock_read_monotonic(&nkclock) > t) {
 				tp->tf_start = t;
-				tp->wnext = 0;
+				tp_switch_frame(tp);
 			} else
 				break;
 		}
 	}
 
+	tp_open_window(tp, now);
+
 	sched = container_of(tp, struct xnsched, tp);
 	xnsched_set_resched(sched);
 }
@@ -72,14 +130,22 @@ static void tp_schedule_next(struct xnsched_tp *tp)
 static void tp_tick_handler(struct xntimer *timer)
 {
 	struct xnsched_tp *tp = container_of(timer, struct xnsched_tp, tf_timer);
-	/*
-	 * Advance beginning date of time frame by a full period if we
-	 * are processing the last window.
-	 */
-	if (tp->wnext + 1 == tp->gps->pwin_nr)
-		tp->tf_start += tp->gps->tf_duration;
+	xnticks_t now = xnclock_read_monotonic(&nkclock);
+
+	tp_close_window(tp, now);
+	tp_advance(tp);
+	tp_schedule_next(tp, now);
+}
+
+static inline void tp_end_slack(struct xnthread *thread)
+{
+	struct xnsched_tp *tp = &thread->sched->tp;
 
-	tp_schedule_next(tp);
+	/* A thread from the current partition is runnable again. */
+	if (tp->slack_start && thread->tps == tp->tps) {
+		tp->slack += xnclock_read_monotonic(&nkclock) - tp->slack_start;
+		tp->slack_start = 0;
+	}
 }
 
 static void xnsched_tp_init(struct xnsched *sched)
@@ -98,8 +164,13 @@ static void xnsched_tp_init(struct xnsched *sched)
 #else
 	strcpy(timer_name, "[tp-tick]");
 #endif
+	for (n = 0; n < CONFIG_XENO_OPT_SCHED_TP_NRSCHED; n++)
+		tp->schedules[n] = NULL;
+
 	tp->tps = NULL;
 	tp->gps = NULL;
+	tp->pending = NULL;
+	tp->slack_start = 0;
 	INIT_LIST_HEAD(&tp->threads);
 	xntimer_init(&tp->tf_timer, &nkclock, tp_tick_handler,
 		     sched, XNTIMER_IGRAVITY);
@@ -194,6 +265,7 @@ static void xnsched_tp_forget(struct xnthread *thread)
 
 static void xnsched_tp_enqueue(struct xnthread *thread)
 {
+	tp_end_slack(thread);
 	xnsched_addq_tail(&thread->tps->runnable, thread);
 }
 
@@ -204,16 +276,25 @@ static void xnsched_tp_dequeue(struct xnthread *thread)
 
 static void xnsched_tp_requeue(struct xnthread *thread)
 {
+	tp_end_slack(thread);
 	xnsched_addq(&thread->tps->runnable, thread);
 }
 
 static struct xnthread *xnsched_tp_pick(struct xnsched *sched)
 {
+	struct xnsched_tp *tp = &sched->tp;
+	struct xnthread *thread;
+
 	/* Never pick a thread if we don't schedule partitions. */
-	if (!xntimer_running_p(&sched->tp.tf_timer))
+	if (!xntimer_running_p(&tp->tf_timer))
 		return NULL;
 
-	return xnsched_getq(&sched->tp.tps->runnable);
+	thread = xnsched_getq(&tp->tps->runnable);
+	/* The active partition leaves the rest of its window unused. */
+	if (thread == NULL && tp->tps != &tp->idle && tp->slack_start == 0)
+		tp->slack_start = xnclock_read_monotonic(&nkclock);
+
+	return thread;
 }
 
 static void xnsched_tp_migrate(struct xnthread *thread, struct xnsched *sched)
@@ -239,9 +320,9 @@ void xnsched_tp_start_schedule(struct xnsched *sched)
 	if (tp->gps == NULL)
 		return;
 
-	tp->wnext = 0;
 	tp->tf_start = xnclock_read_monotonic(&nkclock);
-	tp_schedule_next(tp);
+	tp_switch_frame(tp);
+	tp_schedule_next(tp, tp->tf_start);
 }
 EXPORT_SYMBOL_GPL(xnsched_tp_start_schedule);
 
@@ -280,13 +361,69 @@ xnsched_tp_set_schedule(struct xnsched *sched,
 		__xnthread_set_schedparam(thread, &xnsched_class_rt, &param);
 	}
 done:
-	old_gps = tp->gps;
+	/* The new schedule replaces the one from slot #0. */
+	old_gps = tp->schedules[0];
+	if (gps)
+		gps->slot = 0;
+	tp->schedules[0] = gps;
 	tp->gps = gps;
+	tp->pending = NULL;
 
 	return old_gps;
 }
 EXPORT_SYMBOL_GPL(xnsched_tp_set_schedule);
 
+struct xnsched_tp_schedule *
+xnsched_tp_load_schedule(struct xnsched *sched, int slot,
+			 struct xnsched_tp_schedule *gps)
+{
+	struct xnsched_tp_schedule *old_gps;
+	struct xnsched_tp *tp = &sched->tp;
+
+	if (slot < 0 || slot >= CONFIG_XENO_OPT_SCHED_TP_NRSCHED)
+		return ERR_PTR(-EINVAL);
+
+	old_gps = tp->schedules[slot];
+	if (old_gps && (old_gps == tp->gps || old_gps == tp->pending))
+		return ERR_PTR(-EBUSY);
+
+	if (gps)
+		gps->slot = slot;
+
+	tp->schedules[slot] = gps;
+
+	return old_gps;
+}
+EXPORT_SYMBOL_GPL(xnsched_tp_load_schedule);
+
+int xnsched_tp_switch_schedule(struct xnsched *sched, int slot)
+{
+	struct xnsched_tp *tp = &sched->tp;
+	struct xnsched_tp_schedule *gps;
+
+	if (slot < 0 || slot >= CONFIG_XENO_OPT_SCHED_TP_NRSCHED)
+		return -EINVAL;
+
+	gps = tp->schedules[slot];
+	if (gps == NULL)
+		return -ESRCH;
+
+	/*
+	 * Threads keep their partition across schedules, so there
+	 * is nothing to do for them. If the time frame is running,
+	 * the switch is deferred until it ends.
+	 */
+	if (tp->gps && xntimer_running_p(&tp->tf_timer))
+		tp->pending = gps == tp->gps ? NULL : gps;
+	else {
+		tp->gps = gps;
+		tp->pending = NULL;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xnsched_tp_switch_schedule);
+
 struct xnsched_tp_schedule *
 xnsched_tp_get_schedule(struct xnsched *sched)
 {
@@ -324,10 +461,6 @@ EXPORT_SYMBOL_GPL(xnsched_tp_get_partition);
 
 struct xnvfile_directory sched_tp_vfroot;
 
-struct vfile_sched_tp_priv {
-	struct xnthread *curr;
-};
-
 struct vfile_sched_tp_data {
 	int cpu;
 	pid_t pid;
@@ -339,40 +472,33 @@ struct vfile_sched_tp_data {
 static struct xnvfile_snapshot_ops vfile_sched_tp_ops;
 
 static struct xnvfile_snapshot vfile_sched_tp = {
-	.privsz = sizeof(struct vfile_sched_tp_priv),
 	.datasz = sizeof(struct vfile_sched_tp_data),
-	.tag = &nkthreadlist_tag,
+	.list = &nkthreadlist,
 	.ops = &vfile_sched_tp_ops,
 };
 
 static int vfile_sched_tp_rewind(struct xnvfile_snapshot_iterator *it)
 {
-	struct vfile_sched_tp_priv *priv = xnvfile_iterator_priv(it);
 	int nrthreads = xnsched_class_tp.nthreads;
 
 	if (nrthreads == 0)
 		return -ESRCH;
 
-	priv->curr = list_first_entry(&nkthreadq, struct xnthread, glink);
-
 	return nrthreads;
 }
 
 static int vfile_sched_tp_next(struct xnvfile_snapshot_iterator *it,
 			       void *data)
 {
-	struct vfile_sched_tp_priv *priv = xnvfile_iterator_priv(it);
 	struct vfile_sched_tp_data *p = data;
 	struct xnthread *thread;
+	struct list_head *pos;
 
-	if (priv->curr == NULL)
+	pos = xnvfile_list_next(it);
+	if (pos == NULL)
 		return 0;	/* All done. */
 
-	thread = priv->curr;
-	if (list_is_last(&thread->glink, &nkthreadq))
-		priv->curr = NULL;
-	else
-		priv->curr = list_next_entry(thread, glink);
+	thread = list_entry(pos, struct xnthread, glink);
 
 	if (thread->base_class != &xnsched_class_tp)
 		return VFILE_SEQ_SKIP;
@@ -411,6 +537,87 @@ static struct xnvfile_snapshot_ops vfile_sched_tp_ops = {
 	.show = vfile_sched_tp_show,
 };
 
+static void vfile_sched_tp_show_schedule(struct xnvfile_regular_iterator *it,
+					 int cpu, struct xnsched_tp_schedule *gps,
+					 char state)
+{
+	struct xnsched_tp_window w;
+	xnticks_t avg_slack;
+	spl_t s;
+	int n;
+
+	for (n = 0; n < gps->pwin_nr; n++) {
+		xnlock_get_irqsave(&nklock, s);
+		w = gps->pwins[n];
+		xnlock_put_irqrestore(&nklock, s);
+
+		avg_slack = w.w_count ?
+			xnarch_ulldiv(w.w_slack_sum, w.w_count, NULL) : 0;
+
+		xnvfile_printf(it, "%3u  %3d%c  %-3d  %-4d  %-10Lu %-10Lu "
+			       "%-10lu %-8lu %-10Lu %-10Lu %Lu\n",
+			       cpu, gps->slot, state, n, w.w_part,
+			       w.w_offset, w.w_end - w.w_offset,
+			       w.w_count, w.w_overruns,
+			       w.w_count ? w.w_slack_min : 0, avg_slack,
+			       w.w_jitter_max);
+	}
+}
+
+static int vfile_sched_tp_windows_show(struct xnvfile_regular_iterator *it,
+				       void *data)
+{
+	struct xnsched_tp_schedule *gps;
+	struct xnsched_tp *tp;
+	int cpu, slot;
+	char state;
+	spl_t s;
+
+	/*
+	 * Times are in nanoseconds. The active schedule of each CPU
+	 * is flagged with a star, the one pending for the next time
+	 * frame with a plus sign.
+	 */
+	xnvfile_printf(it, "%-3s  %-4s  %-3s  %-4s  %-10s %-10s "
+		       "%-10s %-8s %-10s %-10s %s\n",
+		       "CPU", "SLOT", "WIN", "PTID", "OFFSET", "DURATION",
+		       "COUNT", "OVERRUN", "MIN-SLACK", "AVG-SLACK",
+		       "MAX-JITTER");
+
+	for_each_realtime_cpu(cpu) {
+		tp = &xnsched_struct(cpu)->tp;
+		for (slot = 0; slot < CONFIG_XENO_OPT_SCHED_TP_NRSCHED; slot++) {
+			xnlock_get_irqsave(&nklock, s);
+			gps = tp->schedules[slot];
+			if (gps == NULL) {
+				xnlock_put_irqrestore(&nklock, s);
+				continue;
+			}
+			atomic_inc(&gps->refcount);
+			if (gps == tp->gps)
+				state = '*';
+			else if (gps == tp->pending)
+				state = '+';
+			else
+				state = ' ';
+			xnlock_put_irqrestore(&nklock, s);
+
+			vfile_sched_tp_show_schedule(it, cpu, gps, state);
+			xnsched_tp_put_schedule(gps);
+		}
+	}
+
+	return 0;
+}
+
+static struct xnvfile_regular_ops vfile_sched_tp_windows_ops = {
+	.show = vfile_sched_tp_windows_show,
+};
+
+static struct xnvfile_regular vfile_sched_tp_windows = {
+	.ops = &vfile_sched_tp_windows_ops,
+};
+
 static int xnsched_tp_init_vfile(struct xnsched_class *schedclass,
 				 struct xnvfile_directory *vfroot)
 {
@@ -420,12 +627,18 @@ static int xnsched_tp_init_vfile(struct xnsched_class *schedclass,
 	if (ret)
 		return ret;
 
-	return xnvfile_init_snapshot("threads", &vfile_sched_tp,
-				     &sched_tp_vfroot);
+	ret = xnvfile_init_snapshot("threads", &vfile_sched_tp,
+				    &sched_tp_vfroot);
+	if (ret)
+		return ret;
+
+	return xnvfile_init_regular("windows", &vfile_sched_tp_windows,
+				    &sched_tp_vfroot);
 }
 
 static void xnsched_tp_cleanup_vfile(struct xnsched_class *schedclass)
 {
+	xnvfile_destroy_regular(&vfile_sched_tp_windows);
 	xnvfile_destroy_snapshot(&vfile_sched_tp);
 	xnvfile_destroy_dir(&sched_tp_vfroot);
 }
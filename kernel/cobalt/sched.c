@@ -47,7 +47,8 @@ LIST_HEAD(nkthreadq);
 int cobalt_nrthreads;
 
 #ifdef CONFIG_XENO_OPT_VFILE
-struct xnvfile_rev_tag nkthreadlist_tag;
+struct xnvfile_list nkthreadlist =
+	XNVFILE_LIST_INITIALIZER(nkthreadlist, &nkthreadq);
 #endif
 
 static struct xnsched_class *xnsched_class_highest;
@@ -1016,6 +1017,7 @@ reschedule:
 
 	xnstat_exectime_switch(sched, &next->stat.account);
 	xnstat_counter_inc(&next->stat.csw);
+	xnthread_switch_budget(prev, next);
 
 	switch_context(sched, prev, next);
 
@@ -1069,7 +1071,6 @@ EXPORT_SYMBOL_GPL(___xnsched_run);
 static struct xnvfile_directory sched_vfroot;
 
 struct vfile_schedlist_priv {
-	struct xnthread *curr;
 	xnticks_t start_time;
 };
 
@@ -1089,7 +1090,7 @@ static struct xnvfile_snapshot_ops vfile_schedlist_ops;
 static struct xnvfile_snapshot schedlist_vfile = {
 	.privsz = sizeof(struct vfile_schedlist_priv),
 	.datasz = sizeof(struct vfile_schedlist_data),
-	.tag = &nkthreadlist_tag,
+	.list = &nkthreadlist,
 	.ops = &vfile_schedlist_ops,
 };
 
@@ -1097,8 +1098,6 @@ static int vfile_schedlist_rewind(struct xnvfile_snapshot_iterator *it)
 {
 	struct vfile_schedlist_priv *priv = xnvfile_iterator_priv(it);
 
-	/* &nkthreadq cannot be empty (root thread(s)). */
-	priv->curr = list_first_entry(&nkthreadq, struct xnthread, glink);
 	priv->start_time = xnclock_read_monotonic(&nkclock);
 
 	return cobalt_nrthreads;
@@ -1111,16 +1110,14 @@ static int vfile_schedlist_next(struct xnvfile_snapshot_iterator *it,
 	struct vfile_schedlist_data *p = data;
 	xnticks_t timeout, period;
 	struct xnthread *thread;
+	struct list_head *pos;
 	xnticks_t base_time;
 
-	if (priv->curr == NULL)
+	pos = xnvfile_list_next(it);
+	if (pos == NULL)
 		return 0;	/* All done. */
 
-	thread = priv->curr;
-	if (list_is_last(&thread->glink, &nkthreadq))
-		priv->curr = NULL;
-	else
-		priv->curr = list_next_entry(thread, glink);
+	thread = list_entry(pos, struct xnthread, glink);
 
 	p->cpu = xnsched_cpu(thread->sched);
 	p->pid = xnthread_host_pid(thread);
@@ -1223,7 +1220,6 @@ static struct xnvfile_lock_ops vfile_schedstat_lockops = {
 
 struct vfile_schedstat_priv {
 	int irq;
-	struct xnthread *curr;
 	struct xnintr_iterator intr_it;
 };
 
@@ -1249,7 +1245,7 @@ static struct xnvfile_snapshot_ops vfile_schedstat_ops;
 static struct xnvfile_snapshot schedstat_vfile = {
 	.privsz = sizeof(struct vfile_schedstat_priv),
 	.datasz = sizeof(struct vfile_schedstat_data),
-	.tag = &nkthreadlist_tag,
+	.list = &nkthreadlist,
 	.ops = &vfile_schedstat_ops,
 	.entry = { .lockops = &vfile_schedstat_lockops },
 };
@@ -1263,7 +1259,6 @@ static int vfile_schedstat_rewind(struct xnvfile_snapshot_iterator *it)
 	 * The activity numbers on each valid interrupt descriptor are
 	 * grouped under a pseudo-thread.
 	 */
-	priv->curr = list_first_entry(&nkthreadq, struct xnthread, glink);
 	priv->irq = 0;
 	irqnr = xnintr_query_init(&priv->intr_it) * NR_CPUS;
 
@@ -1277,21 +1272,19 @@ static int vfile_schedstat_next(struct xnvfile_snapshot_iterator *it,
 	struct vfile_schedstat_data *p = data;
 	struct xnthread *thread;
 	struct xnsched *sched;
+	struct list_head *pos;
 	xnticks_t period;
 	int ret;
 
-	if (priv->curr == NULL)
+	pos = xnvfile_list_next(it);
+	if (pos == NULL)
 		/*
 		 * We are done with actual threads, scan interrupt
 		 * descriptors.
 		 */
 		goto scan_irqs;
 
-	thread = priv->curr;
-	if (list_is_last(&thread->glink, &nkthreadq))
-		priv->curr = NULL;
-	else
-		priv->curr = list_next_entry(thread, glink);
+	thread = list_entry(pos, struct xnthread, glink);
 
 	sched = thread->sched;
 	p->cpu = xnsched_cpu(sched);
@@ -1329,8 +1322,12 @@ scan_irqs:
 
 	ret = xnintr_query_next(priv->irq, &priv->intr_it, p->name);
 	if (ret) {
+		/*
+		 * Interrupt descriptors changed since the previous
+		 * chunk, resync and move to the next line.
+		 */
 		if (ret == -EAGAIN)
-			xnvfile_touch(it->vfile); /* force rewind. */
+			xnintr_query_init(&priv->intr_it);
 		priv->irq++;
 		return VFILE_SEQ_SKIP;
 	}
@@ -1426,7 +1423,7 @@ static struct xnvfile_snapshot_ops vfile_schedacct_ops;
 static struct xnvfile_snapshot schedacct_vfile = {
 	.privsz = sizeof(struct vfile_schedstat_priv),
 	.datasz = sizeof(struct vfile_schedstat_data),
-	.tag = &nkthreadlist_tag,
+	.list = &nkthreadlist,
 	.ops = &vfile_schedacct_ops,
 };
 
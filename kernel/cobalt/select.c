@@ -19,6 +19,7 @@
  */
 #include <linux/types.h>
 #include <linux/bitops.h>	/* For hweight_long */
+#include <linux/string.h>
 #include <cobalt/kernel/heap.h>
 #include <cobalt/kernel/sched.h>
 #include <cobalt/kernel/synch.h>
@@ -67,8 +68,52 @@ void xnselect_init(struct xnselect *select_block)
 }
 EXPORT_SYMBOL_GPL(xnselect_init);
 
-static inline int xnselect_wakeup(struct xnselector *selector)
+/*
+ * Each selector keeps the bindings which have their pending bit set
+ * on a ready list, so that collecting the events after a wakeup
+ * costs O(ready) instead of a scan of the whole descriptor sets. The
+ * pending bitmaps remain the reference, the list mirrors them.
+ */
+static inline void
+selector_mark_ready(struct xnselector *selector,
+		    struct xnselect_binding *binding)
 {
+	__FD_SET__(binding->bit_index,
+		   &selector->fds[binding->type].pending);
+	if (list_empty(&binding->rlink)) {
+		list_add_tail(&binding->rlink, &selector->ready);
+		selector->nr_ready++;
+	}
+}
+
+static inline void
+selector_clear_ready(struct xnselector *selector,
+		     struct xnselect_binding *binding)
+{
+	__FD_CLR__(binding->bit_index,
+		   &selector->fds[binding->type].pending);
+	if (!list_empty(&binding->rlink)) {
+		list_del_init(&binding->rlink);
+		selector->nr_ready--;
+	}
+}
+
+/*
+ * Only wake up the sleeper if it actually waits for the event
+ * @binding received, events it did not ask for are picked on the
+ * next call to xnselect().
+ */
+static inline int xnselect_wakeup(struct xnselector *selector,
+				  struct xnselect_binding *binding)
+{
+	fd_set **fds = selector->wait_fds;
+	unsigned int index = binding->bit_index;
+
+	if (fds == NULL || fds[binding->type] == NULL ||
+	    index >= selector->wait_nfds ||
+	    !__FD_ISSET__(index, fds[binding->type]))
+		return 0;
+
 	return xnsynch_flush(&selector->synchbase, 0) == XNSYNCH_RESCHED;
 }
 
@@ -121,15 +166,16 @@ int xnselect_bind(struct xnselect *select_block,
 	binding->type = type;
 	binding->bit_index = index;
 
+	INIT_LIST_HEAD(&binding->rlink);
 	list_add_tail(&binding->slink, &selector->bindings);
 	list_add_tail(&binding->link, &select_block->bindings);
 	__FD_SET__(index, &selector->fds[type].expected);
 	if (state) {
-		__FD_SET__(index, &selector->fds[type].pending);
-		if (xnselect_wakeup(selector))
+		selector_mark_ready(selector, binding);
+		if (xnselect_wakeup(selector, binding))
 			xnsched_run();
 	} else
-		__FD_CLR__(index, &selector->fds[type].pending);
+		selector_clear_ready(selector, binding);
 
 	return 0;
 }
@@ -147,14 +193,12 @@ int __xnselect_signal(struct xnselect *select_block, unsigned state)
 		if (state) {
 			if (!__FD_ISSET__(binding->bit_index,
 					&selector->fds[binding->type].pending)) {
-				__FD_SET__(binding->bit_index,
-					 &selector->fds[binding->type].pending);
-				if (xnselect_wakeup(selector))
+				selector_mark_ready(selector, binding);
+				if (xnselect_wakeup(selector, binding))
 					resched = 1;
 			}
 		} else
-			__FD_CLR__(binding->bit_index,
-				 &selector->fds[binding->type].pending);
+			selector_clear_ready(selector, binding);
 	}
 
 	return resched;
@@ -188,13 +232,14 @@ void xnselect_destroy(struct xnselect *select_block)
 		selector = binding->selector;
 		__FD_CLR__(binding->bit_index,
 			 &selector->fds[binding->type].expected);
-		if (!__FD_ISSET__(binding->bit_index,
-				&selector->fds[binding->type].pending)) {
-			__FD_SET__(binding->bit_index,
-				 &selector->fds[binding->type].pending);
-			if (xnselect_wakeup(selector))
-				resched = 1;
-		}
+		/*
+		 * The sleeper has to find out that the descriptor
+		 * went away, xnselect() reports it as ready.
+		 */
+		selector_clear_ready(selector, binding);
+		selector->stale = 1;
+		if (xnsynch_flush(&selector->synchbase, 0) == XNSYNCH_RESCHED)
+			resched = 1;
 		list_del(&binding->slink);
 		xnlock_put_irqrestore(&nklock, s);
 		xnfree(binding);
@@ -207,40 +252,56 @@ out:
 }
 EXPORT_SYMBOL_GPL(xnselect_destroy);
 
+/*
+ * The descriptor set helpers below work one long word at a time and
+ * skip empty words, which is what large, sparse sets mostly contain.
+ */
 static unsigned
-fd_set_andnot(fd_set *result, fd_set *first, fd_set *second, unsigned n)
+fd_set_andnot_count(fd_set *result, fd_set *first, fd_set *second, unsigned n)
 {
-	unsigned i, not_empty = 0;
-
-	for (i = 0; i < __FDELT__(n); i++)
-		if((result->fds_bits[i] =
-		    first->fds_bits[i] & ~(second->fds_bits[i])))
-			not_empty = 1;
+	unsigned long bits;
+	unsigned i, count = 0;
+
+	for (i = 0; i < __FDELT__(n); i++) {
+		bits = first->fds_bits[i] & ~second->fds_bits[i];
+		result->fds_bits[i] = bits;
+		if (bits)
+			count += hweight_long(bits);
+	}
 
-	if (i < __FDSET_LONGS__
-	    && (result->fds_bits[i] =
-		first->fds_bits[i] & ~(second->fds_bits[i]) & (__FDMASK__(n) - 1)))
-		not_empty = 1;
+	if (i < __FDSET_LONGS__) {
+		bits = first->fds_bits[i] & ~second->fds_bits[i]
+			& (__FDMASK__(n) - 1);
+		result->fds_bits[i] = bits;
+		if (bits)
+			count += hweight_long(bits);
+	}
 
-	return not_empty;
+	return count;
 }
 
 static unsigned
-fd_set_and(fd_set *result, fd_set *first, fd_set *second, unsigned n)
+fd_set_and_count(fd_set *result, fd_set *first, fd_set *second, unsigned n)
 {
-	unsigned i, not_empty = 0;
-
-	for (i = 0; i < __FDELT__(n); i++)
-		if((result->fds_bits[i] =
-		    first->fds_bits[i] & second->fds_bits[i]))
-			not_empty = 1;
+	unsigned long bits;
+	unsigned i, count = 0;
+
+	for (i = 0; i < __FDELT__(n); i++) {
+		bits = first->fds_bits[i] & second->fds_bits[i];
+		result->fds_bits[i] = bits;
+		if (bits)
+			count += hweight_long(bits);
+	}
 
-	if (i < __FDSET_LONGS__
-	    && (result->fds_bits[i] =
-		first->fds_bits[i] & second->fds_bits[i] & (__FDMASK__(n) - 1)))
-		not_empty = 1;
+	if (i < __FDSET_LONGS__) {
+		bits = first->fds_bits[i] & second->fds_bits[i]
+			& (__FDMASK__(n) - 1);
+		result->fds_bits[i] = bits;
+		if (bits)
+			count += hweight_long(bits);
+	}
 
-	return not_empty;
+	return count;
 }
 
 static void fd_set_zeropad(fd_set *set, unsigned n)
@@ -256,16 +317,57 @@ static void fd_set_zeropad(fd_set *set, unsigned n)
 		set->fds_bits[i] = 0;
 }
 
-static unsigned fd_set_popcount(fd_set *set, unsigned n)
+static unsigned fd_sets_unbound(struct xnselector *selector,
+				fd_set *out_fds[XNSELECT_MAX_TYPES],
+				fd_set *in_fds[XNSELECT_MAX_TYPES],
+				unsigned nfds)
 {
-	unsigned count = 0, i;
+	unsigned i, count = 0;
 
-	for (i = 0; i < __FDELT__(n); i++)
-		if (set->fds_bits[i])
-			count += hweight_long(set->fds_bits[i]);
+	for (i = 0; i < XNSELECT_MAX_TYPES; i++)
+		if (out_fds[i])
+			count += fd_set_andnot_count(out_fds[i], in_fds[i],
+						     &selector->fds[i].expected,
+						     nfds);
+
+	return count;
+}
 
-	if (i < __FDSET_LONGS__ && (set->fds_bits[i] & (__FDMASK__(n) - 1)))
-		count += hweight_long(set->fds_bits[i] & (__FDMASK__(n) - 1));
+/*
+ * Collect the pending events the caller asked for. When only a few
+ * bindings are ready compared to the size of the sets, walk the
+ * ready list; otherwise intersect the sets word by word.
+ */
+static unsigned collect_ready(struct xnselector *selector,
+			      fd_set *out_fds[XNSELECT_MAX_TYPES],
+			      fd_set *in_fds[XNSELECT_MAX_TYPES],
+			      unsigned nfds)
+{
+	unsigned i, index, count = 0, nwords = __FDELT__(nfds + __NFDBITS__ - 1);
+	struct xnselect_binding *binding;
+
+	if (selector->nr_ready > nwords) {
+		for (i = 0; i < XNSELECT_MAX_TYPES; i++)
+			if (out_fds[i])
+				count += fd_set_and_count(out_fds[i], in_fds[i],
+							  &selector->fds[i].pending,
+							  nfds);
+		return count;
+	}
+
+	for (i = 0; i < XNSELECT_MAX_TYPES; i++)
+		if (out_fds[i])
+			memset(out_fds[i]->fds_bits, 0, nwords * sizeof(long));
+
+	list_for_each_entry(binding, &selector->ready, rlink) {
+		i = binding->type;
+		index = binding->bit_index;
+		if (out_fds[i] == NULL || index >= nfds
+		    || !__FD_ISSET__(index, in_fds[i]))
+			continue;
+		__FD_SET__(index, out_fds[i]);
+		count++;
+	}
 
 	return count;
 }
@@ -289,6 +391,11 @@ int xnselector_init(struct xnselector *selector)
 		__FD_ZERO__(&selector->fds[i].pending);
 	}
 	INIT_LIST_HEAD(&selector->bindings);
+	INIT_LIST_HEAD(&selector->ready);
+	selector->nr_ready = 0;
+	selector->wait_fds = NULL;
+	selector->wait_nfds = 0;
+	selector->stale = 0;
 
 	return 0;
 }
@@ -325,8 +432,8 @@ int xnselect(struct xnselector *selector,
 	     int nfds,
 	     xnticks_t timeout, xntmode_t timeout_mode)
 {
-	unsigned int i, not_empty = 0, count;
-	int info = 0;
+	unsigned int i;
+	int info = 0, ret;
 	spl_t s;
 
 	if ((unsigned) nfds > __FD_SETSIZE)
@@ -337,50 +444,48 @@ int xnselect(struct xnselector *selector,
 			fd_set_zeropad(out_fds[i], nfds);
 
 	xnlock_get_irqsave(&nklock, s);
-	for (i = 0; i < XNSELECT_MAX_TYPES; i++)
-		if (out_fds[i]
-		    && fd_set_andnot(out_fds[i], in_fds[i],
-				     &selector->fds[i].expected, nfds))
-			not_empty = 1;
-	xnlock_put_irqrestore(&nklock, s);
-
-	if (not_empty)
-		return -ECHRNG;
-
-	xnlock_get_irqsave(&nklock, s);
-	for (i = 0; i < XNSELECT_MAX_TYPES; i++)
-		if (out_fds[i]
-		    && fd_set_and(out_fds[i], in_fds[i],
-				  &selector->fds[i].pending, nfds))
-			not_empty = 1;
 
-	while (!not_empty) {
-		info = xnsynch_sleep_on(&selector->synchbase,
-					timeout, timeout_mode);
+	selector->stale = 0;
+	if (fd_sets_unbound(selector, out_fds, in_fds, nfds)) {
+		ret = -ECHRNG;
+		goto out;
+	}
 
-		for (i = 0; i < XNSELECT_MAX_TYPES; i++)
-			if (out_fds[i]
-			    && fd_set_and(out_fds[i], in_fds[i],
-					  &selector->fds[i].pending, nfds))
-				not_empty = 1;
+	for (;;) {
+		ret = collect_ready(selector, out_fds, in_fds, nfds);
+		if (ret)
+			break;
 
-		if (info & (XNBREAK | XNTIMEO))
+		if (info & XNBREAK) {
+			ret = -EINTR;
 			break;
-	}
-	xnlock_put_irqrestore(&nklock, s);
+		}
 
-	if (not_empty) {
-		for (count = 0, i = 0; i < XNSELECT_MAX_TYPES; i++)
-			if (out_fds[i])
-				count += fd_set_popcount(out_fds[i], nfds);
+		if (info & XNTIMEO)
+			break;	/* Timeout */
 
-		return count;
+		selector->wait_fds = in_fds;
+		selector->wait_nfds = nfds;
+		info = xnsynch_sleep_on(&selector->synchbase,
+					timeout, timeout_mode);
+		selector->wait_fds = NULL;
+
+		/*
+		 * Some descriptor went away while we slept. Those we
+		 * were waiting for are reported as ready, the next
+		 * call finds them unbound.
+		 */
+		if (selector->stale) {
+			selector->stale = 0;
+			ret = fd_sets_unbound(selector, out_fds, in_fds, nfds);
+			if (ret)
+				break;
+		}
 	}
+out:
+	xnlock_put_irqrestore(&nklock, s);
 
-	if (info & XNBREAK)
-		return -EINTR;
-
-	return 0; /* Timeout */
+	return ret;
 }
 EXPORT_SYMBOL_GPL(xnselect);
 
@@ -39,6 +39,155 @@ static inline int get_ceiling_value(struct xnsynch *synch)
 
 struct xnsynch *lookup_lazy_pp(xnhandle_t handle);
 
+#ifdef CONFIG_XENO_OPT_SCALABLE_SYNCH
+
+#include <linux/bitmap.h>
+#include <cobalt/kernel/heap.h>
+
+/*
+ * Priority index of a wait queue. pendq remains the reference list
+ * of waiters in priority order, this index only records which
+ * weighted priority levels are present and the last waiter of each
+ * level, so that a new waiter can be linked right after the last
+ * waiter with an equal or higher priority, without scanning the
+ * list. Like xnsched_mlq, the bitmap is reversed so that the first
+ * bit found is the highest priority level.
+ */
+#define PRIOQ_CLASS_LEVELS	XNSCHED_CORE_NR_PRIO
+#define PRIOQ_CLASSES		5 /* up to XNSCHED_CLASS_WEIGHT(4) */
+#define PRIOQ_LEVELS		(PRIOQ_CLASSES * PRIOQ_CLASS_LEVELS)
+/* Build the index when that many waiters had to be skipped. */
+#define PRIOQ_THRESHOLD		16
+
+struct xnsynch_prioq {
+	DECLARE_BITMAP(prio_map, PRIOQ_LEVELS);
+	struct xnthread *tails[PRIOQ_LEVELS];
+};
+
+static inline int get_prioq_index(int wprio)
+{
+	int class = wprio / XNSCHED_CLASS_WEIGHT_FACTOR,
+		prio = wprio % XNSCHED_CLASS_WEIGHT_FACTOR;
+
+	XENO_BUG_ON(COBALT, wprio < 0 || class >= PRIOQ_CLASSES ||
+		    prio >= PRIOQ_CLASS_LEVELS);
+
+	return PRIOQ_LEVELS - (class * PRIOQ_CLASS_LEVELS + prio) - 1;
+}
+
+static void build_prioq(struct xnsynch *synch)
+{
+	struct xnsynch_prioq *q;
+	struct xnthread *thread;
+	int idx;
+
+	q = xnmalloc(sizeof(*q));
+	if (q == NULL)
+		return;	/* Keep going with linear insertion. */
+
+	bitmap_zero(q->prio_map, PRIOQ_LEVELS);
+
+	/* Walking in queuing order leaves the last waiter per level. */
+	list_for_each_entry(thread, &synch->pendq, plink) {
+		idx = get_prioq_index(thread->pwprio);
+		__set_bit(idx, q->prio_map);
+		q->tails[idx] = thread;
+	}
+
+	synch->prioq = q;
+}
+
+static void enqueue_sleeper(struct xnsynch *synch, struct xnthread *thread)
+{
+	struct xnsynch_prioq *q = synch->prioq;
+	struct xnthread *pos;
+	int idx, prev, skipped = 0;
+
+	thread->pwprio = thread->wprio;
+
+	if (q == NULL) {
+		list_for_each_entry_reverse(pos, &synch->pendq, plink) {
+			if (thread->pwprio <= pos->pwprio)
+				break;
+			skipped++;
+		}
+		list_add(&thread->plink, &pos->plink);
+		if (skipped >= PRIOQ_THRESHOLD)
+			build_prioq(synch);
+		return;
+	}
+
+	/* Link after the last waiter with a higher or equal priority. */
+	idx = get_prioq_index(thread->pwprio);
+	prev = find_last_bit(q->prio_map, idx + 1);
+	if (prev <= idx)
+		list_add(&thread->plink, &q->tails[prev]->plink);
+	else
+		list_add(&thread->plink, &synch->pendq);
+
+	__set_bit(idx, q->prio_map);
+	q->tails[idx] = thread;
+}
+
+static void dequeue_sleeper(struct xnsynch *synch, struct xnthread *thread)
+{
+	struct xnsynch_prioq *q = synch->prioq;
+	struct xnthread *prev;
+	int idx;
+
+	if (q) {
+		idx = get_prioq_index(thread->pwprio);
+		if (q->tails[idx] == thread) {
+			prev = list_entry(thread->plink.prev,
+					  struct xnthread, plink);
+			if (&prev->plink != &synch->pendq &&
+			    prev->pwprio == thread->pwprio)
+				q->tails[idx] = prev;
+			else
+				__clear_bit(idx, q->prio_map);
+		}
+	}
+
+	list_del(&thread->plink);
+
+	if (q && list_empty(&synch->pendq)) {
+		synch->prioq = NULL;
+		xnfree(q);
+	}
+}
+
+static inline void init_prioq(struct xnsynch *synch)
+{
+	synch->prioq = NULL;
+}
+
+#else /* !CONFIG_XENO_OPT_SCALABLE_SYNCH */
+
+static inline void enqueue_sleeper(struct xnsynch *synch,
+				   struct xnthread *thread)
+{
+	list_add_priff(thread, &synch->pendq, wprio, plink);
+}
+
+static inline void dequeue_sleeper(struct xnsynch *synch,
+				   struct xnthread *thread)
+{
+	list_del(&thread->plink);
+}
+
+static inline void init_prioq(struct xnsynch *synch) { }
+
+#endif /* !CONFIG_XENO_OPT_SCALABLE_SYNCH */
+
+static inline void enqueue_sleeper_fifo(struct xnsynch *synch,
+					struct xnthread *thread)
+{
+#ifdef CONFIG_XENO_OPT_SCALABLE_SYNCH
+	thread->pwprio = thread->wprio;
+#endif
+	list_add_tail(&thread->plink, &synch->pendq);
+}
+
 /**
  * @ingroup cobalt_core
  * @defgroup cobalt_core_synch Thread synchronization services
@@ -98,6 +247,7 @@ void xnsynch_init(struct xnsynch *synch, int flags, atomic_t *fastlock)
 	synch->wprio = -1;
 	synch->ceiling_ref = NULL;
 	INIT_LIST_HEAD(&synch->pendq);
+	init_prioq(synch);
 
 	if (flags & XNSYNCH_OWNER) {
 		BUG_ON(fastlock == NULL);
@@ -220,9 +370,9 @@ int xnsynch_sleep_on(struct xnsynch *synch, xnticks_t timeout,
 	trace_cobalt_synch_sleepon(synch);
 
 	if ((synch->status & XNSYNCH_PRIO) == 0) /* i.e. FIFO */
-		list_add_tail(&thread->plink, &synch->pendq);
+		enqueue_sleeper_fifo(synch, thread);
 	else /* i.e. priority-sorted */
-		list_add_priff(thread, &synch->pendq, wprio, plink);
+		enqueue_sleeper(synch, thread);
 
 	xnthread_suspend(thread, XNPEND, timeout, timeout_mode, synch);
 
@@ -268,7 +418,7 @@ struct xnthread *xnsynch_wakeup_one_sleeper(struct xnsynch *synch)
 
 	trace_cobalt_synch_wakeup(synch);
 	thread = list_first_entry(&synch->pendq, struct xnthread, plink);
-	list_del(&thread->plink);
+	dequeue_sleeper(synch, thread);
 	thread->wchan = NULL;
 	xnthread_resume(thread, XNPEND);
 out:
@@ -296,7 +446,7 @@ int xnsynch_wakeup_many_sleepers(struct xnsynch *synch, int nr)
 	list_for_each_entry_safe(thread, tmp, &synch->pendq, plink) {
 		if (nwakeups++ >= nr)
 			break;
-		list_del(&thread->plink);
+		dequeue_sleeper(synch, thread);
 		thread->wchan = NULL;
 		xnthread_resume(thread, XNPEND);
 	}
@@ -337,7 +487,7 @@ void xnsynch_wakeup_this_sleeper(struct xnsynch *synch, struct xnthread *sleeper
 	xnlock_get_irqsave(&nklock, s);
 
 	trace_cobalt_synch_wakeup(synch);
-	list_del(&sleeper->plink);
+	dequeue_sleeper(synch, sleeper);
 	sleeper->wchan = NULL;
 	xnthread_resume(sleeper, XNPEND);
 
@@ -740,7 +890,7 @@ redo:
 	xnsynch_detect_relaxed_owner(synch, curr);
 
 	if ((synch->status & XNSYNCH_PRIO) == 0) { /* i.e. FIFO */
-		list_add_tail(&curr->plink, &synch->pendq);
+		enqueue_sleeper_fifo(synch, curr);
 		goto block;
 	}
 
@@ -753,7 +903,7 @@ redo:
 			goto grab;
 		}
 
-		list_add_priff(curr, &synch->pendq, wprio, plink);
+		enqueue_sleeper(synch, curr);
 
 		if (synch->status & XNSYNCH_PI) {
 			raise_boost_flag(owner);
@@ -776,7 +926,7 @@ redo:
 			inherit_thread_priority(owner, curr);
 		}
 	} else
-		list_add_priff(curr, &synch->pendq, wprio, plink);
+		enqueue_sleeper(synch, curr);
 block:
 	xnthread_suspend(curr, XNPEND, timeout, timeout_mode, synch);
 	curr->wwake = NULL;
@@ -863,7 +1013,7 @@ static bool transfer_ownership(struct xnsynch *synch,
 	}
 
 	nextowner = list_first_entry(&synch->pendq, struct xnthread, plink);
-	list_del(&nextowner->plink);
+	dequeue_sleeper(synch, nextowner);
 	nextowner->wchan = NULL;
 	nextowner->wwake = synch;
 	set_current_owner_locked(synch, nextowner);
@@ -972,8 +1122,8 @@ void xnsynch_requeue_sleeper(struct xnthread *thread)
 	 * for a lock. This routine propagates the change throughout
 	 * the PI chain if required.
 	 */
-	list_del(&thread->plink);
-	list_add_priff(thread, &synch->pendq, wprio, plink);
+	dequeue_sleeper(synch, thread);
+	enqueue_sleeper(synch, thread);
 	owner = synch->owner;
 
 	/* Only PI-enabled objects are of interest here. */
@@ -1075,7 +1225,7 @@ int xnsynch_flush(struct xnsynch *synch, int reason)
 	} else {
 		ret = XNSYNCH_RESCHED;
 		list_for_each_entry_safe(sleeper, tmp, &synch->pendq, plink) {
-			list_del(&sleeper->plink);
+			dequeue_sleeper(synch, sleeper);
 			xnthread_set_info(sleeper, reason);
 			sleeper->wchan = NULL;
 			xnthread_resume(sleeper, XNPEND);
@@ -1104,7 +1254,7 @@ void xnsynch_forget_sleeper(struct xnthread *thread)
 
 	xnthread_clear_state(thread, XNPEND);
 	thread->wchan = NULL;
-	list_del(&thread->plink); /* synch->pendq */
+	dequeue_sleeper(synch, thread); /* synch->pendq */
 
 	/*
 	 * Only a sleeper leaving a PI chain triggers an update.
@@ -58,6 +58,10 @@ static void timeout_handler(struct xntimer *timer)
 	xnthread_resume(thread, XNDELAY);
 }
 
+static void __stop_budget(struct xnthread_budget *budget);
+
+static void leave_rgroup(struct xnthread *thread);
+
 static void periodic_handler(struct xntimer *timer)
 {
 	struct xnthread *thread = container_of(timer, struct xnthread, ptimer);
@@ -79,7 +83,6 @@ static inline void enlist_new_thread(struct xnthread *thread)
 {				/* nklock held, irqs off */
 	list_add_tail(&thread->glink, &nkthreadq);
 	cobalt_nrthreads++;
-	xnvfile_touch_tag(&nkthreadlist_tag);
 }
 
 struct kthread_arg {
@@ -186,6 +189,8 @@ int __xnthread_init(struct xnthread *thread,
 	thread->bprio = XNSCHED_IDLE_PRIO;
 	thread->lock_count = 0;
 	thread->rrperiod = XN_INFINITE;
+	thread->budget = NULL;
+	thread->rgroup = NULL;
 	thread->wchan = NULL;
 	thread->wwake = NULL;
 	thread->wcontext = NULL;
@@ -391,6 +396,8 @@ xnticks_t xnthread_get_period(struct xnthread *thread)
 	 */
 	if (xntimer_running_p(&thread->ptimer))
 		period = xntimer_interval(&thread->ptimer);
+	else if (thread->rgroup)
+		period = thread->rgmult * thread->rgroup->base;
 	else if (xnthread_test_state(thread,XNRRB))
 		period = thread->rrperiod;
 
@@ -472,9 +479,11 @@ static inline void cleanup_tcb(struct xnthread *curr) /* nklock held, irqs off *
 {
 	struct xnsched *sched = curr->sched;
 
-	list_del(&curr->glink);
+	xnvfile_list_del(&nkthreadlist, &curr->glink);
 	cobalt_nrthreads--;
-	xnvfile_touch_tag(&nkthreadlist_tag);
+
+	if (curr->budget)
+		__stop_budget(curr->budget);
 
 	if (xnthread_test_state(curr, XNREADY)) {
 		XENO_BUG_ON(COBALT, xnthread_test_state(curr, XNTHREAD_BLOCK_BITS));
@@ -511,6 +520,7 @@ void __xnthread_cleanup(struct xnthread *curr)
 
 	xntimer_destroy(&curr->rtimer);
 	xntimer_destroy(&curr->ptimer);
+	leave_rgroup(curr);
 
 	if (curr->selector) {
 		xnselector_destroy(curr->selector);
@@ -544,12 +554,12 @@ void __xnthread_discard(struct xnthread *thread)
 
 	xntimer_destroy(&thread->rtimer);
 	xntimer_destroy(&thread->ptimer);
+	leave_rgroup(thread);
 
 	xnlock_get_irqsave(&nklock, s);
 	if (!list_empty(&thread->glink)) {
-		list_del(&thread->glink);
+		xnvfile_list_del(&nkthreadlist, &thread->glink);
 		cobalt_nrthreads--;
-		xnvfile_touch_tag(&nkthreadlist_tag);
 	}
 	xnthread_deregister(thread);
 	xnlock_put_irqrestore(&nklock, s);
@@ -1260,6 +1270,233 @@ int xnthread_unblock(struct xnthread *thread)
 }
 EXPORT_SYMBOL_GPL(xnthread_unblock);
 
+/*
+ * Release groups. Distinct base periods are few in practice, so
+ * groups live in a static table: joining a group never allocates
+ * memory, and a group descriptor remains valid after its last member
+ * left. All fields are guarded by nklock.
+ */
+#define NR_RGROUPS  16
+
+static struct xnrgroup rgroups[NR_RGROUPS];
+
+static int nrgroups;
+
+#ifdef CONFIG_XENO_OPT_VFILE
+static struct xnvfile_rev_tag rgroup_vfile_tag;
+#endif
+
+static inline xnticks_t rgroup_date(struct xnrgroup *rg, xnticks_t tick)
+{
+	return rg->timer.start_date +
+		xnclock_ns_to_ticks(xntimer_clock(&rg->timer), tick * rg->base);
+}
+
+static void rgroup_handler(struct xntimer *timer)
+{
+	struct xnrgroup *rg = container_of(timer, struct xnrgroup, timer);
+	struct xnthread *thread;
+	xnticks_t tick, now;
+	xnsticks_t delta;
+
+	/*
+	 * The timer is not advanced yet, periodic_ticks is the index
+	 * of the current shot. Catch up with the shots we might have
+	 * missed if we are late, so that no member waits for an extra
+	 * base period.
+	 */
+	tick = timer->periodic_ticks;
+	now = xnclock_read_raw(xntimer_clock(timer));
+	delta = now - rgroup_date(rg, tick);
+	if (unlikely(delta >= (xnsticks_t)timer->interval))
+		tick += xnarch_div64(delta, timer->interval);
+
+	rg->expiries++;
+
+	/*
+	 * Members are ordered by priority as of joining the group,
+	 * with the earliest joiner first among equals. The
+	 * rescheduling procedure runs once on the way out of the
+	 * timer interrupt.
+	 */
+	list_for_each_entry(thread, &rg->members, rglink) {
+		if (thread->rgdue > tick)
+			continue;
+		do
+			thread->rgdue += thread->rgmult;
+		while (thread->rgdue <= tick);
+		/* Same rules as periodic_handler(). */
+		if (xnthread_test_state(thread, XNDELAY|XNPEND) == XNDELAY) {
+			xnthread_resume(thread, XNDELAY);
+			rg->releases++;
+		}
+	}
+}
+
+static void __leave_rgroup(struct xnthread *thread)
+{				/* nklock held, irqs off */
+	struct xnrgroup *rg = thread->rgroup;
+
+	list_del(&thread->rglink);
+	thread->rgroup = NULL;
+	if (--rg->nmembers > 0)
+		return;
+
+	xntimer_destroy(&rg->timer);
+	rg->base = 0;
+	nrgroups--;
+	xnvfile_touch_tag(&rgroup_vfile_tag);
+}
+
+static void leave_rgroup(struct xnthread *thread)
+{
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+	if (thread->rgroup)
+		__leave_rgroup(thread);
+	xnlock_put_irqrestore(&nklock, s);
+}
+
+static struct xnrgroup *get_rgroup(struct xnthread *thread, xnticks_t base,
+				   xnticks_t start)
+{				/* nklock held, irqs off */
+	struct xnrgroup *rg, *free = NULL;
+	int gravity;
+
+	gravity = xnthread_test_state(thread, XNUSER) ?
+		XNTIMER_UGRAVITY : XNTIMER_KGRAVITY;
+
+	for (rg = rgroups; rg < rgroups + NR_RGROUPS; rg++) {
+		if (rg->base == 0) {
+			if (free == NULL)
+				free = rg;
+			continue;
+		}
+		/* Kernel and user threads get distinct timer gravities. */
+		if (rg->base == base && (rg->timer.status & gravity))
+			return rg;
+	}
+
+	if (free == NULL)
+		return NULL;
+
+	rg = free;
+	xntimer_init(&rg->timer, &nkclock, rgroup_handler,
+		     thread->sched, gravity);
+	xntimer_set_name(&rg->timer, "[rgroup]");
+	xntimer_set_priority(&rg->timer, XNTIMER_HIPRIO);
+	INIT_LIST_HEAD(&rg->members);
+	rg->base = base;
+	rg->nmembers = 0;
+	rg->expiries = 0;
+	rg->releases = 0;
+	rg->nsamples = 0;
+	rg->jitter_min = 0;
+	rg->jitter_max = 0;
+	rg->jitter_sum = 0;
+	/* The first release of the founding member is tick #0. */
+	xntimer_start(&rg->timer, start, base, XN_ABSOLUTE);
+	nrgroups++;
+	xnvfile_touch_tag(&rgroup_vfile_tag);
+
+	return rg;
+}
+
+static void join_rgroup(struct xnthread *thread, struct xnrgroup *rg,
+			xnticks_t start, xnticks_t period)
+{				/* nklock held, irqs off */
+	struct xnclock *clock = xntimer_clock(&rg->timer);
+	xnticks_t date, interval, tick = 0;
+
+	/*
+	 * Round the first release up to the next group tick. Ticks
+	 * which already elapsed are out of reach.
+	 */
+	date = xnclock_ns_to_ticks(clock, start);
+	interval = rg->timer.interval;
+	if (date > rg->timer.start_date)
+		tick = xnarch_div64(date - rg->timer.start_date + interval - 1,
+				    interval);
+	if (tick < rg->timer.periodic_ticks)
+		tick = rg->timer.periodic_ticks;
+
+	thread->rgroup = rg;
+	thread->rgmult = xnarch_div64(period, rg->base);
+	thread->rgnext = tick;
+	thread->rgdue = tick;
+	list_add_priff(thread, &rg->members, cprio, rglink);
+	rg->nmembers++;
+}
+
+static void account_release(struct xnrgroup *rg, xnsticks_t delta)
+{				/* nklock held, irqs off */
+	struct xnclock *clock = xntimer_clock(&rg->timer);
+	xnsticks_t lateness;
+
+	if (delta < 0)
+		lateness = -(xnsticks_t)xnclock_ticks_to_ns(clock, -delta);
+	else
+		lateness = xnclock_ticks_to_ns(clock, delta);
+
+	if (rg->nsamples == 0 || lateness < rg->jitter_min)
+		rg->jitter_min = lateness;
+	if (rg->nsamples == 0 || lateness > rg->jitter_max)
+		rg->jitter_max = lateness;
+	rg->jitter_sum += lateness;
+	rg->nsamples++;
+}
+
+static int wait_group_release(struct xnthread *thread,
+			      unsigned long *overruns_r)
+{				/* nklock held, irqs off */
+	struct xnrgroup *rg = thread->rgroup;
+	unsigned long overruns = 0;
+	struct xnclock *clock;
+	xnticks_t now, date;
+	xnsticks_t delta;
+
+	clock = xntimer_clock(&rg->timer);
+	date = rgroup_date(rg, thread->rgnext);
+	now = xnclock_read_raw(clock);
+	/*
+	 * The group timer fires ahead of the release date by the
+	 * clock gravity: do not wait for a release which was already
+	 * processed.
+	 */
+	if (likely((xnsticks_t)(now - date) < 0 &&
+		   thread->rgdue <= thread->rgnext)) {
+		xnthread_suspend(thread, XNDELAY, XN_INFINITE, XN_RELATIVE, NULL);
+		if (unlikely(xnthread_test_info(thread, XNBREAK)))
+			return -EINTR;
+		/* We may have left the group while sleeping. */
+		if (unlikely(thread->rgroup != rg))
+			return -EWOULDBLOCK;
+		now = xnclock_read_raw(clock);
+		account_release(rg, now - date);
+	}
+
+	delta = now - date;
+	if (unlikely(delta > 0)) {
+		overruns = xnarch_div64(xnclock_ticks_to_ns(clock, delta),
+					thread->rgmult * rg->base);
+		thread->rgnext += overruns * thread->rgmult;
+	}
+	thread->rgnext += thread->rgmult;
+
+	/* Hide overruns due to the most recent ptracing session. */
+	if (xnthread_test_localinfo(thread, XNHICCUP))
+		overruns = 0;
+
+	if (overruns)
+		trace_cobalt_thread_missed_period(thread);
+
+	if (likely(overruns_r != NULL))
+		*overruns_r = overruns;
+
+	return overruns ? -ETIMEDOUT : 0;
+}
+
 /**
  * @fn int xnthread_set_periodic(struct xnthread *thread,xnticks_t idate, xntmode_t timeout_mode, xnticks_t period)
  * @brief Make a thread periodic.
@@ -1319,6 +1556,9 @@ int xnthread_set_periodic(struct xnthread *thread, xnticks_t idate,
 		
 	xnlock_get_irqsave(&nklock, s);
 
+	if (thread->rgroup)
+		__leave_rgroup(thread);
+
 	if (period == XN_INFINITE) {
 		if (xntimer_running_p(&thread->ptimer))
 			xntimer_stop(&thread->ptimer);
@@ -1359,6 +1599,224 @@ unlock_and_exit:
 }
 EXPORT_SYMBOL_GPL(xnthread_set_periodic);
 
+/**
+ * @fn int xnthread_set_periodic_group(struct xnthread *thread,xnticks_t idate, xntmode_t timeout_mode, xnticks_t period, xnticks_t base)
+ * @brief Make a thread periodic, within a release group.
+ *
+ * This call works like xnthread_set_periodic(), except that the
+ * thread does not run a periodic timer of its own. Instead, it joins
+ * the release group pacing all periodic threads based on the same
+ * period @a base, which is created on the fly if need be. A group
+ * runs a single timer ticking every @a base nanoseconds, and each
+ * shot readies every member due at this point at once, in priority
+ * order. For harmonic task sets, this turns as many timer events as
+ * there are threads to release into a single one.
+ *
+ * Members are released on group ticks only: the first release point
+ * is rounded up to the next group tick at or after @a idate, then
+ * recurs every @a period nanoseconds. Group timers are paced by the
+ * core clock, and are not affected by changes to the real-time
+ * clock.
+ *
+ * @param thread The core thread to make periodic. If NULL, the
+ * current thread is assumed.
+ *
+ * @param idate The initial (absolute) date of the first release
+ * point, expressed in nanoseconds, or XN_INFINITE for @a period
+ * nanoseconds after the current date.
+ *
+ * @param timeout_mode The mode of the @a idate parameter, either
+ * XN_ABSOLUTE or XN_REALTIME.
+ *
+ * @param period The period of the thread, expressed in
+ * nanoseconds. It must be a multiple of @a base. XN_INFINITE stops
+ * the periodic activity, leaving the group.
+ *
+ * @param base The base period of the release group to join. Zero
+ * means that no group should be joined, in which case this call is
+ * equivalent to xnthread_set_periodic().
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EINVAL is returned if @a period is not a multiple of @a base,
+ * or if @a base is shorter than the scheduling latency value for the
+ * target system. -EINVAL is also returned if @a timeout_mode is not
+ * compatible with @a idate.
+ *
+ * - -EAGAIN is returned if a new group is needed, but the maximum
+ * number of groups is already active.
+ *
+ * - -EPERM is returned if @a thread is NULL, but the caller is not a
+ * Xenomai thread.
+ *
+ * Release groups are listed with statistics by
+ * /proc/xenomai/rgroups.
+ *
+ * @coretags{task-unrestricted}
+ */
+int xnthread_set_periodic_group(struct xnthread *thread, xnticks_t idate,
+				xntmode_t timeout_mode, xnticks_t period,
+				xnticks_t base)
+{
+	struct xnrgroup *rg;
+	xnticks_t now;
+	int ret = 0;
+	spl_t s;
+
+	if (base == 0 || period == XN_INFINITE)
+		return xnthread_set_periodic(thread, idate, timeout_mode, period);
+
+	if (thread == NULL) {
+		thread = xnthread_current();
+		if (thread == NULL)
+			return -EPERM;
+	}
+
+	if (period < base || xnarch_mod64(period, base))
+		return -EINVAL;
+
+	if (base < xnclock_ticks_to_ns(&nkclock,
+			 xnclock_get_gravity(&nkclock, kernel)))
+		return -EINVAL;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if (idate == XN_INFINITE)
+		idate = xnclock_read_monotonic(&nkclock) + period;
+	else if (timeout_mode == XN_REALTIME)
+		idate -= xnclock_get_offset(&nkclock);
+	else if (timeout_mode != XN_ABSOLUTE) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/*
+	 * Like xntimer_start() does, wait for the next point on the
+	 * thread timeline if we are late on arrival.
+	 */
+	now = xnclock_read_monotonic(&nkclock);
+	if ((xnsticks_t)(idate - now) <= 0)
+		idate += period * (xnarch_div64(now - idate, period) + 1);
+
+	if (thread->rgroup)
+		__leave_rgroup(thread);
+
+	if (xntimer_running_p(&thread->ptimer))
+		xntimer_stop(&thread->ptimer);
+
+	rg = get_rgroup(thread, base, idate);
+	if (rg == NULL) {
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	join_rgroup(thread, rg, idate, period);
+out:
+	xnlock_put_irqrestore(&nklock, s);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(xnthread_set_periodic_group);
+
+#ifdef CONFIG_XENO_OPT_VFILE
+
+static struct xnvfile_snapshot_ops rgroup_vfile_ops;
+
+struct rgroup_vfile_priv {
+	struct xnrgroup *curr;
+};
+
+struct rgroup_vfile_data {
+	xnticks_t base;
+	int cpu;
+	int nmembers;
+	unsigned long long expiries;
+	unsigned long long releases;
+	xnsticks_t jitter_min;
+	xnsticks_t jitter_avg;
+	xnsticks_t jitter_max;
+};
+
+static struct xnvfile_snapshot rgroup_vfile = {
+	.privsz = sizeof(struct rgroup_vfile_priv),
+	.datasz = sizeof(struct rgroup_vfile_data),
+	.tag = &rgroup_vfile_tag,
+	.ops = &rgroup_vfile_ops,
+};
+
+static int rgroup_vfile_rewind(struct xnvfile_snapshot_iterator *it)
+{
+	struct rgroup_vfile_priv *priv = xnvfile_iterator_priv(it);
+
+	priv->curr = rgroups;
+
+	return nrgroups;
+}
+
+static int rgroup_vfile_next(struct xnvfile_snapshot_iterator *it,
+			     void *data)
+{
+	struct rgroup_vfile_priv *priv = xnvfile_iterator_priv(it);
+	struct rgroup_vfile_data *p = data;
+	struct xnrgroup *rg;
+
+	for (;;) {
+		if (priv->curr >= rgroups + NR_RGROUPS)
+			return 0;	/* We are done. */
+		rg = priv->curr++;
+		if (rg->base)
+			break;
+	}
+
+	p->base = rg->base;
+	p->cpu = xnsched_cpu(rg->timer.sched);
+	p->nmembers = rg->nmembers;
+	p->expiries = rg->expiries;
+	p->releases = rg->releases;
+	p->jitter_min = rg->jitter_min;
+	p->jitter_max = rg->jitter_max;
+	p->jitter_avg = 0;
+	if (rg->nsamples)
+		p->jitter_avg = div64_s64(rg->jitter_sum, rg->nsamples);
+
+	return 1;
+}
+
+static int rgroup_vfile_show(struct xnvfile_snapshot_iterator *it,
+			     void *data)
+{
+	struct rgroup_vfile_data *p = data;
+
+	if (p == NULL)
+		xnvfile_printf(it, "%-3s  %-12s %-7s %-12s %-12s %-10s %-10s %s\n",
+			       "CPU", "BASE(ns)", "MEMBERS", "EXPIRIES",
+			       "RELEASES", "JMIN(ns)", "JAVG(ns)", "JMAX(ns)");
+	else
+		xnvfile_printf(it, "%3d  %-12Lu %-7d %-12Lu %-12Lu %-10Ld %-10Ld %Ld\n",
+			       p->cpu, p->base, p->nmembers,
+			       p->expiries, p->releases,
+			       p->jitter_min, p->jitter_avg, p->jitter_max);
+	return 0;
+}
+
+static struct xnvfile_snapshot_ops rgroup_vfile_ops = {
+	.rewind = rgroup_vfile_rewind,
+	.next = rgroup_vfile_next,
+	.show = rgroup_vfile_show,
+};
+
+void xnthread_init_proc(void)
+{
+	xnvfile_init_snapshot("rgroups", &rgroup_vfile, &cobalt_vfroot);
+}
+
+void xnthread_cleanup_proc(void)
+{
+	xnvfile_destroy_snapshot(&rgroup_vfile);
+}
+
+#endif /* CONFIG_XENO_OPT_VFILE */
+
 /**
  * @fn int xnthread_wait_period(unsigned long *overruns_r)
  * @brief Wait for the next periodic release point.
@@ -1403,6 +1861,12 @@ int xnthread_wait_period(unsigned long *overruns_r)
 
 	xnlock_get_irqsave(&nklock, s);
 
+	if (thread->rgroup) {
+		trace_cobalt_thread_wait_period(thread);
+		ret = wait_group_release(thread, overruns_r);
+		goto out;
+	}
+
 	if (unlikely(!xntimer_running_p(&thread->ptimer))) {
 		ret = -EWOULDBLOCK;
 		goto out;
@@ -1437,6 +1901,241 @@ int xnthread_wait_period(unsigned long *overruns_r)
 }
 EXPORT_SYMBOL_GPL(xnthread_wait_period);
 
+static void budget_exhausted(struct xnthread_budget *budget)
+{				/* nklock held, irqs off */
+	budget->left = 0;
+	budget->overruns++;
+	trace_cobalt_thread_budget_overrun(budget->thread);
+	budget->handler(budget);
+}
+
+static void budget_depletion_handler(struct xntimer *timer)
+{
+	struct xnthread_budget *budget;
+
+	budget = container_of(timer, struct xnthread_budget, dtimer);
+	budget_exhausted(budget);
+}
+
+static void budget_arm(struct xnthread_budget *budget, xnticks_t now)
+{				/* nklock held, irqs off */
+	budget->resume_date = now;
+	/*
+	 * Once exhausted, wait for the next replenishment. An overrun
+	 * notification might also be pending already.
+	 */
+	if (budget->left == 0 || xntimer_running_p(&budget->dtimer))
+		return;
+
+	xntimer_set_affinity(&budget->dtimer, budget->thread->sched);
+	xntimer_start(&budget->dtimer, budget->left, XN_INFINITE, XN_RELATIVE);
+}
+
+static void budget_charge(struct xnthread_budget *budget, xnticks_t now)
+{				/* nklock held, irqs off */
+	xnticks_t consumed;
+
+	if (!xntimer_running_p(&budget->dtimer))
+		return;
+
+	/*
+	 * If the budget ran out already, the depletion timer is about
+	 * to fire, let it notify the overrun.
+	 */
+	consumed = now - budget->resume_date;
+	if (consumed < budget->left) {
+		xntimer_stop(&budget->dtimer);
+		budget->left -= consumed;
+	}
+}
+
+static void budget_replenish_handler(struct xntimer *timer)
+{
+	struct xnthread_budget *budget;
+	struct xnthread *thread;
+
+	budget = container_of(timer, struct xnthread_budget, rtimer);
+	thread = budget->thread;
+	budget->left = budget->quantum;
+
+	if (thread->sched->curr == thread) {
+		xntimer_stop(&budget->dtimer);
+		budget_arm(budget, xnclock_read_monotonic(&nkclock));
+	}
+
+	/* Follow the thread if it migrated since. */
+	xntimer_set_affinity(&budget->rtimer, thread->sched);
+}
+
+void __xnthread_switch_budget(struct xnthread *prev,
+			      struct xnthread *next)
+{				/* nklock held, irqs off */
+	xnticks_t now = xnclock_read_monotonic(&nkclock);
+
+	if (prev->budget)
+		budget_charge(prev->budget, now);
+
+	if (next->budget)
+		budget_arm(next->budget, now);
+}
+
+static void __stop_budget(struct xnthread_budget *budget)
+{				/* nklock held, irqs off */
+	struct xnthread *thread = budget->thread;
+
+	xntimer_stop(&budget->dtimer);
+	xntimer_stop(&budget->rtimer);
+	if (thread->budget == budget)
+		thread->budget = NULL;
+}
+
+/**
+ * @fn void xnthread_init_budget(struct xnthread_budget *budget, struct xnthread *thread, void (*handler)(struct xnthread_budget *budget))
+ * @brief Initialize a CPU time budget.
+ *
+ * Prepares a CPU time budget descriptor for @a thread. The budget is
+ * not enforced until xnthread_start_budget() is called.
+ *
+ * @param budget The budget descriptor to initialize.
+ *
+ * @param thread The thread the budget applies to.
+ *
+ * @param handler The routine to call when @a thread exhausts its
+ * budget within a period. This handler runs from the timer interrupt
+ * context with nklock held, at most once per period.
+ *
+ * @coretags{secondary-only}
+ */
+void xnthread_init_budget(struct xnthread_budget *budget,
+			  struct xnthread *thread,
+			  void (*handler)(struct xnthread_budget *budget))
+{
+	budget->thread = thread;
+	budget->handler = handler;
+	budget->quantum = 0;
+	budget->left = 0;
+	budget->resume_date = 0;
+	budget->overruns = 0;
+	xntimer_init(&budget->dtimer, &nkclock, budget_depletion_handler,
+		     thread->sched, XNTIMER_IGRAVITY);
+	xntimer_set_name(&budget->dtimer, "budget-depletion");
+	xntimer_init(&budget->rtimer, &nkclock, budget_replenish_handler,
+		     thread->sched, XNTIMER_IGRAVITY);
+	xntimer_set_name(&budget->rtimer, "budget-replenish");
+}
+EXPORT_SYMBOL_GPL(xnthread_init_budget);
+
+/**
+ * @fn int xnthread_start_budget(struct xnthread_budget *budget, xnticks_t quantum, xnticks_t idate, xntmode_t timeout_mode, xnticks_t period)
+ * @brief Enforce a CPU time budget.
+ *
+ * Limits the CPU time the thread may consume in primary mode over
+ * each period to @a quantum. Time spent running in secondary mode
+ * is not charged. When the budget runs out within a period, the
+ * overrun count is incremented and the budget handler is called;
+ * the thread keeps running with no further notification until the
+ * next replenishment.
+ *
+ * The full budget is available immediately, and replenished on
+ * each release point of the timeline defined by @a idate and @a
+ * period, which would normally be the thread's own periodic
+ * timeline. Any previous budget is superseded for the thread.
+ *
+ * @param budget A budget descriptor initialized by
+ * xnthread_init_budget().
+ *
+ * @param quantum The CPU time allotted per period (ns).
+ *
+ * @param idate The first replenishment date. If XN_INFINITE, the
+ * first replenishment occurs @a period nanoseconds from now.
+ *
+ * @param timeout_mode The mode of the @a idate parameter, either
+ * XN_ABSOLUTE or XN_REALTIME.
+ *
+ * @param period The replenishment period (ns).
+ *
+ * @return 0 is returned upon success. Otherwise:
+ *
+ * - -EINVAL is returned if @a quantum is zero, or greater than @a
+ * period, or if @a period is shorter than the clock gravity.
+ *
+ * @coretags{task-unrestricted}
+ */
+int xnthread_start_budget(struct xnthread_budget *budget,
+			  xnticks_t quantum,
+			  xnticks_t idate,
+			  xntmode_t timeout_mode,
+			  xnticks_t period)
+{
+	struct xnthread *thread = budget->thread;
+	spl_t s;
+
+	if (quantum == 0 || quantum > period ||
+	    period < xnclock_ticks_to_ns(&nkclock,
+			 xnclock_get_gravity(&nkclock, user)))
+		return -EINVAL;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if (thread->budget)
+		__stop_budget(thread->budget);
+
+	budget->quantum = quantum;
+	budget->left = quantum;
+	thread->budget = budget;
+
+	xntimer_set_affinity(&budget->rtimer, thread->sched);
+	if (idate == XN_INFINITE)
+		xntimer_start(&budget->rtimer, period, period, XN_RELATIVE);
+	else
+		xntimer_start(&budget->rtimer, idate, period, timeout_mode);
+
+	if (thread->sched->curr == thread)
+		budget_arm(budget, xnclock_read_monotonic(&nkclock));
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xnthread_start_budget);
+
+/**
+ * @fn void xnthread_stop_budget(struct xnthread_budget *budget)
+ * @brief Stop enforcing a CPU time budget.
+ *
+ * @param budget The budget to stop. The overrun count is kept.
+ *
+ * @coretags{task-unrestricted}
+ */
+void xnthread_stop_budget(struct xnthread_budget *budget)
+{
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+	__stop_budget(budget);
+	xnlock_put_irqrestore(&nklock, s);
+}
+EXPORT_SYMBOL_GPL(xnthread_stop_budget);
+
+/**
+ * @fn void xnthread_destroy_budget(struct xnthread_budget *budget)
+ * @brief Release a CPU time budget.
+ *
+ * Stops enforcing the budget if need be, then releases the
+ * resources attached to the descriptor.
+ *
+ * @param budget The budget to release.
+ *
+ * @coretags{secondary-only}
+ */
+void xnthread_destroy_budget(struct xnthread_budget *budget)
+{
+	xnthread_stop_budget(budget);
+	xntimer_destroy(&budget->dtimer);
+	xntimer_destroy(&budget->rtimer);
+}
+EXPORT_SYMBOL_GPL(xnthread_destroy_budget);
+
 /**
  * @fn int xnthread_set_slice(struct xnthread *thread, xnticks_t quantum)
  * @brief Set thread time-slicing information.
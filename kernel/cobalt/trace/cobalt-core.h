@@ -344,6 +344,11 @@ DEFINE_EVENT(curr_thread_event, cobalt_thread_missed_period,
 	TP_ARGS(thread)
 );
 
+DEFINE_EVENT(thread_event, cobalt_thread_budget_overrun,
+	TP_PROTO(struct xnthread *thread),
+	TP_ARGS(thread)
+);
+
 DEFINE_EVENT(curr_thread_event, cobalt_thread_set_mode,
 	TP_PROTO(struct xnthread *thread),
 	TP_ARGS(thread)
@@ -161,7 +161,15 @@
 		__cobalt_symbolic_syscall(ftrace_puts),			\
 		__cobalt_symbolic_syscall(recvmmsg),			\
 		__cobalt_symbolic_syscall(sendmmsg),			\
-		__cobalt_symbolic_syscall(clock_adjtime))
+		__cobalt_symbolic_syscall(clock_adjtime),		\
+		__cobalt_symbolic_syscall(thread_setbudget),		\
+		__cobalt_symbolic_syscall(thread_getbudget),		\
+		__cobalt_symbolic_syscall(mq_ringinfo),			\
+		__cobalt_symbolic_syscall(mq_ringwait),			\
+		__cobalt_symbolic_syscall(mq_ringkick),			\
+		__cobalt_symbolic_syscall(thread_setperiodic),		\
+		__cobalt_symbolic_syscall(thread_waitperiod),		\
+		__cobalt_symbolic_syscall(thread_getperiodic))
 
 DECLARE_EVENT_CLASS(syscall_entry,
 	TP_PROTO(unsigned int nr),
@@ -365,6 +373,60 @@ DEFINE_EVENT(cobalt_posix_pid, cobalt_pthread_stat,
 	TP_ARGS(pid)
 );
 
+TRACE_EVENT(cobalt_pthread_setbudget,
+	TP_PROTO(pid_t pid, const struct cobalt_budget_config *config),
+	TP_ARGS(pid, config),
+	TP_STRUCT__entry(
+		__field(pid_t, pid)
+		__field(__u64, quantum)
+		__field(__u64, period)
+		__field(int, signo)
+		__field(xnhandle_t, event)
+	),
+	TP_fast_assign(
+		__entry->pid = pid;
+		__entry->quantum = config->quantum;
+		__entry->period = config->period;
+		__entry->signo = config->signo;
+		__entry->event = config->event;
+	),
+	TP_printk("pid=%d quantum=%Lu period=%Lu signo=%d event=%#x",
+		  __entry->pid, __entry->quantum, __entry->period,
+		  __entry->signo, __entry->event)
+);
+
+DEFINE_EVENT(cobalt_posix_pid, cobalt_pthread_getbudget,
+	TP_PROTO(pid_t pid),
+	TP_ARGS(pid)
+);
+
+TRACE_EVENT(cobalt_pthread_setperiodic,
+	TP_PROTO(pid_t pid, const struct cobalt_period_config *config),
+	TP_ARGS(pid, config),
+	TP_STRUCT__entry(
+		__field(pid_t, pid)
+		__field(__u64, idate)
+		__field(__u64, period)
+		__field(__u64, base)
+		__field(int, clock)
+	),
+	TP_fast_assign(
+		__entry->pid = pid;
+		__entry->idate = config->idate;
+		__entry->period = config->period;
+		__entry->base = config->base;
+		__entry->clock = config->clock;
+	),
+	TP_printk("pid=%d idate=%Lu period=%Lu base=%Lu clock=%d",
+		  __entry->pid, __entry->idate, __entry->period,
+		  __entry->base, __entry->clock)
+);
+
+DEFINE_EVENT(cobalt_posix_pid, cobalt_pthread_getperiodic,
+	TP_PROTO(pid_t pid),
+	TP_ARGS(pid)
+);
+
 TRACE_EVENT(cobalt_pthread_kill,
 	TP_PROTO(unsigned long pth, int sig),
 	TP_ARGS(pth, sig),
@@ -58,7 +58,10 @@
  * collection phase is not strictly atomic as a whole, but only
  * protected at record level. The vfile implementation can be notified
  * of updates to the underlying data set, and restart the collection
- * from scratch until the snapshot is fully consistent.
+ * from scratch until the snapshot is fully consistent. Alternatively,
+ * vfiles reporting on the members of a (possibly long and busy)
+ * object list may have the list scanned in bounded chunks, resuming
+ * past concurrent updates instead of restarting.
  *
  * - regular sequential file (struct xnvfile_regular). This is
  * basically an encapsulated sequential file object as available from
@@ -144,6 +147,101 @@ static void vfile_snapshot_free(struct xnvfile_snapshot_iterator *it, void *buf)
 	kfree(buf);
 }
 
+static void vfile_snapshot_drop_cursor(struct xnvfile_snapshot_iterator *it)
+{
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+	list_del(&it->cursor);
+	xnlock_put_irqrestore(&nklock, s);
+}
+
+/*
+ * Collect the records of a vfile scanning an object list, in chunks
+ * of at most VFILE_SNAPSHOT_CHUNK records per lock section. Our
+ * cursor on the list is moved past the objects unlinked while the
+ * lock is dropped, so the scan never restarts: objects enlisted
+ * after the scan began are collected only if there is room left in
+ * the buffer, sized from the ->rewind() hint.
+ */
+static int vfile_snapshot_collect_list(struct xnvfile_snapshot_iterator *it)
+{
+	struct xnvfile_snapshot *vfile = it->vfile;
+	struct xnvfile_snapshot_ops *ops = vfile->ops;
+	int ret, nrdata = 0, n;
+	caddr_t data;
+
+	ret = vfile->entry.lockops->get(&vfile->entry);
+	if (ret)
+		return ret;
+
+	it->pos = vfile->list->head->next;
+	list_add(&it->cursor, &vfile->list->cursors);
+
+	if (ops->rewind) {
+		nrdata = ops->rewind(it);
+		if (nrdata < 0) {
+			vfile->entry.lockops->put(&vfile->entry);
+			ret = nrdata;
+			goto out;
+		}
+	}
+
+	vfile->entry.lockops->put(&vfile->entry);
+
+	if (ops->begin) {
+		XENO_BUG_ON(COBALT, ops->end == NULL);
+		data = ops->begin(it);
+		if (data == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		if (data != VFILE_SEQ_EMPTY) {
+			it->databuf = data;
+			it->endfn = ops->end;
+		}
+	} else if (nrdata > 0 && vfile->datasz > 0) {
+		data = kmalloc(vfile->datasz * nrdata, GFP_KERNEL);
+		if (data == NULL) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		it->databuf = data;
+		it->endfn = vfile_snapshot_free;
+	}
+
+	it->nrdata = 0;
+	data = it->databuf;
+	if (data == NULL)
+		goto out;
+
+	for (;;) {
+		ret = vfile->entry.lockops->get(&vfile->entry);
+		if (ret)
+			break;
+		for (n = 0; n < VFILE_SNAPSHOT_CHUNK; n++) {
+			if (it->nrdata >= nrdata) {
+				ret = 0;
+				break;
+			}
+			ret = ops->next(it, data);
+			if (ret <= 0)
+				break;
+			if (ret != VFILE_SEQ_SKIP) {
+				data += vfile->datasz;
+				it->nrdata++;
+			}
+		}
+		vfile->entry.lockops->put(&vfile->entry);
+		if (ret <= 0)
+			break;
+	}
+out:
+	vfile_snapshot_drop_cursor(it);
+
+	return ret;
+}
+
 static int vfile_snapshot_open(struct inode *inode, struct file *file)
 {
 	struct xnvfile_snapshot *vfile = PDE_DATA(inode);
@@ -175,6 +273,16 @@ static int vfile_snapshot_open(struct inode *inode, struct file *file)
 	it->vfile = vfile;
 	xnvfile_file(vfile) = file;
 
+	if (vfile->list) {
+		ret = vfile_snapshot_collect_list(it);
+		if (ret < 0)
+			goto fail;
+		ret = seq_open(file, &vfile_snapshot_ops);
+		if (ret)
+			goto fail;
+		goto finish;
+	}
+
 	ret = vfile->entry.lockops->get(&vfile->entry);
 	if (ret)
 		goto fail;
@@ -365,7 +473,7 @@ static struct file_operations vfile_snapshot_fops = {
  * by the @ref snapshot_next "next() handler" from the @ref
  * snapshot_ops "operation descriptor".
  *
- * - .tag is a pointer to a mandatory vfile revision tag structure
+ * - .tag is a pointer to a vfile revision tag structure
  * (struct xnvfile_rev_tag). This tag will be monitored for changes by
  * the vfile core while collecting data to output, so that any update
  * detected will cause the current snapshot data to be dropped, and
@@ -373,6 +481,16 @@ static struct file_operations vfile_snapshot_fops = {
  * change to the data which may be part of the collected records,
  * should also invoke xnvfile_touch() on the associated tag.
  *
+ * - .list is a pointer to an @ref snapshot_list "object list", to be
+ * given instead of .tag by vfiles outputting one record per object
+ * of such list. The records are then collected in chunks, releasing
+ * the vfile lock in between, and the collection never restarts:
+ * objects unlinked from the list are skipped if not collected yet,
+ * new objects are collected as long as the snapshot buffer has room.
+ * The ->next() handler should pick the next object from the list
+ * using xnvfile_list_next(), and the ->rewind() handler must return
+ * the maximum number of records to collect.
+ *
  * - entry.lockops is a pointer to a @ref vfile_lockops "lock descriptor",
  * defining the lock and unlock operations for the vfile. This pointer
  * may be left to NULL, in which case the operations on the nucleus
@@ -400,7 +518,7 @@ int xnvfile_init_snapshot(const char *name,
 	struct proc_dir_entry *ppde, *pde;
 	int mode;
 
-	XENO_BUG_ON(COBALT, vfile->tag == NULL);
+	XENO_BUG_ON(COBALT, (vfile->tag == NULL) == (vfile->list == NULL));
 
 	if (vfile->entry.lockops == NULL)
 		/* Defaults to nucleus lock */
@@ -18,6 +18,9 @@
 
 #include <linux/slab.h>
 #include <linux/gpio.h>
+#include <linux/delay.h>
+#include <linux/mutex.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <rtdm/driver.h>
 #include <rtdm/gpiopwm.h>
@@ -28,109 +31,588 @@ MODULE_VERSION("0.0.1");
 MODULE_LICENSE("GPL");
 
 #define MAX_DUTY_CYCLE		100
-#define MAX_SAMPLES		(MAX_DUTY_CYCLE + 1)
+#define MAX_CHANNELS		8
+#define MAX_EDGES		(MAX_CHANNELS * 2)
+/* A carried fall plus the rise and fall of the new pulse. */
+#define MAX_FIRST_EDGES		(MAX_CHANNELS * 3)
+/* Lead time for the first period of a group. */
+#define ARM_DELAY		50000
 
-struct gpiopwm_base_signal {
-	unsigned long period;
+/*
+ * All channels of a group share the same period and start date,
+ * phases are relative to the latter. A single timer per group walks
+ * a sorted table of precomputed edges, so that channels switching at
+ * the same offset cost a single timer shot.
+ */
+struct gpiopwm_edge {
+	nanosecs_rel_t offset;
+	int gpio;
+	int value;
+	int minor;
+};
+
+struct gpiopwm_table {
+	int nr_edges;
+	struct gpiopwm_edge edges[MAX_EDGES];
+	/*
+	 * The first period played from a table continues the pulses
+	 * the outgoing table left in flight: the channel levels to
+	 * apply when switching to this table, and the edges of that
+	 * period, which end the former wrapping pulses instead of
+	 * the ones this table would wrap.
+	 */
+	int nr_levels;
+	struct gpiopwm_edge levels[MAX_CHANNELS];
+	int nr_first;
+	struct gpiopwm_edge first[MAX_FIRST_EDGES];
+	/* Falling edges of the pulses wrapping past the period end. */
+	int nr_carries;
+	struct gpiopwm_edge carries[MAX_CHANNELS];
+};
+
+struct gpiopwm_priv;
+
+struct gpiopwm_group {
+	rtdm_lock_t lock;
+	rtdm_timer_t timer;
+	nanosecs_rel_t period;
+	nanosecs_abs_t start;
+	struct gpiopwm_priv *members[MAX_CHANNELS];
+	int nr_members;
+	int nr_running;
+	int armed;
+	/*
+	 * Double-buffered edge tables: updates go to the pending
+	 * table, which replaces the active one at the next period
+	 * boundary, so that no pulse is ever cut short nor emitted
+	 * out of phase.
+	 */
+	struct gpiopwm_table tables[2];
+	int active;
+	int pending;
+	/* Playing the first period of the active table. */
+	int first;
+	int next;
 };
 
 struct gpiopwm_duty_signal {
 	unsigned int range_min;
 	unsigned int range_max;
-	unsigned long period;
-	unsigned int cycle;
 };
 
-struct gpiopwm_control {
+struct gpiopwm_priv {
 	struct gpiopwm_duty_signal duty;
-	unsigned int configured;
-	unsigned int update;
+	struct gpiopwm_group *group;
+	nanosecs_rel_t duty_ns;
+	nanosecs_rel_t phase;
+	int configured;
+	int running;
+	int minor;
+	int gpio;
 };
 
-struct gpiopwm_priv {
-	struct gpiopwm_base_signal base;
-	struct gpiopwm_duty_signal duty;
-	struct gpiopwm_control ctrl;
+static struct gpiopwm_group groups[GPIOPWM_NR_GROUPS];
 
-	rtdm_timer_t base_timer;
-	rtdm_timer_t duty_timer;
+/* Serializes group membership changes. */
+static DEFINE_MUTEX(group_lock);
 
-	int gpio;
-};
+#ifdef CONFIG_XENO_DRIVERS_GPIOPWM_RECORD
+
+#define RECORD_SIZE		1024
+
+/*
+ * Recording backend for testing the sequencer: edges are logged with
+ * their scheduled date instead of being sent to the GPIO lines, which
+ * are left untouched.
+ */
+static struct gpiopwm_record {
+	struct gpiopwm_edge_record buf[RECORD_SIZE];
+	unsigned int head;
+	unsigned int tail;
+} records[MAX_CHANNELS];
+
+static DEFINE_RTDM_LOCK(record_lock);
 
-static inline int div100(long long dividend)
+static void set_output(struct gpiopwm_edge *e, nanosecs_abs_t date)
 {
-	const long long divisor = 0x28f5c29;
-	return ((divisor * dividend) >> 32) & 0xffffffff;
+	struct gpiopwm_record *r = records + e->minor;
+	struct gpiopwm_edge_record *rec;
+	rtdm_lockctx_t c;
+
+	rtdm_lock_get_irqsave(&record_lock, c);
+
+	if (r->head - r->tail < RECORD_SIZE) {
+		rec = r->buf + r->head++ % RECORD_SIZE;
+		rec->timestamp = date;
+		rec->value = e->value;
+		rec->__pad = 0;
+	}
+
+	rtdm_lock_put_irqrestore(&record_lock, c);
 }
 
-static inline unsigned long duty_period(struct gpiopwm_duty_signal *p)
+static void reset_record(int minor)
 {
-	unsigned long period;
+	rtdm_lockctx_t c;
 
-	period = p->range_min + div100((p->range_max - p->range_min) * p->cycle);
-	return period * 1000;
+	rtdm_lock_get_irqsave(&record_lock, c);
+	records[minor].head = records[minor].tail = 0;
+	rtdm_lock_put_irqrestore(&record_lock, c);
 }
 
-static void gpiopwm_handle_base_timer(rtdm_timer_t *timer)
+static ssize_t gpiopwm_read_rt(struct rtdm_fd *fd,
+			       void __user *buf, size_t len)
 {
-	struct gpiopwm_priv *ctx = container_of(timer, struct gpiopwm_priv,
-						base_timer);
-	gpio_set_value(ctx->gpio, 1);
-
-	/* one shot timer to avoid carrying over errors */
-	rtdm_timer_start_in_handler(&ctx->duty_timer, ctx->duty.period, 0,
-		RTDM_TIMERMODE_RELATIVE);
-
-	if (ctx->ctrl.update) {
-		ctx->duty.period = ctx->ctrl.duty.period;
-		ctx->duty.cycle = ctx->ctrl.duty.cycle;
-		ctx->ctrl.update = 0;
+	struct gpiopwm_record *r = records + rtdm_fd_minor(fd);
+	struct gpiopwm_edge_record rec;
+	rtdm_lockctx_t c;
+	size_t count = 0;
+	int ret;
+
+	while (len - count >= sizeof(rec)) {
+		rtdm_lock_get_irqsave(&record_lock, c);
+		if (r->tail == r->head) {
+			rtdm_lock_put_irqrestore(&record_lock, c);
+			break;
+		}
+		rec = r->buf[r->tail++ % RECORD_SIZE];
+		rtdm_lock_put_irqrestore(&record_lock, c);
+		ret = rtdm_safe_copy_to_user(fd, buf + count, &rec, sizeof(rec));
+		if (ret)
+			return ret;
+		count += sizeof(rec);
 	}
+
+	return count;
 }
 
-static void gpiopwm_handle_duty_timer(rtdm_timer_t *timer)
+static inline int request_output(struct rtdm_fd *fd, int gpio)
 {
-	struct gpiopwm_priv *ctx = container_of(timer, struct gpiopwm_priv,
-						duty_timer);
-	gpio_set_value(ctx->gpio, 0);
+	reset_record(rtdm_fd_minor(fd));
+
+	return 0;
 }
 
-static inline int gpiopwm_config(struct rtdm_fd *fd, struct gpiopwm *conf)
+static inline void release_output(int gpio) { }
+
+#else  /* !CONFIG_XENO_DRIVERS_GPIOPWM_RECORD */
+
+static inline void set_output(struct gpiopwm_edge *e, nanosecs_abs_t date)
+{
+	gpio_set_value(e->gpio, e->value);
+}
+
+static int request_output(struct rtdm_fd *fd, int gpio)
 {
 	struct rtdm_dev_context *dev_ctx = rtdm_fd_to_context(fd);
+	int ret;
+
+	ret = gpio_request(gpio, dev_ctx->device->name);
+	if (ret < 0)
+		return ret;
+
+	ret = gpio_direction_output(gpio, 0);
+	if (ret < 0) {
+		gpio_free(gpio);
+		return ret;
+	}
+
+	gpio_set_value(gpio, 0);
+
+	return 0;
+}
+
+static inline void release_output(int gpio)
+{
+	gpio_free(gpio);
+}
+
+#define gpiopwm_read_rt  NULL
+
+#endif /* !CONFIG_XENO_DRIVERS_GPIOPWM_RECORD */
+
+static void insert_edge(struct gpiopwm_edge *edges, int *nr_edges,
+			int max_edges, struct gpiopwm_edge *e)
+{
+	int n;
+
+	if (WARN_ON(*nr_edges >= max_edges))
+		return;
+
+	n = (*nr_edges)++;
+
+	/* Insertion sort, we have a handful of edges at most. */
+	while (n > 0 && edges[n - 1].offset > e->offset) {
+		edges[n] = edges[n - 1];
+		n--;
+	}
+
+	edges[n] = *e;
+}
+
+static void add_edge(struct gpiopwm_edge *edges, int *nr_edges, int max_edges,
+		     struct gpiopwm_priv *ctx, nanosecs_rel_t offset, int value)
+{
+	struct gpiopwm_edge e = {
+		.offset = offset,
+		.gpio = ctx->gpio,
+		.value = value,
+		.minor = ctx->minor,
+	};
+
+	insert_edge(edges, nr_edges, max_edges, &e);
+}
+
+static struct gpiopwm_edge *find_carry(struct gpiopwm_table *t,
+				       struct gpiopwm_priv *ctx)
+{
+	int n;
+
+	for (n = 0; n < t->nr_carries; n++) {
+		if (t->carries[n].minor == ctx->minor)
+			return t->carries + n;
+	}
+
+	return NULL;
+}
+
+/* Group lock held, irqs off. */
+static void build_table(struct gpiopwm_group *g)
+{
+	struct gpiopwm_table *t, *out = g->tables + g->active;
+	nanosecs_rel_t fall, period = g->period;
+	struct gpiopwm_edge *lv, *carry;
+	struct gpiopwm_priv *ctx;
+	int n, spare;
+
+	/*
+	 * The outgoing table remains active until the next period
+	 * boundary, so it tells which pulses will be in flight when
+	 * we switch to the new one.
+	 */
+	spare = !g->active;
+	t = g->tables + spare;
+	t->nr_edges = 0;
+	t->nr_levels = 0;
+	t->nr_first = 0;
+	t->nr_carries = 0;
+
+	for (n = 0; n < g->nr_members; n++) {
+		ctx = g->members[n];
+		lv = t->levels + t->nr_levels++;
+		lv->offset = 0;
+		lv->gpio = ctx->gpio;
+		lv->minor = ctx->minor;
+		if (ctx->running && ctx->duty_ns >= period) {
+			lv->value = 1;
+			continue;
+		}
+		/*
+		 * Let a pulse in flight end as the outgoing table
+		 * planned, it always does before our own rise.
+		 */
+		carry = find_carry(out, ctx);
+		if (carry)
+			insert_edge(t->first, &t->nr_first,
+				    ARRAY_SIZE(t->first), carry);
+		if (!ctx->running || ctx->duty_ns == 0) {
+			lv->value = carry != NULL;
+			continue;
+		}
+		fall = ctx->phase + ctx->duty_ns;
+		lv->value = carry != NULL || ctx->phase == 0;
+		add_edge(t->edges, &t->nr_edges, ARRAY_SIZE(t->edges),
+			 ctx, ctx->phase, 1);
+		add_edge(t->first, &t->nr_first, ARRAY_SIZE(t->first),
+			 ctx, ctx->phase, 1);
+		if (fall < period) {
+			add_edge(t->edges, &t->nr_edges, ARRAY_SIZE(t->edges),
+				 ctx, fall, 0);
+			add_edge(t->first, &t->nr_first, ARRAY_SIZE(t->first),
+				 ctx, fall, 0);
+			continue;
+		}
+		/*
+		 * The pulse wraps to the next period. If another
+		 * table takes over there, it inherits the falling
+		 * edge as a carry.
+		 */
+		fall -= period;
+		add_edge(t->edges, &t->nr_edges, ARRAY_SIZE(t->edges),
+			 ctx, fall, 0);
+		if (fall > 0)
+			add_edge(t->carries, &t->nr_carries,
+				 ARRAY_SIZE(t->carries), ctx, fall, 0);
+	}
+
+	g->pending = spare;
+}
+
+/*
+ * Play all edges due by @now, switching tables at period
+ * boundaries. Returns the date of the next edge, or zero if the
+ * group went idle.
+ */
+static nanosecs_abs_t run_edges(struct gpiopwm_group *g, nanosecs_abs_t now)
+{
+	struct gpiopwm_table *t = g->tables + g->active;
+	struct gpiopwm_edge *edges;
+	nanosecs_abs_t date;
+	int n, nr_edges;
+	u64 rem;
+
+	for (;;) {
+		if (g->first) {
+			edges = t->first;
+			nr_edges = t->nr_first;
+		} else {
+			edges = t->edges;
+			nr_edges = t->nr_edges;
+		}
+
+		if (g->next < nr_edges)
+			date = g->start + edges[g->next].offset;
+		else
+			date = g->start + g->period;
+
+		if (date > now)
+			return date;
+
+		if (g->next < nr_edges) {
+			set_output(edges + g->next++, date);
+			continue;
+		}
+
+		/* Skip periods we missed entirely. */
+		if (now - date >= g->period) {
+			div64_u64_rem(now - date, g->period, &rem);
+			date = now - rem;
+		}
+		g->start = date;
+		g->next = 0;
+		g->first = 0;
+
+		if (g->pending >= 0) {
+			g->active = g->pending;
+			g->pending = -1;
+			g->first = 1;
+			t = g->tables + g->active;
+			for (n = 0; n < t->nr_levels; n++)
+				set_output(t->levels + n, date);
+		}
+
+		/* Idle once the pulses left in flight have ended. */
+		if (g->nr_running == 0 && g->pending < 0 &&
+		    (!g->first || t->nr_first == 0)) {
+			g->armed = 0;
+			return 0;
+		}
+	}
+}
+
+static void gpiopwm_handle_timer(rtdm_timer_t *timer)
+{
+	struct gpiopwm_group *g = container_of(timer, struct gpiopwm_group,
+					       timer);
+	nanosecs_abs_t date;
+	rtdm_lockctx_t c;
+
+	/* Absolute dates so that errors are not carried over. */
+	do {
+		rtdm_lock_get_irqsave(&g->lock, c);
+		date = run_edges(g, rtdm_clock_read_monotonic());
+		rtdm_lock_put_irqrestore(&g->lock, c);
+		if (date == 0)
+			return;
+	} while (rtdm_timer_start_in_handler(timer, date, 0,
+					     RTDM_TIMERMODE_ABSOLUTE));
+}
+
+static void arm_group(struct gpiopwm_group *g)
+{
+	nanosecs_abs_t date;
+	rtdm_lockctx_t c;
+
+	/* Nested locking would invert with the timer handler. */
+	do {
+		rtdm_lock_get_irqsave(&g->lock, c);
+		date = rtdm_clock_read_monotonic() + ARM_DELAY;
+		/* The first shot is a period boundary. */
+		g->start = date - g->period;
+		g->first = 0;
+		g->next = g->tables[g->active].nr_edges;
+		rtdm_lock_put_irqrestore(&g->lock, c);
+	} while (rtdm_timer_start(&g->timer, date, 0,
+				  RTDM_TIMERMODE_ABSOLUTE));
+}
+
+static inline unsigned long long duty_period(struct gpiopwm_duty_signal *p,
+					     unsigned int cycle)
+{
+	/* Range is in microseconds, so percent * 1000 / 100. */
+	return p->range_min * 1000ULL +
+		(unsigned long long)(p->range_max - p->range_min) * cycle * 10;
+}
+
+static int join_group(struct gpiopwm_priv *ctx, int id, nanosecs_rel_t period)
+{
+	struct gpiopwm_group *g = NULL;
+	rtdm_lockctx_t c;
+	int n;
+
+	mutex_lock(&group_lock);
+
+	if (id == GPIOPWM_GROUP_AUTO) {
+		/* Share the timer of a group running at the same pace. */
+		for (n = 0; n < GPIOPWM_NR_GROUPS; n++) {
+			if (groups[n].nr_members > 0 &&
+			    groups[n].period == period) {
+				g = groups + n;
+				break;
+			}
+			if (g == NULL && groups[n].nr_members == 0)
+				g = groups + n;
+		}
+		if (g == NULL) {
+			mutex_unlock(&group_lock);
+			return -EBUSY;
+		}
+	} else {
+		g = groups + id;
+		if (g->nr_members > 0 && g->period != period) {
+			mutex_unlock(&group_lock);
+			return -EINVAL;
+		}
+	}
+
+	rtdm_lock_get_irqsave(&g->lock, c);
+	g->period = period;
+	g->members[g->nr_members++] = ctx;
+	ctx->group = g;
+	build_table(g);
+	rtdm_lock_put_irqrestore(&g->lock, c);
+
+	mutex_unlock(&group_lock);
+
+	return 0;
+}
+
+static void leave_group(struct gpiopwm_priv *ctx)
+{
+	struct gpiopwm_group *g = ctx->group;
+	rtdm_lockctx_t c;
+	int n;
+
+	mutex_lock(&group_lock);
+
+	rtdm_lock_get_irqsave(&g->lock, c);
+	if (ctx->running) {
+		ctx->running = 0;
+		g->nr_running--;
+	}
+	build_table(g);
+	rtdm_lock_put_irqrestore(&g->lock, c);
+
+	/*
+	 * Wait for the next period boundary to stop our pulses, the
+	 * one wrapping past it still ends in the following period.
+	 */
+	while (g->armed && g->pending >= 0)
+		msleep(1);
+
+	rtdm_lock_get_irqsave(&g->lock, c);
+	for (n = 0; n < g->nr_members; n++) {
+		if (g->members[n] == ctx) {
+			g->members[n] = g->members[--g->nr_members];
+			break;
+		}
+	}
+	build_table(g);
+	rtdm_lock_put_irqrestore(&g->lock, c);
+
+	/* Past this point the sequencer won't touch our output anymore. */
+	while (g->armed && g->pending >= 0)
+		msleep(1);
+
+	ctx->group = NULL;
+
+	mutex_unlock(&group_lock);
+}
+
+static int setup_channel(struct rtdm_fd *fd, int gpio, int group,
+			 nanosecs_rel_t period, nanosecs_rel_t duty,
+			 nanosecs_rel_t phase)
+{
 	struct gpiopwm_priv *ctx = rtdm_fd_to_private(fd);
 	int ret;
 
-	if (ctx->ctrl.configured)
+	if (ctx->configured)
 		return -EINVAL;
 
-	if (conf->duty_cycle > MAX_DUTY_CYCLE)
+	if (period <= 0 || phase < 0 || phase >= period || duty < 0)
 		return -EINVAL;
 
-	ret = gpio_request(conf->gpio, dev_ctx->device->name);
-	if (ret < 0) {
+	if (group != GPIOPWM_GROUP_AUTO &&
+	    (group < 0 || group >= GPIOPWM_NR_GROUPS))
+		return -EINVAL;
+
+	ret = request_output(fd, gpio);
+	if (ret < 0)
+		return ret;
+
+	ctx->gpio = gpio;
+	ctx->duty_ns = duty;
+	ctx->phase = phase;
+	ctx->running = 0;
+
+	ret = join_group(ctx, group, period);
+	if (ret) {
+		release_output(gpio);
 		ctx->gpio = -1;
 		return ret;
 	}
 
-	ret = gpio_direction_output(conf->gpio, 0);
-	if (ret < 0)
-		return ret;
+	ctx->configured = 1;
 
-	gpio_set_value(conf->gpio, 0);
+	return 0;
+}
+
+static inline int gpiopwm_config(struct rtdm_fd *fd, struct gpiopwm *conf)
+{
+	struct gpiopwm_priv *ctx = rtdm_fd_to_private(fd);
+
+	if (ctx->configured || conf->duty_cycle > MAX_DUTY_CYCLE)
+		return -EINVAL;
+
+	ctx->duty.range_min = conf->range_min;
+	ctx->duty.range_max = conf->range_max;
+
+	return setup_channel(fd, conf->gpio, GPIOPWM_GROUP_AUTO, conf->period,
+			     duty_period(&ctx->duty, conf->duty_cycle), 0);
+}
+
+static inline int gpiopwm_seq_config(struct rtdm_fd *fd, struct gpiopwm_seq *seq)
+{
+	if (seq->duty > seq->period)
+		return -EINVAL;
+
+	return setup_channel(fd, seq->gpio, seq->group, seq->period,
+			     seq->duty, seq->phase);
+}
 
-	ctx->duty.range_min = ctx->ctrl.duty.range_min = conf->range_min;
-	ctx->duty.range_max = ctx->ctrl.duty.range_max = conf->range_max;
-	ctx->duty.cycle = conf->duty_cycle;
-	ctx->base.period = conf->period;
-	ctx->gpio = conf->gpio;
-	ctx->duty.period = duty_period(&ctx->duty);
+static int gpiopwm_set_duty(struct gpiopwm_priv *ctx, nanosecs_rel_t duty)
+{
+	struct gpiopwm_group *g = ctx->group;
+	rtdm_lockctx_t c;
 
-	rtdm_timer_init(&ctx->base_timer, gpiopwm_handle_base_timer, "base_timer");
-	rtdm_timer_init(&ctx->duty_timer, gpiopwm_handle_duty_timer, "duty_timer");
+	if (!ctx->configured)
+		return -EINVAL;
 
-	ctx->ctrl.configured = 1;
+	/* Takes effect on the next period boundary. */
+	rtdm_lock_get_irqsave(&g->lock, c);
+	ctx->duty_ns = duty;
+	build_table(g);
+	rtdm_lock_put_irqrestore(&g->lock, c);
 
 	return 0;
 }
@@ -140,27 +622,45 @@ static inline int gpiopwm_change_duty_cycle(struct gpiopwm_priv *ctx, unsigned i
 	if (cycle > MAX_DUTY_CYCLE)
 		return -EINVAL;
 
-	/* prepare the new data on the calling thread */
-	ctx->ctrl.duty.cycle = cycle;
-	ctx->ctrl.duty.period = duty_period(&ctx->ctrl.duty);
+	return gpiopwm_set_duty(ctx, duty_period(&ctx->duty, cycle));
+}
 
-	/* update data on the next base signal timeout */
-	ctx->ctrl.update = 1;
+static int gpiopwm_change_duty_ns(struct rtdm_fd *fd, void __user *arg)
+{
+	struct gpiopwm_priv *ctx = rtdm_fd_to_private(fd);
+	__u64 duty;
+	int ret;
 
-	return 0;
+	ret = rtdm_safe_copy_from_user(fd, &duty, arg, sizeof(duty));
+	if (ret)
+		return ret;
+
+	if (!ctx->configured)
+		return -EINVAL;
+
+	if (duty > ctx->group->period)
+		return -EINVAL;
+
+	return gpiopwm_set_duty(ctx, duty);
 }
 
 static inline int gpiopwm_stop(struct rtdm_fd *fd)
 {
 	struct gpiopwm_priv *ctx = rtdm_fd_to_private(fd);
+	struct gpiopwm_group *g = ctx->group;
+	rtdm_lockctx_t c;
 
-	if (!ctx->ctrl.configured)
+	if (!ctx->configured)
 		return -EINVAL;
 
-	gpio_set_value(ctx->gpio, 0);
-
-	rtdm_timer_stop(&ctx->base_timer);
-	rtdm_timer_stop(&ctx->duty_timer);
+	/* Output goes low on the next period boundary. */
+	rtdm_lock_get_irqsave(&g->lock, c);
+	if (ctx->running) {
+		ctx->running = 0;
+		g->nr_running--;
+		build_table(g);
+	}
+	rtdm_lock_put_irqrestore(&g->lock, c);
 
 	return 0;
 }
@@ -168,16 +668,25 @@ static inline int gpiopwm_stop(struct rtdm_fd *fd)
 static inline int gpiopwm_start(struct rtdm_fd *fd)
 {
 	struct gpiopwm_priv *ctx = rtdm_fd_to_private(fd);
+	struct gpiopwm_group *g = ctx->group;
+	rtdm_lockctx_t c;
+	int arm = 0;
 
-	if (!ctx->ctrl.configured)
+	if (!ctx->configured)
 		return -EINVAL;
 
-	/* update duty cycle on next timeout */
-	ctx->ctrl.update = 1;
+	rtdm_lock_get_irqsave(&g->lock, c);
+	if (!ctx->running) {
+		ctx->running = 1;
+		g->nr_running++;
+		build_table(g);
+		if (!g->armed)
+			arm = g->armed = 1;
+	}
+	rtdm_lock_put_irqrestore(&g->lock, c);
 
-	/* start the base signal tick */
-	rtdm_timer_start(&ctx->base_timer, ctx->base.period, ctx->base.period,
-			 RTDM_TIMERMODE_RELATIVE);
+	if (arm)
+		arm_group(g);
 
 	return 0;
 }
@@ -188,9 +697,12 @@ static int gpiopwm_ioctl_rt(struct rtdm_fd *fd, unsigned int request, void __use
 
 	switch (request) {
 	case GPIOPWM_RTIOC_SET_CONFIG:
+	case GPIOPWM_RTIOC_SET_SEQ:
 		return -ENOSYS;
 	case GPIOPWM_RTIOC_CHANGE_DUTY_CYCLE:
 		return gpiopwm_change_duty_cycle(ctx, (unsigned long) arg);
+	case GPIOPWM_RTIOC_CHANGE_DUTY_NS:
+		return gpiopwm_change_duty_ns(fd, arg);
 	case GPIOPWM_RTIOC_START:
 		return gpiopwm_start(fd);
 	case GPIOPWM_RTIOC_STOP:
@@ -204,6 +716,7 @@ static int gpiopwm_ioctl_rt(struct rtdm_fd *fd, unsigned int request, void __use
 
 static int gpiopwm_ioctl_nrt(struct rtdm_fd *fd, unsigned int request, void __user *arg)
 {
+	struct gpiopwm_seq seq;
 	struct gpiopwm conf;
 
 	switch (request) {
@@ -213,6 +726,12 @@ static int gpiopwm_ioctl_nrt(struct rtdm_fd *fd, unsigned int request, void __us
 
 		rtdm_copy_from_user(fd, &conf, arg, sizeof(conf));
 		return gpiopwm_config(fd, &conf);
+	case GPIOPWM_RTIOC_SET_SEQ:
+		if (!rtdm_rw_user_ok(fd, arg, sizeof(seq)))
+			return -EFAULT;
+
+		rtdm_copy_from_user(fd, &seq, arg, sizeof(seq));
+		return gpiopwm_seq_config(fd, &seq);
 	case GPIOPWM_RTIOC_GET_CONFIG:
 	default:
 		return -EINVAL;
@@ -225,7 +744,10 @@ static int gpiopwm_open(struct rtdm_fd *fd, int oflags)
 {
 	struct gpiopwm_priv *ctx = rtdm_fd_to_private(fd);
 
-	ctx->ctrl.configured = 0;
+	ctx->configured = 0;
+	ctx->running = 0;
+	ctx->group = NULL;
+	ctx->minor = rtdm_fd_minor(fd);
 	ctx->gpio = -1;
 
 	return 0;
@@ -235,14 +757,11 @@ static void gpiopwm_close(struct rtdm_fd *fd)
 {
 	struct gpiopwm_priv *ctx = rtdm_fd_to_private(fd);
 
-	if (ctx->gpio >= 0)
-		gpio_free(ctx->gpio);
-
-	if (!ctx->ctrl.configured)
+	if (!ctx->configured)
 		return;
 
-	rtdm_timer_destroy(&ctx->base_timer);
-	rtdm_timer_destroy(&ctx->duty_timer);
+	leave_group(ctx);
+	release_output(ctx->gpio);
 }
 
 static struct rtdm_driver gpiopwm_driver = {
@@ -251,18 +770,19 @@ static struct rtdm_driver gpiopwm_driver = {
 						    RTDM_SUBCLASS_GENERIC,
 						    RTPWM_PROFILE_VER),
 	.device_flags		= RTDM_NAMED_DEVICE | RTDM_EXCLUSIVE,
-	.device_count		= 8,
+	.device_count		= MAX_CHANNELS,
 	.context_size		= sizeof(struct gpiopwm_priv),
 	.ops = {
 		.open		= gpiopwm_open,
 		.close		= gpiopwm_close,
 		.ioctl_rt	= gpiopwm_ioctl_rt,
 		.ioctl_nrt	= gpiopwm_ioctl_nrt,
+		.read_rt	= gpiopwm_read_rt,
 	},
 };
 
-static struct rtdm_device device[8] = {
-	[0 ... 7] = {
+static struct rtdm_device device[MAX_CHANNELS] = {
+	[0 ... MAX_CHANNELS - 1] = {
 		.driver = &gpiopwm_driver,
 		.label = "gpiopwm%d",
 	}
@@ -275,6 +795,13 @@ static int __init __gpiopwm_init(void)
 	if (!realtime_core_enabled())
 		return -ENODEV;
 
+	for (i = 0; i < ARRAY_SIZE(groups); i++) {
+		rtdm_lock_init(&groups[i].lock);
+		rtdm_timer_init(&groups[i].timer, gpiopwm_handle_timer,
+				"gpiopwm");
+		groups[i].pending = -1;
+	}
+
 	for (i = 0; i < ARRAY_SIZE(device); i++) {
 		ret = rtdm_dev_register(device + i);
 		if (ret)
@@ -286,6 +813,9 @@ fail:
 	while (i-- > 0)
 		rtdm_dev_unregister(device + i);
 
+	for (i = 0; i < ARRAY_SIZE(groups); i++)
+		rtdm_timer_destroy(&groups[i].timer);
+
 	return ret;
 }
 
@@ -295,6 +825,9 @@ static void __exit __gpiopwm_exit(void)
 
 	for (i = 0; i < ARRAY_SIZE(device); i++)
 		rtdm_dev_unregister(device + i);
+
+	for (i = 0; i < ARRAY_SIZE(groups); i++)
+		rtdm_timer_destroy(&groups[i].timer);
 }
 
 module_init(__gpiopwm_init);
@@ -27,10 +27,14 @@
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/sched.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/log2.h>
 
 #include <rtdev.h>
 #include <rtnet_chrdev.h>
 #include <rtnet_port.h> /* for netdev_priv() */
+#include <rtcap_ring.h>
 
 MODULE_LICENSE("GPL");
 
@@ -39,6 +43,11 @@ module_param(rtcap_rtskbs, uint, 0444);
 MODULE_PARM_DESC(rtcap_rtskbs, "Number of real-time socket buffers per "
 		 "real-time device");
 
+static unsigned int rtcap_ring_size;
+module_param(rtcap_ring_size, uint, 0444);
+MODULE_PARM_DESC(rtcap_ring_size, "Size of the per-CPU capture rings in "
+		 "bytes, 0 to forward packets to Linux shadow devices instead");
+
 #define TAP_DEV             1
 #define RTMAC_TAP_DEV       2
 #define XMIT_HOOK           4
@@ -48,6 +57,7 @@ static struct rtskb_queue   cap_queue;
 static struct rtskb_pool   cap_pool;
 
 static struct tap_device_t {
+    struct rtnet_device     *rtdev;
     struct net_device       *tap_dev;
     struct net_device       *rtmac_tap_dev;
     struct net_device_stats tap_dev_stats;
@@ -126,6 +136,376 @@ int rtcap_loopback_xmit_hook(struct rtskb *rtskb, struct rtnet_device *rtdev)
 
 
 
+/***
+ *  Ring mode: frames are copied into per-CPU rings which userland maps
+ *  through the "rtcap" device, see rtcap_ring.h for the layout.
+ */
+struct rtcap_ring {
+    struct rtcap_ring_hdr   *hdr;
+    unsigned char           *data;
+    /* Private geometry, the header only carries a copy for readers. */
+    u32                     size;
+    u32                     mask;
+    u32                     head;
+};
+
+static void                 *ring_area;
+static size_t               ring_area_size;
+static size_t               ring_stride;
+static struct rtcap_ring    *rings;
+static unsigned int         ring_count;
+static struct rtcap_filter  ring_filter;
+static DECLARE_WAIT_QUEUE_HEAD(ring_waitq);
+
+
+
+static inline int rtcap_ring_filter(unsigned int dir, struct rtnet_device *rtdev,
+				    const unsigned char *data, unsigned int len)
+{
+    u32 ifmask = READ_ONCE(ring_filter.ifmask);
+    u16 ethertype = READ_ONCE(ring_filter.ethertype);
+    u16 directions = READ_ONCE(ring_filter.directions);
+
+    if (directions != 0 && (directions & dir) == 0)
+	return 0;
+
+    if (ifmask != 0 && (rtdev->ifindex >= 32 ||
+			(ifmask & (1U << rtdev->ifindex)) == 0))
+	return 0;
+
+    if (ethertype != 0 &&
+	(len < ETH_HLEN || ((struct ethhdr *)data)->h_proto != ethertype))
+	return 0;
+
+    return 1;
+}
+
+
+
+/* Called with hard IRQs off on the ring's CPU, making us the only writer. */
+static void rtcap_ring_write(struct rtcap_ring *ring, unsigned int flags,
+			     struct rtnet_device *rtdev,
+			     const unsigned char *data, unsigned int len,
+			     nanosecs_abs_t stamp, nanosecs_abs_t rtmac_stamp)
+{
+    struct rtcap_ring_hdr   *hdr = ring->hdr;
+    struct rtcap_record     *rec;
+    unsigned int            caplen, reclen, pad, pos;
+    u32                     head, tail;
+
+
+    if (!rtcap_ring_filter(flags & (RTCAP_F_RX | RTCAP_F_TX), rtdev,
+			   data, len)) {
+	hdr->filtered++;
+	return;
+    }
+
+    caplen = min_t(unsigned int, len, READ_ONCE(ring_filter.snaplen));
+    reclen = ALIGN(sizeof(*rec) + caplen, RTCAP_RECORD_ALIGN);
+
+    /* Userland owns the tail, a bogus one leaves the ring full. */
+    head = ring->head;
+    tail = READ_ONCE(hdr->tail);
+    if (head - tail > ring->size)
+	tail = head - ring->size;
+    pos  = head & ring->mask;
+
+    /* Records never wrap, skip the rest of the area if needed. */
+    pad = (ring->size - pos < reclen) ? ring->size - pos : 0;
+
+    if (head + pad + reclen - tail > ring->size) {
+	hdr->dropped++;
+	return;
+    }
+    /* Do not overwrite data before the reader released it. */
+    smp_mb();
+
+    if (pad >= sizeof(*rec)) {
+	rec = (struct rtcap_record *)(ring->data + pos);
+	rec->type   = RTCAP_REC_PAD;
+	rec->reclen = pad;
+    }
+    head += pad;
+    pos  = head & ring->mask;
+
+    rec = (struct rtcap_record *)(ring->data + pos);
+    rec->type        = RTCAP_REC_PACKET;
+    rec->flags       = flags;
+    rec->ifindex     = rtdev->ifindex;
+    rec->caplen      = caplen;
+    rec->len         = len;
+    rec->reclen      = reclen;
+    rec->timestamp   = stamp;
+    rec->rtmac_stamp = rtmac_stamp;
+    memcpy(rec + 1, data, caplen);
+
+    /* Publish the record, then check if the reader asked for a wakeup. */
+    smp_wmb();
+    ring->head = head + reclen;
+    WRITE_ONCE(hdr->head, ring->head);
+    smp_mb();
+
+    if (READ_ONCE(hdr->waiting) && xchg(&hdr->waiting, 0))
+	rtdm_nrtsig_pend(&cap_signal);
+}
+
+
+
+static void rtcap_ring_report(unsigned int flags, struct rtskb *rtskb,
+			      const unsigned char *data, unsigned int len,
+			      nanosecs_abs_t stamp)
+{
+    nanosecs_abs_t  rtmac_stamp = 0;
+    rtdm_lockctx_t  context;
+
+
+    if (rtskb->cap_flags & RTSKB_CAP_RTMAC_STAMP) {
+	flags       |= RTCAP_F_RTMAC_STAMP;
+	rtmac_stamp = rtskb->cap_rtmac_stamp;
+    }
+
+    rtdm_lock_irqsave(context);
+    rtcap_ring_write(&rings[ipipe_processor_id()], flags, rtskb->rtdev,
+		     data, len, stamp, rtmac_stamp);
+    rtdm_lock_irqrestore(context);
+}
+
+
+
+void rtcap_ring_rx_hook(struct rtskb *rtskb)
+{
+    rtcap_ring_report(RTCAP_F_RX, rtskb, rtskb->cap_start, rtskb->cap_len,
+		      rtskb->time_stamp);
+}
+
+
+
+int rtcap_ring_xmit_hook(struct rtskb *rtskb, struct rtnet_device *rtdev)
+{
+    struct tap_device_t *tap_dev = &tap_device[rtskb->rtdev->ifindex];
+
+
+    rtskb->time_stamp = rtdm_clock_read();
+
+    rtcap_ring_report(RTCAP_F_TX, rtskb, rtskb->data, rtskb->len,
+		      rtskb->time_stamp);
+
+    return tap_dev->orig_xmit(rtskb, rtdev);
+}
+
+
+
+static int rtcap_ring_pending(void)
+{
+    unsigned int            i;
+
+
+    for (i = 0; i < ring_count; i++) {
+	if (READ_ONCE(rings[i].head) != READ_ONCE(rings[i].hdr->tail))
+	    return 1;
+    }
+
+    return 0;
+}
+
+
+
+static int rtcap_ring_wait(int timeout)
+{
+    long    ret;
+    int     i;
+
+
+    for (i = 0; i < ring_count; i++)
+	WRITE_ONCE(rings[i].hdr->waiting, 1);
+    smp_mb();
+
+    ret = wait_event_interruptible_timeout(ring_waitq, rtcap_ring_pending(),
+			timeout < 0 ? MAX_SCHEDULE_TIMEOUT :
+				      msecs_to_jiffies(timeout));
+    if (ret < 0)
+	return -EINTR;
+
+    return (ret == 0) ? -ETIMEDOUT : 0;
+}
+
+
+
+static void rtcap_ring_signal_handler(rtdm_nrtsig_t *nrtsig, void *arg)
+{
+    wake_up_interruptible(&ring_waitq);
+}
+
+
+
+static int rtcap_ring_init(void)
+{
+    struct rtcap_ring_hdr   *hdr;
+    size_t                  data_offset;
+    unsigned int            i;
+
+
+    if (rtcap_ring_size > (1U << 30))
+	return -EINVAL;
+    if (rtcap_ring_size < PAGE_SIZE)
+	rtcap_ring_size = PAGE_SIZE;
+    rtcap_ring_size = roundup_pow_of_two(rtcap_ring_size);
+
+    data_offset    = L1_CACHE_ALIGN(sizeof(struct rtcap_ring_hdr));
+    ring_count     = nr_cpu_ids;
+    ring_stride    = PAGE_ALIGN(data_offset + rtcap_ring_size);
+    ring_area_size = ring_stride * ring_count;
+
+    if (ring_area_size / ring_count != ring_stride)
+	return -EINVAL;
+
+    rings = kcalloc(ring_count, sizeof(struct rtcap_ring), GFP_KERNEL);
+    if (rings == NULL)
+	return -ENOMEM;
+
+    ring_area = vmalloc_user(ring_area_size);
+    if (ring_area == NULL) {
+	kfree(rings);
+	return -ENOMEM;
+    }
+
+    for (i = 0; i < ring_count; i++) {
+	hdr = ring_area + i * ring_stride;
+	hdr->magic       = RTCAP_RING_MAGIC;
+	hdr->cpu         = i;
+	hdr->size        = rtcap_ring_size;
+	hdr->data_offset = data_offset;
+
+	rings[i].hdr  = hdr;
+	rings[i].data = (unsigned char *)hdr + data_offset;
+	rings[i].size = rtcap_ring_size;
+	rings[i].mask = rtcap_ring_size - 1;
+    }
+
+    ring_filter.snaplen = min_t(unsigned int, 0xFFFF, rtcap_ring_size / 4);
+
+    return 0;
+}
+
+
+
+static void rtcap_ring_cleanup(void)
+{
+    vfree(ring_area);
+    kfree(rings);
+}
+
+
+
+static void rtcap_vm_open(struct vm_area_struct *vma)
+{
+    __module_get(THIS_MODULE);
+}
+
+static void rtcap_vm_close(struct vm_area_struct *vma)
+{
+    module_put(THIS_MODULE);
+}
+
+static struct vm_operations_struct rtcap_vm_ops = {
+    .open   = rtcap_vm_open,
+    .close  = rtcap_vm_close,
+};
+
+static int rtcap_dev_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+    int ret;
+
+
+    if (vma->vm_pgoff != 0 ||
+	vma->vm_end - vma->vm_start > ring_area_size)
+	return -EINVAL;
+
+    ret = rtdm_mmap_vmem(vma, ring_area);
+    if (ret)
+	return ret;
+
+    /* The rings must outlive the module as long as they are mapped. */
+    __module_get(THIS_MODULE);
+    vma->vm_ops = &rtcap_vm_ops;
+
+    return 0;
+}
+
+
+
+static int rtcap_dev_ioctl(struct rtdm_fd *fd, unsigned int request,
+			   void __user *arg)
+{
+    struct rtcap_filter filter;
+    struct rtcap_info   info;
+    int                 timeout;
+
+
+    switch (request) {
+    case RTCAP_RTIOC_GET_INFO:
+	info.cpus        = ring_count;
+	info.ring_stride = ring_stride;
+	info.map_size    = ring_area_size;
+	info.snaplen     = ring_filter.snaplen;
+
+	return rtdm_safe_copy_to_user(fd, arg, &info, sizeof(info));
+
+    case RTCAP_RTIOC_SET_FILTER:
+	if (rtdm_safe_copy_from_user(fd, &filter, arg, sizeof(filter)))
+	    return -EFAULT;
+
+	if (filter.directions & ~(RTCAP_F_RX | RTCAP_F_TX))
+	    return -EINVAL;
+
+	if (filter.snaplen == 0 || filter.snaplen > rtcap_ring_size / 4)
+	    filter.snaplen = rtcap_ring_size / 4;
+	if (filter.snaplen > 0xFFFF)
+	    filter.snaplen = 0xFFFF;
+
+	/* The hooks read each field once, a change may hit a frame
+	 * half-way which is harmless. */
+	WRITE_ONCE(ring_filter.ifmask, filter.ifmask);
+	WRITE_ONCE(ring_filter.ethertype, filter.ethertype);
+	WRITE_ONCE(ring_filter.directions, filter.directions);
+	WRITE_ONCE(ring_filter.snaplen, filter.snaplen);
+
+	return 0;
+
+    case RTCAP_RTIOC_WAIT:
+	if (rtdm_safe_copy_from_user(fd, &timeout, arg, sizeof(timeout)))
+	    return -EFAULT;
+
+	return rtcap_ring_wait(timeout);
+
+    default:
+	return -ENOTTY;
+    }
+}
+
+
+
+static struct rtdm_driver rtcap_driver = {
+    .profile_info = RTDM_PROFILE_INFO(rtcap,
+				    RTDM_CLASS_NETWORK,
+				    RTDM_SUBCLASS_RTNET,
+				    RTNET_RTDM_VER),
+    .device_flags = RTDM_NAMED_DEVICE,
+    .device_count = 1,
+    .context_size = 0,
+    .ops = {
+	.ioctl_nrt =    rtcap_dev_ioctl,
+	.mmap =         rtcap_dev_mmap,
+    },
+};
+
+static struct rtdm_device rtcap_device = {
+    .driver = &rtcap_driver,
+    .label  = "rtcap",
+};
+
+
+
 void rtcap_kfree_rtskb(struct rtskb *rtskb)
 {
     rtdm_lockctx_t  context;
@@ -333,29 +713,29 @@ void cleanup_tap_devices(void)
     struct rtnet_device *rtdev;
 
 
-    for (i = 0; i < MAX_RT_DEVICES; i++)
-	if ((tap_device[i].present & TAP_DEV) != 0) {
-	    if ((tap_device[i].present & XMIT_HOOK) != 0) {
-		rtdev = *(struct rtnet_device **)
-		    netdev_priv(tap_device[i].tap_dev);
-
-		mutex_lock(&rtdev->nrt_lock);
-		rtdev->hard_start_xmit = tap_device[i].orig_xmit;
-		if (rtdev->features & NETIF_F_LLTX)
-		    rtdev->start_xmit = tap_device[i].orig_xmit;
-		mutex_unlock(&rtdev->nrt_lock);
+    for (i = 0; i < MAX_RT_DEVICES; i++) {
+	if ((tap_device[i].present & XMIT_HOOK) != 0) {
+	    rtdev = tap_device[i].rtdev;
 
-		rtdev_dereference(rtdev);
-	    }
+	    mutex_lock(&rtdev->nrt_lock);
+	    rtdev->hard_start_xmit = tap_device[i].orig_xmit;
+	    if (rtdev->features & NETIF_F_LLTX)
+		rtdev->start_xmit = tap_device[i].orig_xmit;
+	    mutex_unlock(&rtdev->nrt_lock);
 
-	    if ((tap_device[i].present & RTMAC_TAP_DEV) != 0) {
-		unregister_netdev(tap_device[i].rtmac_tap_dev);
-		free_netdev(tap_device[i].rtmac_tap_dev);
-	    }
+	    rtdev_dereference(rtdev);
+	}
+
+	if ((tap_device[i].present & RTMAC_TAP_DEV) != 0) {
+	    unregister_netdev(tap_device[i].rtmac_tap_dev);
+	    free_netdev(tap_device[i].rtmac_tap_dev);
+	}
 
+	if ((tap_device[i].present & TAP_DEV) != 0) {
 	    unregister_netdev(tap_device[i].tap_dev);
 	    free_netdev(tap_device[i].tap_dev);
 	}
+    }
 }
 
 
@@ -373,7 +753,14 @@ int __init rtcap_init(void)
 
     rtskb_queue_init(&cap_queue);
 
-    rtdm_nrtsig_init(&cap_signal, rtcap_signal_handler, NULL);
+    if (rtcap_ring_size != 0) {
+	ret = rtcap_ring_init();
+	if (ret < 0)
+	    return ret;
+
+	rtdm_nrtsig_init(&cap_signal, rtcap_ring_signal_handler, NULL);
+    } else
+	rtdm_nrtsig_init(&cap_signal, rtcap_signal_handler, NULL);
 
     for (i = 0; i < MAX_RT_DEVICES; i++) {
 	tap_device[i].present = 0;
@@ -399,48 +786,58 @@ int __init rtcap_init(void)
 		continue;
 	    }
 
-	    memset(&tap_device[i].tap_dev_stats, 0,
-		   sizeof(struct net_device_stats));
-
-	    dev = alloc_netdev(sizeof(struct rtnet_device *), rtdev->name,
-			    NET_NAME_UNKNOWN, tap_dev_setup);
-	    if (!dev) {
-		ret = -ENOMEM;
-		goto error3;
-	    }
-
-	    tap_device[i].tap_dev = dev;
-	    *(struct rtnet_device **)netdev_priv(dev) = rtdev;
-
-	    ret = register_netdev(dev);
-	    if (ret < 0)
-		goto error3;
-
-	    tap_device[i].present = TAP_DEV;
-
+	    tap_device[i].rtdev     = rtdev;
 	    tap_device[i].orig_xmit = rtdev->hard_start_xmit;
 
-	    if ((rtdev->flags & IFF_LOOPBACK) == 0) {
+	    if (rtcap_ring_size != 0) {
+		/* loopback frames are captured on reception */
+		if ((rtdev->flags & IFF_LOOPBACK) == 0)
+		    rtdev->hard_start_xmit = rtcap_ring_xmit_hook;
+		else
+		    rtdev->hard_start_xmit = rtcap_loopback_xmit_hook;
+	    } else {
+		memset(&tap_device[i].tap_dev_stats, 0,
+		       sizeof(struct net_device_stats));
+
 		dev = alloc_netdev(sizeof(struct rtnet_device *), rtdev->name,
-				NET_NAME_UNKNOWN, tap_dev_setup);
+				   NET_NAME_UNKNOWN, tap_dev_setup);
 		if (!dev) {
 		    ret = -ENOMEM;
 		    goto error3;
 		}
 
-		tap_device[i].rtmac_tap_dev = dev;
+		tap_device[i].tap_dev = dev;
 		*(struct rtnet_device **)netdev_priv(dev) = rtdev;
-		strncat(dev->name, "-mac", IFNAMSIZ-strlen(dev->name));
 
 		ret = register_netdev(dev);
 		if (ret < 0)
 		    goto error3;
 
-		tap_device[i].present |= RTMAC_TAP_DEV;
+		tap_device[i].present = TAP_DEV;
 
-		rtdev->hard_start_xmit = rtcap_xmit_hook;
-	    } else
-		rtdev->hard_start_xmit = rtcap_loopback_xmit_hook;
+		if ((rtdev->flags & IFF_LOOPBACK) == 0) {
+		    dev = alloc_netdev(sizeof(struct rtnet_device *),
+				       rtdev->name, NET_NAME_UNKNOWN,
+				       tap_dev_setup);
+		    if (!dev) {
+			ret = -ENOMEM;
+			goto error3;
+		    }
+
+		    tap_device[i].rtmac_tap_dev = dev;
+		    *(struct rtnet_device **)netdev_priv(dev) = rtdev;
+		    strncat(dev->name, "-mac", IFNAMSIZ-strlen(dev->name));
+
+		    ret = register_netdev(dev);
+		    if (ret < 0)
+			goto error3;
+
+		    tap_device[i].present |= RTMAC_TAP_DEV;
+
+		    rtdev->hard_start_xmit = rtcap_xmit_hook;
+		} else
+		    rtdev->hard_start_xmit = rtcap_loopback_xmit_hook;
+	    }
 
 	    /* If the device requires no xmit_lock, start_xmit points equals
 	     * hard_start_xmit => we have to update this as well
@@ -462,6 +859,21 @@ int __init rtcap_init(void)
 	goto error2;
     }
 
+    if (rtcap_ring_size != 0) {
+	ret = rtdm_dev_register(&rtcap_device);
+	if (ret < 0)
+	    goto error2;
+
+	/* register capturing handlers with RTnet core
+	 * (adding the handler need no locking) */
+	rtcap_handler = rtcap_ring_rx_hook;
+
+	printk("RTcap: %u capture rings of %u bytes\n",
+	       ring_count, rtcap_ring_size);
+
+	return 0;
+    }
+
     if (rtskb_module_pool_init(&cap_pool, rtcap_rtskbs * devices) <
 	    rtcap_rtskbs * devices) {
 	rtskb_pool_release(&cap_pool);
@@ -483,6 +895,8 @@ int __init rtcap_init(void)
   error2:
     cleanup_tap_devices();
     rtdm_nrtsig_destroy(&cap_signal);
+    if (rtcap_ring_size != 0)
+	rtcap_ring_cleanup();
 
     return ret;
 }
@@ -494,7 +908,8 @@ void rtcap_cleanup(void)
     rtdm_lockctx_t  context;
 
 
-    rtdm_nrtsig_destroy(&cap_signal);
+    if (rtcap_ring_size != 0)
+	rtdm_dev_unregister(&rtcap_device);
 
     /* unregister capturing handlers
      * (take lock to avoid any unloading code before handler was left) */
@@ -502,12 +917,18 @@ void rtcap_cleanup(void)
     rtcap_handler = NULL;
     rtdm_lock_put_irqrestore(&rtcap_lock, context);
 
-    /* empty queue (should be already empty) */
-    rtcap_signal_handler(0, NULL /* we ignore them anyway */);
-
     cleanup_tap_devices();
 
-    rtskb_pool_release(&cap_pool);
+    rtdm_nrtsig_destroy(&cap_signal);
+
+    if (rtcap_ring_size != 0)
+	rtcap_ring_cleanup();
+    else {
+	/* empty queue (should be already empty) */
+	rtcap_signal_handler(0, NULL /* we ignore them anyway */);
+
+	rtskb_pool_release(&cap_pool);
+    }
 
     printk("RTcap: unloaded\n");
 }
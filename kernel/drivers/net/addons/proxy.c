@@ -16,6 +16,13 @@
  * Only IPV4 based protocols are supported, UDP and ICMP can be send out
  * but not received - as these are handled directly by rtnet!
  *
+ * Batching:
+ * Both directions are batched: the transmission task is only woken up
+ * when it went idle, sends at most proxy_tx_budget frames per batch and
+ * can be limited to proxy_rt_share percent of the CPU; received frames
+ * only raise a signal when Linux drained the previous ones, and are
+ * passed on through NAPI so that GRO coalesces TCP streams.
+ *
  *
  *
  * Based on the linux net driver dummy.c by Nick Holloway
@@ -45,6 +52,7 @@
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/skbuff.h>
+#include <linux/math64.h>
 #include <net/sock.h>
 #include <net/ip.h>
 
@@ -78,11 +86,24 @@ static struct rtskb_queue rx_queue;
 
 /* handle for non-real-time signal */
 static rtdm_nrtsig_t rtnetproxy_rx_signal;
+static atomic_t rtnetproxy_rx_pending;
+
+static struct napi_struct rtnetproxy_napi;
 
 /* Thread for transmission */
 static rtdm_task_t rtnetproxy_tx_task;
 
 static rtdm_event_t rtnetproxy_tx_event;
+static atomic_t rtnetproxy_tx_pending;
+
+static unsigned int proxy_tx_budget = 16;
+module_param(proxy_tx_budget, uint, 0644);
+MODULE_PARM_DESC(proxy_tx_budget, "Frames sent per batch by the transmission task");
+
+static unsigned int proxy_rt_share = 100;
+module_param(proxy_rt_share, uint, 0644);
+MODULE_PARM_DESC(proxy_rt_share, "Percentage of CPU time the transmission task may consume "
+		 "(1-100)");
 
 #ifdef CONFIG_XENO_DRIVERS_NET_ADDON_PROXY_ARP
 static char* rtdev_attach = "rteth0";
@@ -98,20 +119,62 @@ struct rtnet_device *rtnetproxy_rtdev;
  * ************************************************************************
  * ************************************************************************ */
 
-static void rtnetproxy_tx_loop(void *arg)
+static unsigned int rtnetproxy_tx_batch(unsigned int budget)
 {
     struct rtnet_device *rtdev;
     struct rtskb *rtskb;
+    unsigned int sent = 0;
+
+    while (sent < budget && (rtskb = rtskb_dequeue(&tx_queue)) != NULL) {
+	rtdev = rtskb->rtdev;
+	rtdev_xmit_proxy(rtskb);
+	rtdev_dereference(rtdev);
+	sent++;
+    }
+
+    return sent;
+}
+
+static void rtnetproxy_tx_loop(void *arg)
+{
+    nanosecs_abs_t start, idle_start;
+    nanosecs_rel_t debt = 0;
+    unsigned int budget, share, sent;
+
+    idle_start = rtdm_clock_read();
 
     while (!rtdm_task_should_stop()) {
 	if (rtdm_event_wait(&rtnetproxy_tx_event) < 0)
 	    break;
 
-	while ((rtskb = rtskb_dequeue(&tx_queue)) != NULL) {
-	    rtdev = rtskb->rtdev;
-	    rtdev_xmit_proxy(rtskb);
-	    rtdev_dereference(rtdev);
-	}
+	/* Frames queued from now on need a new wakeup. */
+	atomic_set(&rtnetproxy_tx_pending, 0);
+	smp_mb__after_atomic();
+
+	do {
+	    budget = READ_ONCE(proxy_tx_budget) ? : 1;
+
+	    start = rtdm_clock_read();
+	    debt -= start - idle_start;
+	    if (debt < 0)
+		debt = 0;
+
+	    sent = rtnetproxy_tx_batch(budget);
+
+	    idle_start = rtdm_clock_read();
+
+	    /*
+	     * Each batch must be followed by enough idle time to keep
+	     * the task within its CPU share, waiting for new frames
+	     * counts as idle time as well.
+	     */
+	    share = READ_ONCE(proxy_rt_share);
+	    if (share > 0 && share < 100) {
+		debt += div_u64((idle_start - start) * (100 - share), share);
+		if (debt > 0 && rtdm_task_sleep(debt) < 0)
+		    return;
+	    }
+	} while (sent == budget);
     }
 }
 
@@ -193,7 +256,8 @@ drop2:
     dev->stats.tx_bytes += len;
 
     rtskb_queue_tail(&tx_queue, rtskb);
-    rtdm_event_signal(&rtnetproxy_tx_event);
+    if (atomic_xchg(&rtnetproxy_tx_pending, 1) == 0)
+	rtdm_event_signal(&rtnetproxy_tx_event);
 
     return NETDEV_TX_OK;
 }
@@ -223,14 +287,15 @@ static void rtnetproxy_recv(struct rtskb *rtskb)
     }
 
     rtskb_queue_tail(&rx_queue, rtskb);
-    rtdm_nrtsig_pend(&rtnetproxy_rx_signal);
+    if (atomic_xchg(&rtnetproxy_rx_pending, 1) == 0)
+	rtdm_nrtsig_pend(&rtnetproxy_rx_signal);
 }
 
 
 /* ************************************************************************
  * This function runs in kernel mode.
- * It is activated from rtnetproxy_signal_handler whenever rtnet received a
- * frame to be processed by rtnetproxy.
+ * It is activated from rtnetproxy_poll whenever rtnet received a frame to
+ * be processed by rtnetproxy.
  * ************************************************************************ */
 static inline void rtnetproxy_kernel_recv(struct rtskb *rtskb)
 {
@@ -241,8 +306,11 @@ static inline void rtnetproxy_kernel_recv(struct rtskb *rtskb)
     int len        = rtskb->len + header_len;
 
     /* Copy the realtime skb (rtskb) to the standard skb: */
-    skb = dev_alloc_skb(len+2);
-    skb_reserve(skb, 2);
+    skb = napi_alloc_skb(&rtnetproxy_napi, len);
+    if (skb == NULL) {
+	dev->stats.rx_dropped++;
+	return;
+    }
 
     memcpy(skb_put(skb, len), rtskb->data-header_len, len);
 
@@ -262,23 +330,58 @@ static inline void rtnetproxy_kernel_recv(struct rtskb *rtskb)
     dev->stats.rx_bytes+=skb->len;
     dev->stats.rx_packets++;
 
-    netif_rx(skb);  /* pass it to the received stuff */
+    napi_gro_receive(&rtnetproxy_napi, skb);
+}
 
+static void rtnetproxy_rx_purge(void)
+{
+    struct rtskb *rtskb;
+
+    while ((rtskb = rtskb_dequeue(&rx_queue)) != NULL)
+	kfree_rtskb(rtskb);
 }
 
 /* ************************************************************************
- * This function runs in kernel mode.
- * It is activated from rtnetproxy_recv whenever rtnet received a frame to
- * be processed by rtnetproxy.
+ * This function runs in softirq context.
+ * It passes up to budget frames to Linux, GRO merges them on completion.
  * ************************************************************************ */
-static void rtnetproxy_signal_handler(rtdm_nrtsig_t *nrtsig, void *arg)
+static int rtnetproxy_poll(struct napi_struct *napi, int budget)
 {
     struct rtskb *rtskb;
+    int done = 0;
 
-    while ((rtskb = rtskb_dequeue(&rx_queue)) != NULL) {
+    while (done < budget && (rtskb = rtskb_dequeue(&rx_queue)) != NULL) {
 	rtnetproxy_kernel_recv(rtskb);
 	kfree_rtskb(rtskb);
+	done++;
+    }
+
+    if (done < budget) {
+	napi_complete_done(napi, done);
+
+	/* A signal raised while we were polling was ignored. */
+	if (!rtskb_queue_empty(&rx_queue))
+	    napi_schedule(napi);
     }
+
+    return done;
+}
+
+/* ************************************************************************
+ * This function runs in kernel mode.
+ * It is activated from rtnetproxy_recv when rtnet received a frame while
+ * the previous ones had already been picked up by Linux.
+ * ************************************************************************ */
+static void rtnetproxy_signal_handler(rtdm_nrtsig_t *nrtsig, void *arg)
+{
+    /* Frames queued from now on need a new signal. */
+    atomic_set(&rtnetproxy_rx_pending, 0);
+    smp_mb__after_atomic();
+
+    if (netif_running(dev_rtnetproxy))
+	napi_schedule(&rtnetproxy_napi);
+    else
+	rtnetproxy_rx_purge();
 }
 
 /* ************************************************************************
@@ -304,11 +407,16 @@ static int rtnetproxy_open(struct net_device *dev)
     if (err == 0)
 	return -EIDRM;
 
+    napi_enable(&rtnetproxy_napi);
+
     return 0;
 }
 
 static int rtnetproxy_stop(struct net_device *dev)
 {
+    napi_disable(&rtnetproxy_napi);
+    rtnetproxy_rx_purge();
+
     module_put(THIS_MODULE);
     return 0;
 }
@@ -373,6 +481,9 @@ static int __init rtnetproxy_init_module(void)
     rtskb_queue_init(&tx_queue);
     rtskb_queue_init(&rx_queue);
 
+    netif_napi_add(dev_rtnetproxy, &rtnetproxy_napi, rtnetproxy_poll,
+		   NAPI_POLL_WEIGHT);
+
     err = register_netdev(dev_rtnetproxy);
     if (err < 0)
 	goto err3;
@@ -398,6 +509,7 @@ err4:
 err3:
     rtdm_nrtsig_destroy(&rtnetproxy_rx_signal);
 
+    netif_napi_del(&rtnetproxy_napi);
     free_netdev(dev_rtnetproxy);
 
 err1:
@@ -416,24 +528,23 @@ static void __exit rtnetproxy_cleanup_module(void)
     /* Unregister the fallback at rtnet */
     rt_ip_fallback_handler = NULL;
 
+    /* free the non-real-time signal */
+    rtdm_nrtsig_destroy(&rtnetproxy_rx_signal);
+
     /* Unregister the net device: */
     unregister_netdev(dev_rtnetproxy);
+    netif_napi_del(&rtnetproxy_napi);
     free_netdev(dev_rtnetproxy);
 
     rtdm_event_destroy(&rtnetproxy_tx_event);
     rtdm_task_destroy(&rtnetproxy_tx_task);
 
-    /* free the non-real-time signal */
-    rtdm_nrtsig_destroy(&rtnetproxy_rx_signal);
-
     while ((rtskb = rtskb_dequeue(&tx_queue)) != NULL) {
 	rtdev_dereference(rtskb->rtdev);
 	kfree_rtskb(rtskb);
     }
 
-    while ((rtskb = rtskb_dequeue(&rx_queue)) != NULL) {
-	kfree_rtskb(rtskb);
-    }
+    rtnetproxy_rx_purge();
 
     rtskb_pool_release(&rtskb_pool);
 
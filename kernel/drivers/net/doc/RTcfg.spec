@@ -1,7 +1,7 @@
                      RTnet Configuration Service (RTcfg)
                      ===================================
 
-                                Revision: 1.8
+                                Revision: 1.9
 
 
 RTcfg is a configuration service for setting up a RTnet network and
@@ -233,7 +233,8 @@ Flags are encoded as follows:
  ------------+---------------------------------------------------------------
        0     | requests available stage 2 configuration data from the server
        1     | client is ready (i.e. will not send an explicit Ready frame)
-      2-7    | <reserved>
+       2     | client accepts shared stage 2 transfers (see below)
+      3-7    | <reserved>
 
 Furthermore, the client reports its own Stage 2 Burst Rate back to the server.
 The minimum of the server and the client value is selected as the actual burst
@@ -310,6 +311,60 @@ specified offset.
 
 
 
+Shared Stage 2 Configuration Frames
+-----------------------------------
+
+Initial Frame:
+ +----------+----------+-----------------+------------------+ - -
+ |  ID: 9   |  Flags   | Active Stations | Heartbeat Period |
+ | (1 byte) | (1 byte) |    (4 bytes)    |    (2 bytes)     |
+ +----------+----------+-----------------+------------------+ - -
+  - - +----------------------+-----------+--------------------+
+      | Configuration Length |  Session  | Configuration Data |
+      |      (4 bytes)       | (4 bytes) |     (variable)     |
+  - - +----------------------+-----------+--------------------+
+
+Subsequent Fragments:
+ +----------+-----------+-----------------+--------------------+
+ |  ID: 10  |  Session  | Fragment Offset | Configuration Data |
+ | (1 byte) | (4 bytes) |    (4 bytes)    |     (variable)     |
+ +----------+-----------+-----------------+--------------------+
+
+If a client sets bit 2 in its New Announcement frame and requests stage 2
+data, the server may answer with these frames instead of the ones with ID 3
+and 4. The Session field identifies the configuration data, it is the same
+for all clients receiving the same data. The initial frame is sent as
+unicast. Subsequent fragments are sent as broadcast when several clients
+are expecting the same fragment, as unicast otherwise. Clients ignore
+fragments carrying a different session. Except for the first fragment, the
+payload of all fragments is the MTU minus the fragment header size.
+
+The server never sends more fragments than the negotiated burst rate beyond
+the last acknowledged offset of a client. Clients acknowledge the received
+data as described below, but also keep a limited number of fragments
+received out of order and report the missing data with a Negative
+Acknowledge Configuration frame. When a client remains silent for a server
+period while data is outstanding, the server repeats the last fragment sent
+to it as unicast. A client receiving a unicast fragment it already
+acknowledged repeats its Acknowledge Configuration frame.
+
+
+
+Negative Acknowledge Configuration Frames
+-----------------------------------------
+
+ +----------+-----------------+-----------------+
+ |  ID: 11  | Fragment Offset | Fragment Length |
+ | (1 byte) |    (4 bytes)    |    (4 bytes)    |
+ +----------+-----------------+-----------------+
+
+Sent as unicast to the server by a client receiving shared stage 2 fragments
+beyond a gap. The Fragment Offset field is set to the number of bytes
+received contiguously, the Fragment Length field to the size of the gap. The
+server repeats the missing fragments as unicast, up to the burst rate.
+
+
+
 Ready Frame
 -----------
 
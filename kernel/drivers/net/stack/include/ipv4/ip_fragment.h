@@ -35,5 +35,10 @@ extern void rt_ip_frag_invalidate_socket(struct rtsocket *sock);
 extern int __init rt_ip_fragment_init(void);
 extern void rt_ip_fragment_cleanup(void);
 
+#ifdef CONFIG_XENO_OPT_VFILE
+extern int __init rt_ip_fragment_proc_register(void);
+extern void rt_ip_fragment_proc_unregister(void);
+#endif /* CONFIG_XENO_OPT_VFILE */
+
 
 #endif  /* __RTNET_IP_FRAGMENT_H_ */
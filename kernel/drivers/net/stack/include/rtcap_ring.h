@@ -0,0 +1,107 @@
+/***
+ *
+ *  include/rtcap_ring.h
+ *
+ *  RTcap - shared capture ring interface
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __RTCAP_RING_H_
+#define __RTCAP_RING_H_
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/ioctl.h>
+#else
+#include <stdint.h>
+#include <sys/ioctl.h>
+#endif
+
+/*
+ * When RTcap is loaded with a non-zero rtcap_ring_size, captured frames
+ * are copied into one ring per CPU instead of being forwarded to the
+ * shadow network devices. The rings are exported by the RTDM device
+ * "rtcap" (/dev/rtdm/rtcap), which a reader maps at offset 0: ring #n
+ * starts at n * rtcap_info.ring_stride, with a struct rtcap_ring_hdr
+ * followed by the data area at hdr->data_offset.
+ *
+ * head and tail are free-running 32-bit byte counters, the position in the
+ * data area is obtained by masking them with (size - 1). The kernel only
+ * moves head, the reader only moves tail. Records never wrap: if the space left
+ * up to the end of the data area is smaller than a record header, or a
+ * RTCAP_REC_PAD record is found, reading resumes at the start of the data
+ * area.
+ *
+ * RTCAP_RTIOC_WAIT sets hdr->waiting in all rings before sleeping until
+ * one of them is non-empty. The capture hooks clear the flag and raise a
+ * single wakeup for the first record they produce afterwards, so a busy
+ * reader draining the rings costs no signaling at all.
+ */
+
+#define RTCAP_RING_MAGIC        0x52434150  /* "RCAP" */
+#define RTCAP_RECORD_ALIGN      8
+
+struct rtcap_ring_hdr {
+    uint32_t            magic;
+    uint32_t            cpu;
+    uint32_t            size;           /* data area size, power of 2 */
+    uint32_t            data_offset;    /* from the ring header */
+    volatile uint32_t   head;           /* written by the kernel */
+    volatile uint32_t   tail;           /* written by the reader */
+    volatile uint32_t   waiting;        /* reader asks for a wakeup */
+    uint32_t            __reserved;
+    volatile uint64_t   dropped;        /* records lost, ring was full */
+    volatile uint64_t   filtered;       /* frames rejected by the filter */
+};
+
+#define RTCAP_REC_PACKET        1
+#define RTCAP_REC_PAD           2
+
+#define RTCAP_F_RX              0x1
+#define RTCAP_F_TX              0x2
+#define RTCAP_F_RTMAC_STAMP     0x4     /* rtmac_stamp is valid */
+
+struct rtcap_record {
+    uint16_t            type;           /* RTCAP_REC_xxx */
+    uint16_t            flags;          /* RTCAP_F_xxx */
+    uint16_t            ifindex;
+    uint16_t            caplen;         /* bytes stored after the header */
+    uint32_t            len;            /* length on the wire */
+    uint32_t            reclen;         /* total record size, aligned */
+    uint64_t            timestamp;      /* ns, reception or transmission */
+    uint64_t            rtmac_stamp;    /* ns, RTmac enqueuing time */
+};
+
+struct rtcap_info {
+    uint32_t            cpus;           /* number of rings */
+    uint32_t            ring_stride;    /* offset between rings */
+    uint32_t            map_size;       /* total size to map */
+    uint32_t            snaplen;        /* current snap length */
+};
+
+struct rtcap_filter {
+    uint32_t            ifmask;         /* bit per ifindex, 0 for any */
+    uint16_t            ethertype;      /* network order, 0 for any */
+    uint16_t            directions;     /* RTCAP_F_RX|TX, 0 for both */
+    uint32_t            snaplen;        /* 0 for full frames */
+};
+
+#define RTCAP_RTIOC_GET_INFO    _IOR('c', 0x00, struct rtcap_info)
+#define RTCAP_RTIOC_SET_FILTER  _IOW('c', 0x01, struct rtcap_filter)
+#define RTCAP_RTIOC_WAIT        _IOW('c', 0x02, int) /* timeout in ms */
+
+#endif  /* __RTCAP_RING_H_ */
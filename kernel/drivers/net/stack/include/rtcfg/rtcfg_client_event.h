@@ -43,4 +43,6 @@ int rtcfg_main_state_client_2(int ifindex, RTCFG_EVENT event_id,
 int rtcfg_main_state_client_ready(int ifindex, RTCFG_EVENT event_id,
                                   void* event_data);
 
+void rtcfg_client_drop_ooo(int ifindex);
+
 #endif /* __RTCFG_CLIENT_EVENT_H_ */
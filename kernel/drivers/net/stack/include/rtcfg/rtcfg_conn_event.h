@@ -55,6 +55,8 @@ struct rtcfg_connection {
 	size_t					stage1_size;
 	struct rtcfg_file		*stage2_file;
 	u32						cfg_offs;
+	u32						mc_offs;	/* shared stage 2: sent up to */
+	u32						mc_last;	/* shared stage 2: last frame */
 	unsigned int			flags;
 	unsigned int			burstrate;
 	nanosecs_abs_t			last_frame;
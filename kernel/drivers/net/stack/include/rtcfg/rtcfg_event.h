@@ -91,6 +91,11 @@ struct rtcfg_device {
 	    unsigned int            packet_counter;
 	    u32                     chain_len;
 	    struct rtskb            *stage2_chain;
+	    u32                     mc_session;
+	    u32                     nack_offs;
+	    unsigned int            unacked;
+	    unsigned int            ooo_count;
+	    struct rtskb            *stage2_ooo;
 	    u32                     max_stations;
 	    struct rtcfg_station    *station_addr_list;
 	} clt;
@@ -100,6 +105,7 @@ struct rtcfg_device {
 	    struct list_head        conn_list;
 	    u16                     heartbeat;
 	    u64                     heartbeat_timeout;
+	    u64                     period;
 	} srv;
     } spec;
 };
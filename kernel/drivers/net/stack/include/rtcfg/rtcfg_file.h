@@ -35,6 +35,7 @@ struct rtcfg_file {
     const char*      name;
     size_t           size;
     void*            buffer;
+    u32              session;   /* identifies shared stage 2 transfers */
 };
 
 
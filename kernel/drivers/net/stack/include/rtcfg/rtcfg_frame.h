@@ -46,6 +46,10 @@
 #define RTCFG_ID_READY              6
 #define RTCFG_ID_HEARTBEAT          7
 #define RTCFG_ID_DEAD_STATION       8
+#define RTCFG_ID_STAGE_2_CFG_MC     9
+#define RTCFG_ID_STAGE_2_CFG_MFRAG  10
+#define RTCFG_ID_NACK_CFG           11
+#define RTCFG_ID_MAX                RTCFG_ID_NACK_CFG
 
 #define RTCFG_ADDRSIZE_MAC          0
 #define RTCFG_ADDRSIZE_IP           4
@@ -53,9 +57,11 @@
 
 #define RTCFG_FLAG_STAGE_2_DATA 0
 #define RTCFG_FLAG_READY        1
+#define RTCFG_FLAG_MCAST        2   /* client accepts shared stage 2 data */
 
 #define _RTCFG_FLAG_STAGE_2_DATA (1 << RTCFG_FLAG_STAGE_2_DATA)
 #define _RTCFG_FLAG_READY        (1 << RTCFG_FLAG_READY)
+#define _RTCFG_FLAG_MCAST        (1 << RTCFG_FLAG_MCAST)
 
 struct rtcfg_frm_head {
 #if defined(__LITTLE_ENDIAN_BITFIELD)
@@ -102,11 +108,34 @@ struct rtcfg_frm_stage_2_cfg_frag {
     u8                    cfg_data[0];
 } __attribute__((packed));
 
+struct rtcfg_frm_stage_2_cfg_mc {
+    struct rtcfg_frm_head head;
+    u8                    flags;
+    u32                   stations;
+    u16                   heartbeat_period;
+    u32                   cfg_len;
+    u32                   session;
+    u8                    cfg_data[0];
+} __attribute__((packed));
+
+struct rtcfg_frm_stage_2_cfg_mfrag {
+    struct rtcfg_frm_head head;
+    u32                   session;
+    u32                   frag_offs;
+    u8                    cfg_data[0];
+} __attribute__((packed));
+
 struct rtcfg_frm_ack_cfg {
     struct rtcfg_frm_head head;
     u32                   ack_len;
 } __attribute__((packed));
 
+struct rtcfg_frm_nack_cfg {
+    struct rtcfg_frm_head head;
+    u32                   frag_offs;
+    u32                   frag_len;
+} __attribute__((packed));
+
 struct rtcfg_frm_simple {
     struct rtcfg_frm_head head;
 } __attribute__((packed));
@@ -122,9 +151,12 @@ struct rtcfg_frm_dead_station {
 int rtcfg_send_stage_1(struct rtcfg_connection *conn);
 int rtcfg_send_stage_2(struct rtcfg_connection *conn, int send_data);
 int rtcfg_send_stage_2_frag(struct rtcfg_connection *conn);
+int rtcfg_send_stage_2_mfrag(int ifindex, struct rtcfg_file *file, u32 offs,
+                             u8 *dest_addr);
 int rtcfg_send_announce_new(int ifindex);
 int rtcfg_send_announce_reply(int ifindex, u8 *dest_mac_addr);
 int rtcfg_send_ack(int ifindex);
+int rtcfg_send_nack(int ifindex, u32 offs, u32 len);
 int rtcfg_send_dead_station(struct rtcfg_connection *conn);
 
 int rtcfg_send_simple_frame(int ifindex, int frame_id, u8 *dest_addr);
@@ -60,7 +60,10 @@ typedef enum {
     RTCFG_FRM_ACK_CFG,
     RTCFG_FRM_READY,
     RTCFG_FRM_HEARTBEAT,
-    RTCFG_FRM_DEAD_STATION
+    RTCFG_FRM_DEAD_STATION,
+    RTCFG_FRM_STAGE_2_CFG_MC,
+    RTCFG_FRM_STAGE_2_CFG_MFRAG,
+    RTCFG_FRM_NACK_CFG
 } RTCFG_EVENT;
 
 struct rtskb;
@@ -36,6 +36,8 @@
 #include <stack_mgr.h>
 
 
+struct rtpacket_ring;
+
 struct rtsocket {
     unsigned short          protocol;
 
@@ -68,12 +70,14 @@ struct rtsocket {
 	    int             reg_index;  /* index in port registry */
 	    u8              tos;
 	    u8              state;
+	    unsigned int    frag_collectors; /* IP reassemblies in progress */
 	} inet;
 
 	/* packet socket specific */
 	struct {
 	    struct rtpacket_type packet_type;
 	    int                  ifindex;
+	    struct rtpacket_ring *ring;     /* mmap'ed frame ring, or NULL */
 	} packet;
     } prot;
 
@@ -31,6 +31,7 @@
 #include <rtnet_rtpc.h>
 #include <ipv4/arp.h>
 #include <ipv4/icmp.h>
+#include <ipv4/ip_fragment.h>
 #include <ipv4/ip_output.h>
 #include <ipv4/protocol.h>
 #include <ipv4/route.h>
@@ -299,7 +300,9 @@ static int __init rt_ipv4_proto_init(void)
 
 
     /* Network-Layer */
-    rt_ip_init();
+    result = rt_ip_init();
+    if (result < 0)
+	return result;
     rt_arp_init();
 
     /* Transport-Layer */
@@ -312,6 +315,10 @@ static int __init rt_ipv4_proto_init(void)
     result = xnvfile_init_dir("ipv4", &ipv4_proc_root, &rtnet_proc_root);
     if (result < 0)
 	goto err1;
+
+    result = rt_ip_fragment_proc_register();
+    if (result < 0)
+	goto err1a;
 #endif /* CONFIG_XENO_OPT_VFILE */
 
     if ((result = rt_ip_routing_init()) < 0)
@@ -328,6 +335,8 @@ static int __init rt_ipv4_proto_init(void)
 
   err2:
 #ifdef CONFIG_XENO_OPT_VFILE
+    rt_ip_fragment_proc_unregister();
+  err1a:
     xnvfile_destroy_dir(&ipv4_proc_root);
   err1:
 #endif /* CONFIG_XENO_OPT_VFILE */
@@ -349,6 +358,7 @@ static void __exit rt_ipv4_proto_release(void)
     rt_ip_routing_release();
 
 #ifdef CONFIG_XENO_OPT_VFILE
+    rt_ip_fragment_proc_unregister();
     xnvfile_destroy_dir(&ipv4_proc_root);
 #endif
 
@@ -533,6 +533,7 @@ void __init rt_icmp_init(void)
 	printk("RTnet: allocated only %d icmp rtskbs\n", skbs);
 
     icmp_socket->prot.inet.tos = 0;
+    icmp_socket->prot.inet.frag_collectors = 0;
     icmp_fd->refs = 1;
 
     rt_inet_add_protocol(&icmp_protocol);
@@ -21,6 +21,7 @@
 
 
 #include <linux/module.h>
+#include <linux/jhash.h>
 #include <net/checksum.h>
 #include <net/ip.h>
 
@@ -31,6 +32,7 @@
 #include <linux/ip.h>
 #include <linux/in.h>
 
+#include <ipv4/af_inet.h>
 #include <ipv4/ip_fragment.h>
 
 #if IS_ENABLED(CONFIG_XENO_DRIVERS_NET_ADDON_PROXY)
@@ -38,204 +40,456 @@
 #endif /* CONFIG_XENO_DRIVERS_NET_ADDON_PROXY */
 
 /*
- * This defined sets the number of incoming fragmented IP messages that
- * can be handled in parallel.
+ * Number of incoming fragmented IP messages that can be handled in parallel.
+ * This is also the size of the hash table the collectors are indexed in.
  */
-#define COLLECTOR_COUNT 10
+#define COLLECTOR_COUNT     CONFIG_XENO_DRIVERS_NET_RTIPV4_FRAG_COLLECTORS
+#define COLLECTOR_HASH_MASK (COLLECTOR_COUNT - 1)
+
+#if (COLLECTOR_COUNT & COLLECTOR_HASH_MASK) != 0
+#error CONFIG_XENO_DRIVERS_NET_RTIPV4_FRAG_COLLECTORS must be power of 2
+#endif
+
+/*
+ * Fragments which arrive ahead of the first one of their datagram cannot be
+ * charged to a socket yet. They are held at the expense of this pool until
+ * the first fragment shows up and tells us the destination socket.
+ */
+#define DEFAULT_ORPHAN_RTSKBS   16
+
+static unsigned int frag_timeout = 1000;
+module_param(frag_timeout, uint, 0444);
+MODULE_PARM_DESC(frag_timeout, "timeout for incomplete IP datagrams in ms "
+		 "(default: 1000)");
+
+static unsigned int frag_socket_quota = COLLECTOR_COUNT / 4;
+module_param(frag_socket_quota, uint, 0444);
+MODULE_PARM_DESC(frag_socket_quota, "maximum number of collectors a single "
+		 "socket may hold, 0 for unlimited (default: collectors / 4)");
+
+static unsigned int frag_orphan_rtskbs = DEFAULT_ORPHAN_RTSKBS;
+module_param(frag_orphan_rtskbs, uint, 0444);
+MODULE_PARM_DESC(frag_orphan_rtskbs, "number of rtskbs for buffering "
+		 "out-of-order fragments (default: 16)");
 
 struct ip_collector
 {
-    int   in_use;
+    struct hlist_node   hash_link;
+    struct list_head    age_link;   /* in-use list (oldest first) or free list */
+
     __u32 saddr;
     __u32 daddr;
     __u16 id;
     __u8  protocol;
 
-    struct rtskb_queue frags;
-    struct rtsocket *sock;
-    unsigned int buf_size;
+    struct rtskb        *first;     /* fragments, sorted by offset */
+    struct rtskb        *last;
+    struct rtsocket     *sock;      /* NULL until the first fragment arrived */
+    unsigned int        buf_size;   /* payload collected so far */
+    unsigned int        total_size; /* datagram size, 0 while yet unknown */
+    nanosecs_abs_t      expiry;
 };
 
-static struct ip_collector collector[COLLECTOR_COUNT];
+struct ip_frag_stats
+{
+    unsigned long       fragments;
+    unsigned long       reassembled;
+    unsigned long       out_of_order;
+    unsigned long       timeouts;
+    unsigned long       drop_no_collector;
+    unsigned long       drop_quota;
+    unsigned long       drop_no_buffer;
+    unsigned long       drop_invalid;
+    unsigned int        in_use;
+    unsigned int        max_in_use;
+};
 
+static struct ip_collector  collector[COLLECTOR_COUNT];
+static struct hlist_head    collector_hash[COLLECTOR_COUNT];
+static LIST_HEAD(free_collectors);
+static LIST_HEAD(aged_collectors);
+static struct ip_frag_stats frag_stats;
+static DEFINE_RTDM_LOCK(frag_lock);
 
-static void alloc_collector(struct rtskb *skb, struct rtsocket *sock)
-{
-    int                 i;
-    rtdm_lockctx_t      context;
-    struct ip_collector *p_coll;
-    struct iphdr        *iph = skb->nh.iph;
+static struct rtskb_pool    orphan_pool;
+static rtdm_timer_t         frag_timer;
+static int                  frag_timer_armed;
 
 
-    /*
-     * Find a free collector
-     *
-     * Note: We once used to clean up probably outdated chains, but the
-     * algorithm was not stable enough and could cause incorrect drops even
-     * under medium load. If we run in overload, we will loose data anyhow.
-     * What we should do in the future is to account collectors per socket or
-     * socket owner and set quotations.
-     * Garbage collection is now performed only on socket close.
-     */
-    for (i = 0; i < COLLECTOR_COUNT; i++) {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
-
-        if (!p_coll->in_use) {
-            p_coll->in_use        = 1;
-            p_coll->buf_size      = skb->len;
-            p_coll->frags.first   = skb;
-            p_coll->frags.last    = skb;
-            p_coll->saddr         = iph->saddr;
-            p_coll->daddr         = iph->daddr;
-            p_coll->id            = iph->id;
-            p_coll->protocol      = iph->protocol;
-            p_coll->sock          = sock;
-
-            rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-
-            return;
-        }
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-    }
+static inline unsigned int collector_hashkey(__u32 saddr, __u32 daddr,
+                                             __u16 id, __u8 protocol)
+{
+    return jhash_3words(saddr, daddr, ((u32)id << 16) | protocol, 0) &
+        COLLECTOR_HASH_MASK;
+}
 
-    rtdm_printk("RTnet: IP fragmentation - no collector available\n");
-    kfree_rtskb(skb);
+
+
+static inline unsigned int frag_offset(struct rtskb *skb)
+{
+    /* The IP header is still in place, only pulled from the data area. */
+    return (ntohs(skb->nh.iph->frag_off) & IP_OFFSET) << 3;
 }
 
 
 
-/*
- * Return a pointer to the collector that holds the message which
- * fits to the iphdr of the passed rtskb.
- * */
-static struct rtskb *add_to_collector(struct rtskb *skb, unsigned int offset, int more_frags)
+static struct ip_collector *find_collector(struct iphdr *iph)
 {
-	int                 i, err;
-    rtdm_lockctx_t      context;
     struct ip_collector *p_coll;
-    struct iphdr        *iph = skb->nh.iph;
-    struct rtskb        *first_skb;
+    unsigned int        key;
 
 
-    /* Search in existing collectors */
-    for (i = 0; i < COLLECTOR_COUNT; i++)
-    {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
+    key = collector_hashkey(iph->saddr, iph->daddr, iph->id, iph->protocol);
 
-        if (p_coll->in_use  &&
-            (iph->saddr    == p_coll->saddr) &&
+    hlist_for_each_entry(p_coll, &collector_hash[key], hash_link)
+        if ((iph->saddr    == p_coll->saddr) &&
             (iph->daddr    == p_coll->daddr) &&
             (iph->id       == p_coll->id) &&
             (iph->protocol == p_coll->protocol))
-        {
-            first_skb = p_coll->frags.first;
+            return p_coll;
 
-            /* Acquire the rtskb at the expense of the protocol pool */
-            if (rtskb_acquire(skb, &p_coll->sock->skb_pool) != 0) {
-                /* We have to drop this fragment => clean up the whole chain */
-                p_coll->in_use = 0;
+    return NULL;
+}
 
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
 
-#ifdef FRAG_DBG
-                rtdm_printk("RTnet: Compensation pool empty - IP fragments "
-                            "dropped (saddr:%x, daddr:%x)\n",
-                            iph->saddr, iph->daddr);
-#endif
 
-                kfree_rtskb(first_skb);
-                kfree_rtskb(skb);
-                return NULL;
-            }
+/*
+ * Grab a free collector for the datagram the passed fragment belongs to.
+ * Returns with *start_timer set if the caller has to arm the expiry timer
+ * after dropping frag_lock. Called with frag_lock held.
+ */
+static struct ip_collector *alloc_collector(struct iphdr *iph,
+                                            int *start_timer)
+{
+    struct ip_collector *p_coll;
+    unsigned int        key;
+
 
-            /* Optimized version of __rtskb_queue_tail */
-            skb->next = NULL;
-            p_coll->frags.last->next = skb;
-            p_coll->frags.last = skb;
+    if (list_empty(&free_collectors)) {
+        frag_stats.drop_no_collector++;
+        return NULL;
+    }
 
-            /* Extend the chain */
-            first_skb->chain_end = skb;
+    p_coll = list_first_entry(&free_collectors, struct ip_collector,
+                              age_link);
+    list_del(&p_coll->age_link);
+
+    p_coll->saddr       = iph->saddr;
+    p_coll->daddr       = iph->daddr;
+    p_coll->id          = iph->id;
+    p_coll->protocol    = iph->protocol;
+    p_coll->first       = NULL;
+    p_coll->last        = NULL;
+    p_coll->sock        = NULL;
+    p_coll->buf_size    = 0;
+    p_coll->total_size  = 0;
+    p_coll->expiry      = rtdm_clock_read() +
+        (nanosecs_abs_t)frag_timeout * 1000000;
+
+    key = collector_hashkey(iph->saddr, iph->daddr, iph->id, iph->protocol);
+    hlist_add_head(&p_coll->hash_link, &collector_hash[key]);
+
+    /* Timeouts are constant, so appending keeps the list sorted by expiry. */
+    list_add_tail(&p_coll->age_link, &aged_collectors);
+
+    if (++frag_stats.in_use > frag_stats.max_in_use)
+        frag_stats.max_in_use = frag_stats.in_use;
+
+    if (!frag_timer_armed) {
+        frag_timer_armed = 1;
+        *start_timer = 1;
+    }
+
+    return p_coll;
+}
 
-            /* Sanity check: unordered fragments are not allowed! */
-            if (offset != p_coll->buf_size) {
-                /* We have to drop this fragment => clean up the whole chain */
-                p_coll->in_use = 0;
-                skb = first_skb;
 
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-                break; /* leave the for loop */
-            }
 
-            p_coll->buf_size += skb->len;
+/*
+ * Release a collector, dropping all fragments it still holds.
+ * Called with frag_lock held.
+ */
+static void free_collector(struct ip_collector *p_coll)
+{
+    if (p_coll->first) {
+        p_coll->first->chain_end = p_coll->last;
+        kfree_rtskb(p_coll->first);
+    }
 
-            if (!more_frags) {
-                p_coll->in_use = 0;
+    if (p_coll->sock)
+        p_coll->sock->prot.inet.frag_collectors--;
 
-		err = rt_socket_reference(p_coll->sock);
+    hlist_del(&p_coll->hash_link);
+    list_move_tail(&p_coll->age_link, &free_collectors);
+    frag_stats.in_use--;
+}
 
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
 
-		if (err < 0) {
-			kfree_rtskb(first_skb);
-			return NULL;
-		}
 
-                return first_skb;
-            } else {
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-                return NULL;
-            }
+/*
+ * Insert a fragment into the collector, keeping the chain sorted by offset.
+ * Returns 0 on success or -EINVAL if the fragment overlaps with data which
+ * was already received. Called with frag_lock held.
+ */
+static int insert_fragment(struct ip_collector *p_coll, struct rtskb *skb,
+                           unsigned int offset)
+{
+    struct rtskb    *prev = NULL;
+    struct rtskb    *next = p_coll->first;
+
+
+    /* Fast path: fragments arriving in order go to the tail */
+    if (p_coll->last && frag_offset(p_coll->last) < offset) {
+        prev = p_coll->last;
+        next = NULL;
+    } else
+        while (next && frag_offset(next) < offset) {
+            prev = next;
+            next = next->next;
         }
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-    }
+    if ((prev && frag_offset(prev) + prev->len > offset) ||
+        (next && offset + skb->len > frag_offset(next)))
+        return -EINVAL;
+
+    if (next)
+        frag_stats.out_of_order++;
+
+    skb->next = next;
+    skb->chain_end = skb;
+    if (prev)
+        prev->next = skb;
+    else
+        p_coll->first = skb;
+    if (!next)
+        p_coll->last = skb;
+
+    p_coll->first->chain_end = p_coll->last;
+    p_coll->buf_size += skb->len;
 
+    return 0;
+}
+
+
+
+/*
+ * Charge all fragments collected so far to the socket pool, now that the
+ * first fragment told us the destination. Called with frag_lock held.
+ */
+static int adopt_orphans(struct ip_collector *p_coll, struct rtsocket *sock)
+{
+    struct rtskb    *skb;
+
+
+    for (skb = p_coll->first; skb; skb = skb->next)
+        if (skb->pool != &sock->skb_pool &&
+            rtskb_acquire(skb, &sock->skb_pool) != 0)
+            return -ENOMEM;
+
+    return 0;
+}
+
+
+
+/*
+ * Files the fragment into its collector. Returns the first rtskb of the
+ * complete datagram chain once all fragments have been received, NULL
+ * otherwise. The passed socket is only non-NULL for the first fragment.
+ */
+static struct rtskb *add_to_collector(struct rtskb *skb, unsigned int offset,
+                                      int more_frags, struct rtsocket *sock)
+{
+    rtdm_lockctx_t      context;
+    struct ip_collector *p_coll;
+    struct iphdr        *iph = skb->nh.iph;
+    struct rtskb        *first_skb = NULL;
+    unsigned int        end;
+    int                 start_timer = 0;
+    int                 err;
+
+
+    rtdm_lock_get_irqsave(&frag_lock, context);
+
+    frag_stats.fragments++;
+
+    p_coll = find_collector(iph);
+    if (!p_coll) {
 #if IS_ENABLED(CONFIG_XENO_DRIVERS_NET_ADDON_PROXY)
-    if (rt_ip_fallback_handler) {
+        /* Keep Linux traffic out of the collectors, it will not be
+           reassembled here anyway. */
+        if (!sock && rt_ip_fallback_handler) {
+            rtdm_lock_put_irqrestore(&frag_lock, context);
             __rtskb_push(skb, iph->ihl*4);
             rt_ip_fallback_handler(skb);
             return NULL;
+        }
+#endif /* CONFIG_XENO_DRIVERS_NET_ADDON_PROXY */
+
+        if (sock && frag_socket_quota &&
+            sock->prot.inet.frag_collectors >= frag_socket_quota) {
+            frag_stats.drop_quota++;
+            goto drop_skb;
+        }
+
+        p_coll = alloc_collector(iph, &start_timer);
+        if (!p_coll)
+            goto drop_skb;
     }
-#endif
 
+    if (sock && !p_coll->sock) {
+        if (frag_socket_quota &&
+            sock->prot.inet.frag_collectors >= frag_socket_quota) {
+            frag_stats.drop_quota++;
+            free_collector(p_coll);
+            goto drop_skb;
+        }
+
+        p_coll->sock = sock;
+        sock->prot.inet.frag_collectors++;
+
+        if (adopt_orphans(p_coll, sock) != 0) {
+            frag_stats.drop_no_buffer++;
+            free_collector(p_coll);
+            goto drop_skb;
+        }
+    }
+
+    /* Acquire the rtskb at the expense of the protocol or orphan pool */
+    if (rtskb_acquire(skb, p_coll->sock ?
+                      &p_coll->sock->skb_pool : &orphan_pool) != 0) {
 #ifdef FRAG_DBG
-    rtdm_printk("RTnet: Unordered IP fragment (saddr:%x, daddr:%x)"
-                " - dropped\n", iph->saddr, iph->daddr);
+        rtdm_printk("RTnet: Compensation pool empty - IP fragments "
+                    "dropped (saddr:%x, daddr:%x)\n",
+                    iph->saddr, iph->daddr);
 #endif
+        /* We have to drop this fragment => clean up the whole chain */
+        frag_stats.drop_no_buffer++;
+        free_collector(p_coll);
+        goto drop_skb;
+    }
+
+    /* Nothing may lie past the end of the datagram once it is known,
+       or it could stand in for a missing fragment. */
+    end = offset + skb->len;
+    if (!more_frags) {
+        if (p_coll->total_size || (p_coll->last &&
+            frag_offset(p_coll->last) + p_coll->last->len > end)) {
+            frag_stats.drop_invalid++;
+            free_collector(p_coll);
+            goto drop_skb;
+        }
+    } else if (p_coll->total_size && end > p_coll->total_size) {
+        frag_stats.drop_invalid++;
+        goto drop_skb;
+    }
+
+    if (insert_fragment(p_coll, skb, offset) != 0) {
+        /* Overlapping or duplicate fragment, keep what we have */
+        frag_stats.drop_invalid++;
+        goto drop_skb;
+    }
+
+    if (!more_frags)
+        p_coll->total_size = end;
+
+    if (!p_coll->sock || !p_coll->total_size ||
+        p_coll->buf_size < p_coll->total_size)
+        goto out;
 
+    if (p_coll->buf_size > p_coll->total_size) {
+        frag_stats.drop_invalid++;
+        free_collector(p_coll);
+        goto out;
+    }
+
+    err = rt_socket_reference(p_coll->sock);
+    if (err == 0) {
+        first_skb = p_coll->first;
+        p_coll->first = NULL;
+        frag_stats.reassembled++;
+    }
+    free_collector(p_coll);
+    goto out;
+
+  drop_skb:
+    rtdm_lock_put_irqrestore(&frag_lock, context);
+
+#ifdef FRAG_DBG
+    rtdm_printk("RTnet: IP fragment (saddr:%x, daddr:%x) dropped\n",
+                iph->saddr, iph->daddr);
+#endif
     kfree_rtskb(skb);
-    return NULL;
+    goto arm;
+
+  out:
+    rtdm_lock_put_irqrestore(&frag_lock, context);
+
+  arm:
+    /* Must not take nklock under frag_lock, the expiry handler nests the
+       other way around. */
+    if (start_timer)
+        rtdm_timer_start(&frag_timer, rtdm_clock_read() +
+                         (nanosecs_abs_t)frag_timeout * 1000000, 0,
+                         RTDM_TIMERMODE_ABSOLUTE);
+
+    return first_skb;
 }
 
 
 
 /*
- * Cleans up all collectors referring to the specified socket.
- * This is now the only kind of garbage collection we do.
+ * Reclaims collectors of datagrams which did not complete in time.
  */
-void rt_ip_frag_invalidate_socket(struct rtsocket *sock)
+static void frag_expiry_handler(rtdm_timer_t *timer)
 {
-    int                 i;
     rtdm_lockctx_t      context;
     struct ip_collector *p_coll;
+    nanosecs_abs_t      now = rtdm_clock_read();
+    nanosecs_abs_t      next_expiry = 0;
 
 
-    for (i = 0; i < COLLECTOR_COUNT; i++)
-    {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
+    rtdm_lock_get_irqsave(&frag_lock, context);
 
-        if ((p_coll->in_use) && (p_coll->sock == sock))
-        {
-            p_coll->in_use = 0;
-            kfree_rtskb(p_coll->frags.first);
+    while (!list_empty(&aged_collectors)) {
+        p_coll = list_first_entry(&aged_collectors, struct ip_collector,
+                                  age_link);
+        if (p_coll->expiry > now) {
+            next_expiry = p_coll->expiry;
+            break;
         }
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
+        frag_stats.timeouts++;
+        free_collector(p_coll);
     }
+
+    frag_timer_armed = (next_expiry != 0);
+
+    rtdm_lock_put_irqrestore(&frag_lock, context);
+
+    if (next_expiry)
+        rtdm_timer_start_in_handler(timer, next_expiry, 0,
+                                    RTDM_TIMERMODE_ABSOLUTE);
+}
+
+
+
+/*
+ * Cleans up all collectors referring to the specified socket.
+ */
+void rt_ip_frag_invalidate_socket(struct rtsocket *sock)
+{
+    rtdm_lockctx_t      context;
+    struct ip_collector *p_coll, *tmp;
+
+
+    rtdm_lock_get_irqsave(&frag_lock, context);
+
+    list_for_each_entry_safe(p_coll, tmp, &aged_collectors, age_link)
+        if (p_coll->sock == sock)
+            free_collector(p_coll);
+
+    rtdm_lock_put_irqrestore(&frag_lock, context);
 }
 EXPORT_SYMBOL_GPL(rt_ip_frag_invalidate_socket);
 
@@ -246,24 +500,38 @@ EXPORT_SYMBOL_GPL(rt_ip_frag_invalidate_socket);
  */
 static void cleanup_all_collectors(void)
 {
-    int                 i;
     rtdm_lockctx_t      context;
-    struct ip_collector *p_coll;
+    struct ip_collector *p_coll, *tmp;
 
 
-    for (i = 0; i < COLLECTOR_COUNT; i++)
-    {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
+    rtdm_lock_get_irqsave(&frag_lock, context);
 
-        if (p_coll->in_use)
-        {
-            p_coll->in_use = 0;
-            kfree_rtskb(p_coll->frags.first);
-        }
+    list_for_each_entry_safe(p_coll, tmp, &aged_collectors, age_link)
+        free_collector(p_coll);
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
+    rtdm_lock_put_irqrestore(&frag_lock, context);
+}
+
+
+
+/*
+ * Drops the collector matching the passed IP header, if any.
+ */
+static void drop_collector(struct iphdr *iph)
+{
+    rtdm_lockctx_t      context;
+    struct ip_collector *p_coll;
+
+
+    rtdm_lock_get_irqsave(&frag_lock, context);
+
+    p_coll = find_collector(iph);
+    if (p_coll) {
+        frag_stats.drop_invalid++;
+        free_collector(p_coll);
     }
+
+    rtdm_lock_put_irqrestore(&frag_lock, context);
 }
 
 
@@ -278,8 +546,8 @@ struct rtskb *rt_ip_defrag(struct rtskb *skb, struct rtinet_protocol *ipprot)
     unsigned int    more_frags;
     unsigned int    offset;
     struct rtsocket *sock;
+    struct rtskb    *first_skb;
     struct iphdr    *iph = skb->nh.iph;
-    int             ret;
 
 
     /* Parse the IP header */
@@ -288,65 +556,117 @@ struct rtskb *rt_ip_defrag(struct rtskb *skb, struct rtinet_protocol *ipprot)
     offset &= IP_OFFSET;
     offset <<= 3;   /* offset is in 8-byte chunks */
 
-    /* First fragment? */
-    if (offset == 0)
-    {
-        /* Get the destination socket */
-        if ((sock = ipprot->dest_socket(skb)) == NULL) {
+    /* Only the first fragment carries the transport header */
+    if (offset != 0)
+        return add_to_collector(skb, offset, more_frags, NULL);
+
+    /* Get the destination socket */
+    if ((sock = ipprot->dest_socket(skb)) == NULL) {
+        /* Drop what may already have been collected for this datagram */
+        drop_collector(iph);
 #if IS_ENABLED(CONFIG_XENO_DRIVERS_NET_ADDON_PROXY)
-                if (rt_ip_fallback_handler) {
-                    __rtskb_push(skb, iph->ihl*4);
-                    rt_ip_fallback_handler(skb);
-                    return NULL;
-                }
-#endif
-            /* Drop the rtskb */
-            kfree_rtskb(skb);
+        if (rt_ip_fallback_handler) {
+            __rtskb_push(skb, iph->ihl*4);
+            rt_ip_fallback_handler(skb);
             return NULL;
         }
+#endif
+        /* Drop the rtskb */
+        kfree_rtskb(skb);
+        return NULL;
+    }
 
-	/* Acquire the rtskb, to unlock the device skb pool */
-        ret = rtskb_acquire(skb, &sock->skb_pool);
+    first_skb = add_to_collector(skb, offset, more_frags, sock);
 
-        if (ret != 0) {
-            /* Drop the rtskb */
-            kfree_rtskb(skb);
-        } else {
-            /* Allocates a new collector */
-            alloc_collector(skb, sock);
-        }
+    /* Packet is queued or freed, the collector holds its own reference if
+       the datagram is complete */
+    rt_socket_dereference(sock);
 
-        /* Packet is queued or freed, socket can be released */
-        rt_socket_dereference(sock);
+    return first_skb;
+}
 
-        return NULL;
-    }
-    else
-    {
-        /* Add to an existing collector */
-        return add_to_collector(skb, offset, more_frags);
-    }
+
+
+#ifdef CONFIG_XENO_OPT_VFILE
+static int rt_ip_frag_show(struct xnvfile_regular_iterator *it, void *data)
+{
+    struct ip_frag_stats    stats;
+    rtdm_lockctx_t          context;
+
+
+    rtdm_lock_get_irqsave(&frag_lock, context);
+    stats = frag_stats;
+    rtdm_lock_put_irqrestore(&frag_lock, context);
+
+    xnvfile_printf(it, "Collectors used/max/total:\t%u/%u/%u\n"
+                   "Per-socket quota:\t\t%u\n"
+                   "Timeout (ms):\t\t\t%u\n"
+                   "Fragments received:\t\t%lu\n"
+                   "Datagrams reassembled:\t\t%lu\n"
+                   "Out-of-order fragments:\t\t%lu\n"
+                   "Timeouts:\t\t\t%lu\n"
+                   "Dropped (no collector):\t\t%lu\n"
+                   "Dropped (socket quota):\t\t%lu\n"
+                   "Dropped (no buffer):\t\t%lu\n"
+                   "Dropped (invalid):\t\t%lu\n",
+                   stats.in_use, stats.max_in_use, COLLECTOR_COUNT,
+                   frag_socket_quota, frag_timeout,
+                   stats.fragments, stats.reassembled, stats.out_of_order,
+                   stats.timeouts, stats.drop_no_collector, stats.drop_quota,
+                   stats.drop_no_buffer, stats.drop_invalid);
+
+    return 0;
+}
+
+static struct xnvfile_regular_ops rt_ip_frag_vfile_ops = {
+    .show = rt_ip_frag_show,
+};
+
+static struct xnvfile_regular rt_ip_frag_vfile = {
+    .ops = &rt_ip_frag_vfile_ops,
+};
+
+int __init rt_ip_fragment_proc_register(void)
+{
+    return xnvfile_init_regular("ip_fragment", &rt_ip_frag_vfile,
+                                &ipv4_proc_root);
 }
 
+void rt_ip_fragment_proc_unregister(void)
+{
+    xnvfile_destroy_regular(&rt_ip_frag_vfile);
+}
+#endif /* CONFIG_XENO_OPT_VFILE */
+
 
 
 int __init rt_ip_fragment_init(void)
 {
-    int i;
+    int i, ret;
 
 
-    /* Probably not needed (static variable...) */
-    memset(collector, 0, sizeof(collector));
+    for (i = 0; i < COLLECTOR_COUNT; i++) {
+        INIT_HLIST_HEAD(&collector_hash[i]);
+        list_add_tail(&collector[i].age_link, &free_collectors);
+    }
 
-    for (i = 0; i < COLLECTOR_COUNT; i++)
-        rtdm_lock_init(&collector[i].frags.lock);
+    if (rtskb_module_pool_init(&orphan_pool, frag_orphan_rtskbs) <
+        frag_orphan_rtskbs)
+        printk("RTnet: IP fragmentation - orphan pool only partially "
+               "allocated\n");
 
-    return 0;
+    ret = rtdm_timer_init(&frag_timer, frag_expiry_handler, "rtnet-ipfrag");
+    if (ret < 0)
+        rtskb_pool_release(&orphan_pool);
+
+    return ret;
 }
 
 
 
 void rt_ip_fragment_cleanup(void)
 {
+    rtdm_timer_destroy(&frag_timer);
     cleanup_all_collectors();
+    rtskb_pool_release(&orphan_pool);
 }
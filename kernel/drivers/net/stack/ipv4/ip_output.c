@@ -262,10 +262,19 @@ static struct rtpacket_type ip_packet_type = {
 /***
  *  ip_init
  */
-void __init rt_ip_init(void)
+int __init rt_ip_init(void)
 {
+    int ret;
+
+
+    /* Fragments may come in as soon as the packet type is added. */
+    ret = rt_ip_fragment_init();
+    if (ret < 0)
+        return ret;
+
     rtdev_add_pack(&ip_packet_type);
-    rt_ip_fragment_init();
+
+    return 0;
 }
 
 
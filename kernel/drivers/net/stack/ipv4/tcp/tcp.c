@@ -1198,6 +1198,7 @@ static int rt_tcp_socket_create(struct tcp_socket* ts)
     sock->prot.inet.saddr = INADDR_ANY;
     sock->prot.inet.state = TCP_CLOSE;
     sock->prot.inet.tos   = 0;
+    sock->prot.inet.frag_collectors = 0;
     /*
       rtdm_printk("rttcp: rt_tcp_socket_create 0x%p\n", ts);
     */
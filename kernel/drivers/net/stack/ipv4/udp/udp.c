@@ -294,6 +294,7 @@ int rt_udp_socket(struct rtdm_fd *fd)
     sock->prot.inet.saddr = INADDR_ANY;
     sock->prot.inet.state = TCP_CLOSE;
     sock->prot.inet.tos   = 0;
+    sock->prot.inet.frag_collectors = 0;
 
     rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
 
@@ -25,6 +25,8 @@
 #include <linux/module.h>
 #include <linux/sched.h>
 #include <linux/err.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
 
 #include <rtnet_iovec.h>
 #include <rtnet_socket.h>
@@ -33,6 +35,218 @@
 MODULE_LICENSE("GPL");
 
 
+/***
+ *  mmap'ed frame rings
+ */
+struct rtpacket_ring {
+    void            *area;      /* vmalloc'ed, RX frames then TX frames */
+    size_t          size;
+    unsigned int    frame_size;
+    unsigned int    rx_frames;
+    unsigned int    tx_frames;
+    unsigned int    rx_head;    /* next RX frame the stack fills */
+    unsigned int    tx_head;    /* next TX frame the stack sends */
+    rtdm_mutex_t    tx_lock;    /* serializes TX ring walks */
+    int             losing;
+    atomic_t        refs;       /* socket + user mappings */
+};
+
+static inline struct rtnet_packet_frame *
+rx_frame(struct rtpacket_ring *ring, unsigned int n)
+{
+    return ring->area + n * ring->frame_size;
+}
+
+static inline struct rtnet_packet_frame *
+tx_frame(struct rtpacket_ring *ring, unsigned int n)
+{
+    return ring->area + (ring->rx_frames + n) * ring->frame_size;
+}
+
+static void rt_packet_ring_put(struct rtpacket_ring *ring)
+{
+    if (atomic_dec_and_test(&ring->refs)) {
+	rtdm_mutex_destroy(&ring->tx_lock);
+	vfree(ring->area);
+	kfree(ring);
+    }
+}
+
+static int rt_packet_ring_setup(struct rtdm_fd *fd, struct rtsocket *sock,
+				const struct rtnet_packet_ring_req *req)
+{
+    struct rtpacket_ring *ring;
+    size_t size;
+
+    if (rtdm_in_rt_context())
+	return -ENOSYS;
+
+    if (req->frame_size <= RTNET_PACKET_FRAME_HDRLEN ||
+	(req->frame_size & (RTNET_PACKET_FRAME_ALIGN - 1)) ||
+	req->rx_frames + req->tx_frames == 0 ||
+	req->rx_frames > INT_MAX / req->frame_size ||
+	req->tx_frames > INT_MAX / req->frame_size - req->rx_frames)
+	return -EINVAL;
+
+    size = PAGE_ALIGN((size_t)(req->rx_frames + req->tx_frames) *
+		      req->frame_size);
+
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (ring == NULL)
+	return -ENOMEM;
+
+    ring->area = vmalloc_user(size);
+    if (ring->area == NULL) {
+	kfree(ring);
+	return -ENOMEM;
+    }
+
+    mutex_lock(&sock->pool_nrt_lock);
+
+    /* A ring cannot be resized or dropped while mapped. */
+    if (sock->prot.packet.ring) {
+	mutex_unlock(&sock->pool_nrt_lock);
+	vfree(ring->area);
+	kfree(ring);
+	return -EBUSY;
+    }
+
+    ring->size       = size;
+    ring->frame_size = req->frame_size;
+    ring->rx_frames  = req->rx_frames;
+    ring->tx_frames  = req->tx_frames;
+    rtdm_mutex_init(&ring->tx_lock);
+    atomic_set(&ring->refs, 1);
+
+    /* Publish a fully initialized ring to rt_packet_rcv. */
+    smp_wmb();
+    sock->prot.packet.ring = ring;
+
+    mutex_unlock(&sock->pool_nrt_lock);
+
+    return 0;
+}
+
+static void rt_packet_ring_vmopen(struct vm_area_struct *vma)
+{
+    struct rtpacket_ring *ring = vma->vm_private_data;
+
+    atomic_inc(&ring->refs);
+}
+
+static void rt_packet_ring_vmclose(struct vm_area_struct *vma)
+{
+    rt_packet_ring_put(vma->vm_private_data);
+}
+
+static struct vm_operations_struct rt_packet_ring_vmops = {
+    .open = rt_packet_ring_vmopen,
+    .close = rt_packet_ring_vmclose,
+};
+
+static int rt_packet_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+    struct rtsocket *sock = rtdm_fd_to_private(fd);
+    struct rtpacket_ring *ring = sock->prot.packet.ring;
+    int ret;
+
+    if (ring == NULL)
+	return -ENXIO;
+
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > ring->size)
+	return -EINVAL;
+
+    ret = rtdm_mmap_vmem(vma, ring->area);
+    if (ret)
+	return ret;
+
+    atomic_inc(&ring->refs);
+    vma->vm_ops = &rt_packet_ring_vmops;
+    vma->vm_private_data = ring;
+
+    return 0;
+}
+
+/* Copy a received packet into the next RX frame, if userland released it. */
+static void rt_packet_ring_rcv(struct rtsocket *sock,
+			       struct rtpacket_ring *ring, struct rtskb *skb)
+{
+    struct rtnet_packet_frame *frame = rx_frame(ring, ring->rx_head);
+    unsigned int len, snaplen, status;
+    unsigned char *data = skb->data;
+
+    if (READ_ONCE(frame->status) != RTNET_PACKET_STATUS_KERNEL) {
+	ring->losing = 1;
+	return;
+    }
+    /* Do not overwrite the frame before userland is done with it. */
+    smp_mb();
+
+    /* Include the header in raw delivery */
+    if (rtdm_fd_to_context(rt_socket_fd(sock))->device->driver->socket_type
+	!= SOCK_DGRAM)
+	data = skb->mac.raw;
+
+    len = skb->tail - data;
+    snaplen = min_t(unsigned int, len,
+		    ring->frame_size - RTNET_PACKET_FRAME_HDRLEN);
+    status = RTNET_PACKET_STATUS_USER;
+    if (snaplen < len)
+	status |= RTNET_PACKET_STATUS_TRUNC;
+    if (ring->losing) {
+	status |= RTNET_PACKET_STATUS_LOSING;
+	ring->losing = 0;
+    }
+
+    memcpy((void *)frame + RTNET_PACKET_FRAME_HDRLEN, data, snaplen);
+    frame->len       = len;
+    frame->snaplen   = snaplen;
+    frame->protocol  = skb->protocol;
+    frame->pkttype   = skb->pkt_type;
+    frame->ifindex   = skb->rtdev->ifindex;
+    frame->timestamp = skb->time_stamp;
+
+    smp_wmb();
+    WRITE_ONCE(frame->status, status);
+
+    if (++ring->rx_head == ring->rx_frames)
+	ring->rx_head = 0;
+
+    rtdm_sem_up(&sock->pending_sem);
+}
+
+
+
+/* Wait for RX frames, return the number delivered since the last call. */
+static ssize_t rt_packet_ring_wait(struct rtsocket *sock, int msg_flags)
+{
+    nanosecs_rel_t timeout = sock->timeout;
+    ssize_t count = 0;
+    int ret;
+
+    /* non-blocking receive? */
+    if (msg_flags & MSG_DONTWAIT)
+	timeout = -1;
+
+    ret = rtdm_sem_timeddown(&sock->pending_sem, timeout, NULL);
+    if (unlikely(ret < 0))
+	switch (ret) {
+	    default:
+		ret = -EBADF;   /* socket has been closed */
+	    case -EWOULDBLOCK:
+	    case -ETIMEDOUT:
+	    case -EINTR:
+		return ret;
+	}
+
+    /* Collapse all pending wakeups into a single call. */
+    do
+	count++;
+    while (rtdm_sem_timeddown(&sock->pending_sem, -1, NULL) == 0);
+
+    return count;
+}
+
 /***
  *  rt_packet_rcv
  */
@@ -43,12 +257,24 @@ static int rt_packet_rcv(struct rtskb *skb, struct rtpacket_type *pt)
     int             ifindex = sock->prot.packet.ifindex;
     void            (*callback_func)(struct rtdm_fd *, void *);
     void            *callback_arg;
+    struct rtpacket_ring *ring;
     rtdm_lockctx_t  context;
 
 
     if (unlikely((ifindex != 0) && (ifindex != skb->rtdev->ifindex)))
 	return -EUNATCH;
 
+    ring = READ_ONCE(sock->prot.packet.ring);
+    if (ring && ring->rx_frames) {
+	smp_rmb();
+	rt_packet_ring_rcv(sock, ring, skb);
+#ifdef CONFIG_XENO_DRIVERS_NET_ETH_P_ALL
+	if (pt->type != htons(ETH_P_ALL))
+#endif /* CONFIG_XENO_DRIVERS_NET_ETH_P_ALL */
+	    kfree_rtskb(skb);
+	goto signal;
+    }
+
 #ifdef CONFIG_XENO_DRIVERS_NET_ETH_P_ALL
     if (pt->type == htons(ETH_P_ALL)) {
 	struct rtskb *clone_skb = rtskb_clone(skb, &sock->skb_pool);
@@ -65,6 +291,7 @@ static int rt_packet_rcv(struct rtskb *skb, struct rtpacket_type *pt)
     rtskb_queue_tail(&sock->incoming, skb);
     rtdm_sem_up(&sock->pending_sem);
 
+  signal:
     rtdm_lock_get_irqsave(&sock->param_lock, context);
     callback_func = sock->callback_func;
     callback_arg  = sock->callback_arg;
@@ -216,6 +443,7 @@ static int rt_packet_socket(struct rtdm_fd *fd, int protocol)
 
     sock->prot.packet.packet_type.type		= protocol;
     sock->prot.packet.ifindex			= 0;
+    sock->prot.packet.ring			= NULL;
     sock->prot.packet.packet_type.trylock	= rt_packet_trylock;
     sock->prot.packet.packet_type.unlock        = rt_packet_unlock;
 
@@ -260,6 +488,12 @@ static void rt_packet_close(struct rtdm_fd *fd)
 	kfree_rtskb(del);
     }
 
+    /* the ring lives on as long as userland keeps it mapped */
+    if (sock->prot.packet.ring) {
+	rt_packet_ring_put(sock->prot.packet.ring);
+	sock->prot.packet.ring = NULL;
+    }
+
     rt_socket_cleanup(fd);
 }
 
@@ -275,6 +509,15 @@ static int rt_packet_ioctl(struct rtdm_fd *fd, unsigned int request, void __user
 	struct _rtdm_setsockaddr_args _setaddr;
 	const struct _rtdm_getsockaddr_args *getaddr;
 	struct _rtdm_getsockaddr_args _getaddr;
+	const struct rtnet_packet_ring_req *ringreq;
+	struct rtnet_packet_ring_req _ringreq;
+
+	if (request == RTNET_RTIOC_PACKET_RING) {
+		ringreq = rtnet_get_arg(fd, &_ringreq, arg, sizeof(_ringreq));
+		if (IS_ERR(ringreq))
+			return PTR_ERR(ringreq);
+		return rt_packet_ring_setup(fd, sock, ringreq);
+	}
 
 	/* fast path for common socket IOCTLs */
 	if (_IOC_TYPE(request) == RTIOC_TYPE_NETWORK)
@@ -318,6 +561,10 @@ rt_packet_recvmsg(struct rtdm_fd *fd, struct user_msghdr *u_msg, int msg_flags)
     socklen_t namelen;
     struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
 
+    /* frames are delivered through the RX ring, just wait for them */
+    if (sock->prot.packet.ring && sock->prot.packet.ring->rx_frames)
+	return rt_packet_ring_wait(sock, msg_flags);
+
     msg = rtnet_get_arg(fd, &_msg, u_msg, sizeof(_msg));
     if (IS_ERR(msg))
 	    return PTR_ERR(msg);
@@ -414,88 +661,68 @@ fail:
 
 
 /***
- *  rt_packet_sendmsg
+ *  rt_packet_get_dest - resolve the destination of an outgoing message
+ *
+ *  Returns 1 if the destination address was passed by the caller, 0 if the
+ *  socket binding applies, or a negative error code.
  */
-static ssize_t
-rt_packet_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg, int msg_flags)
+static int rt_packet_get_dest(struct rtdm_fd *fd, struct rtsocket *sock,
+			      const struct user_msghdr *msg,
+			      struct sockaddr_ll *dest)
 {
-    struct rtsocket     *sock = rtdm_fd_to_private(fd);
-    size_t              len;
-    struct sockaddr_ll  _sll, *sll;
-    struct rtnet_device *rtdev;
-    struct rtskb        *rtskb;
-    unsigned short      proto;
-    unsigned char       *addr;
-    int                 ifindex;
-    ssize_t             ret;
-    struct user_msghdr _msg;
-    struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+    struct sockaddr_ll *sll;
 
-    if (msg_flags & MSG_OOB)    /* Mirror BSD error message compatibility */
-	return -EOPNOTSUPP;
-    if (msg_flags & ~MSG_DONTWAIT)
-	return -EINVAL;
+    if (msg->msg_name == NULL) {
+	/* Note: We do not care about races with rt_packet_bind here -
+	   the user has to do so. */
+	dest->sll_ifindex  = sock->prot.packet.ifindex;
+	dest->sll_protocol = sock->prot.packet.packet_type.type;
+	return 0;
+    }
 
-    msg = rtnet_get_arg(fd, &_msg, msg, sizeof(*msg));
-    if (IS_ERR(msg))
-	    return PTR_ERR(msg);
+    sll = rtnet_get_arg(fd, dest, msg->msg_name, sizeof(*dest));
+    if (IS_ERR(sll))
+	return PTR_ERR(sll);
 
-    if (msg->msg_iovlen < 0)
-	    return -EINVAL;
+    if ((msg->msg_namelen < sizeof(struct sockaddr_ll)) ||
+	(msg->msg_namelen <
+	 (sll->sll_halen + offsetof(struct sockaddr_ll, sll_addr))) ||
+	((sll->sll_family != AF_PACKET) &&
+	 (sll->sll_family != AF_UNSPEC)))
+	return -EINVAL;
 
-    if (msg->msg_iovlen == 0)
-	    return 0;
-    
-    ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
-    if (ret)
-	    return ret;
+    if (sll != dest)
+	*dest = *sll;
 
-    if (msg->msg_name == NULL) {
-	/* Note: We do not care about races with rt_packet_bind here -
-	   the user has to do so. */
-	ifindex = sock->prot.packet.ifindex;
-	proto   = sock->prot.packet.packet_type.type;
-	addr    = NULL;
-	sll = NULL;
-    } else {
-	    sll = rtnet_get_arg(fd, &_sll, msg->msg_name, sizeof(_sll));
-	    if (IS_ERR(sll)) {
-		    ret = PTR_ERR(sll);
-		    goto abort;
-	    }
+    return 1;
+}
 
-	    if ((msg->msg_namelen < sizeof(struct sockaddr_ll)) ||
-		(msg->msg_namelen <
-		 (sll->sll_halen + offsetof(struct sockaddr_ll, sll_addr))) ||
-		((sll->sll_family != AF_PACKET) &&
-		 (sll->sll_family != AF_UNSPEC))) {
-		    ret = -EINVAL;
-		    goto abort;
-	    }
 
-	    ifindex = sll->sll_ifindex;
-	    proto   = sll->sll_protocol;
-	    addr    = sll->sll_addr;
-    }
 
-    if ((rtdev = rtdev_get_by_index(ifindex)) == NULL) {
-	    ret = -ENODEV;
-	    goto abort;
-    }
+/***
+ *  rt_packet_alloc_xmit - allocate and prepare a rtskb for @len bytes
+ */
+static struct rtskb *rt_packet_alloc_xmit(struct rtdm_fd *fd,
+					  struct rtsocket *sock,
+					  struct rtnet_device *rtdev,
+					  const struct sockaddr_ll *sll,
+					  size_t len)
+{
+    struct rtskb        *rtskb;
+    int                 socket_type;
+    int                 ret;
+
+    socket_type = rtdm_fd_to_context(fd)->device->driver->socket_type;
 
-    len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
     rtskb = alloc_rtskb(rtdev->hard_header_len + len, &sock->skb_pool);
-    if (rtskb == NULL) {
-	ret = -ENOBUFS;
-	goto out;
-    }
+    if (rtskb == NULL)
+	return ERR_PTR(-ENOBUFS);
 
     /* If an RTmac discipline is active, this becomes a pure sanity check to
        avoid writing beyond rtskb boundaries. The hard check is then performed
        upon rtdev_xmit() by the discipline's xmit handler. */
     if (len > rtdev->mtu +
-	((rtdm_fd_to_context(fd)->device->driver->socket_type == SOCK_RAW) ?
-	    rtdev->hard_header_len : 0)) {
+	((socket_type == SOCK_RAW) ? rtdev->hard_header_len : 0)) {
 	ret = -EMSGSIZE;
 	goto err;
     }
@@ -514,15 +741,164 @@ rt_packet_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg, int msg_fla
 	int hdr_len;
 
 	ret = -EINVAL;
-	hdr_len = rtdev->hard_header(rtskb, rtdev, ntohs(proto),
-				     addr, NULL, len);
-	if (rtdm_fd_to_context(fd)->device->driver->socket_type != SOCK_DGRAM) {
+	hdr_len = rtdev->hard_header(rtskb, rtdev,
+				     ntohs(sll ? sll->sll_protocol :
+					   sock->prot.packet.packet_type.type),
+				     sll ? (void *)sll->sll_addr : NULL,
+				     NULL, len);
+	if (socket_type != SOCK_DGRAM) {
 	    rtskb->tail = rtskb->data;
 	    rtskb->len = 0;
 	} else if (hdr_len < 0)
 	    goto err;
     }
 
+    return rtskb;
+
+ err:
+    kfree_rtskb(rtskb);
+    return ERR_PTR(ret);
+}
+
+
+
+/***
+ *  rt_packet_ring_xmit - send all frames userland queued in the TX ring
+ */
+static ssize_t rt_packet_ring_xmit(struct rtdm_fd *fd, struct rtsocket *sock,
+				   struct rtpacket_ring *ring,
+				   const struct user_msghdr *msg)
+{
+    struct rtnet_packet_frame *frame;
+    struct sockaddr_ll  dest;
+    struct rtnet_device *rtdev;
+    struct rtskb        *rtskb;
+    unsigned int        n, len;
+    ssize_t             ret, sent = 0;
+    int                 err;
+
+    ret = rt_packet_get_dest(fd, sock, msg, &dest);
+    if (ret < 0)
+	return ret;
+
+    if ((rtdev = rtdev_get_by_index(dest.sll_ifindex)) == NULL)
+	return -ENODEV;
+
+    if ((rtdev->flags & IFF_UP) == 0) {
+	ret = -ENETDOWN;
+	goto out;
+    }
+
+    /* Concurrent flushes must not pick up the same frames. */
+    err = rtdm_mutex_lock(&ring->tx_lock);
+    if (err) {
+	ret = err;
+	goto out;
+    }
+
+    for (n = 0; n < ring->tx_frames; n++) {
+	frame = tx_frame(ring, ring->tx_head);
+	if (READ_ONCE(frame->status) != RTNET_PACKET_STATUS_SEND_REQUEST)
+	    break;
+	/* Read the frame only after userland released it. */
+	smp_rmb();
+
+	len = frame->len;
+	if (len == 0 || len > ring->frame_size - RTNET_PACKET_FRAME_HDRLEN)
+	    rtskb = ERR_PTR(-EINVAL);
+	else
+	    rtskb = rt_packet_alloc_xmit(fd, sock, rtdev,
+					 ret ? &dest : NULL, len);
+	if (IS_ERR(rtskb)) {
+	    if (PTR_ERR(rtskb) == -ENOBUFS) {
+		/* Leave the frame queued, it may be flushed later. */
+		if (sent == 0)
+		    sent = -ENOBUFS;
+		break;
+	    }
+	    WRITE_ONCE(frame->status, RTNET_PACKET_STATUS_WRONG_FORMAT);
+	} else {
+	    memcpy(rtskb_put(rtskb, len),
+		   (void *)frame + RTNET_PACKET_FRAME_HDRLEN, len);
+
+	    if (rtdev_xmit(rtskb) != 0) {
+		WRITE_ONCE(frame->status, RTNET_PACKET_STATUS_WRONG_FORMAT);
+	    } else {
+		smp_mb();
+		WRITE_ONCE(frame->status, RTNET_PACKET_STATUS_AVAILABLE);
+		if (sent >= 0)
+		    sent += len;
+	    }
+	}
+
+	if (++ring->tx_head == ring->tx_frames)
+	    ring->tx_head = 0;
+    }
+
+    rtdm_mutex_unlock(&ring->tx_lock);
+
+    ret = sent;
+ out:
+    rtdev_dereference(rtdev);
+
+    return ret;
+}
+
+
+
+/***
+ *  rt_packet_sendmsg
+ */
+static ssize_t
+rt_packet_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg, int msg_flags)
+{
+    struct rtsocket     *sock = rtdm_fd_to_private(fd);
+    struct rtpacket_ring *ring = sock->prot.packet.ring;
+    size_t              len;
+    struct sockaddr_ll  sll;
+    struct rtnet_device *rtdev;
+    struct rtskb        *rtskb;
+    ssize_t             ret;
+    struct user_msghdr _msg;
+    struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+
+    if (msg_flags & MSG_OOB)    /* Mirror BSD error message compatibility */
+	return -EOPNOTSUPP;
+    if (msg_flags & ~MSG_DONTWAIT)
+	return -EINVAL;
+
+    msg = rtnet_get_arg(fd, &_msg, msg, sizeof(*msg));
+    if (IS_ERR(msg))
+	    return PTR_ERR(msg);
+
+    if (msg->msg_iovlen < 0)
+	    return -EINVAL;
+
+    /* an empty message flushes the TX ring */
+    if (msg->msg_iovlen == 0)
+	    return (ring && ring->tx_frames) ?
+		    rt_packet_ring_xmit(fd, sock, ring, msg) : 0;
+    
+    ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+    if (ret)
+	    return ret;
+
+    ret = rt_packet_get_dest(fd, sock, msg, &sll);
+    if (ret < 0)
+	    goto abort;
+
+    if ((rtdev = rtdev_get_by_index(sll.sll_ifindex)) == NULL) {
+	    ret = -ENODEV;
+	    goto abort;
+    }
+
+    len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
+    rtskb = rt_packet_alloc_xmit(fd, sock, rtdev, ret ? &sll : NULL, len);
+    if (IS_ERR(rtskb)) {
+	ret = PTR_ERR(rtskb);
+	goto out;
+    }
+
     ret = rtnet_read_from_iov(fd, iov, msg->msg_iovlen, rtskb_put(rtskb, len), len);
 
     if ((rtdev->flags & IFF_UP) != 0) {
@@ -567,6 +943,7 @@ static struct rtdm_driver packet_proto_drv = {
 	.recvmsg_rt =   rt_packet_recvmsg,
 	.sendmsg_rt =   rt_packet_sendmsg,
 	.select =       rt_socket_select_bind,
+	.mmap =         rt_packet_mmap,
     },
 };
 
@@ -596,6 +973,7 @@ static struct rtdm_driver raw_packet_proto_drv = {
 	.recvmsg_rt =   rt_packet_recvmsg,
 	.sendmsg_rt =   rt_packet_sendmsg,
 	.select =       rt_socket_select_bind,
+	.mmap =         rt_packet_mmap,
     },
 };
 
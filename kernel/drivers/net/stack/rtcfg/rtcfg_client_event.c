@@ -35,6 +35,8 @@ static void rtcfg_client_recv_stage_1(int ifindex, struct rtskb *rtskb);
 static int rtcfg_client_recv_announce(int ifindex, struct rtskb *rtskb);
 static void rtcfg_client_recv_stage_2_cfg(int ifindex, struct rtskb *rtskb);
 static void rtcfg_client_recv_stage_2_frag(int ifindex, struct rtskb *rtskb);
+static void rtcfg_client_recv_stage_2_mfrag(int ifindex, struct rtskb *rtskb);
+static void rtcfg_client_recv_stage_2_dup(int ifindex, struct rtskb *rtskb);
 static int rtcfg_client_recv_ready(int ifindex, struct rtskb *rtskb);
 static void rtcfg_client_recv_dead_station(int ifindex, struct rtskb *rtskb);
 static void rtcfg_client_update_server(int ifindex, struct rtskb *rtskb);
@@ -69,6 +71,10 @@ int rtcfg_main_state_client_0(int ifindex, RTCFG_EVENT event_id,
                 rtdm_mutex_unlock(&device[ifindex].dev_mutex);
             break;
 
+        case RTCFG_FRM_STAGE_2_CFG_MFRAG:
+            rtcfg_client_recv_stage_2_dup(ifindex, rtskb);
+            break;
+
         default:
             rtdm_mutex_unlock(&device[ifindex].dev_mutex);
             RTCFG_DEBUG(1, "RTcfg: unknown event %s for rtdev %d in %s()\n",
@@ -113,8 +119,11 @@ int rtcfg_main_state_client_1(int ifindex, RTCFG_EVENT event_id,
             rtcfg_queue_blocking_call(ifindex,
                 (struct rt_proc_call *)event_data);
 
-	    if (cmd_event->args.announce.flags & _RTCFG_FLAG_STAGE_2_DATA)
+	    if (cmd_event->args.announce.flags & _RTCFG_FLAG_STAGE_2_DATA) {
 		set_bit(RTCFG_FLAG_STAGE_2_DATA, &rtcfg_dev->flags);
+		/* we can take the data from a shared transfer */
+		set_bit(RTCFG_FLAG_MCAST, &rtcfg_dev->flags);
+	    }
 	    if (cmd_event->args.announce.flags & _RTCFG_FLAG_READY)
 		set_bit(RTCFG_FLAG_READY, &rtcfg_dev->flags);
             if (cmd_event->args.announce.burstrate < rtcfg_dev->burstrate)
@@ -165,6 +174,10 @@ int rtcfg_main_state_client_1(int ifindex, RTCFG_EVENT event_id,
             kfree_rtskb(rtskb);
             break;
 
+        case RTCFG_FRM_STAGE_2_CFG_MFRAG:
+            rtcfg_client_recv_stage_2_dup(ifindex, rtskb);
+            break;
+
         default:
             rtdm_mutex_unlock(&rtcfg_dev->dev_mutex);
             RTCFG_DEBUG(1, "RTcfg: unknown event %s for rtdev %d in %s()\n",
@@ -200,6 +213,18 @@ int rtcfg_main_state_client_announced(int ifindex, RTCFG_EVENT event_id,
             rtcfg_client_recv_stage_2_frag(ifindex, rtskb);
             break;
 
+        case RTCFG_FRM_STAGE_2_CFG_MC:
+            /* repeated by the server if our first ACK got lost */
+            if (device[ifindex].spec.clt.mc_session != 0)
+                rtcfg_client_recv_stage_2_dup(ifindex, rtskb);
+            else
+                rtcfg_client_recv_stage_2_cfg(ifindex, rtskb);
+            break;
+
+        case RTCFG_FRM_STAGE_2_CFG_MFRAG:
+            rtcfg_client_recv_stage_2_mfrag(ifindex, rtskb);
+            break;
+
         case RTCFG_FRM_ANNOUNCE_NEW:
             if (rtcfg_client_recv_announce(ifindex, rtskb) == 0) {
                 rtcfg_send_announce_reply(ifindex,
@@ -268,6 +293,14 @@ int rtcfg_main_state_client_all_known(int ifindex, RTCFG_EVENT event_id,
             rtcfg_client_recv_stage_2_frag(ifindex, rtskb);
             break;
 
+        case RTCFG_FRM_STAGE_2_CFG_MC:
+            rtcfg_client_recv_stage_2_dup(ifindex, rtskb);
+            break;
+
+        case RTCFG_FRM_STAGE_2_CFG_MFRAG:
+            rtcfg_client_recv_stage_2_mfrag(ifindex, rtskb);
+            break;
+
         case RTCFG_FRM_READY:
             if (rtcfg_client_recv_ready(ifindex, rtskb) == 0)
                 rtdm_mutex_unlock(&device[ifindex].dev_mutex);
@@ -370,6 +403,11 @@ int rtcfg_main_state_client_all_frames(int ifindex, RTCFG_EVENT event_id,
             kfree_rtskb(rtskb);
             break;
 
+        case RTCFG_FRM_STAGE_2_CFG_MC:
+        case RTCFG_FRM_STAGE_2_CFG_MFRAG:
+            rtcfg_client_recv_stage_2_dup(ifindex, rtskb);
+            break;
+
         default:
             rtdm_mutex_unlock(&device[ifindex].dev_mutex);
             RTCFG_DEBUG(1, "RTcfg: unknown event %s for rtdev %d in %s()\n",
@@ -434,6 +472,11 @@ int rtcfg_main_state_client_2(int ifindex, RTCFG_EVENT event_id,
             kfree_rtskb(rtskb);
             break;
 
+        case RTCFG_FRM_STAGE_2_CFG_MC:
+        case RTCFG_FRM_STAGE_2_CFG_MFRAG:
+            rtcfg_client_recv_stage_2_dup(ifindex, rtskb);
+            break;
+
         default:
             rtdm_mutex_unlock(&device[ifindex].dev_mutex);
             RTCFG_DEBUG(1, "RTcfg: unknown event %s for rtdev %d in %s()\n",
@@ -485,6 +528,11 @@ int rtcfg_main_state_client_ready(int ifindex, RTCFG_EVENT event_id,
             rtcfg_client_update_server(ifindex, rtskb);
             break;
 
+        case RTCFG_FRM_STAGE_2_CFG_MC:
+        case RTCFG_FRM_STAGE_2_CFG_MFRAG:
+            rtcfg_client_recv_stage_2_dup(ifindex, rtskb);
+            break;
+
         default:
             rtdm_mutex_unlock(&device[ifindex].dev_mutex);
             RTCFG_DEBUG(1, "RTcfg: unknown event %s for rtdev %d in %s()\n",
@@ -508,6 +556,7 @@ static int rtcfg_client_get_frag(int ifindex, struct rt_proc_call *call)
     }
 
     rtcfg_send_ack(ifindex);
+    rtcfg_dev->spec.clt.unacked = 0;
 
     if (rtcfg_dev->spec.clt.cfg_offs >= rtcfg_dev->spec.clt.cfg_len) {
         if (rtcfg_dev->stations_found == rtcfg_dev->other_stations) {
@@ -554,6 +603,7 @@ static void rtcfg_client_detach(int ifindex, struct rt_proc_call *call)
 
     if (test_and_clear_bit(FLAG_TIMER_STARTED, &rtcfg_dev->flags))
         rtdm_timer_destroy(&rtcfg_dev->timer);
+    rtcfg_client_drop_ooo(ifindex);
     rtcfg_reset_device(ifindex);
 
     rtcfg_next_main_state(cmd_event->internal.data.ifindex, RTCFG_MAIN_OFF);
@@ -866,19 +916,30 @@ static void rtcfg_client_recv_stage_2_cfg(int ifindex, struct rtskb *rtskb)
 {
     struct rtcfg_frm_stage_2_cfg *stage_2_cfg;
     struct rtcfg_device          *rtcfg_dev = &device[ifindex];
+    size_t                       hdr_len;
     size_t                       data_len;
     int                          ret;
 
 
-    if (rtskb->len < sizeof(struct rtcfg_frm_stage_2_cfg)) {
+    stage_2_cfg = (struct rtcfg_frm_stage_2_cfg *)rtskb->data;
+
+    /* the shared variant only appends the session to the header */
+    hdr_len = (stage_2_cfg->head.id == RTCFG_ID_STAGE_2_CFG_MC) ?
+        sizeof(struct rtcfg_frm_stage_2_cfg_mc) :
+        sizeof(struct rtcfg_frm_stage_2_cfg);
+
+    if (rtskb->len < hdr_len) {
         rtdm_mutex_unlock(&rtcfg_dev->dev_mutex);
         RTCFG_DEBUG(1, "RTcfg: received invalid stage_2_cfg frame\n");
         kfree_rtskb(rtskb);
         return;
     }
 
-    stage_2_cfg = (struct rtcfg_frm_stage_2_cfg *)rtskb->data;
-    __rtskb_pull(rtskb, sizeof(struct rtcfg_frm_stage_2_cfg));
+    if (stage_2_cfg->head.id == RTCFG_ID_STAGE_2_CFG_MC)
+        rtcfg_dev->spec.clt.mc_session =
+            ntohl(((struct rtcfg_frm_stage_2_cfg_mc *)stage_2_cfg)->session);
+
+    __rtskb_pull(rtskb, hdr_len);
 
     if (stage_2_cfg->heartbeat_period) {
 	ret = rtdm_timer_init(&rtcfg_dev->timer, rtcfg_timer, "rtcfg-timer");
@@ -913,6 +974,7 @@ static void rtcfg_client_recv_stage_2_cfg(int ifindex, struct rtskb *rtskb)
 
     if (test_bit(RTCFG_FLAG_STAGE_2_DATA, &rtcfg_dev->flags) &&
         (data_len > 0)) {
+        rtcfg_dev->spec.clt.unacked = 1;
         rtcfg_client_queue_frag(ifindex, rtskb, data_len);
         rtskb = NULL;
 
@@ -984,6 +1046,188 @@ static void rtcfg_client_recv_stage_2_frag(int ifindex, struct rtskb *rtskb)
 
 
 
+static inline u32 rtcfg_mfrag_offs(struct rtskb *rtskb)
+{
+    return ntohl(((struct rtcfg_frm_stage_2_cfg_mfrag *)rtskb->data)->frag_offs);
+}
+
+
+
+void rtcfg_client_drop_ooo(int ifindex)
+{
+    struct rtcfg_device *rtcfg_dev = &device[ifindex];
+    struct rtskb        *rtskb;
+
+
+    while ((rtskb = rtcfg_dev->spec.clt.stage2_ooo) != NULL) {
+        rtcfg_dev->spec.clt.stage2_ooo = rtskb->next;
+        rtskb->next = NULL;
+        kfree_rtskb(rtskb);
+    }
+    rtcfg_dev->spec.clt.ooo_count = 0;
+}
+
+
+
+static void rtcfg_client_queue_mfrag(int ifindex, struct rtskb *rtskb)
+{
+    struct rtcfg_device *rtcfg_dev = &device[ifindex];
+
+
+    __rtskb_pull(rtskb, sizeof(struct rtcfg_frm_stage_2_cfg_mfrag));
+
+    rtcfg_dev->spec.clt.unacked++;
+    rtcfg_client_queue_frag(ifindex, rtskb,
+        MIN(rtcfg_dev->spec.clt.cfg_len - rtcfg_dev->spec.clt.cfg_offs,
+            rtskb->len));
+}
+
+
+
+/* Fragments arriving ahead of a gap are kept sorted by offset, at most
+ * burstrate of them. Returns non-zero for fragments we already hold. */
+static int rtcfg_client_hold_mfrag(int ifindex, struct rtskb *rtskb)
+{
+    struct rtcfg_device *rtcfg_dev = &device[ifindex];
+    struct rtskb        **pos = &rtcfg_dev->spec.clt.stage2_ooo;
+    u32                 offs = rtcfg_mfrag_offs(rtskb);
+
+
+    while ((*pos != NULL) && (rtcfg_mfrag_offs(*pos) < offs))
+        pos = &(*pos)->next;
+
+    if ((*pos != NULL) && (rtcfg_mfrag_offs(*pos) == offs)) {
+        kfree_rtskb(rtskb);
+        return 1;
+    }
+
+    if (rtcfg_dev->spec.clt.ooo_count >= rtcfg_dev->burstrate) {
+        kfree_rtskb(rtskb);
+        return 0;
+    }
+
+    rtskb->next = *pos;
+    *pos = rtskb;
+    rtcfg_dev->spec.clt.ooo_count++;
+
+    return 0;
+}
+
+
+
+static void rtcfg_client_drain_ooo(int ifindex)
+{
+    struct rtcfg_device *rtcfg_dev = &device[ifindex];
+    struct rtskb        *rtskb;
+    u32                 offs;
+
+
+    while (((rtskb = rtcfg_dev->spec.clt.stage2_ooo) != NULL) &&
+           (rtcfg_dev->spec.clt.unacked < rtcfg_dev->burstrate)) {
+        offs = rtcfg_mfrag_offs(rtskb);
+        if (offs > rtcfg_dev->spec.clt.cfg_offs)
+            break;
+
+        rtcfg_dev->spec.clt.stage2_ooo = rtskb->next;
+        rtcfg_dev->spec.clt.ooo_count--;
+        rtskb->next = NULL;
+
+        if (offs == rtcfg_dev->spec.clt.cfg_offs)
+            rtcfg_client_queue_mfrag(ifindex, rtskb);
+        else
+            kfree_rtskb(rtskb);
+    }
+}
+
+
+
+/* Reports the gap in front of the held fragments, once per gap unless
+ * forced by a repeated fragment. */
+static void rtcfg_client_check_gap(int ifindex, u32 offs, int force)
+{
+    struct rtcfg_device *rtcfg_dev = &device[ifindex];
+    u32                 cfg_offs = rtcfg_dev->spec.clt.cfg_offs;
+
+
+    if (rtcfg_dev->spec.clt.stage2_ooo != NULL)
+        offs = rtcfg_mfrag_offs(rtcfg_dev->spec.clt.stage2_ooo);
+
+    if ((offs <= cfg_offs) ||
+        (!force && (rtcfg_dev->spec.clt.nack_offs == cfg_offs)))
+        return;
+
+    rtcfg_send_nack(ifindex, cfg_offs, offs - cfg_offs);
+    rtcfg_dev->spec.clt.nack_offs = cfg_offs;
+}
+
+
+
+static void rtcfg_client_recv_stage_2_mfrag(int ifindex, struct rtskb *rtskb)
+{
+    struct rtcfg_frm_stage_2_cfg_mfrag *stage_2_frag;
+    struct rtcfg_device                *rtcfg_dev = &device[ifindex];
+    u32                                offs;
+
+
+    if (rtskb->len < sizeof(struct rtcfg_frm_stage_2_cfg_mfrag)) {
+        rtdm_mutex_unlock(&rtcfg_dev->dev_mutex);
+        RTCFG_DEBUG(1, "RTcfg: received invalid stage_2_cfg_mfrag frame\n");
+        kfree_rtskb(rtskb);
+        return;
+    }
+
+    stage_2_frag = (struct rtcfg_frm_stage_2_cfg_mfrag *)rtskb->data;
+    offs = ntohl(stage_2_frag->frag_offs);
+
+    if ((test_bit(RTCFG_FLAG_STAGE_2_DATA, &rtcfg_dev->flags) == 0) ||
+        (ntohl(stage_2_frag->session) != rtcfg_dev->spec.clt.mc_session)) {
+        /* transfer to other stations */
+        rtdm_mutex_unlock(&rtcfg_dev->dev_mutex);
+        kfree_rtskb(rtskb);
+        return;
+    }
+
+    if (offs < rtcfg_dev->spec.clt.cfg_offs) {
+        rtcfg_client_recv_stage_2_dup(ifindex, rtskb);
+        return;
+    }
+
+    if (rtcfg_dev->spec.clt.unacked >= rtcfg_dev->burstrate)
+        /* beyond our window, the server will repeat it */
+        kfree_rtskb(rtskb);
+    else if (offs == rtcfg_dev->spec.clt.cfg_offs) {
+        rtcfg_client_queue_mfrag(ifindex, rtskb);
+        rtcfg_client_drain_ooo(ifindex);
+        rtcfg_client_check_gap(ifindex, 0, 0);
+    } else
+        rtcfg_client_check_gap(ifindex, offs,
+                               rtcfg_client_hold_mfrag(ifindex, rtskb));
+
+    rtdm_mutex_unlock(&rtcfg_dev->dev_mutex);
+}
+
+
+
+/* Repeated shared stage 2 frames. A unicast one is the server probing
+ * us, so our last ACK may have been lost - unless the application did
+ * not fetch the last burst yet and thus did not acknowledge it. */
+static void rtcfg_client_recv_stage_2_dup(int ifindex, struct rtskb *rtskb)
+{
+    struct rtcfg_device *rtcfg_dev = &device[ifindex];
+
+
+    if ((rtskb->pkt_type == PACKET_HOST) &&
+        (rtcfg_dev->spec.clt.mc_session != 0) &&
+        (rtcfg_dev->spec.clt.unacked == 0))
+        rtcfg_send_ack(ifindex);
+
+    rtdm_mutex_unlock(&rtcfg_dev->dev_mutex);
+
+    kfree_rtskb(rtskb);
+}
+
+
+
 /* Notes:
  *  o On success, rtcfg_client_recv_ready returns without releasing the
  *    device lock.
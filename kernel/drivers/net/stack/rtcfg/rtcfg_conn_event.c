@@ -59,6 +59,10 @@ static void rtcfg_conn_recv_announce_new(struct rtcfg_connection *conn,
                                          struct rtskb *rtskb);
 static void rtcfg_conn_check_cfg_timeout(struct rtcfg_connection *conn);
 static void rtcfg_conn_check_heartbeat(struct rtcfg_connection *conn);
+static void rtcfg_conn_mc_send(struct rtcfg_connection *conn);
+static void rtcfg_conn_mc_resend(struct rtcfg_connection *conn, u32 offs,
+                                 u32 end);
+static void rtcfg_conn_mc_probe(struct rtcfg_connection *conn);
 
 
 
@@ -74,6 +78,23 @@ static int (*state[])(struct rtcfg_connection *conn, RTCFG_EVENT event_id,
 
 
 
+/*
+ * Shared stage 2 transfers: clients announcing _RTCFG_FLAG_MCAST receive
+ * the configuration data in frames which carry the session of the file,
+ * so that stations loading the same file concurrently can be served by
+ * broadcasting each fragment once. Every connection keeps the offset up
+ * to which the data was sent to it (mc_offs) next to the acknowledged
+ * one (cfg_offs). Losses are reported by the clients via NACK frames or
+ * detected by the timer, and repaired by unicast retransmissions.
+ */
+static inline int rtcfg_conn_is_mc(struct rtcfg_connection *conn)
+{
+    return (conn->flags & (_RTCFG_FLAG_STAGE_2_DATA | _RTCFG_FLAG_MCAST)) ==
+        (_RTCFG_FLAG_STAGE_2_DATA | _RTCFG_FLAG_MCAST);
+}
+
+
+
 int rtcfg_do_conn_event(struct rtcfg_connection *conn, RTCFG_EVENT event_id,
                         void* event_data)
 {
@@ -141,6 +162,8 @@ static int rtcfg_conn_state_stage_1(struct rtcfg_connection *conn,
     struct rtskb             *rtskb     = (struct rtskb *)event_data;
     struct rtcfg_device      *rtcfg_dev = &device[conn->ifindex];
     struct rtcfg_frm_ack_cfg *ack_cfg;
+    struct rtcfg_frm_nack_cfg *nack_cfg;
+    u32                      offs;
     int                      packets;
 
 
@@ -149,7 +172,11 @@ static int rtcfg_conn_state_stage_1(struct rtcfg_connection *conn,
             conn->last_frame = rtskb->time_stamp;
 
             ack_cfg = (struct rtcfg_frm_ack_cfg *)rtskb->data;
-            conn->cfg_offs = ntohl(ack_cfg->ack_len);
+            offs    = ntohl(ack_cfg->ack_len);
+
+            /* Shared transfers may reorder acknowledgements. */
+            if (!rtcfg_conn_is_mc(conn) || offs > conn->cfg_offs)
+                conn->cfg_offs = offs;
 
             if ((conn->flags & _RTCFG_FLAG_STAGE_2_DATA) != 0) {
                 if (conn->cfg_offs >= conn->stage2_file->size) {
@@ -160,7 +187,9 @@ static int rtcfg_conn_state_stage_1(struct rtcfg_connection *conn,
                     rtcfg_next_conn_state(conn,
                         ((conn->flags & _RTCFG_FLAG_READY) != 0) ?
                         RTCFG_CONN_READY : RTCFG_CONN_STAGE_2);
-                } else {
+                } else if (rtcfg_conn_is_mc(conn))
+                    rtcfg_conn_mc_send(conn);
+                else {
                     packets = conn->burstrate;
                     while ((conn->cfg_offs < conn->stage2_file->size) &&
                         (packets > 0)) {
@@ -180,8 +209,23 @@ static int rtcfg_conn_state_stage_1(struct rtcfg_connection *conn,
 
             break;
 
+        case RTCFG_FRM_NACK_CFG:
+            conn->last_frame = rtskb->time_stamp;
+
+            if (rtcfg_conn_is_mc(conn)) {
+                nack_cfg = (struct rtcfg_frm_nack_cfg *)rtskb->data;
+                offs     = ntohl(nack_cfg->frag_offs);
+                rtcfg_conn_mc_resend(conn, offs,
+                                     offs + ntohl(nack_cfg->frag_len));
+            }
+            break;
+
         case RTCFG_TIMER:
             rtcfg_conn_check_cfg_timeout(conn);
+            if ((conn->state == RTCFG_CONN_STAGE_1) && rtcfg_conn_is_mc(conn)) {
+                rtcfg_conn_mc_probe(conn);
+                rtcfg_conn_mc_send(conn);
+            }
             break;
 
         default:
@@ -304,6 +348,12 @@ static void rtcfg_conn_recv_announce_new(struct rtcfg_connection *conn,
 
         rtcfg_send_stage_2(conn, 1);
 
+        if (rtcfg_conn_is_mc(conn)) {
+            /* join the stations currently loading the same file */
+            rtcfg_conn_mc_send(conn);
+            return;
+        }
+
         while ((conn->cfg_offs < conn->stage2_file->size) &&
             (packets > 0)) {
             rtcfg_send_stage_2_frag(conn);
@@ -394,3 +444,154 @@ static void rtcfg_conn_check_heartbeat(struct rtcfg_connection *conn)
 #endif /* CONFIG_XENO_DRIVERS_NET_RTIPV4 */
     }
 }
+
+
+
+static unsigned int rtcfg_conn_mc_frag_size(int ifindex)
+{
+    struct rtnet_device *rtdev;
+    unsigned int        frag_size;
+
+
+    rtdev = rtdev_get_by_index(ifindex);
+    if (rtdev == NULL)
+        return 0;
+
+    frag_size = rtdev->get_mtu(rtdev, RTCFG_SKB_PRIO) -
+        sizeof(struct rtcfg_frm_stage_2_cfg_mfrag);
+
+    rtdev_dereference(rtdev);
+
+    return frag_size;
+}
+
+
+
+/* Stations which did not respond during the last period do not slow down
+ * the others, they are caught up via retransmissions. */
+static int rtcfg_conn_mc_active(struct rtcfg_connection *conn,
+                                struct rtcfg_file *file, nanosecs_abs_t now)
+{
+    return (conn->state == RTCFG_CONN_STAGE_1) && rtcfg_conn_is_mc(conn) &&
+        (conn->stage2_file == file) && (conn->mc_offs < file->size) &&
+        (now < conn->last_frame + device[conn->ifindex].spec.srv.period);
+}
+
+
+
+/*
+ * Streams the file to all active stations loading it. Stations sharing
+ * the same transmission offset are served by a single frame, broadcast
+ * if there is more than one of them. The stream lagging behind always
+ * goes first, so that late-comers catch up with and merge into the
+ * stream ahead. No station gets more than burstrate frames beyond its
+ * last acknowledgement.
+ */
+static void rtcfg_conn_mc_send(struct rtcfg_connection *conn)
+{
+    struct rtcfg_device     *rtcfg_dev = &device[conn->ifindex];
+    struct rtcfg_file       *file = conn->stage2_file;
+    struct rtcfg_connection *member;
+    nanosecs_abs_t          now = rtdm_clock_read();
+    unsigned int            frag_size;
+    unsigned int            members;
+    u8                      *dest_addr = NULL;
+    u32                     offs;
+    int                     ret;
+
+
+    frag_size = rtcfg_conn_mc_frag_size(conn->ifindex);
+    if (frag_size == 0)
+        return;
+
+    while (1) {
+        offs = file->size;
+        list_for_each_entry(member, &rtcfg_dev->spec.srv.conn_list, entry)
+            if (rtcfg_conn_mc_active(member, file, now) &&
+                (member->mc_offs < offs))
+                offs = member->mc_offs;
+
+        if (offs >= file->size)
+            return;
+
+        members = 0;
+        list_for_each_entry(member, &rtcfg_dev->spec.srv.conn_list, entry) {
+            if (!rtcfg_conn_mc_active(member, file, now) ||
+                (member->mc_offs != offs))
+                continue;
+
+            /* window exhausted, wait for the acknowledgement */
+            if (offs + frag_size >
+                member->cfg_offs + member->burstrate * frag_size)
+                return;
+
+            dest_addr = member->mac_addr;
+            members++;
+        }
+
+        ret = rtcfg_send_stage_2_mfrag(conn->ifindex, file, offs,
+                                       (members > 1) ? NULL : dest_addr);
+        if (ret < 0)
+            return;
+
+        list_for_each_entry(member, &rtcfg_dev->spec.srv.conn_list, entry)
+            if (rtcfg_conn_mc_active(member, file, now) &&
+                (member->mc_offs == offs)) {
+                member->mc_last = offs;
+                member->mc_offs = offs + ret;
+            }
+    }
+}
+
+
+
+/* Unicast retransmission of [offs, end), limited to the station's window. */
+static void rtcfg_conn_mc_resend(struct rtcfg_connection *conn, u32 offs,
+                                 u32 end)
+{
+    unsigned int frag_size;
+    int          packets = conn->burstrate;
+    int          ret;
+
+
+    frag_size = rtcfg_conn_mc_frag_size(conn->ifindex);
+    if (frag_size == 0)
+        return;
+
+    if (end > conn->mc_offs)
+        end = conn->mc_offs;
+
+    /* The initial frame cannot be requested, it carries the session. */
+    if ((offs == 0) || (offs < conn->cfg_offs))
+        return;
+
+    while ((offs < end) && (packets > 0)) {
+        ret = rtcfg_send_stage_2_mfrag(conn->ifindex, conn->stage2_file, offs,
+                                       conn->mac_addr);
+        if (ret < 0)
+            return;
+        offs += ret;
+        packets--;
+    }
+}
+
+
+
+/*
+ * A station which remained silent for a period although data is
+ * outstanding may have lost the tail of its last burst, or its
+ * acknowledgement got lost. Repeat the last frame, the station will
+ * respond with an ACK or a NACK.
+ */
+static void rtcfg_conn_mc_probe(struct rtcfg_connection *conn)
+{
+    if ((conn->mc_offs <= conn->cfg_offs) ||
+        (rtdm_clock_read() < conn->last_frame +
+         device[conn->ifindex].spec.srv.period))
+        return;
+
+    if (conn->mc_last == 0)
+        rtcfg_send_stage_2(conn, 1);
+    else
+        rtcfg_conn_mc_resend(conn, conn->mc_last, conn->mc_offs);
+}
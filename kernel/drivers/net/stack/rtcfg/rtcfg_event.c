@@ -62,7 +62,10 @@ const char *rtcfg_event[] = {
     "RTCFG_FRM_ACK_CFG",
     "RTCFG_FRM_READY",
     "RTCFG_FRM_HEARTBEAT",
-    "RTCFG_FRM_DEAD_STATION"
+    "RTCFG_FRM_DEAD_STATION",
+    "RTCFG_FRM_STAGE_2_CFG_MC",
+    "RTCFG_FRM_STAGE_2_CFG_MFRAG",
+    "RTCFG_FRM_NACK_CFG"
 };
 
 const char *rtcfg_main_state[] = {
@@ -102,7 +105,8 @@ static int rtcfg_server_del(struct rtcfg_cmd *cmd_event);
 static int rtcfg_server_detach(int ifindex, struct rtcfg_cmd *cmd_event);
 static int rtcfg_server_recv_announce(int ifindex, RTCFG_EVENT event_id,
 				      struct rtskb *rtskb);
-static int rtcfg_server_recv_ack(int ifindex, struct rtskb *rtskb);
+static int rtcfg_server_recv_ack(int ifindex, RTCFG_EVENT event_id,
+				 struct rtskb *rtskb);
 static int rtcfg_server_recv_simple_frame(int ifindex, RTCFG_EVENT event_id,
 					  struct rtskb *rtskb);
 
@@ -169,6 +173,9 @@ static int rtcfg_main_state_off(int ifindex, RTCFG_EVENT event_id,
 
 	    rtcfg_dev->burstrate = cmd_event->args.server.burstrate;
 
+	    rtcfg_dev->spec.srv.period =
+		    ((u64)cmd_event->args.server.period) * 1000000;
+
 	    rtcfg_dev->spec.srv.heartbeat = cmd_event->args.server.heartbeat;
 
 	    rtcfg_dev->spec.srv.heartbeat_timeout =
@@ -278,8 +285,15 @@ static int rtcfg_main_state_server_running(int ifindex, RTCFG_EVENT event_id,
 	    return rtcfg_server_recv_announce(ifindex, event_id, rtskb);
 
 	case RTCFG_FRM_ACK_CFG:
+	case RTCFG_FRM_NACK_CFG:
 	    rtskb = (struct rtskb *)event_data;
-	    return rtcfg_server_recv_ack(ifindex, rtskb);
+	    return rtcfg_server_recv_ack(ifindex, event_id, rtskb);
+
+	case RTCFG_FRM_STAGE_2_CFG_MFRAG:
+	    /* our own broadcast, looped back */
+	    rtdm_mutex_unlock(&device[ifindex].dev_mutex);
+	    kfree_rtskb((struct rtskb *)event_data);
+	    break;
 
 	case RTCFG_FRM_READY:
 	case RTCFG_FRM_HEARTBEAT:
@@ -570,14 +584,17 @@ out:
 
 
 
-static int rtcfg_server_recv_ack(int ifindex, struct rtskb *rtskb)
+static int rtcfg_server_recv_ack(int ifindex, RTCFG_EVENT event_id,
+				 struct rtskb *rtskb)
 {
     struct rtcfg_device     *rtcfg_dev = &device[ifindex];
     struct list_head        *entry;
     struct rtcfg_connection *conn;
 
 
-    if (rtskb->len < sizeof(struct rtcfg_frm_ack_cfg)) {
+    if (rtskb->len < ((event_id == RTCFG_FRM_ACK_CFG) ?
+		      sizeof(struct rtcfg_frm_ack_cfg) :
+		      sizeof(struct rtcfg_frm_nack_cfg))) {
 	rtdm_mutex_unlock(&rtcfg_dev->dev_mutex);
 	RTCFG_DEBUG(1, "RTcfg: received invalid ack_cfg frame\n");
 	return -EINVAL;
@@ -591,7 +608,7 @@ static int rtcfg_server_recv_ack(int ifindex, struct rtskb *rtskb)
 		   rtskb->mac.ethernet->h_source, ETH_ALEN) != 0)
 	    continue;
 
-	rtcfg_do_conn_event(conn, RTCFG_FRM_ACK_CFG, rtskb);
+	rtcfg_do_conn_event(conn, event_id, rtskb);
 
 	break;
     }
@@ -771,6 +788,8 @@ void rtcfg_cleanup_state_machines(void)
 
 	    if (rtcfg_dev->spec.clt.stage2_chain != NULL)
 		kfree_rtskb(rtcfg_dev->spec.clt.stage2_chain);
+
+	    rtcfg_client_drop_ooo(i);
 	}
 
 	while (1) {
@@ -37,6 +37,8 @@
  */
 LIST_HEAD(rtcfg_files);
 
+static u32 rtcfg_file_session;
+
 
 struct rtcfg_file *rtcfg_get_file(const char *filename)
 {
@@ -69,6 +71,12 @@ void rtcfg_add_file(struct rtcfg_file *file)
     RTCFG_DEBUG(4, "RTcfg: adding file %s to list\n", file->name);
 
     file->ref_count = 1;
+
+    /* zero is never used, clients start with it */
+    if (++rtcfg_file_session == 0)
+        rtcfg_file_session = 1;
+    file->session = rtcfg_file_session;
+
     list_add_tail(&file->entry, &rtcfg_files);
 }
 
@@ -79,15 +79,16 @@ static void rtcfg_rx_task(void *arg)
 		continue;
 	    }
 
-	    if (rtskb->len < sizeof(struct rtcfg_frm_head)) {
+	    frm_head = (struct rtcfg_frm_head *)rtskb->data;
+
+	    if ((rtskb->len < sizeof(struct rtcfg_frm_head)) ||
+		(frm_head->id > RTCFG_ID_MAX)) {
 		RTCFG_DEBUG(1, "RTcfg: %s() received an invalid frame\n",
 			    __FUNCTION__);
 		kfree_rtskb(rtskb);
 		continue;
 	    }
 
-	    frm_head = (struct rtcfg_frm_head *)rtskb->data;
-
 	    if (rtcfg_do_main_event(rtskb->rtdev->ifindex,
 				    frm_head->id + RTCFG_FRM_STAGE_1_CFG,
 				    rtskb) < 0)
@@ -206,25 +207,31 @@ int rtcfg_send_stage_2(struct rtcfg_connection *conn, int send_data)
     struct rtskb                 *rtskb;
     unsigned int                 rtskb_size;
     struct rtcfg_frm_stage_2_cfg *stage_2_frm;
+    size_t                       hdr_size;
     size_t                       total_size;
     size_t                       frag_size;
+    int                          shared;
 
 
     rtdev = rtdev_get_by_index(conn->ifindex);
     if (rtdev == NULL)
 	return -ENODEV;
 
+    shared = send_data &&
+	((conn->flags & _RTCFG_FLAG_MCAST) != 0);
+    hdr_size = shared ? sizeof(struct rtcfg_frm_stage_2_cfg_mc) :
+	sizeof(struct rtcfg_frm_stage_2_cfg);
+
     if (send_data) {
 	total_size = conn->stage2_file->size;
-	frag_size  = MIN(rtdev->get_mtu(rtdev, RTCFG_SKB_PRIO) -
-			 sizeof(struct rtcfg_frm_stage_2_cfg), total_size);
+	frag_size  = MIN(rtdev->get_mtu(rtdev, RTCFG_SKB_PRIO) - hdr_size,
+			 total_size);
     } else {
 	total_size = 0;
 	frag_size  = 0;
     }
 
-    rtskb_size = rtdev->hard_header_len +
-	sizeof(struct rtcfg_frm_stage_2_cfg) + frag_size;
+    rtskb_size = rtdev->hard_header_len + hdr_size + frag_size;
 
     rtskb = alloc_rtskb(rtskb_size, &rtcfg_pool);
     if (rtskb == NULL) {
@@ -234,10 +241,10 @@ int rtcfg_send_stage_2(struct rtcfg_connection *conn, int send_data)
 
     rtskb_reserve(rtskb, rtdev->hard_header_len);
 
-    stage_2_frm = (struct rtcfg_frm_stage_2_cfg *)
-	rtskb_put(rtskb, sizeof(struct rtcfg_frm_stage_2_cfg));
+    stage_2_frm = (struct rtcfg_frm_stage_2_cfg *)rtskb_put(rtskb, hdr_size);
 
-    stage_2_frm->head.id          = RTCFG_ID_STAGE_2_CFG;
+    stage_2_frm->head.id          = shared ? RTCFG_ID_STAGE_2_CFG_MC :
+	RTCFG_ID_STAGE_2_CFG;
     stage_2_frm->head.version     = 0;
     stage_2_frm->flags            = rtcfg_dev->flags;
     stage_2_frm->stations         = htonl(rtcfg_dev->other_stations);
@@ -247,7 +254,16 @@ int rtcfg_send_stage_2(struct rtcfg_connection *conn, int send_data)
     if (send_data)
 	memcpy(rtskb_put(rtskb, frag_size), conn->stage2_file->buffer,
 	       frag_size);
-    conn->cfg_offs = frag_size;
+
+    if (shared) {
+	((struct rtcfg_frm_stage_2_cfg_mc *)stage_2_frm)->session =
+	    htonl(conn->stage2_file->session);
+	/* nothing acknowledged yet, the rest follows via rtcfg_conn_mc_send */
+	conn->mc_last  = 0;
+	conn->mc_offs  = frag_size;
+	conn->cfg_offs = 0;
+    } else
+	conn->cfg_offs = frag_size;
 
     return rtcfg_send_frame(rtskb, rtdev, conn->mac_addr);
 }
@@ -298,6 +314,56 @@ int rtcfg_send_stage_2_frag(struct rtcfg_connection *conn)
 
 
 
+/* Sends the fragment of a shared transfer starting at offs, broadcast if
+ * dest_addr is NULL. Returns the payload size on success. */
+int rtcfg_send_stage_2_mfrag(int ifindex, struct rtcfg_file *file, u32 offs,
+			     u8 *dest_addr)
+{
+    struct rtnet_device                *rtdev;
+    struct rtskb                       *rtskb;
+    unsigned int                       rtskb_size;
+    struct rtcfg_frm_stage_2_cfg_mfrag *stage_2_frm;
+    size_t                             frag_size;
+    int                                ret;
+
+
+    rtdev = rtdev_get_by_index(ifindex);
+    if (rtdev == NULL)
+	return -ENODEV;
+
+    frag_size = MIN(rtdev->get_mtu(rtdev, RTCFG_SKB_PRIO) -
+		    sizeof(struct rtcfg_frm_stage_2_cfg_mfrag),
+		    file->size - offs);
+
+    rtskb_size = rtdev->hard_header_len +
+	sizeof(struct rtcfg_frm_stage_2_cfg_mfrag) + frag_size;
+
+    rtskb = alloc_rtskb(rtskb_size, &rtcfg_pool);
+    if (rtskb == NULL) {
+	rtdev_dereference(rtdev);
+	return -ENOBUFS;
+    }
+
+    rtskb_reserve(rtskb, rtdev->hard_header_len);
+
+    stage_2_frm = (struct rtcfg_frm_stage_2_cfg_mfrag *)
+	rtskb_put(rtskb, sizeof(struct rtcfg_frm_stage_2_cfg_mfrag));
+
+    stage_2_frm->head.id      = RTCFG_ID_STAGE_2_CFG_MFRAG;
+    stage_2_frm->head.version = 0;
+    stage_2_frm->session      = htonl(file->session);
+    stage_2_frm->frag_offs    = htonl(offs);
+
+    memcpy(rtskb_put(rtskb, frag_size), file->buffer + offs, frag_size);
+
+    ret = rtcfg_send_frame(rtskb, rtdev,
+			   (dest_addr) ? dest_addr : rtdev->broadcast);
+
+    return (ret < 0) ? ret : frag_size;
+}
+
+
+
 int rtcfg_send_announce_new(int ifindex)
 {
     struct rtcfg_device       *rtcfg_dev = &device[ifindex];
@@ -444,6 +510,42 @@ int rtcfg_send_ack(int ifindex)
 
 
 
+int rtcfg_send_nack(int ifindex, u32 offs, u32 len)
+{
+    struct rtnet_device       *rtdev;
+    struct rtskb              *rtskb;
+    unsigned int              rtskb_size;
+    struct rtcfg_frm_nack_cfg *nack_frm;
+
+
+    rtdev = rtdev_get_by_index(ifindex);
+    if (rtdev == NULL)
+	return -ENODEV;
+
+    rtskb_size = rtdev->hard_header_len + sizeof(struct rtcfg_frm_nack_cfg);
+
+    rtskb = alloc_rtskb(rtskb_size, &rtcfg_pool);
+    if (rtskb == NULL) {
+	rtdev_dereference(rtdev);
+	return -ENOBUFS;
+    }
+
+    rtskb_reserve(rtskb, rtdev->hard_header_len);
+
+    nack_frm = (struct rtcfg_frm_nack_cfg *)
+	rtskb_put(rtskb, sizeof(struct rtcfg_frm_nack_cfg));
+
+    nack_frm->head.id      = RTCFG_ID_NACK_CFG;
+    nack_frm->head.version = 0;
+    nack_frm->frag_offs    = htonl(offs);
+    nack_frm->frag_len     = htonl(len);
+
+    return rtcfg_send_frame(rtskb, rtdev,
+			    device[ifindex].spec.clt.srv_mac_addr);
+}
+
+
+
 int rtcfg_send_simple_frame(int ifindex, int frame_id, u8 *dest_addr)
 {
     struct rtnet_device     *rtdev;
@@ -293,7 +293,7 @@ int rtcfg_ioctl_add(struct rtnet_device *rtdev, struct rtcfg_cmd *cmd)
     /* load file if missing */
     if (ret > 0) {
         struct file  *filp;
-        mm_segment_t oldfs;
+        loff_t       pos = 0;
 
 
         filp = filp_open(file->name, O_RDONLY, 0);
@@ -314,14 +314,9 @@ int rtcfg_ioctl_add(struct rtnet_device *rtdev, struct rtcfg_cmd *cmd)
             goto err;
         }
 
-        oldfs = get_fs();
-        set_fs(KERNEL_DS);
-        filp->f_pos = 0;
+        /* f_op->read is not available on all file systems */
+        ret = cobalt_kernel_read(filp, file->buffer, file->size, &pos);
 
-        ret = filp->f_op->read(filp, file->buffer, file->size,
-                               &filp->f_pos);
-
-        set_fs(oldfs);
         fput(filp);
 
         if (ret != (int)file->size) {
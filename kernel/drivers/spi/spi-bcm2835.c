@@ -318,6 +318,19 @@ static int bcm2835_transfer_iobufs(struct rtdm_spi_remote_slave *slave)
 	return do_transfer_irq(slave);
 }
 
+static int bcm2835_transfer(struct rtdm_spi_remote_slave *slave,
+			    struct rtdm_spi_xfer *xfer)
+{
+	struct spi_master_bcm2835 *spim = to_master_bcm2835(slave);
+
+	spim->tx_len = xfer->len;
+	spim->rx_len = xfer->len;
+	spim->tx_buf = xfer->tx_buf;
+	spim->rx_buf = xfer->rx_buf;
+
+	return do_transfer_irq(slave);
+}
+
 static ssize_t bcm2835_read(struct rtdm_spi_remote_slave *slave,
 			    void *rx, size_t len)
 {
@@ -403,6 +416,17 @@ static int bcm2835_set_iobufs(struct rtdm_spi_remote_slave *slave,
 	return 0;
 }
 
+static void bcm2835_get_iobufs(struct rtdm_spi_remote_slave *slave,
+			       struct rtdm_spi_iomem *iomem)
+{
+	struct spi_slave_bcm2835 *bcm = to_slave_bcm2835(slave);
+
+	iomem->len = bcm->io_len;
+	smp_rmb();	/* Pairs with set_iobufs(). */
+	iomem->virt = bcm->io_virt;
+	iomem->dma = bcm->io_dma;
+}
+
 static int bcm2835_mmap_iobufs(struct rtdm_spi_remote_slave *slave,
 			       struct vm_area_struct *vma)
 {
@@ -549,6 +573,8 @@ static struct rtdm_spi_master_ops bcm2835_master_ops = {
 	.mmap_iobufs = bcm2835_mmap_iobufs,
 	.mmap_release = bcm2835_mmap_release,
 	.transfer_iobufs = bcm2835_transfer_iobufs,
+	.get_iobufs = bcm2835_get_iobufs,
+	.transfer = bcm2835_transfer,
 	.write = bcm2835_write,
 	.read = bcm2835_read,
 	.attach_slave = bcm2835_attach_slave,
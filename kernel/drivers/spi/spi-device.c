@@ -21,6 +21,7 @@
 #include <linux/slab.h>
 #include <linux/mutex.h>
 #include <linux/err.h>
+#include <linux/delay.h>
 #include <linux/gpio.h>
 #include <linux/spi/spi.h>
 #include "spi-master.h"
@@ -97,7 +98,16 @@ void rtdm_spi_remove_remote_slave(struct rtdm_spi_remote_slave *slave)
 	mutex_destroy(&slave->ctl_lock);
 	rtdm_lock_get_irqsave(&master->lock, c);
 	list_del(&slave->next);
+	if (master->cfg == slave)
+		master->cfg = NULL;
 	rtdm_lock_put_irqrestore(&master->lock, c);
+
+	/*
+	 * Transfer lists of other slaves may still address us by
+	 * chip select, find_slave() won't hand us out anymore.
+	 */
+	while (atomic_read(&slave->xfer_refs))
+		msleep(1);
 	dev = &slave->dev;
 	rtdm_dev_unregister(dev);
 	kfree(dev->label);
@@ -36,6 +36,8 @@ struct rtdm_spi_remote_slave {
 	struct rtdm_spi_config config;
 	struct rtdm_spi_master *master;
 	atomic_t mmap_refs;
+	/* Transfer lists of other slaves addressing us. */
+	atomic_t xfer_refs;
 	struct mutex ctl_lock;
 };
 
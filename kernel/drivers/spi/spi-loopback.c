@@ -0,0 +1,437 @@
+/**
+ * Software loopback SPI master, for testing the RTDM SPI core
+ * without hardware.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/gfp.h>
+#include <linux/io.h>
+#include <linux/platform_device.h>
+#include <linux/spi/spi.h>
+#include "spi-master.h"
+
+/*
+ * Slaves behave as follows: with SPI_LOOP set in their mode, received
+ * data is a copy of the data sent. Otherwise, each byte received is
+ * the count of bytes exchanged since chip select was last asserted,
+ * which makes chip select handling observable from userland.
+ *
+ * Transfers of at least LOOPBACK_DMA_MIN_LENGTH bytes go through an
+ * emulated DMA engine, which only deals with bus addresses, and
+ * completes from a timer firing after the wire time has elapsed.
+ * Shorter transfers are carried out synchronously, busy waiting for
+ * the wire time.
+ */
+#define LOOPBACK_DMA_MIN_LENGTH	96
+#define LOOPBACK_MAX_SPEED_HZ	50000000
+
+static int num_slaves = 4;
+module_param(num_slaves, int, 0444);
+MODULE_PARM_DESC(num_slaves, "Number of slaves on the loopback bus");
+
+struct spi_master_loopback {
+	struct rtdm_spi_master master;
+	rtdm_timer_t dma_timer;
+	rtdm_event_t transfer_done;
+	struct rtdm_spi_xfer dma_xfer;
+	bool dma_loop;
+	unsigned int count;
+};
+
+struct spi_slave_loopback {
+	struct rtdm_spi_remote_slave slave;
+	void *io_virt;
+	dma_addr_t io_dma;
+	size_t io_len;
+};
+
+static struct platform_device *loopback_pdev;
+
+static inline struct spi_slave_loopback *
+to_slave_loopback(struct rtdm_spi_remote_slave *slave)
+{
+	return container_of(slave, struct spi_slave_loopback, slave);
+}
+
+static inline struct spi_master_loopback *
+to_master_loopback(struct rtdm_spi_remote_slave *slave)
+{
+	return container_of(slave->master, struct spi_master_loopback, master);
+}
+
+static void exchange(struct spi_master_loopback *spim, bool loop,
+		     const u8 *tx, u8 *rx, size_t len)
+{
+	size_t n;
+
+	if (rx == NULL) {
+		spim->count += len;
+		return;
+	}
+
+	for (n = 0; n < len; n++, spim->count++)
+		rx[n] = loop ? (tx ? tx[n] : 0) : (u8)spim->count;
+}
+
+static nanosecs_rel_t wire_time(struct rtdm_spi_remote_slave *slave,
+				size_t len)
+{
+	return div_u64((u64)len * 8 * NSEC_PER_SEC, slave->config.speed_hz);
+}
+
+static void loopback_dma_handler(rtdm_timer_t *timer)
+{
+	struct spi_master_loopback *spim;
+	struct rtdm_spi_xfer *xfer;
+
+	spim = container_of(timer, struct spi_master_loopback, dma_timer);
+	xfer = &spim->dma_xfer;
+	exchange(spim, spim->dma_loop, phys_to_virt(xfer->tx_dma),
+		 phys_to_virt(xfer->rx_dma), xfer->len);
+	rtdm_event_signal(&spim->transfer_done);
+}
+
+static int do_transfer(struct rtdm_spi_remote_slave *slave,
+		       const void *tx, void *rx, size_t len)
+{
+	struct spi_master_loopback *spim = to_master_loopback(slave);
+
+	exchange(spim, !!(slave->config.mode & SPI_LOOP), tx, rx, len);
+	rtdm_task_busy_sleep(wire_time(slave, len));
+
+	return 0;
+}
+
+static int do_transfer_dma(struct rtdm_spi_remote_slave *slave,
+			   struct rtdm_spi_xfer *xfer)
+{
+	struct spi_master_loopback *spim = to_master_loopback(slave);
+	int ret;
+
+	spim->dma_xfer = *xfer;
+	spim->dma_loop = !!(slave->config.mode & SPI_LOOP);
+
+	ret = rtdm_timer_start(&spim->dma_timer, wire_time(slave, xfer->len),
+			       0, RTDM_TIMERMODE_RELATIVE);
+	if (ret)
+		return ret;
+
+	ret = rtdm_event_wait(&spim->transfer_done);
+	if (ret)
+		rtdm_timer_stop(&spim->dma_timer);
+
+	return ret;
+}
+
+static int loopback_configure(struct rtdm_spi_remote_slave *slave)
+{
+	struct rtdm_spi_config *config = &slave->config;
+
+	if (config->speed_hz == 0 ||
+	    config->speed_hz > LOOPBACK_MAX_SPEED_HZ ||
+	    config->bits_per_word != 8)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void loopback_chip_select(struct rtdm_spi_remote_slave *slave,
+				 bool active)
+{
+	struct spi_master_loopback *spim = to_master_loopback(slave);
+
+	if (active)
+		spim->count = 0;
+}
+
+static int loopback_transfer_iobufs(struct rtdm_spi_remote_slave *slave)
+{
+	struct spi_slave_loopback *lb = to_slave_loopback(slave);
+	struct rtdm_spi_xfer xfer;
+
+	if (lb->io_len == 0)
+		return -EINVAL;	/* No I/O buffers set. */
+
+	xfer.len = lb->io_len / 2;
+	xfer.rx_buf = lb->io_virt;
+	xfer.rx_dma = lb->io_dma;
+	xfer.tx_buf = lb->io_virt + xfer.len;
+	xfer.tx_dma = lb->io_dma + xfer.len;
+
+	return do_transfer_dma(slave, &xfer);
+}
+
+static int loopback_transfer(struct rtdm_spi_remote_slave *slave,
+			     struct rtdm_spi_xfer *xfer)
+{
+	if (xfer->len >= LOOPBACK_DMA_MIN_LENGTH)
+		return do_transfer_dma(slave, xfer);
+
+	return do_transfer(slave, xfer->tx_buf, xfer->rx_buf, xfer->len);
+}
+
+static ssize_t loopback_read(struct rtdm_spi_remote_slave *slave,
+			     void *rx, size_t len)
+{
+	return do_transfer(slave, NULL, rx, len) ?: len;
+}
+
+static ssize_t loopback_write(struct rtdm_spi_remote_slave *slave,
+			      const void *tx, size_t len)
+{
+	return do_transfer(slave, tx, NULL, len) ?: len;
+}
+
+static int set_iobufs(struct spi_slave_loopback *lb, size_t len)
+{
+	void *p;
+
+	if (len == 0)
+		return -EINVAL;
+
+	len = L1_CACHE_ALIGN(len) * 2;
+	if (len == lb->io_len)
+		return 0;
+
+	if (lb->io_len)
+		return -EINVAL;	/* I/O buffers may not be resized. */
+
+	/* rtdm_mmap_kmem() wants page-aligned memory. */
+	p = alloc_pages_exact(PAGE_ALIGN(len), GFP_KERNEL | __GFP_ZERO);
+	if (p == NULL)
+		return -ENOMEM;
+
+	lb->io_dma = virt_to_phys(p);
+	lb->io_virt = p;
+	smp_mb();
+	/* May race with transfers, must be set last. */
+	lb->io_len = len;
+
+	return 0;
+}
+
+static int loopback_set_iobufs(struct rtdm_spi_remote_slave *slave,
+			       struct rtdm_spi_iobufs *p)
+{
+	struct spi_slave_loopback *lb = to_slave_loopback(slave);
+	int ret;
+
+	ret = set_iobufs(lb, p->io_len);
+	if (ret)
+		return ret;
+
+	p->i_offset = 0;
+	p->o_offset = lb->io_len / 2;
+	p->map_len = lb->io_len;
+
+	return 0;
+}
+
+static void loopback_get_iobufs(struct rtdm_spi_remote_slave *slave,
+				struct rtdm_spi_iomem *iomem)
+{
+	struct spi_slave_loopback *lb = to_slave_loopback(slave);
+
+	iomem->len = lb->io_len;
+	smp_rmb();	/* Pairs with set_iobufs(). */
+	iomem->virt = lb->io_virt;
+	iomem->dma = lb->io_dma;
+}
+
+static int loopback_mmap_iobufs(struct rtdm_spi_remote_slave *slave,
+				struct vm_area_struct *vma)
+{
+	struct spi_slave_loopback *lb = to_slave_loopback(slave);
+
+	return rtdm_mmap_kmem(vma, lb->io_virt);
+}
+
+static void free_iobufs(struct spi_slave_loopback *lb)
+{
+	free_pages_exact(lb->io_virt, PAGE_ALIGN(lb->io_len));
+	lb->io_len = 0;
+}
+
+static void loopback_mmap_release(struct rtdm_spi_remote_slave *slave)
+{
+	free_iobufs(to_slave_loopback(slave));
+}
+
+static struct rtdm_spi_remote_slave *
+loopback_attach_slave(struct rtdm_spi_master *master, struct spi_device *spi)
+{
+	struct spi_slave_loopback *lb;
+	int ret;
+
+	lb = kzalloc(sizeof(*lb), GFP_KERNEL);
+	if (lb == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	ret = rtdm_spi_add_remote_slave(&lb->slave, master, spi);
+	if (ret) {
+		dev_err(&spi->dev,
+			"%s: failed to attach slave\n", __func__);
+		kfree(lb);
+		return ERR_PTR(ret);
+	}
+
+	return &lb->slave;
+}
+
+static void loopback_detach_slave(struct rtdm_spi_remote_slave *slave)
+{
+	struct spi_slave_loopback *lb = to_slave_loopback(slave);
+
+	rtdm_spi_remove_remote_slave(slave);
+	/* I/O buffers which were never mapped are still ours. */
+	if (lb->io_len && atomic_read(&slave->mmap_refs) == 0)
+		free_iobufs(lb);
+	kfree(lb);
+}
+
+static struct rtdm_spi_master_ops loopback_master_ops = {
+	.configure = loopback_configure,
+	.chip_select = loopback_chip_select,
+	.set_iobufs = loopback_set_iobufs,
+	.mmap_iobufs = loopback_mmap_iobufs,
+	.mmap_release = loopback_mmap_release,
+	.transfer_iobufs = loopback_transfer_iobufs,
+	.get_iobufs = loopback_get_iobufs,
+	.transfer = loopback_transfer,
+	.write = loopback_write,
+	.read = loopback_read,
+	.attach_slave = loopback_attach_slave,
+	.detach_slave = loopback_detach_slave,
+};
+
+static int loopback_spi_probe(struct platform_device *pdev)
+{
+	struct spi_board_info info = {
+		.modalias = "rtdm_spi_device",
+		.max_speed_hz = LOOPBACK_MAX_SPEED_HZ,
+		.mode = SPI_MODE_0,
+	};
+	struct spi_master_loopback *spim;
+	struct rtdm_spi_master *master;
+	struct spi_master *kmaster;
+	struct spi_device *spi;
+	int ret, n;
+
+	master = rtdm_spi_alloc_master(&pdev->dev,
+		   struct spi_master_loopback, master);
+	if (master == NULL)
+		return -ENOMEM;
+
+	master->subclass = RTDM_SUBCLASS_SPI_LOOPBACK;
+	master->ops = &loopback_master_ops;
+	platform_set_drvdata(pdev, master);
+
+	kmaster = master->kmaster;
+	kmaster->mode_bits = SPI_CPOL | SPI_CPHA | SPI_CS_HIGH | SPI_LOOP;
+	kmaster->bits_per_word_mask = SPI_BPW_MASK(8);
+	kmaster->max_speed_hz = LOOPBACK_MAX_SPEED_HZ;
+	kmaster->num_chipselect = num_slaves;
+	kmaster->bus_num = -1;
+
+	spim = container_of(master, struct spi_master_loopback, master);
+	rtdm_event_init(&spim->transfer_done, 0);
+	rtdm_timer_init(&spim->dma_timer, loopback_dma_handler,
+			dev_name(&pdev->dev));
+
+	ret = rtdm_spi_add_master(&spim->master);
+	if (ret) {
+		dev_err(&pdev->dev, "%s: failed to add master\n",
+			__func__);
+		goto fail;
+	}
+
+	for (n = 0; n < num_slaves; n++) {
+		info.chip_select = n;
+		spi = spi_new_device(kmaster, &info);
+		if (spi == NULL)
+			dev_warn(&pdev->dev, "%s: cannot add slave%d\n",
+				 __func__, n);
+	}
+
+	return 0;
+fail:
+	rtdm_timer_destroy(&spim->dma_timer);
+	rtdm_event_destroy(&spim->transfer_done);
+	spi_master_put(kmaster);
+
+	return ret;
+}
+
+static int loopback_spi_remove(struct platform_device *pdev)
+{
+	struct rtdm_spi_master *master = platform_get_drvdata(pdev);
+	struct spi_master_loopback *spim;
+
+	spim = container_of(master, struct spi_master_loopback, master);
+	/*
+	 * Detach the slaves first, so that no transfer may wait for
+	 * the DMA timer anymore. Our state lives in the SPI master,
+	 * keep it around until we are done.
+	 */
+	spi_master_get(master->kmaster);
+	rtdm_spi_remove_master(master);
+	rtdm_timer_destroy(&spim->dma_timer);
+	rtdm_event_destroy(&spim->transfer_done);
+	spi_master_put(master->kmaster);
+
+	return 0;
+}
+
+static struct platform_driver loopback_spi_driver = {
+	.driver		= {
+		.name		= "rtdm-spi-loopback",
+	},
+	.probe		= loopback_spi_probe,
+	.remove		= loopback_spi_remove,
+};
+
+static int __init loopback_spi_init(void)
+{
+	int ret;
+
+	if (num_slaves < 1 || num_slaves > 255)
+		return -EINVAL;
+
+	ret = platform_driver_register(&loopback_spi_driver);
+	if (ret)
+		return ret;
+
+	loopback_pdev = platform_device_register_simple("rtdm-spi-loopback",
+							-1, NULL, 0);
+	if (IS_ERR(loopback_pdev)) {
+		platform_driver_unregister(&loopback_spi_driver);
+		return PTR_ERR(loopback_pdev);
+	}
+
+	return 0;
+}
+module_init(loopback_spi_init);
+
+static void __exit loopback_spi_exit(void)
+{
+	platform_device_unregister(loopback_pdev);
+	platform_driver_unregister(&loopback_spi_driver);
+}
+module_exit(loopback_spi_exit);
+
+MODULE_LICENSE("GPL");
@@ -56,6 +56,7 @@ static int update_slave_config(struct rtdm_spi_remote_slave *slave,
 		return ret;
 	}
 
+	master->cfg = slave;
 	rtdm_mutex_unlock(&master->bus_lock);
 	
 	dev_info(to_kdev(slave),
@@ -103,11 +104,22 @@ static int do_chip_select(struct rtdm_spi_remote_slave *slave)
 {				/* master->bus_lock held */
 	struct rtdm_spi_master *master = slave->master;
 	rtdm_lockctx_t c;
-	int state;
+	int state, ret;
 
 	if (slave->config.speed_hz == 0)
 		return -EINVAL; /* Setup is missing. */
 
+	/*
+	 * Slaves sharing the bus may run different settings, reload
+	 * ours if another slave was configured last.
+	 */
+	if (master->cfg != slave) {
+		ret = master->ops->configure(slave);
+		if (ret)
+			return ret;
+		master->cfg = slave;
+	}
+
 	/* Serialize with spi_master_close() */
 	rtdm_lock_get_irqsave(&master->lock, c);
 	
@@ -144,11 +156,186 @@ static void do_chip_deselect(struct rtdm_spi_remote_slave *slave)
 	rtdm_lock_put_irqrestore(&master->lock, c);
 }
 
+/*
+ * Pin the slave at @chip_select, which remains valid until
+ * put_slave() is called.
+ */
+static struct rtdm_spi_remote_slave *
+find_slave(struct rtdm_spi_master *master, int chip_select)
+{
+	struct rtdm_spi_remote_slave *slave, *ret = NULL;
+	rtdm_lockctx_t c;
+
+	rtdm_lock_get_irqsave(&master->lock, c);
+
+	list_for_each_entry(slave, &master->slaves, next) {
+		if (slave->chip_select == chip_select) {
+			atomic_inc(&slave->xfer_refs);
+			ret = slave;
+			break;
+		}
+	}
+
+	rtdm_lock_put_irqrestore(&master->lock, c);
+
+	return ret;
+}
+
+static inline void put_slave(struct rtdm_spi_remote_slave *slave)
+{
+	atomic_dec(&slave->xfer_refs);
+}
+
+/* Release a slave in use by a transfer list of @owner. */
+static void release_slave(struct rtdm_spi_remote_slave *owner,
+			  struct rtdm_spi_remote_slave *slave)
+{
+	do_chip_deselect(slave);
+	/* The owner is pinned by its open file. */
+	if (slave != owner)
+		put_slave(slave);
+}
+
+static int check_segments(struct rtdm_spi_segment *segs, int nr,
+			  size_t maxlen)
+{
+	struct rtdm_spi_segment *seg;
+	int n;
+
+	for (n = 0, seg = segs; n < nr; n++, seg++) {
+		if (seg->len == 0 || seg->len > maxlen ||
+		    seg->i_offset > maxlen - seg->len ||
+		    seg->o_offset > maxlen - seg->len ||
+		    (seg->flags & ~(SPI_SEG_CS_CHANGE|SPI_SEG_SLAVE)))
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int run_segments(struct rtdm_spi_remote_slave *slave,
+			struct rtdm_spi_segment *segs, int nr,
+			struct rtdm_spi_iomem *iomem)
+{				/* master->bus_lock held */
+	struct rtdm_spi_remote_slave *target, *cur = NULL;
+	struct rtdm_spi_master *master = slave->master;
+	size_t half = iomem->len / 2;
+	struct rtdm_spi_segment *seg;
+	struct rtdm_spi_xfer xfer;
+	int n, ret = 0;
+
+	for (n = 0, seg = segs; n < nr; n++, seg++) {
+		target = slave;
+		if (seg->flags & SPI_SEG_SLAVE) {
+			target = find_slave(master, seg->chip_select);
+			if (target == NULL) {
+				ret = -ENODEV;
+				break;
+			}
+			/* Keep a single reference on the current slave. */
+			if (target == slave || target == cur)
+				put_slave(target);
+		}
+
+		if (cur && cur != target) {
+			release_slave(slave, cur);
+			cur = NULL;
+		}
+
+		if (cur == NULL) {
+			ret = do_chip_select(target);
+			if (ret) {
+				if (target != slave)
+					put_slave(target);
+				break;
+			}
+			cur = target;
+		}
+
+		/* Input area first, output area next. */
+		xfer.rx_buf = iomem->virt + seg->i_offset;
+		xfer.rx_dma = iomem->dma + seg->i_offset;
+		xfer.tx_buf = iomem->virt + half + seg->o_offset;
+		xfer.tx_dma = iomem->dma + half + seg->o_offset;
+		xfer.len = seg->len;
+		ret = master->ops->transfer(target, &xfer);
+		if (ret)
+			break;
+
+		if (seg->delay_us) {
+			if (seg->delay_us < 20)
+				rtdm_task_busy_sleep(seg->delay_us * 1000ULL);
+			else
+				rtdm_task_sleep(seg->delay_us * 1000ULL);
+		}
+
+		if (seg->flags & SPI_SEG_CS_CHANGE) {
+			release_slave(slave, cur);
+			cur = NULL;
+		}
+	}
+
+	if (cur)
+		release_slave(slave, cur);
+
+	return ret;
+}
+
+static int do_transfer_list(struct rtdm_fd *fd,
+			    struct rtdm_spi_remote_slave *slave,
+			    struct rtdm_spi_xfer_list *list)
+{
+	struct rtdm_spi_segment stack_segs[16], *segs = stack_segs;
+	struct rtdm_spi_master *master = slave->master;
+	struct rtdm_spi_iomem iomem;
+	size_t size;
+	int ret;
+
+	if (master->ops->transfer == NULL || master->ops->get_iobufs == NULL)
+		return -EINVAL;
+
+	if (list->nr_segments == 0)
+		return 0;
+
+	if (list->nr_segments > SPI_XFER_LIST_MAX)
+		return -EINVAL;
+
+	master->ops->get_iobufs(slave, &iomem);
+	if (iomem.len == 0)
+		return -EINVAL;	/* No I/O buffers set. */
+
+	size = list->nr_segments * sizeof(*segs);
+	if (list->nr_segments > ARRAY_SIZE(stack_segs)) {
+		segs = xnmalloc(size);
+		if (segs == NULL)
+			return -ENOMEM;
+	}
+
+	ret = rtdm_safe_copy_from_user(fd, segs,
+			(void __user *)(unsigned long)list->segments, size);
+	if (ret)
+		goto out;
+
+	ret = check_segments(segs, list->nr_segments, iomem.len / 2);
+	if (ret)
+		goto out;
+
+	rtdm_mutex_lock(&master->bus_lock);
+	ret = run_segments(slave, segs, list->nr_segments, &iomem);
+	rtdm_mutex_unlock(&master->bus_lock);
+out:
+	if (segs != stack_segs)
+		xnfree(segs);
+
+	return ret;
+}
+
 static int spi_master_ioctl_rt(struct rtdm_fd *fd,
 			       unsigned int request, void *arg)
 {
 	struct rtdm_spi_remote_slave *slave = fd_to_slave(fd);
 	struct rtdm_spi_master *master = slave->master;
+	struct rtdm_spi_xfer_list list;
 	struct rtdm_spi_config config;
 	int ret;
 
@@ -178,6 +365,12 @@ static int spi_master_ioctl_rt(struct rtdm_fd *fd,
 			rtdm_mutex_unlock(&master->bus_lock);
 		}
 		break;
+	case SPI_RTIOC_TRANSFER_LIST:
+		ret = rtdm_safe_copy_from_user(fd, &list,
+					       arg, sizeof(list));
+		if (ret == 0)
+			ret = do_transfer_list(fd, slave, &list);
+		break;
 	default:
 		ret = -ENOSYS;
 	}
@@ -364,6 +557,7 @@ int __rtdm_spi_setup_driver(struct rtdm_spi_master *master)
 
 	master->devclass->devnode = spi_slave_devnode;
 	master->cs = NULL;
+	master->cfg = NULL;
 
 	master->driver.profile_info = (struct rtdm_profile_info)
 		RTDM_PROFILE_INFO(rtdm_spi_master,
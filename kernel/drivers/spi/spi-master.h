@@ -27,6 +27,25 @@ struct device_node;
 struct rtdm_spi_master;
 struct spi_master;
 
+/* I/O buffers of a slave: input area first, then output area. */
+struct rtdm_spi_iomem {
+	void *virt;
+	dma_addr_t dma;
+	size_t len;		/* Zero if unset. */
+};
+
+/*
+ * Single transfer from a transfer list. Buffers belong to the I/O
+ * area, so their bus addresses are valid for DMA as well.
+ */
+struct rtdm_spi_xfer {
+	const void *tx_buf;
+	void *rx_buf;
+	dma_addr_t tx_dma;
+	dma_addr_t rx_dma;
+	size_t len;
+};
+
 struct rtdm_spi_master_ops {
 	int (*open)(struct rtdm_spi_remote_slave *slave);
 	void (*close)(struct rtdm_spi_remote_slave *slave);
@@ -39,6 +58,10 @@ struct rtdm_spi_master_ops {
 			   struct vm_area_struct *vma);
 	void (*mmap_release)(struct rtdm_spi_remote_slave *slave);
 	int (*transfer_iobufs)(struct rtdm_spi_remote_slave *slave);
+	void (*get_iobufs)(struct rtdm_spi_remote_slave *slave,
+			   struct rtdm_spi_iomem *iomem);
+	int (*transfer)(struct rtdm_spi_remote_slave *slave,
+			struct rtdm_spi_xfer *xfer);
 	ssize_t (*write)(struct rtdm_spi_remote_slave *slave,
 			 const void *tx, size_t len);
 	ssize_t (*read)(struct rtdm_spi_remote_slave *slave,
@@ -62,6 +85,7 @@ struct rtdm_spi_master {
 		rtdm_lock_t lock;
 		rtdm_mutex_t bus_lock;
 		struct rtdm_spi_remote_slave *cs;
+		struct rtdm_spi_remote_slave *cfg;
 	};
 };
 
@@ -355,6 +355,19 @@ static int sun6i_transfer_iobufs(struct rtdm_spi_remote_slave *slave)
 	return do_transfer_irq(slave);
 }
 
+static int sun6i_transfer(struct rtdm_spi_remote_slave *slave,
+			  struct rtdm_spi_xfer *xfer)
+{
+	struct spi_master_sun6i *spim = to_master_sun6i(slave);
+
+	spim->tx_len = xfer->len;
+	spim->rx_len = xfer->len;
+	spim->tx_buf = xfer->tx_buf;
+	spim->rx_buf = xfer->rx_buf;
+
+	return do_transfer_irq(slave);
+}
+
 static ssize_t sun6i_read(struct rtdm_spi_remote_slave *slave,
 			  void *rx, size_t len)
 {
@@ -425,6 +438,17 @@ static int sun6i_set_iobufs(struct rtdm_spi_remote_slave *slave,
 	return 0;
 }
 
+static void sun6i_get_iobufs(struct rtdm_spi_remote_slave *slave,
+			     struct rtdm_spi_iomem *iomem)
+{
+	struct spi_slave_sun6i *sun6i = to_slave_sun6i(slave);
+
+	iomem->len = sun6i->io_len;
+	smp_rmb();	/* Pairs with set_iobufs(). */
+	iomem->virt = sun6i->io_virt;
+	iomem->dma = sun6i->io_dma;
+}
+
 static int sun6i_mmap_iobufs(struct rtdm_spi_remote_slave *slave,
 			     struct vm_area_struct *vma)
 {
@@ -480,6 +504,8 @@ static struct rtdm_spi_master_ops sun6i_master_ops = {
 	.mmap_iobufs = sun6i_mmap_iobufs,
 	.mmap_release = sun6i_mmap_release,
 	.transfer_iobufs = sun6i_transfer_iobufs,
+	.get_iobufs = sun6i_get_iobufs,
+	.transfer = sun6i_transfer,
 	.write = sun6i_write,
 	.read = sun6i_read,
 	.attach_slave = sun6i_attach_slave,
@@ -0,0 +1,125 @@
+/*
+ * Xenomai is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xenomai is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Xenomai; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/module.h>
+#include <rtdm/driver.h>
+#include <rtdm/udd.h>
+#include <rtdm/uapi/testing.h>
+
+MODULE_DESCRIPTION("UDD event ring test helper module");
+MODULE_LICENSE("GPL");
+
+#define UDDTEST_NR_EVENTS  64
+
+/*
+ * A UDD device with a software interrupt source: a timer posts
+ * bursts of events with status words, for checking the event ring
+ * from userland.
+ */
+static struct uddtest {
+	struct udd_device udd;
+	rtdm_timer_t timer;
+	rtdm_lock_t lock;
+	u32 count;
+	u32 status;
+} uddtest;
+
+static void burst_handler(rtdm_timer_t *timer)
+{
+	struct uddtest *ut = container_of(timer, struct uddtest, timer);
+	rtdm_lockctx_t c;
+	u32 status = 0;
+	bool last;
+
+	rtdm_lock_get_irqsave(&ut->lock, c);
+	last = ut->count == 0;
+	if (!last) {
+		ut->count--;
+		status = ++ut->status;
+	}
+	rtdm_lock_put_irqrestore(&ut->lock, c);
+
+	if (last) {
+		rtdm_timer_stop_in_handler(timer);
+		return;
+	}
+
+	udd_notify_event_status(&ut->udd, status);
+}
+
+static int uddtest_ioctl(struct rtdm_fd *fd,
+			 unsigned int request, void *arg)
+{
+	struct rttst_udd_burst burst;
+	rtdm_lockctx_t c;
+	int ret;
+
+	switch (request) {
+	case RTTST_RTIOC_UDD_BURST:
+		ret = rtdm_safe_copy_from_user(fd, &burst, arg, sizeof(burst));
+		if (ret)
+			return ret;
+		if (burst.count == 0 || burst.period_ns == 0)
+			return -EINVAL;
+		rtdm_timer_stop(&uddtest.timer);
+		rtdm_lock_get_irqsave(&uddtest.lock, c);
+		uddtest.count = burst.count;
+		rtdm_lock_put_irqrestore(&uddtest.lock, c);
+		return rtdm_timer_start(&uddtest.timer, burst.period_ns,
+					burst.period_ns,
+					RTDM_TIMERMODE_RELATIVE);
+	case UDD_RTIOC_IRQEN:
+	case UDD_RTIOC_IRQDIS:
+		/* Our software source cannot be masked. */
+		return 0;
+	}
+
+	return -ENOSYS;
+}
+
+static int __init uddtest_init(void)
+{
+	int ret;
+
+	if (!realtime_core_enabled())
+		return -ENODEV;
+
+	rtdm_lock_init(&uddtest.lock);
+	ret = rtdm_timer_init(&uddtest.timer, burst_handler, "uddtest");
+	if (ret)
+		return ret;
+
+	uddtest.udd.device_name = "uddtest";
+	uddtest.udd.device_flags = RTDM_EXCLUSIVE;
+	uddtest.udd.device_subclass = RTDM_SUBCLASS_UDDTEST;
+	uddtest.udd.irq = UDD_IRQ_CUSTOM;
+	uddtest.udd.nr_events = UDDTEST_NR_EVENTS;
+	uddtest.udd.ops.ioctl = uddtest_ioctl;
+
+	ret = udd_register_device(&uddtest.udd);
+	if (ret)
+		rtdm_timer_destroy(&uddtest.timer);
+
+	return ret;
+}
+
+static void __exit uddtest_exit(void)
+{
+	rtdm_timer_destroy(&uddtest.timer);
+	udd_unregister_device(&uddtest.udd);
+}
+
+module_init(uddtest_init);
+module_exit(uddtest_exit);
@@ -21,14 +21,20 @@
 #include <linux/init.h>
 #include <linux/slab.h>
 #include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/log2.h>
 #include <rtdm/cobalt.h>
 #include <rtdm/driver.h>
 #include <rtdm/udd.h>
 
 struct udd_context {
 	u32 event_count;
+	u32 lost;
 };
 
+/* Ring entries copied out at once, with the ring locked. */
+#define UDD_READ_CHUNK  8
+
 static int udd_open(struct rtdm_fd *fd, int oflags)
 {
 	struct udd_context *context;
@@ -44,6 +50,7 @@ static int udd_open(struct rtdm_fd *fd, int oflags)
 
 	context = rtdm_fd_to_private(fd);
 	context->event_count = 0;
+	context->lost = 0;
 
 	return 0;
 }
@@ -60,7 +67,9 @@ static void udd_close(struct rtdm_fd *fd)
 static int udd_ioctl_rt(struct rtdm_fd *fd,
 			unsigned int request, void __user *arg)
 {
+	struct udd_context *context;
 	struct udd_signotify signfy;
+	struct udd_event_stat stat;
 	struct udd_reserved *ur;
 	struct udd_device *udd;
 	rtdm_event_t done;
@@ -104,6 +113,15 @@ static int udd_ioctl_rt(struct rtdm_fd *fd,
 		if (ret != -EIDRM)
 			rtdm_event_destroy(&done);
 		break;
+	case UDD_RTIOC_EVSTAT:
+		if (ur->ring == NULL)
+			return -ENXIO;
+		context = rtdm_fd_to_private(fd);
+		stat.seq = context->event_count;
+		stat.head = atomic_read(&ur->event);
+		stat.lost = context->lost;
+		ret = rtdm_safe_copy_to_user(fd, arg, &stat, sizeof(stat));
+		break;
 	default:
 		ret = -EINVAL;
 	}
@@ -111,6 +129,50 @@ static int udd_ioctl_rt(struct rtdm_fd *fd,
 	return ret;
 }
 
+static ssize_t read_events(struct rtdm_fd *fd, struct udd_reserved *ur,
+			   void __user *buf, size_t len)
+{
+	struct udd_context *context = rtdm_fd_to_private(fd);
+	struct udd_event events[UDD_READ_CHUNK];
+	struct udd_event_ring *ring = ur->ring;
+	u32 head, avail, n, nr;
+	size_t count = 0;
+	rtdm_lockctx_t c;
+	int ret;
+
+	do {
+		rtdm_lock_get_irqsave(&ur->ring_lock, c);
+
+		head = ur->ring_head;
+		avail = head - context->event_count;
+		if (avail > ur->ring_mask + 1) {
+			/* We were lapped, skip to the oldest entry. */
+			context->lost += avail - (ur->ring_mask + 1);
+			context->event_count = head - (ur->ring_mask + 1);
+			avail = ur->ring_mask + 1;
+		}
+
+		nr = min_t(u32, avail, UDD_READ_CHUNK);
+		nr = min_t(u32, nr, (len - count) / sizeof(events[0]));
+		for (n = 0; n < nr; n++) {
+			context->event_count++;
+			events[n] = ring->entries[context->event_count &
+						  ur->ring_mask];
+		}
+
+		rtdm_lock_put_irqrestore(&ur->ring_lock, c);
+
+		ret = rtdm_copy_to_user(fd, buf + count, events,
+					nr * sizeof(events[0]));
+		if (ret)
+			return ret;
+
+		count += nr * sizeof(events[0]);
+	} while (nr > 0 && avail > nr);
+
+	return count;
+}
+
 static ssize_t udd_read_rt(struct rtdm_fd *fd,
 			   void __user *buf, size_t len)
 {
@@ -120,14 +182,17 @@ static ssize_t udd_read_rt(struct rtdm_fd *fd,
 	ssize_t ret;
 	u32 count;
 
-	if (len != sizeof(count))
+	udd = container_of(rtdm_fd_device(fd), struct udd_device, __reserved.device);
+	ur = &udd->__reserved;
+
+	if (len != sizeof(count) &&
+	    (ur->ring == NULL || len < sizeof(struct udd_event) ||
+	     len % sizeof(struct udd_event)))
 		return -EINVAL;
 
-	udd = container_of(rtdm_fd_device(fd), struct udd_device, __reserved.device);
 	if (udd->irq == UDD_IRQ_NONE)
 		return -EIO;
 
-	ur = &udd->__reserved;
 	context = rtdm_fd_to_private(fd);
 
 	for (;;) {
@@ -138,6 +203,9 @@ static ssize_t udd_read_rt(struct rtdm_fd *fd,
 			return ret;
 	}
 
+	if (len != sizeof(count))
+		return read_events(fd, ur, buf, len);
+
 	count = atomic_read(&ur->event);
 	context->event_count = count;
 	ret = rtdm_copy_to_user(fd, buf, &count, sizeof(count));
@@ -179,16 +247,25 @@ static int udd_select(struct rtdm_fd *fd, struct xnselector *selector,
 static int udd_irq_handler(rtdm_irq_t *irqh)
 {
 	struct udd_device *udd;
-	int ret;
+	int ret, status;
 
 	udd = rtdm_irq_get_arg(irqh, struct udd_device);
-	ret = udd->ops.interrupt(udd);
+	status = udd->ops.interrupt(udd);
+	ret = status & (UDD_IRQ_STATUS(1) - 1);
 	if (ret == RTDM_IRQ_HANDLED)
-		udd_notify_event(udd);
+		udd_notify_event_status(udd, status);
 
 	return ret;
 }
 
+static inline bool mapper_present(struct udd_device *udd, int minor)
+{
+	if (minor == UDD_RING_MAP)
+		return udd->__reserved.ring != NULL;
+
+	return udd->mem_regions[minor].type != UDD_MEM_NONE;
+}
+
 static int mapper_open(struct rtdm_fd *fd, int oflags)
 {
 	int minor = rtdm_fd_minor(fd);
@@ -206,11 +283,11 @@ static int mapper_open(struct rtdm_fd *fd, int oflags)
 	 * We support sparse region arrays, so the device minor shall
 	 * match the mem_regions[] index exactly.
 	 */
-	if (minor < 0 || minor >= UDD_NR_MAPS)
+	if (minor < 0 || minor > UDD_RING_MAP)
 		return -EIO;
 
 	udd = udd_get_device(fd);
-	if (udd->mem_regions[minor].type == UDD_MEM_NONE)
+	if (!mapper_present(udd, minor))
 		return -EIO;
 
 	return 0;
@@ -229,13 +306,26 @@ static int mapper_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
 	int ret;
 
 	udd = udd_get_device(fd);
+	len = vma->vm_end - vma->vm_start;
+
+	if (rtdm_fd_minor(fd) == UDD_RING_MAP) {
+		/*
+		 * The event ring belongs to us, and is read-only:
+		 * prevent mprotect() from making it writable later.
+		 */
+		if (udd->__reserved.ring_len < len ||
+		    (vma->vm_flags & VM_WRITE))
+			return -EINVAL;
+		vma->vm_flags &= ~VM_MAYWRITE;
+		return rtdm_mmap_kmem(vma, udd->__reserved.ring);
+	}
+
 	if (udd->ops.mmap)
 		/* Offload to client driver if handler is present. */
 		return udd->ops.mmap(fd, vma);
 
 	/* Otherwise DIY using the RTDM helpers. */
 
-	len = vma->vm_end - vma->vm_start;
 	rn = udd->mem_regions + rtdm_fd_minor(fd);
 	if (rn->len < len)
 		/* Can't map that much, bail out. */
@@ -278,7 +368,6 @@ static inline int register_mapper(struct udd_device *udd)
 	struct udd_reserved *ur = &udd->__reserved;
 	struct rtdm_driver *drv = &ur->mapper_driver;
 	struct udd_mapper *mapper;
-	struct udd_memregion *rn;
 	int n, ret;
 
 	ur->mapper_name = kasformat("%s,mapper%%d", udd->device_name);
@@ -289,7 +378,7 @@ static inline int register_mapper(struct udd_device *udd)
 		RTDM_PROFILE_INFO(mapper, RTDM_CLASS_MEMORY,
 				  RTDM_SUBCLASS_GENERIC, 0);
 	drv->device_flags = RTDM_NAMED_DEVICE|RTDM_FIXED_MINOR;
-	drv->device_count = UDD_NR_MAPS;
+	drv->device_count = UDD_NR_MAPS + 1;
 	drv->base_minor = 0;
 	drv->ops = (struct rtdm_fd_ops){
 		.open		=	mapper_open,
@@ -297,9 +386,8 @@ static inline int register_mapper(struct udd_device *udd)
 		.mmap		=	mapper_mmap,
 	};
 
-	for (n = 0, mapper = ur->mapdev; n < UDD_NR_MAPS; n++, mapper++) {
-		rn = udd->mem_regions + n;
-		if (rn->type == UDD_MEM_NONE)
+	for (n = 0, mapper = ur->mapdev; n <= UDD_RING_MAP; n++, mapper++) {
+		if (!mapper_present(udd, n))
 			continue;
 		mapper->dev.driver = drv;
 		mapper->dev.label = ur->mapper_name;
@@ -312,12 +400,71 @@ static inline int register_mapper(struct udd_device *udd)
 
 	return 0;
 undo:
-	while (--n >= 0)
-		rtdm_dev_unregister(&ur->mapdev[n].dev);
+	while (--n >= 0) {
+		if (mapper_present(udd, n))
+			rtdm_dev_unregister(&ur->mapdev[n].dev);
+	}
 
 	return ret;
 }
 
+static void unregister_mapper(struct udd_device *udd)
+{
+	struct udd_reserved *ur = &udd->__reserved;
+	int n;
+
+	for (n = 0; n <= UDD_RING_MAP; n++) {
+		if (mapper_present(udd, n))
+			rtdm_dev_unregister(&ur->mapdev[n].dev);
+	}
+}
+
+static int alloc_ring(struct udd_device *udd)
+{
+	struct udd_reserved *ur = &udd->__reserved;
+	struct udd_event_ring *ring;
+	size_t len;
+
+	BUILD_BUG_ON(UDD_RING_MAP != UDD_NR_MAPS);
+
+	ur->ring = NULL;
+	ur->ring_len = 0;
+
+	if (udd->nr_events == 0)
+		return 0;
+
+	if (udd->nr_events < 0 || !is_power_of_2(udd->nr_events))
+		return -EINVAL;
+
+	/* rtdm_mmap_kmem() wants page-aligned memory. */
+	len = PAGE_ALIGN(sizeof(*ring) +
+			 udd->nr_events * sizeof(struct udd_event));
+	ring = alloc_pages_exact(len, GFP_KERNEL | __GFP_ZERO);
+	if (ring == NULL)
+		return -ENOMEM;
+
+	/*
+	 * Userland gets a copy of the ring geometry, the kernel only
+	 * trusts its own.
+	 */
+	ring->mask = udd->nr_events - 1;
+	ur->ring_mask = ring->mask;
+	ur->ring_head = 0;
+	rtdm_lock_init(&ur->ring_lock);
+	ur->ring = ring;
+	ur->ring_len = len;
+
+	return 0;
+}
+
+static void free_ring(struct udd_device *udd)
+{
+	struct udd_reserved *ur = &udd->__reserved;
+
+	if (ur->ring)
+		free_pages_exact(ur->ring, ur->ring_len);
+}
+
 /**
  * @brief Register a UDD device
  *
@@ -375,6 +522,10 @@ int udd_register_device(struct udd_device *udd)
 		udd->__reserved.nr_maps++;
 	}
 
+	ret = alloc_ring(udd);
+	if (ret)
+		return ret;
+
 	drv->profile_info = (struct rtdm_profile_info)
 		RTDM_PROFILE_INFO(udd->device_name, RTDM_CLASS_UDD,
 				  udd->device_subclass, 0);
@@ -395,9 +546,9 @@ int udd_register_device(struct udd_device *udd)
 
 	ret = rtdm_dev_register(dev);
 	if (ret)
-		return ret;
+		goto fail_register;
 
-	if (ur->nr_maps > 0) {
+	if (ur->nr_maps > 0 || ur->ring) {
 		ret = register_mapper(udd);
 		if (ret)
 			goto fail_mapper;
@@ -419,15 +570,13 @@ int udd_register_device(struct udd_device *udd)
 	return 0;
 
 fail_irq_request:
-	for (n = 0; n < UDD_NR_MAPS; n++) {
-		rn = udd->mem_regions + n;
-		if (rn->type != UDD_MEM_NONE)
-			rtdm_dev_unregister(&ur->mapdev[n].dev);
-	}
+	unregister_mapper(udd);
 fail_mapper:
 	rtdm_dev_unregister(dev);
 	if (ur->mapper_name)
 		kfree(ur->mapper_name);
+fail_register:
+	free_ring(udd);
 
 	return ret;
 }
@@ -450,8 +599,6 @@ EXPORT_SYMBOL_GPL(udd_register_device);
 int udd_unregister_device(struct udd_device *udd)
 {
 	struct udd_reserved *ur = &udd->__reserved;
-	struct udd_memregion *rn;
-	int n;
 
 	if (!realtime_core_enabled())
 		return -ENXIO;
@@ -461,17 +608,15 @@ int udd_unregister_device(struct udd_device *udd)
 	if (udd->irq != UDD_IRQ_NONE && udd->irq != UDD_IRQ_CUSTOM)
 		rtdm_irq_free(&ur->irqh);
 
-	for (n = 0; n < UDD_NR_MAPS; n++) {
-		rn = udd->mem_regions + n;
-		if (rn->type != UDD_MEM_NONE)
-			rtdm_dev_unregister(&ur->mapdev[n].dev);
-	}
+	unregister_mapper(udd);
 
 	if (ur->mapper_name)
 		kfree(ur->mapper_name);
 
 	rtdm_dev_unregister(&ur->device);
 
+	free_ring(udd);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(udd_unregister_device);
@@ -498,19 +643,57 @@ EXPORT_SYMBOL_GPL(udd_unregister_device);
  * the device via the write(2) system call has the same effect.
  */
 void udd_notify_event(struct udd_device *udd)
+{
+	udd_notify_event_status(udd, 0);
+}
+EXPORT_SYMBOL_GPL(udd_notify_event);
+
+/**
+ * @brief Notify an IRQ event with status for an unmanaged interrupt
+ *
+ * This service is a variant of udd_notify_event(), which logs @a
+ * status along with the event into the @ref udd_event_ring "event
+ * ring" of the device, if present.
+ *
+ * @param udd UDD device descriptor receiving the IRQ.
+ *
+ * @param status Device-specific status word.
+ *
+ * @coretags{coreirq-only}
+ */
+void udd_notify_event_status(struct udd_device *udd, u32 status)
 {
 	struct udd_reserved *ur = &udd->__reserved;
+	struct udd_event_ring *ring = ur->ring;
+	struct udd_event *e;
 	union sigval sival;
+	rtdm_lockctx_t c;
+	u32 seq;
+
+	if (ring) {
+		rtdm_lock_get_irqsave(&ur->ring_lock, c);
+		seq = atomic_inc_return(&ur->event);
+		e = &ring->entries[seq & ur->ring_mask];
+		e->seq = 0;	/* Invalid while we update. */
+		smp_wmb();
+		e->timestamp = rtdm_clock_read_monotonic();
+		e->status = status;
+		smp_wmb();
+		e->seq = seq;
+		ur->ring_head = seq;
+		ring->head = seq;
+		rtdm_lock_put_irqrestore(&ur->ring_lock, c);
+	} else
+		seq = atomic_inc_return(&ur->event);
 
-	atomic_inc(&ur->event);
 	rtdm_event_signal(&ur->pulse);
 
 	if (ur->signfy.pid > 0) {
-		sival.sival_int = atomic_read(&ur->event);
+		sival.sival_int = seq;
 		__cobalt_sigqueue(ur->signfy.pid, ur->signfy.sig, &sival);
 	}
 }
-EXPORT_SYMBOL_GPL(udd_notify_event);
+EXPORT_SYMBOL_GPL(udd_notify_event_status);
 
 struct irqswitch_work {
 	struct ipipe_work_header work; /* Must be first. */
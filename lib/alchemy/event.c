@@ -53,7 +53,7 @@ struct syncluster alchemy_event_table;
 static DEFINE_NAME_GENERATOR(event_namegen, "event",
 			     struct alchemy_event, name);
 
-DEFINE_LOOKUP_PRIVATE(event, RT_EVENT);
+DEFINE_LOOKUP(event, RT_EVENT);
 
 #ifdef CONFIG_XENO_REGISTRY
 
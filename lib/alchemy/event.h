@@ -36,4 +36,6 @@ struct alchemy_event {
 
 extern struct syncluster alchemy_event_table;
 
+struct alchemy_event *find_alchemy_event(RT_EVENT *event, int *err_r);
+
 #endif /* _ALCHEMY_EVENT_H */
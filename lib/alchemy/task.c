@@ -29,6 +29,7 @@
 #include "queue.h"
 #include "timer.h"
 #include "heap.h"
+#include "event.h"
 
 /**
  * @ingroup alchemy
@@ -195,6 +196,9 @@ static void task_finalizer(struct threadobj *thobj)
 	ret = __bt(syncobj_lock(&tcb->sobj_msg, &syns));
 	if (ret == 0)
 		syncobj_destroy(&tcb->sobj_msg, &syns);
+
+	if (tcb->msgbuf)
+		xnfree(tcb->msgbuf);
 }
 
 static int task_prologue_1(void *arg)
@@ -280,6 +284,8 @@ static int create_tcb(struct alchemy_task **tcbp, RT_TASK *task,
 
 	tcb->suspends = 0;
 	tcb->flowgen = 0;
+	tcb->msgbuf = NULL;
+	tcb->donated_prio = -1;
 
 	idata.magic = task_magic;
 	idata.finalizer = task_finalizer;
@@ -926,6 +932,101 @@ int rt_task_wait_period(unsigned long *overruns_r)
 	return threadobj_wait_period(overruns_r);
 }
 
+/**
+ * @fn int rt_task_set_budget(RT_TASK *task, RTIME budget, RT_EVENT *event, unsigned int mask)
+ * @brief Set the CPU time budget of a periodic task.
+ *
+ * Declare the amount of CPU time a periodic task is expected to
+ * consume between two release points. When the task exceeds this
+ * budget within a period, the flags from @a mask are posted to @a
+ * event as soon as the overrun happens, so that a supervisor task
+ * waiting on @a event may act upon it. The overrun is notified once
+ * per period, the task keeps running unaffected.
+ *
+ * The budget is replenished on each release point of the periodic
+ * timeline set by rt_task_set_periodic(). Calling
+ * rt_task_set_periodic() again cancels the budget, which should be
+ * set anew afterwards.
+ *
+ * @param task The task descriptor. If @a task is NULL, the budget
+ * applies to the current task. @a task must belong the current
+ * process.
+ *
+ * @param budget The CPU time allotted to the task per period,
+ * expressed in clock ticks (see note). Passing TM_INFINITE disables
+ * budget enforcement for the task.
+ *
+ * @param event The event flag group to post overruns to. If NULL,
+ * overruns are counted but not notified. The event should not be
+ * deleted while the budget is enforced.
+ *
+ * @param mask The set of flags to post to @a event.
+ *
+ * @return Zero is returned upon success. Otherwise:
+ *
+ * - -EINVAL is returned if @a task is NULL but the caller is not a
+ * Xenomai task, or if @a task is non-NULL but not a valid task
+ * descriptor, or if @a event is non-NULL but not a valid event flag
+ * group descriptor, or if @a budget is longer than the period.
+ *
+ * - -EWOULDBLOCK is returned if rt_task_set_periodic() was not
+ * called for @a task.
+ *
+ * @apitags{mode-unrestricted, switch-secondary}
+ *
+ * @note Over Cobalt, the budget accounts for the time the task runs
+ * in primary mode, and the overrun is detected by the real-time core
+ * when it happens. Over Mercury, the overall CPU time of the task is
+ * tracked instead, and the notification is issued by an ancillary
+ * thread. In both cases, the overrun count is reported by
+ * rt_task_inquire().
+ *
+ * @note The @a budget value is interpreted as a multiple of the
+ * Alchemy clock resolution (see --alchemy-clock-resolution option,
+ * defaults to 1 nanosecond).
+ */
+int rt_task_set_budget(RT_TASK *task, RTIME budget,
+		       RT_EVENT *event, unsigned int mask)
+{
+	struct alchemy_event *evcb = NULL;
+	struct alchemy_task *tcb;
+	struct service svc;
+	struct timespec bts;
+	int ret;
+
+	CANCEL_DEFER(svc);
+
+	if (budget == TM_INFINITE) {
+		bts.tv_sec = 0;
+		bts.tv_nsec = 0;
+	} else {
+		clockobj_ticks_to_timespec(&alchemy_clock, budget, &bts);
+		if (event) {
+			evcb = find_alchemy_event(event, &ret);
+			if (evcb == NULL)
+				goto out;
+		}
+	}
+
+	tcb = get_alchemy_task_or_self(task, &ret);
+	if (tcb == NULL)
+		goto out;
+
+	if (!threadobj_local_p(&tcb->thobj)) {
+		ret = -EINVAL;
+		goto put;
+	}
+
+	ret = threadobj_set_budget(&tcb->thobj, &bts,
+				   evcb ? &evcb->evobj : NULL, mask, 0);
+put:
+	put_alchemy_task(tcb);
+out:
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
 /**
  * @fn int rt_task_sleep_until(RTIME date)
  * @brief Delay the current real-time task (with absolute wakeup date).
@@ -1574,6 +1675,70 @@ out:
 }
 
 
+static void *get_msgbuf(size_t size)
+{
+	struct alchemy_task *current = alchemy_task_current();
+
+	/*
+	 * A sender waits for the reply before sending again, so a
+	 * single buffer serves both directions of all its transfers,
+	 * the request being always collected before the reply is
+	 * posted.
+	 */
+	if (current == NULL || size > TASK_MSGBUF_SIZE)
+		return xnmalloc(size);
+
+	if (current->msgbuf == NULL)
+		current->msgbuf = xnmalloc(TASK_MSGBUF_SIZE);
+
+	return current->msgbuf;
+}
+
+static void put_msgbuf(void *buf)
+{
+	struct alchemy_task *current = alchemy_task_current();
+
+	if (buf && (current == NULL || buf != current->msgbuf))
+		xnfree(buf);
+}
+
+/*
+ * Run the server at the priority of the client it is serving if the
+ * latter is higher, or back to its base priority if @prio is
+ * negative.
+ */
+static void donate_priority(struct alchemy_task *current, int prio)
+{
+	struct sched_param_ex param_ex;
+	int policy;
+
+	threadobj_lock(&current->thobj);
+
+	if (current->donated_prio < 0) {
+		if (prio <= threadobj_get_priority(&current->thobj))
+			goto out;
+		current->base_policy = threadobj_get_policy(&current->thobj);
+		current->base_prio = threadobj_get_priority(&current->thobj);
+	} else if (prio <= current->base_prio)
+		prio = -1;
+
+	if (prio == current->donated_prio)
+		goto out;
+
+	if (prio < 0) {
+		policy = current->base_policy;
+		param_ex.sched_priority = current->base_prio;
+	} else {
+		policy = SCHED_FIFO;
+		param_ex.sched_priority = prio;
+	}
+
+	if (threadobj_set_schedparam(&current->thobj, policy, &param_ex) == 0)
+		current->donated_prio = prio;
+out:
+	threadobj_unlock(&current->thobj);
+}
+
 /**
  * @fn ssize_t rt_task_send(RT_TASK *task, RT_TASK_MCB *mcb_s, RT_TASK_MCB *mcb_r, RTIME timeout)
  * @brief Send a message to a real-time task (with relative scalar timeout).
@@ -1767,7 +1932,7 @@ ssize_t rt_task_send_timed(RT_TASK *task,
 	 * main heap.
 	 */
 	if (mcb_s->size > 0 && !threadobj_local_p(&tcb->thobj)) {
-		rbufin = xnmalloc(mcb_s->size);
+		rbufin = get_msgbuf(mcb_s->size);
 		if (rbufin == NULL) {
 			ret = -ENOMEM;
 			goto cleanup;
@@ -1780,7 +1945,7 @@ ssize_t rt_task_send_timed(RT_TASK *task,
 		wait->reply.size = mcb_r->size;
 		wait->reply.data = mcb_r->data;
 		if (mcb_r->size > 0 && !threadobj_local_p(&tcb->thobj)) {
-			rbufout = xnmalloc(mcb_r->size);
+			rbufout = get_msgbuf(mcb_r->size);
 			if (rbufout == NULL) {
 				ret = -ENOMEM;
 				goto cleanup;
@@ -1804,6 +1969,8 @@ ssize_t rt_task_send_timed(RT_TASK *task,
 	}
 
 	ret = wait->reply.size;
+	if (mcb_r)
+		mcb_r->opcode = wait->reply.opcode;
 	if (!threadobj_local_p(&tcb->thobj) && ret > 0 && mcb_r)
 		memcpy(mcb_r->data, rbufout, ret);
 cleanup:
@@ -1811,16 +1978,108 @@ cleanup:
 done:
 	syncobj_unlock(&tcb->sobj_msg, &syns);
 out:
-	if (rbufin)
-		xnfree(rbufin);
-	if (rbufout)
-		xnfree(rbufout);
-	
+	put_msgbuf(rbufin);
+	put_msgbuf(rbufout);
+
 	CANCEL_RESTORE(svc);
 
 	return ret;
 }
 
+static int fetch_request(struct alchemy_task *current, RT_TASK_MCB *mcb_r,
+			 const struct timespec *abs_timeout,
+			 struct syncstate *syns, int *prio_r)
+{
+	struct alchemy_task_wait *wait;
+	struct threadobj *thobj;
+	RT_TASK_MCB *mcb_s;
+	int ret;
+
+	while (!syncobj_grant_wait_p(&current->sobj_msg)) {
+		if (alchemy_poll_mode(abs_timeout))
+			return -EWOULDBLOCK;
+		ret = syncobj_wait_drain(&current->sobj_msg, abs_timeout, syns);
+		if (ret)
+			return ret;
+	}
+
+	thobj = syncobj_peek_grant(&current->sobj_msg);
+	wait = threadobj_get_wait(thobj);
+	mcb_s = &wait->request;
+
+	if (mcb_s->size > mcb_r->size) {
+		ret = -ENOBUFS;
+		goto fixup;
+	}
+
+	if (mcb_s->size > 0) {
+		if (!threadobj_local_p(thobj))
+			memcpy(mcb_r->data, __mptr(mcb_s->__dref), mcb_s->size);
+		else
+			memcpy(mcb_r->data, mcb_s->data, mcb_s->size);
+	}
+
+	/* The flow identifier is always strictly positive. */
+	ret = mcb_s->flowid;
+	mcb_r->opcode = mcb_s->opcode;
+	if (prio_r)
+		*prio_r = threadobj_get_priority(thobj);
+fixup:
+	mcb_r->size = mcb_s->size;
+
+	return ret;
+}
+
+static int post_reply(struct alchemy_task *current,
+		      int flowid, RT_TASK_MCB *mcb_s)
+{
+	struct alchemy_task_wait *wait = NULL;
+	struct threadobj *thobj;
+	RT_TASK_MCB *mcb_r;
+	size_t size;
+	int ret;
+
+	if (!syncobj_grant_wait_p(&current->sobj_msg))
+		return -ENXIO;
+
+	syncobj_for_each_grant_waiter(&current->sobj_msg, thobj) {
+		wait = threadobj_get_wait(thobj);
+		if (wait->request.flowid == flowid)
+			goto reply;
+	}
+
+	return -ENXIO;
+ reply:
+	size = mcb_s ? mcb_s->size : 0;
+	syncobj_grant_to(&current->sobj_msg, thobj);
+	mcb_r = &wait->reply;
+
+	/*
+	 * NOTE: sending back a NULL or zero-length reply is perfectly
+	 * valid; it just means to unblock the client without passing
+	 * it back any reply data. Sending a response larger than what
+	 * the client expects is invalid.
+	 */
+	if (mcb_r->size < size) {
+		ret = -ENOBUFS;	/* Client will get this too. */
+		mcb_r->size = -ENOBUFS;
+	} else {
+		ret = 0;
+		mcb_r->size = size;
+		if (size > 0) {
+			if (!threadobj_local_p(thobj))
+				memcpy(__mptr(mcb_r->__dref), mcb_s->data, size);
+			else
+				memcpy(mcb_r->data, mcb_s->data, size);
+		}
+	}
+
+	mcb_r->flowid = flowid;
+	mcb_r->opcode = mcb_s ? mcb_s->opcode : 0;
+
+	return ret;
+}
+
 /**
  * @fn ssize_t rt_task_receive(RT_TASK_MCB *mcb_r, RTIME timeout)
  * @brief Receive a message from a real-time task (with relative scalar timeout).
@@ -1924,12 +2183,9 @@ out:
 int rt_task_receive_timed(RT_TASK_MCB *mcb_r,
 			  const struct timespec *abs_timeout)
 {
-	struct alchemy_task_wait *wait;
 	struct alchemy_task *current;
-	struct threadobj *thobj;
 	struct syncstate syns;
 	struct service svc;
-	RT_TASK_MCB *mcb_s;
 	int ret;
 
 	current = alchemy_task_current();
@@ -1942,38 +2198,10 @@ int rt_task_receive_timed(RT_TASK_MCB *mcb_r,
 	if (ret)
 		goto out;
 
-	while (!syncobj_grant_wait_p(&current->sobj_msg)) {
-		if (alchemy_poll_mode(abs_timeout)) {
-			ret = -EWOULDBLOCK;
-			goto done;
-		}
-		ret = syncobj_wait_drain(&current->sobj_msg, abs_timeout, &syns);
-		if (ret)
-			goto done;
-	}
-
-	thobj = syncobj_peek_grant(&current->sobj_msg);
-	wait = threadobj_get_wait(thobj);
-	mcb_s = &wait->request;
-
-	if (mcb_s->size > mcb_r->size) {
-		ret = -ENOBUFS;
-		goto fixup;
-	}
-
-	if (mcb_s->size > 0) {
-		if (!threadobj_local_p(thobj))
-			memcpy(mcb_r->data, __mptr(mcb_s->__dref), mcb_s->size);
-		else
-			memcpy(mcb_r->data, mcb_s->data, mcb_s->size);
-	}
+	ret = fetch_request(current, mcb_r, abs_timeout, &syns, NULL);
+	if (ret == -EIDRM)
+		goto out;
 
-	/* The flow identifier is always strictly positive. */
-	ret = mcb_s->flowid;
-	mcb_r->opcode = mcb_s->opcode;
-fixup:
-	mcb_r->size = mcb_s->size;
-done:
 	syncobj_unlock(&current->sobj_msg, &syns);
 out:
 	CANCEL_RESTORE(svc);
@@ -2042,13 +2270,9 @@ out:
  */
 int rt_task_reply(int flowid, RT_TASK_MCB *mcb_s)
 {
-	struct alchemy_task_wait *wait = NULL;
 	struct alchemy_task *current;
-	struct threadobj *thobj;
 	struct syncstate syns;
 	struct service svc;
-	RT_TASK_MCB *mcb_r;
-	size_t size;
 	int ret;
 
 	current = alchemy_task_current();
@@ -2064,51 +2288,154 @@ int rt_task_reply(int flowid, RT_TASK_MCB *mcb_s)
 	if (ret)
 		goto out;
 
-	ret = -ENXIO;
-	if (!syncobj_grant_wait_p(&current->sobj_msg))
-		goto done;
+	ret = post_reply(current, flowid, mcb_s);
 
-	syncobj_for_each_grant_waiter(&current->sobj_msg, thobj) {
-		wait = threadobj_get_wait(thobj);
-		if (wait->request.flowid == flowid)
-			goto reply;
-	}
-	goto done;
- reply:
-	size = mcb_s ? mcb_s->size : 0;
-	syncobj_grant_to(&current->sobj_msg, thobj);
-	mcb_r = &wait->reply;
+	syncobj_unlock(&current->sobj_msg, &syns);
+
+	/* Drop any priority received from rt_task_reply_receive(). */
+	if (current->donated_prio >= 0)
+		donate_priority(current, -1);
+out:
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
+/**
+ * @fn int rt_task_reply_receive(int flowid, RT_TASK_MCB *mcb_s, RT_TASK_MCB *mcb_r, RTIME timeout)
+ * @brief Reply to a message then receive the next one (with relative scalar timeout).
+ *
+ * This routine is a variant of rt_task_reply_receive_timed()
+ * accepting a relative timeout specification expressed as a scalar
+ * value.
+ *
+ * @apitags{xthread-only, switch-primary}
+ */
+
+/**
+ * @fn int rt_task_reply_receive_until(int flowid, RT_TASK_MCB *mcb_s, RT_TASK_MCB *mcb_r, RTIME abs_timeout)
+ * @brief Reply to a message then receive the next one (with absolute scalar timeout).
+ *
+ * This routine is a variant of rt_task_reply_receive_timed()
+ * accepting an absolute timeout specification expressed as a scalar
+ * value.
+ *
+ * @apitags{xthread-only, switch-primary}
+ */
+
+/**
+ * @fn int rt_task_reply_receive_timed(int flowid, RT_TASK_MCB *mcb_s, RT_TASK_MCB *mcb_r, const struct timespec *abs_timeout)
+ * @brief Reply to a message then receive the next one.
+ *
+ * This service is the fast path of the synchronous message passing
+ * support, for tasks serving requests in a loop. It combines
+ * rt_task_reply() and rt_task_receive_timed() in a single operation:
+ * the client is released and the caller waits for the next request
+ * atomically, so that the CPU is handed over directly to the client
+ * if the latter has precedence. Conversely, a client sending a
+ * message to a server waiting in this service hands over the CPU
+ * directly to the server.
+ *
+ * In addition, a server receiving a message through this service
+ * inherits the priority of the sending task if higher than its own,
+ * until it replies. The server does not compete with tasks of lower
+ * priority than its clients while processing their requests.
+ *
+ * Payloads exchanged with tasks from other processes go through a
+ * buffer owned by the sending task, which is reused from one
+ * transfer to the next for messages up to 4 KiB.
+ *
+ * @param flowid The flow identifier of the transaction to reply to,
+ * as returned by the previous call to this service or to
+ * rt_task_receive(). Zero means that no reply should be sent, which
+ * is used to enter the server loop.
+ *
+ * @param mcb_s The address of an optional message control block
+ * referring to the message to be sent back, as described for
+ * rt_task_reply(). Ignored if @a flowid is zero.
+ *
+ * @param mcb_r The address of a message control block referring to
+ * the receive message area, as described for rt_task_receive().
+ *
+ * @param abs_timeout An absolute date expressed in clock ticks,
+ * specifying a time limit to wait for the next message. Passing NULL
+ * causes the caller to block indefinitely until a remote task
+ * eventually sends a message. Passing { .tv_sec = 0, .tv_nsec = 0 }
+ * causes the service to return immediately without waiting if no
+ * remote task is currently waiting for sending a message.
+ *
+ * @return A strictly positive value is returned upon success,
+ * representing the flow identifier of the new transaction. Otherwise,
+ * any error code returned by rt_task_reply() is passed back if the
+ * reply failed, in which case no message is received. Any error
+ * code returned by rt_task_receive() may be returned as well.
+ *
+ * @apitags{xthread-only, switch-primary}
+ *
+ * @note The priority inherited from a client is dropped when the
+ * server replies with rt_task_reply(), or fails receiving the next
+ * message. Changing the priority of a server while it processes a
+ * request with an inherited priority is not supported.
+ *
+ * @note @a abs_timeout is interpreted as a multiple of the Alchemy
+ * clock resolution (see --alchemy-clock-resolution option, defaults
+ * to 1 nanosecond).
+ */
+int rt_task_reply_receive_timed(int flowid, RT_TASK_MCB *mcb_s,
+				RT_TASK_MCB *mcb_r,
+				const struct timespec *abs_timeout)
+{
+	struct alchemy_task *current;
+	struct syncstate syns;
+	struct service svc;
+	int ret, prio = -1;
+
+	current = alchemy_task_current();
+	if (current == NULL)
+		return -EPERM;
+
+	if (flowid < 0)
+		return -EINVAL;
+
+	CANCEL_DEFER(svc);
+
+	ret = __bt(syncobj_lock(&current->sobj_msg, &syns));
+	if (ret)
+		goto out;
 
 	/*
-	 * NOTE: sending back a NULL or zero-length reply is perfectly
-	 * valid; it just means to unblock the client without passing
-	 * it back any reply data. Sending a response larger than what
-	 * the client expects is invalid.
+	 * The client is granted when we drop the monitor for waiting
+	 * on the next request, which runs both in a single step.
 	 */
-	if (mcb_r->size < size) {
-		ret = -ENOBUFS;	/* Client will get this too. */
-		mcb_r->size = -ENOBUFS;
-	} else {
-		ret = 0;
-		mcb_r->size = size;
-		if (size > 0) {
-			if (!threadobj_local_p(thobj))
-				memcpy(__mptr(mcb_r->__dref), mcb_s->data, size);
-			else
-				memcpy(mcb_r->data, mcb_s->data, size);
-		}
+	if (flowid > 0) {
+		ret = post_reply(current, flowid, mcb_s);
+		if (ret)
+			goto done;
 	}
 
-	mcb_r->flowid = flowid;
-	mcb_r->opcode = mcb_s ? mcb_s->opcode : 0;
+	ret = fetch_request(current, mcb_r, abs_timeout, &syns, &prio);
+	if (ret == -EIDRM)
+		goto out;
 done:
 	syncobj_unlock(&current->sobj_msg, &syns);
+
+	/*
+	 * We keep the priority inherited from the previous client
+	 * while waiting, so that serving a stream of requests from
+	 * the same client does not change it. The next request is
+	 * picked at this priority, then we switch to the one of the
+	 * new client if it differs.
+	 */
+	if (ret <= 0)
+		prio = -1;
+
+	if (prio >= 0 || current->donated_prio >= 0)
+		donate_priority(current, prio);
 out:
 	CANCEL_RESTORE(svc);
 
 	return ret;
 }
-
 /**
  * @fn int rt_task_bind(RT_TASK *task, const char *name, RTIME timeout)
  * @brief Bind to a task.
@@ -36,6 +36,10 @@ struct alchemy_task {
 	int suspends;
 	struct syncobj sobj_msg;
 	int flowgen;
+	void *msgbuf;
+	int donated_prio;
+	int base_policy;
+	int base_prio;
 	struct threadobj thobj;
 	struct clusterobj cobj;
 	void (*entry)(void *arg);
@@ -51,6 +55,9 @@ struct alchemy_task_wait {
 
 #define task_magic	0x8282ebeb
 
+/* Payloads up to this size are sent to remote tasks without allocation. */
+#define TASK_MSGBUF_SIZE	4096
+
 static inline struct alchemy_task *alchemy_task_current(void)
 {
 	struct threadobj *thobj = threadobj_current();
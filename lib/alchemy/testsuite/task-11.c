@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <copperplate/traceobj.h>
+#include <alchemy/task.h>
+#include <alchemy/event.h>
+
+#define PERIOD		10000000	/* 10 ms */
+#define BUDGET		2000000		/* 2 ms */
+#define GO_BIT		0x1
+#define OVERRUN_BIT	0x4
+
+static struct traceobj trobj;
+
+static int tseq[] = {
+	1, 5, 2, 6, 3, 7, 4
+};
+
+static RT_TASK t_periodic;
+
+static RT_EVENT event;
+
+static void periodic_task(void *arg)
+{
+	unsigned long overruns;
+	unsigned int mask;
+	int ret, n;
+
+	traceobj_enter(&trobj);
+
+	traceobj_mark(&trobj, 5);
+
+	ret = rt_task_set_periodic(NULL, TM_NOW, PERIOD);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_set_budget(NULL, BUDGET, &event, OVERRUN_BIT);
+	traceobj_check(&trobj, ret, 0);
+
+	/* Stay within the budget for a few periods. */
+	for (n = 0; n < 5; n++) {
+		ret = rt_task_wait_period(&overruns);
+		traceobj_check(&trobj, ret, 0);
+		rt_timer_spin(BUDGET / 4);
+	}
+
+	traceobj_mark(&trobj, 6);
+
+	ret = rt_task_wait_period(&overruns);
+	traceobj_check(&trobj, ret, 0);
+	rt_timer_spin(BUDGET * 4);
+
+	ret = rt_event_wait(&event, GO_BIT, &mask, EV_ANY, TM_INFINITE);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_mark(&trobj, 7);
+
+	ret = rt_task_set_periodic(NULL, TM_NOW, TM_INFINITE);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_exit(&trobj);
+}
+
+int main(int argc, char *const argv[])
+{
+	unsigned int mask;
+	RT_TASK_INFO info;
+	int ret;
+
+	traceobj_init(&trobj, argv[0], sizeof(tseq) / sizeof(int));
+
+	ret = rt_event_create(&event, "EVENT", 0, EV_FIFO);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_create(&t_periodic, "periodic", 0, 20, T_JOINABLE);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_mark(&trobj, 1);
+
+	ret = rt_task_start(&t_periodic, periodic_task, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_mark(&trobj, 2);
+
+	/* The overrun must be notified while the task still runs. */
+	ret = rt_event_wait(&event, OVERRUN_BIT, &mask, EV_ANY, 1000000000);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, mask == OVERRUN_BIT);
+
+	ret = rt_task_inquire(&t_periodic, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.stat.budget_overruns == 1);
+
+	traceobj_mark(&trobj, 3);
+
+	ret = rt_event_signal(&event, GO_BIT);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_join(&t_periodic);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_mark(&trobj, 4);
+
+	traceobj_verify(&trobj, tseq, sizeof(tseq) / sizeof(int));
+
+	ret = rt_event_delete(&event);
+	traceobj_check(&trobj, ret, 0);
+
+	exit(0);
+}
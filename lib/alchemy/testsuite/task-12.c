@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <copperplate/traceobj.h>
+#include <alchemy/task.h>
+#include <alchemy/timer.h>
+
+#define ROUNDS		10000
+#define MSGSIZE		64
+#define OP_ECHO		1
+#define OP_SWITCH	2
+#define OP_STOP		3
+
+static struct traceobj trobj;
+
+static int tseq[] = {
+	1, 5, 2, 6, 7, 3, 4
+};
+
+static RT_TASK t_server, t_client;
+
+static RTIME legacy_rtt, handoff_rtt;
+
+static void check_priority(int prio)
+{
+	RT_TASK_INFO info;
+	int ret;
+
+	ret = rt_task_inquire(NULL, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.prio == prio);
+}
+
+static void server_task(void *arg)
+{
+	RT_TASK_MCB mcb_s, mcb_r;
+	char buf[MSGSIZE];
+	int flowid, ret;
+
+	traceobj_enter(&trobj);
+
+	traceobj_mark(&trobj, 5);
+
+	/* First phase: separate receive and reply calls. */
+	for (;;) {
+		mcb_r.data = buf;
+		mcb_r.size = sizeof(buf);
+		flowid = rt_task_receive(&mcb_r, TM_INFINITE);
+		traceobj_assert(&trobj, flowid > 0);
+		if (mcb_r.opcode == OP_SWITCH)
+			break;
+		ret = rt_task_reply(flowid, &mcb_r);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	traceobj_mark(&trobj, 6);
+
+	/*
+	 * Second phase: reply to the pending request and wait for the
+	 * next one in a single call. The reply is copied out before the
+	 * next request is received, so both may share the buffer. The
+	 * client priority is inherited while its request is served.
+	 */
+	for (;;) {
+		mcb_s = mcb_r;
+		mcb_r.data = buf;
+		mcb_r.size = sizeof(buf);
+		flowid = rt_task_reply_receive(flowid, &mcb_s, &mcb_r,
+					       TM_INFINITE);
+		traceobj_assert(&trobj, flowid > 0);
+		check_priority(30);
+		if (mcb_r.opcode == OP_STOP)
+			break;
+	}
+
+	traceobj_mark(&trobj, 7);
+
+	ret = rt_task_reply(flowid, &mcb_r);
+	traceobj_check(&trobj, ret, 0);
+
+	check_priority(10);
+
+	traceobj_exit(&trobj);
+}
+
+static RTIME ping_pong(int rounds)
+{
+	char sbuf[MSGSIZE], rbuf[MSGSIZE];
+	RT_TASK_MCB mcb_s, mcb_r;
+	RTIME start;
+	ssize_t ret;
+	int n;
+
+	start = rt_timer_read();
+
+	for (n = 0; n < rounds; n++) {
+		memset(sbuf, n, sizeof(sbuf));
+		mcb_s.opcode = OP_ECHO;
+		mcb_s.data = sbuf;
+		mcb_s.size = sizeof(sbuf);
+		mcb_r.data = rbuf;
+		mcb_r.size = sizeof(rbuf);
+		ret = rt_task_send(&t_server, &mcb_s, &mcb_r, TM_INFINITE);
+		traceobj_assert(&trobj, ret == sizeof(rbuf));
+		traceobj_assert(&trobj, mcb_r.opcode == OP_ECHO);
+		traceobj_assert(&trobj, memcmp(sbuf, rbuf, sizeof(rbuf)) == 0);
+	}
+
+	return (rt_timer_read() - start) / rounds;
+}
+
+static void send_control(int opcode)
+{
+	RT_TASK_MCB mcb_s, mcb_r;
+	ssize_t ret;
+
+	mcb_s.opcode = opcode;
+	mcb_s.data = NULL;
+	mcb_s.size = 0;
+	mcb_r.data = NULL;
+	mcb_r.size = 0;
+	ret = rt_task_send(&t_server, &mcb_s, &mcb_r, TM_INFINITE);
+	traceobj_assert(&trobj, ret >= 0);
+}
+
+static void client_task(void *arg)
+{
+	traceobj_enter(&trobj);
+
+	legacy_rtt = ping_pong(ROUNDS);
+	send_control(OP_SWITCH);
+	handoff_rtt = ping_pong(ROUNDS);
+	send_control(OP_STOP);
+
+	traceobj_exit(&trobj);
+}
+
+int main(int argc, char *const argv[])
+{
+	int ret;
+
+	traceobj_init(&trobj, argv[0], sizeof(tseq) / sizeof(int));
+
+	ret = rt_task_create(&t_server, "server", 0, 10, T_JOINABLE);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_create(&t_client, "client", 0, 30, T_JOINABLE);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_mark(&trobj, 1);
+
+	ret = rt_task_start(&t_server, server_task, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_mark(&trobj, 2);
+
+	ret = rt_task_start(&t_client, client_task, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_join(&t_client);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_mark(&trobj, 3);
+
+	ret = rt_task_join(&t_server);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_mark(&trobj, 4);
+
+	traceobj_verify(&trobj, tseq, sizeof(tseq) / sizeof(int));
+
+	printf("%s: round trip %llu ns with receive+reply, %llu ns with reply_receive\n",
+	       argv[0], (unsigned long long)rt_timer_ticks2ns(legacy_rtt),
+	       (unsigned long long)rt_timer_ticks2ns(handoff_rtt));
+
+	exit(0);
+}
@@ -25,6 +25,7 @@
 #include <assert.h>
 
 #include <rtdm/analogy.h>
+#include "simd.h"
 
 struct vec {
 	unsigned dim;
@@ -403,16 +404,13 @@ int a4l_math_polyfit(unsigned r_dim, double *r, double orig, const unsigned dim,
  * @param[in] val Array of input values
  * @param[in] nr Number of array elements
  *
+ * The values are summed by blocks with the vector unit of the CPU
+ * when available. The result does not depend on the instruction set
+ * in use.
  */
 void a4l_math_mean(double *pmean, double *val, unsigned nr)
 {
-	double sum;
-	int i;
-
-	for (sum = 0, i = 0; i < nr; i++)
-		sum += val[i];
-
-	*pmean = sum / nr;
+	*pmean = a4l_simd->sum(val, nr) / nr;
 }
 
 /**
@@ -427,13 +425,8 @@ void a4l_math_mean(double *pmean, double *val, unsigned nr)
 void a4l_math_stddev(double *pstddev, double mean, double *val, unsigned nr)
 {
 	double sum, sum_sq;
-	int i;
 
-	for (sum = 0, sum_sq = 0, i = 0; i < nr; i++) {
-		double x = val[i] - mean;
-		sum_sq += x * x;
-		sum += x;
-	}
+	a4l_simd->sum_dev(val, nr, mean, &sum, &sum_sq);
 
 	*pstddev = sqrt((sum_sq - (sum * sum) / nr) / (nr - 1));
 }
@@ -454,4 +447,65 @@ void a4l_math_stddev_of_mean(double *pstddevm, double mean, double *val, unsigne
 }
 
 
+/**
+ * @brief Generate a block of sine wave samples
+ *
+ * Sample i of the waveform is offset - amplitude / 2 + amplitude / 2
+ * * cos(2 * pi * i * ratio), the block starting at sample @a first.
+ * Streaming applications may thus regenerate a waveform block by
+ * block, the output does not depend on the block size.
+ *
+ * @param[out] dst Array receiving the samples
+ * @param[in] first Rank of the first sample of the block
+ * @param[in] nr Number of samples to generate
+ * @param[in] ratio Waveform frequency divided by the sampling
+ * frequency, in ]0, 0.5]
+ * @param[in] amplitude Peak to peak amplitude
+ * @param[in] offset Offset of the waveform
+ *
+ * The result is accurate to a few units in the last place for
+ * phases below 10^6 radians.
+ */
+void a4l_math_sine(double *dst, unsigned int first, unsigned int nr,
+		   double ratio, double amplitude, double offset)
+{
+	a4l_simd->sine(dst, first, nr, ratio, amplitude, offset);
+}
+
+/**
+ * @brief Generate a block of square wave samples
+ *
+ * The waveform is centered on @a offset, high during the first half
+ * of each period. See a4l_math_sine() for the parameters.
+ */
+void a4l_math_square(double *dst, unsigned int first, unsigned int nr,
+		     double ratio, double amplitude, double offset)
+{
+	a4l_simd->square(dst, first, nr, ratio, amplitude, offset);
+}
+
+/**
+ * @brief Generate a block of triangle wave samples
+ *
+ * The waveform is centered on @a offset, rising during the first
+ * half of each period. See a4l_math_sine() for the parameters.
+ */
+void a4l_math_triangle(double *dst, unsigned int first, unsigned int nr,
+		       double ratio, double amplitude, double offset)
+{
+	a4l_simd->triangle(dst, first, nr, ratio, amplitude, offset);
+}
+
+/**
+ * @brief Generate a block of sawtooth wave samples
+ *
+ * The waveform is centered on @a offset. See a4l_math_sine() for the
+ * parameters.
+ */
+void a4l_math_sawtooth(double *dst, unsigned int first, unsigned int nr,
+		       double ratio, double amplitude, double offset)
+{
+	a4l_simd->sawtooth(dst, first, nr, ratio, amplitude, offset);
+}
+
 /** @} Math API */
@@ -23,6 +23,7 @@
 #include <errno.h>
 #include <math.h>
 #include "internal.h"
+#include "simd.h"
 #include <rtdm/analogy.h>
 
 #ifndef DOXYGEN_CPP
@@ -417,6 +418,17 @@ int a4l_rawtod(a4l_chinfo_t * chan,
 		(((1ULL << chan->nb_bits) - 1) * A4L_RNG_FACTOR);
 	b = ((double)rng->min) / A4L_RNG_FACTOR;
 
+	/* 16 and 32-bit samples are converted by blocks */
+	if (cnt > 0 && size == 2) {
+		a4l_simd->rawtod16(dst, src, cnt, a, b);
+		return cnt;
+	}
+
+	if (cnt > 0 && size == 4) {
+		a4l_simd->rawtod32(dst, src, cnt, a, b);
+		return cnt;
+	}
+
 	while (j < cnt) {
 
 		/* Properly retrieve the data */
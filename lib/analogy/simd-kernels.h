@@ -0,0 +1,228 @@
+/*
+ * Analogy for Linux, vectorized block kernels
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/*
+ * This file is included once per instruction set by simd.c, with
+ * KERNEL() naming the variant and KERNEL_ATTR selecting the target.
+ */
+
+static KERNEL_ATTR
+void KERNEL(rawtod16)(double *dst, const uint16_t *src,
+		      unsigned int nr, double a, double b)
+{
+	unsigned int n;
+	v4hu raw;
+	v4df x;
+
+	for (n = 0; n + 4 <= nr; n += 4) {
+		memcpy(&raw, src + n, sizeof(raw));
+		x = vec_convert(raw, v4df) * a + b;
+		memcpy(dst + n, &x, sizeof(x));
+	}
+
+	for (; n < nr; n++)
+		dst[n] = src[n] * a + b;
+}
+
+static KERNEL_ATTR
+void KERNEL(rawtod32)(double *dst, const uint32_t *src,
+		      unsigned int nr, double a, double b)
+{
+	unsigned int n;
+	v4su raw;
+	v4df x;
+
+	for (n = 0; n + 4 <= nr; n += 4) {
+		memcpy(&raw, src + n, sizeof(raw));
+		x = vec_convert(raw, v4df) * a + b;
+		memcpy(dst + n, &x, sizeof(x));
+	}
+
+	for (; n < nr; n++)
+		dst[n] = src[n] * a + b;
+}
+
+static KERNEL_ATTR
+double KERNEL(sum)(const double *val, unsigned int nr)
+{
+	v4df acc0 = { 0, 0, 0, 0 }, acc1 = { 0, 0, 0, 0 }, x0, x1;
+	unsigned int n;
+	double sum;
+
+	/* Two accumulators hide the latency of the additions. */
+	for (n = 0; n + 8 <= nr; n += 8) {
+		memcpy(&x0, val + n, sizeof(x0));
+		memcpy(&x1, val + n + 4, sizeof(x1));
+		acc0 += x0;
+		acc1 += x1;
+	}
+
+	acc0 += acc1;
+	sum = (acc0[0] + acc0[1]) + (acc0[2] + acc0[3]);
+	for (; n < nr; n++)
+		sum += val[n];
+
+	return sum;
+}
+
+static KERNEL_ATTR
+void KERNEL(sum_dev)(const double *val, unsigned int nr, double mean,
+		     double *psum, double *psum_sq)
+{
+	v4df acc = { 0, 0, 0, 0 }, acc_sq = { 0, 0, 0, 0 }, x;
+	double sum, sum_sq, d;
+	unsigned int n;
+
+	for (n = 0; n + 4 <= nr; n += 4) {
+		memcpy(&x, val + n, sizeof(x));
+		x -= mean;
+		acc += x;
+		acc_sq += x * x;
+	}
+
+	sum = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	sum_sq = (acc_sq[0] + acc_sq[1]) + (acc_sq[2] + acc_sq[3]);
+	for (; n < nr; n++) {
+		d = val[n] - mean;
+		sum += d;
+		sum_sq += d * d;
+	}
+
+	*psum = sum;
+	*psum_sq = sum_sq;
+}
+
+/*
+ * Waveform kernels compute the sample of rank i from i alone, the
+ * last partial block being computed in full then stored partially,
+ * so that the output does not depend on how a stream is split into
+ * blocks. Ranks are carried in double precision, which holds any
+ * unsigned int exactly, and so do the period counts derived from
+ * them.
+ */
+
+static KERNEL_ATTR
+void KERNEL(sine)(double *dst, unsigned int first, unsigned int nr,
+		  double ratio, double amplitude, double offset)
+{
+	const double base = offset - amplitude / 2, half = 0.5 * amplitude;
+	v4df idx = { 0, 1, 2, 3 }, x, t, q, r, z, c, s, y;
+	unsigned int n;
+	v4du qi, m;
+
+	idx += first;
+
+	for (n = 0; n < nr; n += 4, idx += 4) {
+		x = idx * 2 * M_PI * ratio;
+		/*
+		 * Reduce to [-pi/4, pi/4] then pick the sine or cosine
+		 * polynomial depending on the quadrant. The rounding
+		 * constant leaves the quadrant number in the low bits
+		 * of the mantissa.
+		 */
+		t = x * M_2_PI + ROUND_MAGIC;
+		q = t - ROUND_MAGIC;
+		qi = (v4du)t;
+		r = ((x - q * PIO2_1) - q * PIO2_2) - q * PIO2_3;
+		z = r * r;
+		s = r + z * r * (S1 + z * (S2 + z * (S3 + z *
+					(S4 + z * (S5 + z * S6)))));
+		y = z * z * (C1 + z * (C2 + z * (C3 + z *
+					(C4 + z * (C5 + z * C6)))));
+		t = 1.0 - 0.5 * z;
+		c = t + (((1.0 - t) - 0.5 * z) + y);
+		m = -(qi & 1);
+		y = (v4df)(((v4du)s & m) | ((v4du)c & ~m));
+		y = (v4df)((v4du)y ^ (((qi + 1) & 2) << 62));
+		vec_store(dst + n, base + half * y, nr - n);
+	}
+}
+
+static KERNEL_ATTR
+void KERNEL(square)(double *dst, unsigned int first, unsigned int nr,
+		    double ratio, double amplitude, double offset)
+{
+	const double base = offset - amplitude / 2;
+	const v4df one = { 1.0, 1.0, 1.0, 1.0 };
+	v4df idx = { 0, 1, 2, 3 }, x;
+	unsigned int n;
+	v4du odd;
+
+	idx += first;
+
+	for (n = 0; n < nr; n += 4, idx += 4) {
+		vec_floor(idx * 2 * ratio, &odd);
+		/* High during even half periods. */
+		x = (v4df)((v4du)one & (odd - 1));
+		vec_store(dst + n, base + x * amplitude, nr - n);
+	}
+}
+
+static KERNEL_ATTR
+void KERNEL(triangle)(double *dst, unsigned int first, unsigned int nr,
+		      double ratio, double amplitude, double offset)
+{
+	const double base = offset - amplitude / 2;
+	v4df idx = { 0, 1, 2, 3 }, x, x2, period, rise, fall;
+	unsigned int n;
+	v4du odd;
+
+	idx += first;
+
+	for (n = 0; n < nr; n += 4, idx += 4) {
+		x = idx * ratio;
+		x2 = idx * 2 * ratio;
+		period = vec_floor(x, &odd);
+		vec_floor(x2, &odd);
+		rise = (base - period * 2 * amplitude) + x2 * amplitude;
+		fall = (base + (period + 1) * 2 * amplitude) - x2 * amplitude;
+		x = (v4df)(((v4du)fall & -odd) | ((v4du)rise & (odd - 1)));
+		vec_store(dst + n, x, nr - n);
+	}
+}
+
+static KERNEL_ATTR
+void KERNEL(sawtooth)(double *dst, unsigned int first, unsigned int nr,
+		      double ratio, double amplitude, double offset)
+{
+	const double base = offset - amplitude / 2;
+	v4df idx = { 0, 1, 2, 3 }, x, period;
+	unsigned int n;
+	v4du odd;
+
+	idx += first;
+
+	for (n = 0; n < nr; n += 4, idx += 4) {
+		x = idx * ratio;
+		period = vec_floor(x, &odd);
+		x = (base - period * amplitude) + x * amplitude;
+		vec_store(dst + n, x, nr - n);
+	}
+}
+
+static const struct a4l_simd_ops KERNEL(ops) = {
+	.name = KERNEL_NAME,
+	.rawtod16 = KERNEL(rawtod16),
+	.rawtod32 = KERNEL(rawtod32),
+	.sum = KERNEL(sum),
+	.sum_dev = KERNEL(sum_dev),
+	.sine = KERNEL(sine),
+	.square = KERNEL(square),
+	.triangle = KERNEL(triangle),
+	.sawtooth = KERNEL(sawtooth),
+};
@@ -0,0 +1,128 @@
+/*
+ * Analogy for Linux, vectorized block kernels
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "simd.h"
+
+/*
+ * The kernels are written with the generic vector extensions of the
+ * compiler, which lowers them to SSE2 on x86_64, NEON on aarch64, or
+ * plain scalar code elsewhere. On x86, a second instance is built for
+ * AVX2 and picked at startup if the CPU supports it. FMA contraction
+ * is disabled for the whole library, so that every instance rounds
+ * the same way.
+ */
+typedef double v4df __attribute__((vector_size(32)));
+typedef unsigned long long v4du __attribute__((vector_size(32)));
+typedef unsigned int v4su __attribute__((vector_size(16)));
+typedef unsigned short v4hu __attribute__((vector_size(8)));
+
+#if defined(__clang__) || __GNUC__ >= 9
+#define vec_convert(__v, __type)  __builtin_convertvector(__v, __type)
+#else
+#define vec_convert(__v, __type)			\
+	({						\
+		__type __r;				\
+		int __i;				\
+		for (__i = 0; __i < 4; __i++)		\
+			__r[__i] = (__v)[__i];		\
+		__r;					\
+	})
+#endif
+
+/* Store the first __nr lanes of a block, at most 4. */
+#define vec_store(__dst, __v, __nr)					\
+	do {								\
+		v4df __x = (__v);					\
+		memcpy(__dst, &__x, (__nr) >= 4 ?			\
+		       sizeof(__x) : (__nr) * sizeof(double));		\
+	} while (0)
+
+/* 1.5 * 2^52, rounds to the nearest integer when added. */
+#define ROUND_MAGIC	6755399441055744.0
+
+/*
+ * Floor of __x in [0, 2^51[, its parity stored to __odd. The rounded
+ * integer lands in the low bits of the mantissa, step down by one
+ * whenever it was rounded up.
+ */
+#define vec_floor(__x, __odd)						\
+	({								\
+		const v4df __one = { 1.0, 1.0, 1.0, 1.0 };		\
+		v4df __v = (__x), __t = __v + ROUND_MAGIC;		\
+		v4df __r = __t - ROUND_MAGIC;				\
+		v4du __below = (v4du)(__r > __v);			\
+		*(__odd) = ((v4du)__t + __below) & 1;			\
+		__r - (v4df)((v4du)__one & __below);			\
+	})
+
+/* pi/2 split in 33-bit chunks, exact products for |q| < 2^20. */
+#define PIO2_1		1.57079632673412561417e+00
+#define PIO2_2		6.07710050630396597660e-11
+#define PIO2_3		2.02226624871116645580e-21
+
+/* Minimax coefficients over [-pi/4, pi/4], from fdlibm. */
+#define S1		-1.66666666666666324348e-01
+#define S2		 8.33333333332248946124e-03
+#define S3		-1.98412698298579493134e-04
+#define S4		 2.75573137070700676789e-06
+#define S5		-2.50507602534068634195e-08
+#define S6		 1.58969099521155010221e-10
+#define C1		 4.16666666666666019037e-02
+#define C2		-1.38888888888741095749e-03
+#define C3		 2.48015872894767294178e-05
+#define C4		-2.75573143513906633035e-07
+#define C5		 2.08757232129817482790e-09
+#define C6		-1.13596475577881948265e-11
+
+#define KERNEL(__name)	__name ## _generic
+#define KERNEL_ATTR
+#if defined(__SSE2__)
+#define KERNEL_NAME	"sse2"
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define KERNEL_NAME	"neon"
+#else
+#define KERNEL_NAME	"generic"
+#endif
+#include "simd-kernels.h"
+#undef KERNEL
+#undef KERNEL_ATTR
+#undef KERNEL_NAME
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNEL(__name)	__name ## _avx2
+#define KERNEL_ATTR	__attribute__((target("avx2")))
+#define KERNEL_NAME	"avx2"
+#include "simd-kernels.h"
+#undef KERNEL
+#undef KERNEL_ATTR
+#undef KERNEL_NAME
+#endif
+
+const struct a4l_simd_ops *a4l_simd = &ops_generic;
+
+static __attribute__((constructor)) void a4l_simd_init(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		a4l_simd = &ops_avx2;
+#endif
+}
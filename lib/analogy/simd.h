@@ -0,0 +1,54 @@
+/*
+ * Analogy for Linux, vectorized block kernels
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef __ANALOGY_LIB_SIMD__
+#define __ANALOGY_LIB_SIMD__
+
+#include <stdint.h>
+
+#ifndef DOXYGEN_CPP
+
+/*
+ * Block kernels behind the conversion, statistics and waveform
+ * routines. All implementations share the same source and perform
+ * the same floating-point operations in the same order, so that the
+ * results do not depend on the instruction set picked at runtime.
+ */
+struct a4l_simd_ops {
+	const char *name;
+	void (*rawtod16)(double *dst, const uint16_t *src,
+			 unsigned int nr, double a, double b);
+	void (*rawtod32)(double *dst, const uint32_t *src,
+			 unsigned int nr, double a, double b);
+	double (*sum)(const double *val, unsigned int nr);
+	void (*sum_dev)(const double *val, unsigned int nr, double mean,
+			double *psum, double *psum_sq);
+	void (*sine)(double *dst, unsigned int first, unsigned int nr,
+		     double ratio, double amplitude, double offset);
+	void (*square)(double *dst, unsigned int first, unsigned int nr,
+		       double ratio, double amplitude, double offset);
+	void (*triangle)(double *dst, unsigned int first, unsigned int nr,
+			 double ratio, double amplitude, double offset);
+	void (*sawtooth)(double *dst, unsigned int first, unsigned int nr,
+			 double ratio, double amplitude, double offset);
+};
+
+extern const struct a4l_simd_ops *a4l_simd;
+
+#endif /* !DOXYGEN_CPP */
+
+#endif /* __ANALOGY_LIB_SIMD__ */
@@ -64,6 +64,45 @@ int cobalt_thread_stat(pid_t pid, struct cobalt_threadstat *stat)
 	return XENOMAI_SYSCALL2(sc_cobalt_thread_getstat, pid, stat);
 }
 
+int cobalt_thread_setbudget(pid_t pid,
+			    const struct cobalt_budget_config *config)
+{
+	return XENOMAI_SYSCALL2(sc_cobalt_thread_setbudget, pid, config);
+}
+
+int cobalt_thread_getbudget(pid_t pid, struct cobalt_budget_info *info)
+{
+	return XENOMAI_SYSCALL2(sc_cobalt_thread_getbudget, pid, info);
+}
+
+int cobalt_thread_setperiodic(pid_t pid,
+			      const struct cobalt_period_config *config)
+{
+	return XENOMAI_SYSCALL2(sc_cobalt_thread_setperiodic, pid, config);
+}
+
+int cobalt_thread_waitperiod(unsigned long *overruns_r)
+{
+	int ret, oldtype;
+	__u32 overruns;
+
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
+
+	ret = XENOMAI_SYSCALL1(sc_cobalt_thread_waitperiod, &overruns);
+
+	pthread_setcanceltype(oldtype, NULL);
+
+	if ((ret == 0 || ret == -ETIMEDOUT) && overruns_r)
+		*overruns_r = overruns;
+
+	return ret;
+}
+
+int cobalt_thread_getperiodic(pid_t pid, struct cobalt_period_info *info)
+{
+	return XENOMAI_SYSCALL2(sc_cobalt_thread_getperiodic, pid, info);
+}
+
 pid_t cobalt_thread_pid(pthread_t thread)
 {
 	return XENOMAI_SYSCALL1(sc_cobalt_thread_getpid, thread);
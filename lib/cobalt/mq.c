@@ -18,11 +18,14 @@
 
 #include <errno.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <mqueue.h>
 #include <asm/xenomai/syscall.h>
+#include <cobalt/uapi/mqueue.h>
 #include "internal.h"
 
 /**
@@ -39,6 +42,350 @@
  *@{
  */
 
+/*
+ * Descriptors of the queues running in MQ_SHRING mode, indexed by
+ * file descriptor. The table only grows, and is read locklessly, so
+ * superseded tables are never released. For the same reason, a
+ * descriptor dropped by mq_close() may still be in use by a lockless
+ * sender or receiver, so it is parked on a free list for reuse by a
+ * later mq_open(), instead of being returned to malloc().
+ */
+struct mq_ringdesc {
+	struct cobalt_mq_ring *ring;
+	int oflags;
+	struct mq_ringdesc *next;
+};
+
+static struct mq_ringdesc **ringdesc_table;
+
+static struct mq_ringdesc *ringdesc_free;
+
+static int ringdesc_size;
+
+static pthread_mutex_t ringdesc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline struct mq_ringdesc *mq_get_ringdesc(mqd_t q)
+{
+	struct mq_ringdesc **table;
+	int size;
+
+	size = ACCESS_ONCE(ringdesc_size);
+	if ((unsigned int)q >= (unsigned int)size)
+		return NULL;
+
+	smp_rmb();
+	table = ACCESS_ONCE(ringdesc_table);
+
+	return ACCESS_ONCE(table[q]);
+}
+
+static int mq_set_ringdesc(mqd_t q, struct mq_ringdesc *desc)
+{
+	struct mq_ringdesc **table, *odesc;
+	int size;
+
+	pthread_mutex_lock(&ringdesc_lock);
+
+	if (q >= ringdesc_size) {
+		if (desc == NULL) {
+			pthread_mutex_unlock(&ringdesc_lock);
+			return 0;
+		}
+		size = ringdesc_size ?: 64;
+		while (size <= q)
+			size *= 2;
+		table = calloc(size, sizeof(*table));
+		if (table == NULL) {
+			pthread_mutex_unlock(&ringdesc_lock);
+			return -ENOMEM;
+		}
+		if (ringdesc_table)
+			memcpy(table, ringdesc_table,
+			       ringdesc_size * sizeof(*table));
+		ringdesc_table = table;
+		smp_wmb();
+		ringdesc_size = size;
+	}
+
+	odesc = ringdesc_table[q];
+	smp_wmb();
+	ringdesc_table[q] = desc;
+	if (odesc) {
+		odesc->next = ringdesc_free;
+		ringdesc_free = odesc;
+	}
+
+	pthread_mutex_unlock(&ringdesc_lock);
+
+	return 0;
+}
+
+static struct mq_ringdesc *mq_alloc_ringdesc(void)
+{
+	struct mq_ringdesc *desc;
+
+	pthread_mutex_lock(&ringdesc_lock);
+
+	desc = ringdesc_free;
+	if (desc)
+		ringdesc_free = desc->next;
+
+	pthread_mutex_unlock(&ringdesc_lock);
+
+	return desc ?: malloc(sizeof(*desc));
+}
+
+static void mq_release_ringdesc(struct mq_ringdesc *desc)
+{
+	pthread_mutex_lock(&ringdesc_lock);
+	desc->next = ringdesc_free;
+	ringdesc_free = desc;
+	pthread_mutex_unlock(&ringdesc_lock);
+}
+
+static int mq_attach_ring(mqd_t q, int oflags)
+{
+	struct mq_ringdesc *desc;
+	__u32 offset;
+	int ret;
+
+	ret = XENOMAI_SYSCALL2(sc_cobalt_mq_ringinfo, q, &offset);
+	if (ret)
+		/* Regular queue, drop any stale descriptor. */
+		return ret == -ENOENT ? mq_set_ringdesc(q, NULL) : ret;
+
+	desc = mq_alloc_ringdesc();
+	if (desc == NULL)
+		return -ENOMEM;
+
+	desc->ring = cobalt_umm_shared + offset;
+	desc->oflags = oflags & (O_ACCMODE | O_NONBLOCK);
+
+	ret = mq_set_ringdesc(q, desc);
+	if (ret)
+		mq_release_ringdesc(desc);
+
+	return ret;
+}
+
+static inline int mq_ring_push(struct cobalt_mq_ring *ring,
+			       const char *buffer, size_t len,
+			       unsigned int *pos_r)
+{
+	struct cobalt_mq_slot *slot;
+	unsigned int pos, seq;
+	int dif;
+
+	pos = atomic_read(&ring->head);
+	for (;;) {
+		slot = cobalt_mq_ring_slot(ring, pos);
+		compiler_barrier();
+		seq = atomic_read(&slot->seq);
+		dif = (int)(seq - pos);
+		if (dif == 0) {
+			if (pos - atomic_read(&ring->tail) >= ring->maxmsg)
+				return -EAGAIN;
+			seq = atomic_cmpxchg(&ring->head, pos, pos + 1);
+			if (seq == pos)
+				break;
+			pos = seq;
+		} else if (dif < 0)
+			return -EAGAIN;
+		else {
+			compiler_barrier();
+			pos = atomic_read(&ring->head);
+		}
+	}
+
+	memcpy(slot->data, buffer, len);
+	slot->len = len;
+	smp_wmb();
+	atomic_set(&slot->seq, pos + 1);
+	/* Publish the message before sampling the waiters. */
+	smp_mb();
+	*pos_r = pos;
+
+	return 0;
+}
+
+static inline int mq_ring_pop(struct cobalt_mq_ring *ring,
+			      char *buffer, size_t *len_r,
+			      unsigned int *pos_r)
+{
+	struct cobalt_mq_slot *slot;
+	unsigned int pos, seq;
+	size_t len;
+	int dif;
+
+	pos = atomic_read(&ring->tail);
+	for (;;) {
+		slot = cobalt_mq_ring_slot(ring, pos);
+		compiler_barrier();
+		seq = atomic_read(&slot->seq);
+		dif = (int)(seq - (pos + 1));
+		if (dif == 0) {
+			/* Full barrier, orders the data reads. */
+			seq = atomic_cmpxchg(&ring->tail, pos, pos + 1);
+			if (seq == pos)
+				break;
+			pos = seq;
+		} else if (dif < 0)
+			return -EAGAIN;
+		else {
+			compiler_barrier();
+			pos = atomic_read(&ring->tail);
+		}
+	}
+
+	len = slot->len;
+	memcpy(buffer, slot->data, len);
+	smp_mb();
+	atomic_set(&slot->seq, pos + ring->nslots);
+	/* Release the slot before sampling the waiters. */
+	smp_mb();
+	*len_r = len;
+	*pos_r = pos;
+
+	return 0;
+}
+
+/*
+ * The kernel is only told about transitions it may have to act
+ * upon: waking up a sleeper, sending the mq_notify() signal, or
+ * updating the select() state.
+ */
+static void mq_ring_sent(mqd_t q, struct cobalt_mq_ring *ring,
+			 unsigned int pos)
+{
+	unsigned int tail;
+	int flags;
+
+	if (atomic_read(&ring->rwaiters) > 0)
+		goto kick;
+
+	flags = atomic_read(&ring->flags);
+	if (flags == 0)
+		return;
+
+	tail = atomic_read(&ring->tail);
+	if (tail == pos)	/* Was empty. */
+		goto kick;
+
+	if ((flags & COBALT_MQ_RING_SELECT) &&
+	    pos + 1 - tail >= ring->maxmsg)
+		goto kick;
+
+	return;
+kick:
+	XENOMAI_SYSCALL1(sc_cobalt_mq_ringkick, q);
+}
+
+static void mq_ring_received(mqd_t q, struct cobalt_mq_ring *ring,
+			     unsigned int pos)
+{
+	unsigned int head;
+
+	if (atomic_read(&ring->swaiters) > 0)
+		goto kick;
+
+	if ((atomic_read(&ring->flags) & COBALT_MQ_RING_SELECT) == 0)
+		return;
+
+	head = atomic_read(&ring->head);
+	if (head == pos + 1 || head - pos >= ring->maxmsg)
+		goto kick;
+
+	return;
+kick:
+	XENOMAI_SYSCALL1(sc_cobalt_mq_ringkick, q);
+}
+
+static int mq_ring_wait(mqd_t q, int op, const struct timespec *timeout)
+{
+	int ret, oldtype;
+
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
+
+	ret = XENOMAI_SYSCALL3(sc_cobalt_mq_ringwait, q, op, timeout);
+
+	pthread_setcanceltype(oldtype, NULL);
+
+	return ret;
+}
+
+static int mq_ring_send(mqd_t q, struct mq_ringdesc *desc,
+			const char *buffer, size_t len,
+			const struct timespec *timeout)
+{
+	struct cobalt_mq_ring *ring = desc->ring;
+	unsigned int pos;
+	int ret;
+
+	if ((desc->oflags & O_ACCMODE) == O_RDONLY)
+		return -EBADF;
+
+	if (len > ring->msgsize)
+		return -EMSGSIZE;
+
+	for (;;) {
+		ret = mq_ring_push(ring, buffer, len, &pos);
+		if (ret == 0) {
+			mq_ring_sent(q, ring, pos);
+			return 0;
+		}
+		if (desc->oflags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = mq_ring_wait(q, COBALT_MQ_WAIT_SEND, timeout);
+		if (ret)
+			return ret;
+	}
+}
+
+static ssize_t mq_ring_receive(mqd_t q, struct mq_ringdesc *desc,
+			       char *buffer, size_t len, unsigned *prio,
+			       const struct timespec *timeout)
+{
+	struct cobalt_mq_ring *ring = desc->ring;
+	unsigned int pos;
+	ssize_t rlen;
+	size_t mlen;
+	int ret;
+
+	if ((desc->oflags & O_ACCMODE) == O_WRONLY)
+		return -EBADF;
+
+	if (len < ring->msgsize)
+		return -EMSGSIZE;
+
+	for (;;) {
+		/*
+		 * Messages of non-zero priority are queued by the
+		 * kernel, which does not block us in ring mode.
+		 */
+		if (atomic_read(&ring->kqueued) > 0) {
+			rlen = (ssize_t)len;
+			ret = XENOMAI_SYSCALL5(sc_cobalt_mq_timedreceive,
+					       q, buffer, &rlen, prio, NULL);
+			if (ret == 0)
+				return rlen;
+			if (ret != -EAGAIN)
+				return ret;
+		}
+		ret = mq_ring_pop(ring, buffer, &mlen, &pos);
+		if (ret == 0) {
+			mq_ring_received(q, ring, pos);
+			if (prio)
+				*prio = 0;
+			return (ssize_t)mlen;
+		}
+		if (desc->oflags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = mq_ring_wait(q, COBALT_MQ_WAIT_RECV, timeout);
+		if (ret)
+			return ret;
+	}
+}
+
 /**
  * @brief Open a message queue
  *
@@ -71,6 +418,16 @@
  * - @a mq_maxmsg is the maximum number of messages in the queue (128 by
  *   default);
  * - @a mq_msgsize is the maximum size of each message (128 by default).
+ * - @a mq_flags may have the Cobalt-specific MQ_SHRING bit set, for
+ *   backing the queue with a ring allocated from the shared memory
+ *   heap. Messages of priority zero are then exchanged through the
+ *   ring without entering the kernel, unless the caller has to block
+ *   or a peer has to be woken up; messages of higher priority are
+ *   still queued by the kernel, and received first. If the shared
+ *   heap cannot hold the ring, the queue works the regular way,
+ *   which mq_getattr() tells by clearing MQ_SHRING in @a mq_flags.
+ *   In this mode, O_NONBLOCK should be changed with mq_setattr()
+ *   only.
  *
  * @a name may be any arbitrary string, in which slashes have no particular
  * meaning. However, for portability, using a name which starts with a slash and
@@ -106,7 +463,7 @@ COBALT_IMPL(mqd_t, mq_open, (const char *name, int oflags, ...))
 	struct mq_attr *attr = NULL;
 	mode_t mode = 0;
 	va_list ap;
-	int fd;
+	int fd, ret;
 
 	if ((oflags & O_CREAT) != 0) {
 		va_start(ap, oflags);
@@ -121,6 +478,13 @@ COBALT_IMPL(mqd_t, mq_open, (const char *name, int oflags, ...))
 		return (mqd_t)-1;
 	}
 
+	ret = mq_attach_ring(fd, oflags);
+	if (ret) {
+		XENOMAI_SYSCALL1(sc_cobalt_mq_close, fd);
+		errno = -ret;
+		return (mqd_t)-1;
+	}
+
 	return (mqd_t)fd;
 }
 
@@ -148,6 +512,8 @@ COBALT_IMPL(int, mq_close, (mqd_t mqd))
 {
 	int err;
 
+	mq_set_ringdesc(mqd, NULL);
+
 	err = XENOMAI_SYSCALL1(sc_cobalt_mq_close, mqd);
 	if (err) {
 		errno = -err;
@@ -264,6 +630,7 @@ COBALT_IMPL(int, mq_setattr, (mqd_t mqd,
 			      const struct mq_attr *__restrict__ attr,
 			      struct mq_attr *__restrict__ oattr))
 {
+	struct mq_ringdesc *desc;
 	int err = 0, flags;
 
 	if (oattr) {
@@ -281,8 +648,13 @@ COBALT_IMPL(int, mq_setattr, (mqd_t mqd,
 	flags = (flags & ~O_NONBLOCK) | (attr->mq_flags & O_NONBLOCK);
 
 	err = __WRAP(fcntl(mqd, F_SETFL, flags));
-	if (!err)
+	if (!err) {
+		desc = mq_get_ringdesc(mqd);
+		if (desc)
+			desc->oflags = (desc->oflags & ~O_NONBLOCK) |
+				(flags & O_NONBLOCK);
 		return 0;
+	}
 
   out_err:
 	errno = -err;
@@ -328,15 +700,22 @@ COBALT_IMPL(int, mq_setattr, (mqd_t mqd,
  */
 COBALT_IMPL(int, mq_send, (mqd_t q, const char *buffer, size_t len, unsigned prio))
 {
+	struct mq_ringdesc *desc;
 	int err, oldtype;
 
+	desc = prio ? NULL : mq_get_ringdesc(q);
+	if (desc) {
+		err = mq_ring_send(q, desc, buffer, len, NULL);
+		goto out;
+	}
+
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
 
 	err = XENOMAI_SYSCALL5(sc_cobalt_mq_timedsend,
 			       q, buffer, len, prio, NULL);
 
 	pthread_setcanceltype(oldtype, NULL);
-
+out:
 	if (!err)
 		return 0;
 
@@ -385,18 +764,25 @@ COBALT_IMPL(int, mq_timedsend, (mqd_t q,
 				size_t len,
 				unsigned prio, const struct timespec *timeout))
 {
+	struct mq_ringdesc *desc;
 	int err, oldtype;
 
 	if (timeout == NULL)
 		return -EFAULT;
 
+	desc = prio ? NULL : mq_get_ringdesc(q);
+	if (desc) {
+		err = mq_ring_send(q, desc, buffer, len, timeout);
+		goto out;
+	}
+
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
 
 	err = XENOMAI_SYSCALL5(sc_cobalt_mq_timedsend,
 			       q, buffer, len, prio, timeout);
 
 	pthread_setcanceltype(oldtype, NULL);
-
+out:
 	if (!err)
 		return 0;
 
@@ -447,8 +833,18 @@ COBALT_IMPL(int, mq_timedsend, (mqd_t q,
 COBALT_IMPL(ssize_t, mq_receive, (mqd_t q, char *buffer, size_t len, unsigned *prio))
 {
 	ssize_t rlen = (ssize_t) len;
+	struct mq_ringdesc *desc;
 	int err, oldtype;
 
+	desc = mq_get_ringdesc(q);
+	if (desc) {
+		rlen = mq_ring_receive(q, desc, buffer, len, prio, NULL);
+		if (rlen >= 0)
+			return rlen;
+		errno = -rlen;
+		return -1;
+	}
+
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
 
 	err = XENOMAI_SYSCALL5(sc_cobalt_mq_timedreceive,
@@ -509,11 +905,21 @@ COBALT_IMPL(ssize_t, mq_timedreceive, (mqd_t q,
 				       const struct timespec * __restrict__ timeout))
 {
 	ssize_t rlen = (ssize_t) len;
+	struct mq_ringdesc *desc;
 	int err, oldtype;
 
 	if (timeout == NULL)
 		return -EFAULT;
 
+	desc = mq_get_ringdesc(q);
+	if (desc) {
+		rlen = mq_ring_receive(q, desc, buffer, len, prio, timeout);
+		if (rlen >= 0)
+			return rlen;
+		errno = -rlen;
+		return -1;
+	}
+
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
 
 	err = XENOMAI_SYSCALL5(sc_cobalt_mq_timedreceive,
@@ -35,6 +35,7 @@
 #define RT_PRINT_DEFAULT_BUFFER		16*1024
 #define RT_PRINT_DEFAULT_SYNCDELAY	100 /* ms */
 #define RT_PRINT_DEFAULT_BUFFERS_COUNT  4
+#define RT_PRINT_MIN_SYNCDELAY		1000000 /* ns */
 
 #define RT_PRINT_LINE_BREAK		256
 
@@ -51,10 +52,17 @@ struct entry_head {
 	char data[0];
 } __attribute__((packed));
 
+/*
+ * Buffers are linked to a push-only list, which the printer may walk
+ * without locking: once attached, a buffer is never unlinked nor
+ * freed, but recycled for new threads when released. Pool buffers
+ * are tracked by pool_bitmap, others by their busy flag.
+ */
 struct print_buffer {
 	off_t write_pos;
 
-	struct print_buffer *next, *prev;
+	struct print_buffer *next;
+	atomic_t busy;
 
 	void *ring;
 	size_t size;
@@ -75,9 +83,10 @@ int __cobalt_print_bufcount = RT_PRINT_DEFAULT_BUFFERS_COUNT;
 int __cobalt_print_syncdelay = RT_PRINT_DEFAULT_SYNCDELAY;
 
 static struct print_buffer *first_buffer;
-static int buffers;
+static atomic_t buffers;
 static uint32_t seq_no;
 static struct timespec syncdelay;
+/* Serializes consumers, i.e. the printer and flushers. */
 static pthread_mutex_t buffer_lock;
 static pthread_cond_t printer_wakeup;
 static pthread_key_t buffer_key;
@@ -367,8 +376,15 @@ static void set_buffer_name(struct print_buffer *buffer, const char *name)
 	}
 }
 
+static inline int pool_buffer_p(struct print_buffer *buffer)
+{
+	return (unsigned long)buffer - pool_start < pool_len;
+}
+
 static void rt_print_init_inner(struct print_buffer *buffer, size_t size)
 {
+	struct print_buffer *head;
+
 	buffer->size = size;
 
 	memset(buffer->ring, 0, size);
@@ -376,19 +392,32 @@ static void rt_print_init_inner(struct print_buffer *buffer, size_t size)
 	buffer->read_pos  = 0;
 	buffer->write_pos = 0;
 
-	buffer->prev = NULL;
+	do {
+		head = first_buffer;
+		buffer->next = head;
+	} while (!__sync_bool_compare_and_swap(&first_buffer, head, buffer));
 
-	pthread_mutex_lock(&buffer_lock);
+	/* Only the very first buffer has to wake up the printer. */
+	if (atomic_add_fetch(&buffers, 1) == 1) {
+		pthread_mutex_lock(&buffer_lock);
+		pthread_cond_signal(&printer_wakeup);
+		pthread_mutex_unlock(&buffer_lock);
+	}
+}
 
-	buffer->next = first_buffer;
-	if (first_buffer)
-		first_buffer->prev = buffer;
-	first_buffer = buffer;
+static struct print_buffer *recycle_buffer(size_t size)
+{
+	struct print_buffer *pos;
 
-	buffers++;
-	pthread_cond_signal(&printer_wakeup);
+	for (pos = first_buffer; pos; pos = pos->next) {
+		if (pool_buffer_p(pos) || pos->size != size ||
+		    atomic_read(&pos->busy))
+			continue;
+		if (atomic_cmpxchg(&pos->busy, 0, 1) == 0)
+			return pos;
+	}
 
-	pthread_mutex_unlock(&buffer_lock);
+	return NULL;
 }
 
 int rt_print_init(size_t buffer_size, const char *buffer_name)
@@ -441,6 +470,9 @@ int rt_print_init(size_t buffer_size, const char *buffer_name)
 
   not_found:
 
+	if (!buffer)
+		buffer = recycle_buffer(size);
+
 	if (!buffer) {
 		cobalt_assert_nrt();
 
@@ -449,9 +481,12 @@ int rt_print_init(size_t buffer_size, const char *buffer_name)
 			return ENOMEM;
 
 		buffer->ring = malloc(size);
-		if (!buffer->ring)
+		if (!buffer->ring) {
+			free(buffer);
 			return ENOMEM;
+		}
 
+		atomic_set(&buffer->busy, 1);
 		rt_print_init_inner(buffer, size);
 	}
 
@@ -487,26 +522,19 @@ void rt_print_flush_buffers(void)
 	pthread_mutex_unlock(&buffer_lock);
 }
 
-static void release_buffer(struct print_buffer *buffer)
+static void put_buffer(struct print_buffer *buffer)
 {
-	struct print_buffer *prev, *next;
 	unsigned long old_bitmap, bitmap;
 	unsigned int i, j;
 
-	cobalt_assert_nrt();
-
-	pthread_setspecific(buffer_key, NULL);
-
-	pthread_mutex_lock(&buffer_lock);
-
-	print_buffers();
-
-	pthread_mutex_unlock(&buffer_lock);
+	if (!pool_buffer_p(buffer)) {
+		/* Pending output remains, the printer drains it. */
+		smp_mb();
+		atomic_set(&buffer->busy, 0);
+		return;
+	}
 
 	/* Return the buffer to the pool */
-	if ((unsigned long)buffer - pool_start >= pool_len)
-		goto dofree;
-
 	j = ((unsigned long)buffer - pool_start) / pool_buf_size;
 	i = j / LONG_BIT;
 	j = j % LONG_BIT;
@@ -518,27 +546,12 @@ static void release_buffer(struct print_buffer *buffer)
 					    bitmap,
 					    bitmap | (1UL << j));
 	} while (old_bitmap != bitmap);
+}
 
-	return;
-dofree:
-	pthread_mutex_lock(&buffer_lock);
-
-	prev = buffer->prev;
-	next = buffer->next;
-
-	if (prev)
-		prev->next = next;
-	else
-		first_buffer = next;
-	if (next)
-		next->prev = prev;
-
-	buffers--;
-
-	pthread_mutex_unlock(&buffer_lock);
-
-	free(buffer->ring);
-	free(buffer);
+static void release_buffer(struct print_buffer *buffer)
+{
+	pthread_setspecific(buffer_key, NULL);
+	put_buffer(buffer);
 }
 
 static void do_cleanup(void *arg)
@@ -619,19 +632,76 @@ static void print_buffers(void)
 	}
 }
 
+/* Highest fill level of all buffers, in percents. */
+static int get_fill_level(void)
+{
+	struct print_buffer *pos;
+	off_t read_pos, write_pos;
+	int level, max = 0;
+	size_t used;
+
+	for (pos = first_buffer; pos; pos = pos->next) {
+		read_pos = pos->read_pos;
+		write_pos = pos->write_pos;
+		if (write_pos >= read_pos)
+			used = write_pos - read_pos;
+		else
+			used = pos->size - read_pos + write_pos;
+		level = used * 100 / pos->size;
+		if (level > max)
+			max = level;
+	}
+
+	return max;
+}
+
+/*
+ * Drain faster when some buffer is filling up, back off to the
+ * configured delay as the load decreases.
+ */
+static void adapt_syncdelay(struct timespec *delay, int level)
+{
+	long long ns, max_ns, min_ns;
+
+	ns = delay->tv_sec * 1000000000LL + delay->tv_nsec;
+	max_ns = syncdelay.tv_sec * 1000000000LL + syncdelay.tv_nsec;
+	min_ns = max_ns < RT_PRINT_MIN_SYNCDELAY ?
+		max_ns : RT_PRINT_MIN_SYNCDELAY;
+
+	if (level >= 50)
+		ns /= 4;
+	else if (level >= 25)
+		ns /= 2;
+	else if (level < 10)
+		ns *= 2;
+
+	if (ns < min_ns)
+		ns = min_ns;
+	else if (ns > max_ns)
+		ns = max_ns;
+
+	delay->tv_sec = ns / 1000000000LL;
+	delay->tv_nsec = ns % 1000000000LL;
+}
+
 static void *printer_loop(void *arg)
 {
+	struct timespec delay = syncdelay;
+	int level;
+
 	while (1) {
 		pthread_mutex_lock(&buffer_lock);
 
-		while (buffers == 0)
+		while (atomic_read(&buffers) == 0)
 			pthread_cond_wait(&printer_wakeup, &buffer_lock);
 
+		level = get_fill_level();
 		print_buffers();
 
 		pthread_mutex_unlock(&buffer_lock);
 
-		nanosleep(&syncdelay, NULL);
+		adapt_syncdelay(&delay, level);
+		nanosleep(&delay, NULL);
 	}
 
 	return NULL;
@@ -645,32 +715,49 @@ static void spawn_printer_thread(void)
 	pthread_create(&printer_thread, &thattr, printer_loop, NULL);
 }
 
+static void fill_pool_bitmap(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < __cobalt_print_bufcount / LONG_BIT; i++)
+		atomic_long_set(&pool_bitmap[i], ~0UL);
+	if (__cobalt_print_bufcount % LONG_BIT)
+		atomic_long_set(&pool_bitmap[i],
+				(1UL << (__cobalt_print_bufcount % LONG_BIT)) - 1);
+}
+
 void cobalt_print_init_atfork(void)
 {
 	struct print_buffer *my_buffer = pthread_getspecific(buffer_key);
-	struct print_buffer **pbuffer = &first_buffer;
+	struct print_buffer *pos;
+	unsigned int i;
 
-	if (my_buffer) {
-		/* Any content of my_buffer should be printed by our parent,
-		   not us. */
+	if (my_buffer)
 		memset(my_buffer->ring, 0, my_buffer->size);
 
-		my_buffer->read_pos  = 0;
-		my_buffer->write_pos = 0;
-	}
-
 	/* re-init to avoid finding it locked by some parent thread */
 	pthread_mutex_init(&buffer_lock, NULL);
 
-	while (*pbuffer) {
-		if (*pbuffer == my_buffer)
-			pbuffer = &(*pbuffer)->next;
-		else if ((unsigned long)*pbuffer - pool_start < pool_len) {
-			release_buffer(*pbuffer);
-			pbuffer = &(*pbuffer)->next;
-		}
-		else
-			release_buffer(*pbuffer);
+	/*
+	 * Any pending content should be printed by our parent, not
+	 * us. Buffers of the parent threads are ours to reuse.
+	 */
+	fill_pool_bitmap();
+
+	for (pos = first_buffer; pos; pos = pos->next) {
+		pos->read_pos  = 0;
+		pos->write_pos = 0;
+		if (!pool_buffer_p(pos))
+			atomic_set(&pos->busy, 0);
+	}
+
+	if (my_buffer) {
+		if (pool_buffer_p(my_buffer)) {
+			i = ((unsigned long)my_buffer - pool_start) / pool_buf_size;
+			atomic_fetch_and(&pool_bitmap[i / LONG_BIT],
+					 ~(1UL << (i % LONG_BIT)));
+		} else
+			atomic_set(&my_buffer->busy, 1);
 	}
 
 	spawn_printer_thread();
@@ -681,11 +768,15 @@ void cobalt_print_init(void)
 	unsigned int i;
 
 	first_buffer = NULL;
+	atomic_set(&buffers, 0);
 	seq_no = 0;
 
 	syncdelay.tv_sec  = __cobalt_print_syncdelay / 1000;
 	syncdelay.tv_nsec = (__cobalt_print_syncdelay % 1000) * 1000000;
 
+	pthread_mutex_init(&buffer_lock, NULL);
+	pthread_cond_init(&printer_wakeup, NULL);
+
 	/* Fill the buffer pool */
 	pool_bitmap_len = (__cobalt_print_bufcount+LONG_BIT-1)/LONG_BIT;
 	if (!pool_bitmap_len)
@@ -701,11 +792,7 @@ void cobalt_print_init(void)
 	if (!pool_start)
 		early_panic("error allocating print relay buffers");
 
-	for (i = 0; i < __cobalt_print_bufcount / LONG_BIT; i++)
-		atomic_long_set(&pool_bitmap[i], ~0UL);
-	if (__cobalt_print_bufcount % LONG_BIT)
-		atomic_long_set(&pool_bitmap[i],
-				(1UL << (__cobalt_print_bufcount % LONG_BIT)) - 1);
+	fill_pool_bitmap();
 
 	for (i = 0; i < __cobalt_print_bufcount; i++) {
 		struct print_buffer *buffer =
@@ -717,10 +804,8 @@ void cobalt_print_init(void)
 		rt_print_init_inner(buffer, __cobalt_print_bufsz);
 	}
 done:
-	pthread_mutex_init(&buffer_lock, NULL);
 	pthread_key_create(&buffer_key, (void (*)(void*))release_buffer);
 	pthread_key_create(&cleanup_key, do_cleanup);
-	pthread_cond_init(&printer_wakeup, NULL);
 	spawn_printer_thread();
 	/* We just need a non-zero TSD to trigger the dtor upon unwinding. */
 	pthread_setspecific(cleanup_key, (void *)1);
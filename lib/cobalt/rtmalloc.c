@@ -0,0 +1,691 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/*
+ * Real-time safe replacement for the malloc() family, to be
+ * preloaded by Cobalt applications, or linked before libc.
+ *
+ * Cobalt threads are served from a pre-faulted, locked arena managed
+ * by the heapmem allocator, which only serializes on a Cobalt mutex,
+ * so that allocating never faults nor switches to secondary mode.
+ * Small blocks released by a Cobalt thread are kept in a per-thread
+ * cache, for reuse without locking. Plain Linux threads, and any
+ * caller before the arena is set up, are served by the libc
+ * allocator.
+ *
+ * Linux threads cannot lock a Cobalt mutex, so arena blocks they
+ * release are queued, and returned to the heap by the next Cobalt
+ * thread running short of cached memory.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <dlfcn.h>
+#include <getopt.h>
+#include <boilerplate/setup.h>
+#include <boilerplate/heapmem.h>
+#include <boilerplate/ancillaries.h>
+#include <boilerplate/atomic.h>
+#include <cobalt/sys/cobalt.h>
+#include <cobalt/rtmalloc.h>
+#include "current.h"
+
+extern void *__libc_malloc(size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+/* Cached size classes, from 32 to 512 bytes, header included. */
+#define RTMALLOC_MIN_SHIFT	5
+#define RTMALLOC_NR_CLASSES	5
+#define RTMALLOC_CACHE_DEPTH	32
+/* Max. number of queued blocks released per allocation. */
+#define RTMALLOC_DRAIN_BATCH	16
+
+struct rtmalloc_thread;
+
+struct rtmalloc_header {
+	struct rtmalloc_thread *owner;
+	uint32_t size;
+	/* Distance from the start of the heap block. */
+	uint32_t offset : 31;
+	/* Heap block sized after a size class, may be cached. */
+	uint32_t cached : 1;
+} __attribute__((aligned(16)));
+
+/*
+ * Per-thread context. Never released, so that block headers may
+ * always refer to the statistics of their owner.
+ */
+struct rtmalloc_thread {
+	struct rtmalloc_stats stats;
+	struct rtmalloc_thread *next;
+	void *cache[RTMALLOC_NR_CLASSES];
+	int nr_cached[RTMALLOC_NR_CLASSES];
+};
+
+static struct heap_memory arena;
+
+/* NULL until the arena is set up. */
+static void *arena_base;
+
+static size_t arena_len;
+
+static size_t arena_size = 8 * 1024 * 1024;
+
+static size_t arena_peak;
+
+static int dump_stats;
+
+static struct rtmalloc_thread *thread_list;
+
+static void *deferred_frees;
+
+static int draining;
+
+static size_t (*libc_usable_size)(void *ptr);
+
+#ifdef HAVE_TLS
+
+static __thread __attribute__ ((tls_model (CONFIG_XENO_TLS_MODEL)))
+struct rtmalloc_thread *rtmalloc_current;
+
+static inline struct rtmalloc_thread *get_current_thread(void)
+{
+	return rtmalloc_current;
+}
+
+static inline void set_current_thread(struct rtmalloc_thread *t)
+{
+	rtmalloc_current = t;
+}
+
+#else /* !HAVE_TLS */
+
+static pthread_key_t rtmalloc_current_key;
+
+static inline struct rtmalloc_thread *get_current_thread(void)
+{
+	return arena_base ? pthread_getspecific(rtmalloc_current_key) : NULL;
+}
+
+static inline void set_current_thread(struct rtmalloc_thread *t)
+{
+	pthread_setspecific(rtmalloc_current_key, t);
+}
+
+#endif /* !HAVE_TLS */
+
+static inline int in_arena(const void *ptr)
+{
+	return (const char *)ptr >= (const char *)arena_base &&
+		(const char *)ptr < (const char *)arena_base + arena_len;
+}
+
+static inline int is_cobalt_thread(void)
+{
+	return cobalt_get_current_fast() != XN_NO_HANDLE;
+}
+
+/* Size class of a block of @bsize bytes, -1 if not cached. */
+static inline int block_class(size_t bsize)
+{
+	int c;
+
+	if (bsize > (1UL << (RTMALLOC_MIN_SHIFT + RTMALLOC_NR_CLASSES - 1)))
+		return -1;
+
+	if (bsize <= (1UL << RTMALLOC_MIN_SHIFT))
+		return 0;
+
+	c = sizeof(long) * CHAR_BIT - __builtin_clzl(bsize - 1);
+
+	return c - RTMALLOC_MIN_SHIFT;
+}
+
+static void defer_free(void *raw)
+{
+	void *head;
+
+	do {
+		head = ACCESS_ONCE(deferred_frees);
+		*(void **)raw = head;
+	} while (!__sync_bool_compare_and_swap(&deferred_frees, head, raw));
+}
+
+/*
+ * Only one thread drains at a time, so that blocks are never
+ * popped concurrently, which rules out ABA issues.
+ */
+static void drain_deferred(void)
+{
+	void *raw;
+	int n;
+
+	if (ACCESS_ONCE(deferred_frees) == NULL ||
+	    __sync_lock_test_and_set(&draining, 1))
+		return;
+
+	for (n = 0; n < RTMALLOC_DRAIN_BATCH; n++) {
+		do {
+			raw = ACCESS_ONCE(deferred_frees);
+			if (raw == NULL)
+				goto out;
+		} while (!__sync_bool_compare_and_swap(&deferred_frees,
+						       raw, *(void **)raw));
+		heapmem_free(&arena, raw);
+	}
+out:
+	__sync_lock_release(&draining);
+}
+
+static void *heap_alloc(size_t bsize)
+{
+	size_t used, peak;
+	void *raw;
+
+	drain_deferred();
+
+	raw = heapmem_alloc(&arena, bsize);
+	if (raw == NULL)
+		return NULL;
+
+	used = heapmem_used_size(&arena);
+	do {
+		peak = ACCESS_ONCE(arena_peak);
+		if (used <= peak)
+			break;
+	} while (!__sync_bool_compare_and_swap(&arena_peak, peak, used));
+
+	return raw;
+}
+
+static struct rtmalloc_thread *get_thread(void)
+{
+	struct rtmalloc_thread *t = get_current_thread();
+
+	if (t)
+		return t;
+
+	if (arena_base == NULL || !is_cobalt_thread())
+		return NULL;
+
+	t = heap_alloc(sizeof(*t));
+	if (t == NULL)
+		return NULL;
+
+	memset(t, 0, sizeof(*t));
+	t->stats.thread = pthread_self();
+	t->stats.alive = 1;
+	do
+		t->next = ACCESS_ONCE(thread_list);
+	while (!__sync_bool_compare_and_swap(&thread_list, t->next, t));
+
+	set_current_thread(t);
+
+	return t;
+}
+
+static void *rt_alloc(struct rtmalloc_thread *t, size_t size, size_t align)
+{
+	struct rtmalloc_header *h;
+	size_t bsize, in_use;
+	uintptr_t ptr;
+	void *raw;
+	int c;
+
+	if (align > UINT32_MAX / 2 || size > UINT32_MAX / 2 - align)
+		return NULL;
+
+	if (align <= sizeof(*h)) {
+		bsize = size + sizeof(*h);
+		c = block_class(bsize);
+		if (c >= 0) {
+			bsize = 1UL << (c + RTMALLOC_MIN_SHIFT);
+			raw = t->cache[c];
+			if (raw) {
+				t->cache[c] = *(void **)raw;
+				t->nr_cached[c]--;
+				goto hit;
+			}
+		}
+		raw = heap_alloc(bsize);
+		if (raw == NULL)
+			return NULL;
+	hit:
+		h = raw;
+		h->offset = 0;
+		h->cached = c >= 0;
+	} else {
+		/*
+		 * Aligned blocks are never cached, even when the
+		 * header happens to start the heap block: they are
+		 * not sized after their class.
+		 */
+		raw = heap_alloc(size + sizeof(*h) + align - 1);
+		if (raw == NULL)
+			return NULL;
+		ptr = ((uintptr_t)raw + sizeof(*h) + align - 1) & ~(align - 1);
+		h = (struct rtmalloc_header *)ptr - 1;
+		h->offset = (char *)h - (char *)raw;
+		h->cached = 0;
+	}
+
+	h->owner = t;
+	h->size = size;
+
+	t->stats.nr_allocs++;
+	in_use = __sync_add_and_fetch(&t->stats.in_use, size);
+	if (in_use > t->stats.peak)
+		t->stats.peak = in_use;
+
+	return h + 1;
+}
+
+static void rt_free(void *ptr)
+{
+	struct rtmalloc_thread *t, *owner;
+	struct rtmalloc_header *h;
+	void *raw;
+	int c;
+
+	h = (struct rtmalloc_header *)ptr - 1;
+	owner = h->owner;
+	__sync_sub_and_fetch(&owner->stats.in_use, h->size);
+	__sync_add_and_fetch(&owner->stats.nr_frees, 1);
+	raw = (char *)h - h->offset;
+
+	t = get_current_thread();
+	if (t && h->cached) {
+		c = block_class(h->size + sizeof(*h));
+		if (t->nr_cached[c] < RTMALLOC_CACHE_DEPTH) {
+			*(void **)raw = t->cache[c];
+			t->cache[c] = raw;
+			t->nr_cached[c]++;
+			return;
+		}
+	}
+
+	if (is_cobalt_thread())
+		heapmem_free(&arena, raw);
+	else
+		defer_free(raw);
+}
+
+/*
+ * When the arena runs short, only a thread already running in
+ * secondary mode may fall back to the libc allocator.
+ */
+static void *alloc_failed(struct rtmalloc_thread *t, size_t size, size_t align)
+{
+	if (cobalt_get_current_mode() & XNRELAX)
+		return align ? __libc_memalign(align, size) : __libc_malloc(size);
+
+	t->stats.nr_failures++;
+	errno = ENOMEM;
+
+	return NULL;
+}
+
+static void *alloc_aligned(size_t align, size_t size)
+{
+	struct rtmalloc_thread *t;
+	void *ptr;
+
+	t = get_thread();
+	if (t == NULL)
+		return __libc_memalign(align, size);
+
+	ptr = rt_alloc(t, size, align);
+	if (ptr == NULL)
+		return alloc_failed(t, size, align);
+
+	return ptr;
+}
+
+void *malloc(size_t size)
+{
+	struct rtmalloc_thread *t;
+	void *ptr;
+
+	t = get_thread();
+	if (t == NULL)
+		return __libc_malloc(size);
+
+	ptr = rt_alloc(t, size, 0);
+	if (ptr == NULL)
+		return alloc_failed(t, size, 0);
+
+	return ptr;
+}
+
+void free(void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	if (in_arena(ptr))
+		rt_free(ptr);
+	else
+		__libc_free(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	struct rtmalloc_thread *t;
+	void *ptr;
+
+	t = get_thread();
+	if (t == NULL)
+		return __libc_calloc(nmemb, size);
+
+	if (size && nmemb > SIZE_MAX / size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	ptr = malloc(nmemb * size);
+	if (ptr)
+		memset(ptr, 0, nmemb * size);
+
+	return ptr;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	struct rtmalloc_header *h;
+	void *nptr;
+
+	if (ptr == NULL)
+		return malloc(size);
+
+	if (!in_arena(ptr))
+		return __libc_realloc(ptr, size);
+
+	if (size == 0) {
+		rt_free(ptr);
+		return NULL;
+	}
+
+	h = (struct rtmalloc_header *)ptr - 1;
+	if (size <= h->size)
+		return ptr;
+
+	nptr = malloc(size);
+	if (nptr == NULL)
+		return NULL;
+
+	memcpy(nptr, ptr, h->size);
+	rt_free(ptr);
+
+	return nptr;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	if (alignment < sizeof(void *) || (alignment & (alignment - 1)))
+		return EINVAL;
+
+	ptr = alloc_aligned(alignment, size);
+	if (ptr == NULL)
+		return ENOMEM;
+
+	*memptr = ptr;
+
+	return 0;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	if (alignment & (alignment - 1)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return alloc_aligned(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+	return alloc_aligned(getpagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+	size_t pagesz = getpagesize();
+
+	return alloc_aligned(pagesz, __align_to(size, pagesz));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+	struct rtmalloc_header *h;
+
+	if (ptr == NULL)
+		return 0;
+
+	if (in_arena(ptr)) {
+		h = (struct rtmalloc_header *)ptr - 1;
+		return h->size;
+	}
+
+	if (libc_usable_size == NULL)
+		libc_usable_size = dlsym(RTLD_NEXT, "malloc_usable_size");
+
+	return libc_usable_size ? libc_usable_size(ptr) : 0;
+}
+
+int rtmalloc_get_stats(struct rtmalloc_stats *stats)
+{
+	struct rtmalloc_thread *t = get_current_thread();
+
+	if (t == NULL)
+		return -ESRCH;
+
+	*stats = t->stats;
+
+	return 0;
+}
+
+int rtmalloc_walk_stats(int (*walk)(const struct rtmalloc_stats *stats,
+				    void *arg), void *arg)
+{
+	struct rtmalloc_thread *t;
+	struct rtmalloc_stats s;
+	int ret;
+
+	for (t = ACCESS_ONCE(thread_list); t; t = t->next) {
+		s = t->stats;
+		ret = walk(&s, arg);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int rtmalloc_get_arena_stats(struct rtmalloc_arena_stats *stats)
+{
+	if (arena_base == NULL)
+		return -ENXIO;
+
+	stats->size = heapmem_usable_size(&arena);
+	stats->used = heapmem_used_size(&arena);
+	stats->peak = arena_peak;
+
+	return 0;
+}
+
+static void flush_cache(void)
+{
+	struct rtmalloc_thread *t = get_current_thread();
+	void *raw;
+	int c;
+
+	if (t == NULL)
+		return;
+
+	for (c = 0; c < RTMALLOC_NR_CLASSES; c++) {
+		while ((raw = t->cache[c]) != NULL) {
+			t->cache[c] = *(void **)raw;
+			heapmem_free(&arena, raw);
+		}
+		t->nr_cached[c] = 0;
+	}
+
+	t->stats.alive = 0;
+	set_current_thread(NULL);
+}
+
+static void create_context(void)
+{
+	/* Contexts are set up on first allocation. */
+}
+
+static struct cobalt_tsd_hook tsd_hook = {
+	.create_tsd = create_context,
+	.delete_tsd = flush_cache,
+};
+
+static int dump_thread_stats(const struct rtmalloc_stats *stats, void *arg)
+{
+	fprintf(stderr, "  thread %#lx%s: %lu allocs, %lu frees, %lu failures, "
+		"%zu bytes in use, %zu peak\n",
+		(unsigned long)stats->thread, stats->alive ? "" : " (exited)",
+		stats->nr_allocs, stats->nr_frees, stats->nr_failures,
+		stats->in_use, stats->peak);
+
+	return 0;
+}
+
+static void dump_all_stats(void)
+{
+	struct rtmalloc_arena_stats as;
+
+	if (rtmalloc_get_arena_stats(&as))
+		return;
+
+	fprintf(stderr, "rtmalloc: arena %zu bytes, %zu used, %zu peak\n",
+		as.size, as.used, as.peak);
+	rtmalloc_walk_stats(dump_thread_stats, NULL);
+}
+
+static int rtmalloc_init(void)
+{
+	size_t len = HEAPMEM_ARENA_SIZE(arena_size);
+	void *mem;
+	int ret;
+
+	mem = __STD(mmap(NULL, len, PROT_READ|PROT_WRITE,
+			 MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0));
+	if (mem == MAP_FAILED)
+		return __bt(-errno);
+
+	if (mlock(mem, len))
+		warning("cannot lock the real-time malloc arena (%s)",
+			symerror(-errno));
+
+	ret = heapmem_init(&arena, mem, len);
+	if (ret) {
+		munmap(mem, len);
+		return ret;
+	}
+
+#ifndef HAVE_TLS
+	ret = pthread_key_create(&rtmalloc_current_key, NULL);
+	if (ret) {
+		heapmem_destroy(&arena);
+		munmap(mem, len);
+		return __bt(-ret);
+	}
+#endif
+
+	cobalt_register_tsd_hook(&tsd_hook);
+
+	arena_len = len;
+	smp_wmb();
+	arena_base = mem;
+
+	if (dump_stats)
+		atexit(dump_all_stats);
+
+	return 0;
+}
+
+static const struct option rtmalloc_options[] = {
+	{
+#define arena_opt	0
+		.name = "rtmalloc-arena",
+		.has_arg = required_argument,
+	},
+	{
+#define dump_opt	1
+		.name = "rtmalloc-dump",
+		.has_arg = no_argument,
+		.flag = &dump_stats,
+		.val = 1,
+	},
+	{ /* Sentinel */ }
+};
+
+static int rtmalloc_parse_option(int optnum, const char *optarg)
+{
+	switch (optnum) {
+	case arena_opt:
+		arena_size = get_mem_size(optarg);
+		if (arena_size == 0)
+			return -EINVAL;
+		break;
+	case dump_opt:
+		break;
+	default:
+		/* Paranoid, can't happen. */
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void rtmalloc_help(void)
+{
+	fprintf(stderr, "--rtmalloc-arena=<size[K|M|G]>	size of the real-time malloc arena\n");
+	fprintf(stderr, "--rtmalloc-dump			dump malloc statistics on exit\n");
+}
+
+static struct setup_descriptor rtmalloc_interface = {
+	.name = "rtmalloc",
+	.init = rtmalloc_init,
+	.options = rtmalloc_options,
+	.parse_option = rtmalloc_parse_option,
+	.help = rtmalloc_help,
+};
+
+post_setup_call(rtmalloc_interface);
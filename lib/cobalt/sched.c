@@ -465,13 +465,27 @@ int sched_get_priority_max_ex(int policy)
  * - config.tp.op specifies the operation to perform:
  *
  * - @a sched_tp_install installs a new TP schedule on @a cpu, defined
- *   by config.tp.windows[]. The global time frame is not activated
- *   upon return from this request yet; @a sched_tp_start must be
- *   issued to activate the temporal scheduling on @a CPU.
- *
- * - @a sched_tp_uninstall removes the current TP schedule from @a
- *   cpu, releasing all the attached resources. If no TP schedule
- *   exists on @a CPU, this request has no effect.
+ *   by config.tp.windows[], into slot #0 and makes it the active
+ *   one. The global time frame is not activated upon return from
+ *   this request yet; @a sched_tp_start must be issued to activate
+ *   the temporal scheduling on @a CPU.
+ *
+ * - @a sched_tp_uninstall removes all TP schedules from @a cpu,
+ *   releasing all the attached resources. If no TP schedule exists
+ *   on @a CPU, this request has no effect.
+ *
+ * - @a sched_tp_load preloads the TP schedule defined by
+ *   config.tp.windows[] into slot config.tp.slot, in the range
+ *   [0..CONFIG_XENO_OPT_SCHED_TP_NRSCHED-1], without affecting the
+ *   current time frame. A zero config.tp.nr_windows empties the
+ *   slot. The slot must be neither active nor pending a switch.
+ *
+ * - @a sched_tp_switch makes the schedule preloaded into slot
+ *   config.tp.slot the active one. If the global time frame is
+ *   running, the switch happens atomically when the current time
+ *   frame ends, so that no partition window is cut short; otherwise
+ *   it takes effect immediately. Threads keep their partition
+ *   assignment across switches.
  *
  * - @a sched_tp_start enables the temporal scheduling on @a cpu,
  * starting the global time frame. If no TP schedule exists on @a cpu,
@@ -483,10 +497,11 @@ int sched_get_priority_max_ex(int policy)
  * @attention As a consequence of this request, threads assigned to the
  * un-scheduled partitions may be starved from CPU time.
  *
- * - for a @a sched_tp_install operation, config.tp.nr_windows
- * indicates the number of elements present in the config.tp.windows[]
- * array. If config.tp.nr_windows is zero, the action taken is
- * identical to @a sched_tp_uninstall.
+ * - for a @a sched_tp_install or @a sched_tp_load operation,
+ * config.tp.nr_windows indicates the number of elements present in
+ * the config.tp.windows[] array. If config.tp.nr_windows is zero,
+ * the action taken by @a sched_tp_install is identical to @a
+ * sched_tp_uninstall.
  *
  * - if config.tp.nr_windows is non-zero, config.tp.windows[] is a set
  * scheduling time slots for threads assigned to @a cpu. Each window
@@ -494,7 +509,7 @@ int sched_get_priority_max_ex(int policy)
  * (windows[].offset), its duration (windows[].duration), and the
  * partition id it should activate during such period of time
  * (windows[].ptid). This field is not considered for other requests
- * than @a sched_tp_install.
+ * than @a sched_tp_install and @a sched_tp_load.
  *
  * Time slots must be strictly contiguous, i.e. windows[n].offset +
  * windows[n].duration shall equal windows[n + 1].offset.  If
@@ -513,6 +528,12 @@ int sched_get_priority_max_ex(int policy)
  * config.tp depending on the number of time slots to be defined in
  * config.tp.windows[], as specified by config.tp.nr_windows.
  *
+ * @note /proc/xenomai/sched/tp/windows reports, for each window of
+ * every loaded schedule, how many times the partition was still busy
+ * when its window closed (overruns), the idle time it left in its
+ * window (slack), and the worst delay in starting the window
+ * (jitter).
+ *
  * @par Settings applicable to SCHED_QUOTA
  *
  * This call manages thread groups running on @a cpu, defining
@@ -552,10 +573,14 @@ int sched_get_priority_max_ex(int policy)
  * - ENOMEM, lack of memory to perform the operation.
  *
  * - EBUSY, with @a policy equal to SCHED_QUOTA, if an attempt is made
- *   to remove a thread group which still manages threads.
+ *   to remove a thread group which still manages threads, or with @a
+ *   policy equal to SCHED_TP, if @a sched_tp_load targets the active
+ *   or pending slot.
  *
  * - ESRCH, with @a policy equal to SCHED_QUOTA, if the group
- *   identifier required to perform the operation is not valid.
+ *   identifier required to perform the operation is not valid, or
+ *   with @a policy equal to SCHED_TP, if @a sched_tp_switch targets
+ *   an empty slot.
  *
  * @apitags{thread-unrestricted, switch-primary}
  */
@@ -583,7 +608,8 @@ int sched_setconfig_np(int cpu, int policy,
  * @par SCHED_TP specifics
  *
  * On successful return, config->quota.tp contains the TP schedule
- * active on @a cpu.
+ * active on @a cpu, config->tp.slot telling which slot it was loaded
+ * into.
  *
  * @par SCHED_QUOTA specifics
  *
@@ -172,7 +172,8 @@ int eventobj_init(struct eventobj *evobj, unsigned int value, int flags,
 		return __bt(ret);
 
 	evobj->core.flags = flags;
-	evobj->core.value = value;
+	atomic_set(&evobj->core.value, value);
+	atomic_set(&evobj->core.waiters, 0);
 	evobj->finalizer = finalizer;
 
 	return 0;
@@ -202,22 +203,43 @@ int eventobj_wait(struct eventobj *evobj,
 		  unsigned int bits, unsigned int *bits_r,
 		  int mode, const struct timespec *timeout)
 {
+	unsigned int value, waitval, testval;
 	struct eventobj_wait_struct *wait;
-	unsigned int waitval, testval;
 	struct syncstate syns;
 	int ret = 0;
 
+	/*
+	 * Fast path: the event value is only read, so checking for
+	 * the condition without locking is fine.
+	 */
+	if (evobj->core.sobj.magic == SYNCOBJ_MAGIC) {
+		value = atomic_read(&evobj->core.value);
+		waitval = value & bits;
+		testval = mode & EVOBJ_ANY ? waitval : value;
+		if (bits == 0 || (waitval && waitval == testval)) {
+			*bits_r = bits ? waitval : value;
+			return 0;
+		}
+	}
+
 	ret = syncobj_lock(&evobj->core.sobj, &syns);
 	if (ret)
 		return ret;
 
+	/*
+	 * Tell posters to look for waiters before checking the value
+	 * anew, so that either we see their bits, or they see us.
+	 */
+	atomic_add_fetch(&evobj->core.waiters, 1);
+
+	value = atomic_read(&evobj->core.value);
 	if (bits == 0) {
-		*bits_r = evobj->core.value;
+		*bits_r = value;
 		goto done;
 	}
 
-	waitval = evobj->core.value & bits;
-	testval = mode & EVOBJ_ANY ? waitval : evobj->core.value;
+	waitval = value & bits;
+	testval = mode & EVOBJ_ANY ? waitval : value;
 
 	if (waitval && waitval == testval) {
 		*bits_r = waitval;
@@ -246,6 +268,7 @@ int eventobj_wait(struct eventobj *evobj,
 
 	threadobj_finish_wait();
 done:
+	atomic_sub_fetch(&evobj->core.waiters, 1);
 	syncobj_unlock(&evobj->core.sobj, &syns);
 
 	return ret;
@@ -259,11 +282,18 @@ int eventobj_post(struct eventobj *evobj, unsigned int bits)
 	struct syncstate syns;
 	int ret;
 
+	/* Fast path: set the bits, done unless somebody waits. */
+	if (evobj->core.sobj.magic == SYNCOBJ_MAGIC) {
+		atomic_fetch_or(&evobj->core.value, bits);
+		if (atomic_read(&evobj->core.waiters) == 0)
+			return 0;
+	}
+
 	ret = syncobj_lock(&evobj->core.sobj, &syns);
 	if (ret)
 		return ret;
 
-	evobj->core.value |= bits;
+	atomic_fetch_or(&evobj->core.value, bits);
 
 	if (!syncobj_grant_wait_p(&evobj->core.sobj))
 		goto done;
@@ -295,8 +325,7 @@ int eventobj_clear(struct eventobj *evobj,
 	if (ret)
 		return ret;
 
-	oldval = evobj->core.value;
-	evobj->core.value &= ~bits;
+	oldval = atomic_fetch_and(&evobj->core.value, ~bits);
 
 	syncobj_unlock(&evobj->core.sobj, &syns);
 
@@ -327,7 +356,7 @@ int eventobj_inquire(struct eventobj *evobj, size_t waitsz,
 		}
 	}
 
-	*bits_r = evobj->core.value;
+	*bits_r = atomic_read(&evobj->core.value);
 
 	syncobj_unlock(&evobj->core.sobj, &syns);
 
@@ -220,6 +220,7 @@ static int copperplate_init(void)
 		ret = registry_pkg_init(__base_setup_data.arg0, regflags);
 		if (ret)
 			return ret;
+		registry_add_dir("/metrics");
 	}
 
 	ret = threadobj_pkg_init((regflags & REGISTRY_ANON) != 0);
@@ -0,0 +1,165 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+/*
+ * Reader side of the metric channels. This code has no dependency
+ * on the Xenomai runtime, so that plain Linux processes may link
+ * against the standalone libmetricobj library to sample the metrics.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "copperplate/metricobj.h"
+
+#define METRICOBJ_READ_TRIES	100000
+
+int metricobj_attach(struct metricobj_reader *reader,
+		     const char *session, const char *name)
+{
+	const struct metricobj_header *hdr;
+	char fsname[64];
+	struct stat sbuf;
+	int fd, ret;
+
+	ret = snprintf(fsname, sizeof(fsname), "/xeno:%s.metrics.%s",
+		       session, name);
+	if (ret >= (int)sizeof(fsname))
+		return -ENAMETOOLONG;
+
+	fd = shm_open(fsname, O_RDONLY, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &sbuf)) {
+		ret = -errno;
+		goto fail;
+	}
+
+	if (sbuf.st_size < (off_t)sizeof(*hdr)) {
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	hdr = mmap(NULL, sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED) {
+		ret = -errno;
+		goto fail;
+	}
+
+	close(fd);
+
+	/* The magic word is set last by the writer. */
+	if (ACCESS_ONCE(hdr->magic) != METRICOBJ_MAGIC ||
+	    hdr->version != METRICOBJ_VERSION ||
+	    hdr->size > sbuf.st_size) {
+		munmap((void *)hdr, sbuf.st_size);
+		return -EINVAL;
+	}
+
+	smp_rmb();
+	reader->hdr = hdr;
+	reader->len = sbuf.st_size;
+
+	return 0;
+fail:
+	close(fd);
+
+	return ret;
+}
+
+void metricobj_detach(struct metricobj_reader *reader)
+{
+	munmap((void *)reader->hdr, reader->len);
+	reader->hdr = NULL;
+}
+
+int metricobj_count(const struct metricobj_reader *reader)
+{
+	return ACCESS_ONCE(reader->hdr->nr_metrics);
+}
+
+int __metricobj_sample(const struct metricobj_header *hdr,
+		       int index, struct metric_sample *sample)
+{
+	const struct metric_histogram *h;
+	const struct metricobj_desc *d;
+	unsigned int nr, n, tries;
+	const void *data;
+	uint32_t seq;
+
+	if (index < 0 || index >= (int)ACCESS_ONCE(hdr->nr_metrics))
+		return -EINVAL;
+
+	/* Pairs with the publication of the descriptor. */
+	smp_rmb();
+	d = hdr->desc + index;
+	if (d->offset >= hdr->size)
+		return -EINVAL;
+
+	data = (const char *)hdr + d->offset;
+	sample->name = d->name;
+	sample->type = d->type;
+
+	switch (d->type) {
+	case METRIC_COUNTER:
+		sample->count = metric_load64(&((const struct metric_counter *)data)->value);
+		break;
+	case METRIC_GAUGE:
+		sample->value = metric_load64(&((const struct metric_gauge *)data)->value);
+		break;
+	case METRIC_HISTOGRAM:
+		h = data;
+		nr = h->nr_buckets + 2;
+		if (d->offset + sizeof(*h) + nr * sizeof(h->buckets[0]) > hdr->size)
+			return -EINVAL;
+		/*
+		 * Do not wait forever for a writer which may have died
+		 * in the middle of an update.
+		 */
+		tries = 0;
+		do {
+			if (++tries > METRICOBJ_READ_TRIES)
+				return -EAGAIN;
+			seq = metric_histogram_read_begin(h);
+			sample->count = h->count;
+			sample->sum = h->sum;
+			sample->min = h->min;
+			sample->max = h->max;
+			for (n = 0; n < nr && n < sample->nr_buckets; n++)
+				sample->buckets[n] = h->buckets[n];
+		} while (metric_histogram_read_retry(h, seq));
+		sample->base = h->base;
+		sample->width = h->width;
+		sample->nr_buckets = nr;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int metricobj_sample(const struct metricobj_reader *reader,
+		     int index, struct metric_sample *sample)
+{
+	return __metricobj_sample(reader->hdr, index, sample);
+}
@@ -0,0 +1,305 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <boilerplate/ancillaries.h>
+#include <boilerplate/lock.h>
+#include "copperplate/metricobj.h"
+#include "copperplate/registry-obstack.h"
+#include "copperplate/tunables.h"
+#include "copperplate/debug.h"
+
+/*
+ * Metric channels are backed by a shared memory file named after the
+ * session and the channel, which readers map read-only. Metrics are
+ * added by bumping the data break, then published by incrementing
+ * the descriptor count; they are never removed until the channel is
+ * destroyed.
+ */
+
+#ifdef CONFIG_XENO_REGISTRY
+
+static int metric_registry_open(struct fsobj *fsobj, void *priv)
+{
+	struct fsobstack *o = priv;
+	struct metric_sample s;
+	struct metricobj *mobj;
+	int n, nr, ret;
+
+	mobj = container_of(fsobj, struct metricobj, fsobj);
+	nr = ACCESS_ONCE(mobj->hdr->nr_metrics);
+
+	fsobstack_init(o);
+
+	fsobstack_grow_format(o, "%-24s %-10s %s\n", "NAME", "TYPE", "VALUE");
+
+	for (n = 0; n < nr; n++) {
+		s.nr_buckets = 0;
+		ret = __metricobj_sample(mobj->hdr, n, &s);
+		if (ret)
+			continue;
+		switch (s.type) {
+		case METRIC_COUNTER:
+			fsobstack_grow_format(o, "%-24s %-10s %llu\n",
+					      s.name, "counter",
+					      (unsigned long long)s.count);
+			break;
+		case METRIC_GAUGE:
+			fsobstack_grow_format(o, "%-24s %-10s %lld\n",
+					      s.name, "gauge",
+					      (long long)s.value);
+			break;
+		case METRIC_HISTOGRAM:
+			fsobstack_grow_format(o, "%-24s %-10s count=%llu min=%lld max=%lld avg=%lld\n",
+					      s.name, "histogram",
+					      (unsigned long long)s.count,
+					      (long long)s.min, (long long)s.max,
+					      s.count ? (long long)(s.sum / (int64_t)s.count) : 0LL);
+			break;
+		}
+	}
+
+	fsobstack_finish(o);
+
+	return 0;
+}
+
+static struct registry_operations registry_ops = {
+	.open		= metric_registry_open,
+	.release	= fsobj_obstack_release,
+	.read		= fsobj_obstack_read
+};
+
+#else /* !CONFIG_XENO_REGISTRY */
+
+static struct registry_operations registry_ops;
+
+#endif /* CONFIG_XENO_REGISTRY */
+
+/*
+ * A channel left behind by a process which died is recycled, an
+ * active one belongs to its creator.
+ */
+static int channel_is_stale(const char *fsname)
+{
+	struct metricobj_header *hdr;
+	int fd, stale = 0;
+	pid_t pid;
+
+	fd = shm_open(fsname, O_RDONLY, 0);
+	if (fd < 0)
+		return errno == ENOENT;
+
+	hdr = __STD(mmap(NULL, sizeof(*hdr), PROT_READ, MAP_SHARED, fd, 0));
+	__STD(close(fd));
+	if (hdr == MAP_FAILED)
+		return 0;
+
+	pid = hdr->pid;
+	if (hdr->magic != METRICOBJ_MAGIC || pid <= 0 ||
+	    (kill(pid, 0) && errno == ESRCH))
+		stale = 1;
+
+	munmap(hdr, sizeof(*hdr));
+
+	return stale;
+}
+
+int metricobj_init(struct metricobj *mobj, const char *name,
+		   unsigned int max_metrics, size_t datasz)
+{
+	const char *session = __copperplate_setup_data.session_label;
+	struct metricobj_header *hdr;
+	pthread_mutexattr_t mattr;
+	size_t len, brk;
+	int fd, ret;
+
+	if (*name == '\0' || strlen(name) >= METRICOBJ_NAMELEN ||
+	    strchr(name, '/') || max_metrics == 0)
+		return __bt(-EINVAL);
+
+	brk = __align_to(sizeof(*hdr) + max_metrics * sizeof(hdr->desc[0]),
+			 sizeof(uint64_t));
+	len = brk + __align_to(datasz, sizeof(uint64_t));
+	if (len > UINT32_MAX)
+		return __bt(-EINVAL);
+
+	ret = snprintf(mobj->fsname, sizeof(mobj->fsname),
+		       "/xeno:%s.metrics.%s", session, name);
+	if (ret >= (int)sizeof(mobj->fsname))
+		return __bt(-ENAMETOOLONG);
+
+	fd = shm_open(mobj->fsname, O_RDWR|O_CREAT|O_EXCL, 0644);
+	if (fd < 0 && errno == EEXIST && channel_is_stale(mobj->fsname)) {
+		shm_unlink(mobj->fsname);
+		fd = shm_open(mobj->fsname, O_RDWR|O_CREAT|O_EXCL, 0644);
+	}
+	if (fd < 0)
+		return __bt(-errno);
+
+	ret = ftruncate(fd, len);
+	if (__bterrno(ret))
+		goto fail;
+
+	hdr = __STD(mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0));
+	if (hdr == MAP_FAILED) {
+		ret = __bt(-errno);
+		goto fail;
+	}
+
+	__STD(close(fd));
+
+	hdr->version = METRICOBJ_VERSION;
+	strcpy(hdr->name, name);
+	hdr->pid = getpid();
+	hdr->size = len;
+	hdr->max_metrics = max_metrics;
+	hdr->nr_metrics = 0;
+	hdr->brk = brk;
+	/* Readers check the magic word first. */
+	metric_wmb();
+	hdr->magic = METRICOBJ_MAGIC;
+
+	mobj->hdr = hdr;
+	mobj->len = len;
+
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_settype(&mattr, mutex_type_attribute);
+	pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_PRIVATE);
+	__RT(pthread_mutex_init(&mobj->lock, &mattr));
+	pthread_mutexattr_destroy(&mattr);
+
+	registry_init_file_obstack(&mobj->fsobj, &registry_ops);
+	ret = __bt(registry_add_file(&mobj->fsobj, O_RDONLY,
+				     "/metrics/%s", name));
+	if (ret)
+		warning("failed to export metric channel %s to registry, %s",
+			name, symerror(ret));
+
+	return 0;
+fail:
+	__STD(close(fd));
+	shm_unlink(mobj->fsname);
+
+	return ret;
+}
+
+void metricobj_destroy(struct metricobj *mobj)
+{
+	registry_destroy_file(&mobj->fsobj);
+	__RT(pthread_mutex_destroy(&mobj->lock));
+	shm_unlink(mobj->fsname);
+	munmap(mobj->hdr, mobj->len);
+}
+
+static int add_metric(struct metricobj *mobj, const char *name,
+		      int type, size_t size, void **data_r,
+		      const struct metric_histogram *geometry)
+{
+	struct metricobj_header *hdr = mobj->hdr;
+	struct metric_histogram *h;
+	struct metricobj_desc *d;
+	unsigned int n;
+	void *data;
+	int ret = 0;
+
+	if (*name == '\0' || strlen(name) >= METRICOBJ_NAMELEN)
+		return __bt(-EINVAL);
+
+	size = __align_to(size, sizeof(uint64_t));
+
+	__RT(pthread_mutex_lock(&mobj->lock));
+
+	for (n = 0; n < hdr->nr_metrics; n++) {
+		if (strcmp(hdr->desc[n].name, name) == 0) {
+			ret = -EEXIST;
+			goto out;
+		}
+	}
+
+	if (hdr->nr_metrics >= hdr->max_metrics ||
+	    hdr->brk + size > hdr->size) {
+		ret = -ENOSPC;
+		goto out;
+	}
+
+	/*
+	 * The data space is still zeroed from the creation of the
+	 * channel. Fill in the descriptor, then publish it.
+	 */
+	d = hdr->desc + hdr->nr_metrics;
+	strcpy(d->name, name);
+	d->type = type;
+	d->offset = hdr->brk;
+	data = (char *)hdr + hdr->brk;
+	if (geometry) {
+		h = data;
+		h->nr_buckets = geometry->nr_buckets;
+		h->base = geometry->base;
+		h->width = geometry->width;
+	}
+	hdr->brk += size;
+	metric_wmb();
+	hdr->nr_metrics++;
+	*data_r = data;
+out:
+	__RT(pthread_mutex_unlock(&mobj->lock));
+
+	return __bt(ret);
+}
+
+int metricobj_add_counter(struct metricobj *mobj, const char *name,
+			  struct metric_counter **counter_r)
+{
+	return add_metric(mobj, name, METRIC_COUNTER,
+			  sizeof(**counter_r), (void **)counter_r, NULL);
+}
+
+int metricobj_add_gauge(struct metricobj *mobj, const char *name,
+			struct metric_gauge **gauge_r)
+{
+	return add_metric(mobj, name, METRIC_GAUGE,
+			  sizeof(**gauge_r), (void **)gauge_r, NULL);
+}
+
+int metricobj_add_histogram(struct metricobj *mobj, const char *name,
+			    int64_t base, int64_t width,
+			    unsigned int nr_buckets,
+			    struct metric_histogram **histogram_r)
+{
+	struct metric_histogram geometry;
+
+	if (width <= 0 || nr_buckets == 0 || nr_buckets > 65536)
+		return __bt(-EINVAL);
+
+	geometry.nr_buckets = nr_buckets;
+	geometry.base = base;
+	geometry.width = width;
+
+	return add_metric(mobj, name, METRIC_HISTOGRAM,
+			  sizeof(geometry) +
+			  (nr_buckets + 2) * sizeof(geometry.buckets[0]),
+			  (void **)histogram_r, &geometry);
+}
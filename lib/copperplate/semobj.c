@@ -18,6 +18,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include "copperplate/threadobj.h"
 #include "copperplate/semobj.h"
 #include "copperplate/heapobj.h"
@@ -208,7 +209,7 @@ int semobj_init(struct semobj *smobj, int flags, int value,
 		return __bt(ret);
 
 	smobj->core.flags = flags;
-	smobj->core.value = value;
+	atomic_set(&smobj->core.value, value);
 	smobj->finalizer = finalizer;
 
 	return 0;
@@ -234,14 +235,20 @@ int semobj_post(struct semobj *smobj)
 	struct syncstate syns;
 	int ret;
 
+	/* Pulse mode always needs the lock to drop the count. */
+	if ((smobj->core.flags & SEMOBJ_PULSE) == 0 &&
+	    syncobj_fast_give(&smobj->core.sobj, &smobj->core.value,
+			      INT_MAX) == 0)
+		return 0;
+
 	ret = syncobj_lock(&smobj->core.sobj, &syns);
 	if (ret)
 		return ret;
 
-	if (++smobj->core.value <= 0)
+	if (atomic_add_fetch(&smobj->core.value, 1) <= 0)
 		syncobj_grant_one(&smobj->core.sobj);
 	else if (smobj->core.flags & SEMOBJ_PULSE)
-		smobj->core.value = 0;
+		atomic_set(&smobj->core.value, 0);
 
 	syncobj_unlock(&smobj->core.sobj, &syns);
 
@@ -257,8 +264,8 @@ int semobj_broadcast(struct semobj *smobj)
 	if (ret)
 		return ret;
 
-	if (smobj->core.value < 0) {
-		smobj->core.value = 0;
+	if (atomic_read(&smobj->core.value) < 0) {
+		atomic_set(&smobj->core.value, 0);
 		syncobj_grant_all(&smobj->core.sobj);
 	}
 
@@ -272,21 +279,25 @@ int semobj_wait(struct semobj *smobj, const struct timespec *timeout)
 	struct syncstate syns;
 	int ret = 0;
 
+	if (syncobj_fast_take(&smobj->core.sobj, &smobj->core.value) == 0)
+		return 0;
+
 	ret = syncobj_lock(&smobj->core.sobj, &syns);
 	if (ret)
 		return ret;
 
-	if (--smobj->core.value >= 0)
+	if (atomic_sub_fetch(&smobj->core.value, 1) >= 0)
 		goto done;
 
 	if (timeout &&
 	    timeout->tv_sec == 0 && timeout->tv_nsec == 0) {
-		smobj->core.value++;
+		atomic_add_fetch(&smobj->core.value, 1);
 		ret = -EWOULDBLOCK;
 		goto done;
 	}
 
 	if (!threadobj_current_p()) {
+		atomic_add_fetch(&smobj->core.value, 1);
 		ret = -EPERM;
 		goto done;
 	}
@@ -301,7 +312,8 @@ int semobj_wait(struct semobj *smobj, const struct timespec *timeout)
 		if (ret == -EIDRM)
 			return ret;
 
-		smobj->core.value++; /* Fix up semaphore count. */
+		/* Fix up semaphore count. */
+		atomic_add_fetch(&smobj->core.value, 1);
 	}
 done:
 	syncobj_unlock(&smobj->core.sobj, &syns);
@@ -316,7 +328,7 @@ int semobj_getvalue(struct semobj *smobj, int *sval)
 	if (syncobj_lock(&smobj->core.sobj, &syns))
 		return -EINVAL;
 
-	*sval = smobj->core.value;
+	*sval = atomic_read(&smobj->core.value);
 
 	syncobj_unlock(&smobj->core.sobj, &syns);
 
@@ -344,7 +356,7 @@ int semobj_inquire(struct semobj *smobj, size_t waitsz,
 		}
 	}
 
-	*val_r = smobj->core.value;
+	*val_r = atomic_read(&smobj->core.value);
 
 	syncobj_unlock(&smobj->core.sobj, &syns);
 
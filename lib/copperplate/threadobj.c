@@ -464,6 +464,7 @@ static inline void disable_rr_corespec(struct threadobj *thobj) /* thobj->lock h
 
 int threadobj_stat(struct threadobj *thobj, struct threadobj_stat *p) /* thobj->lock held */
 {
+	struct cobalt_budget_info budget;
 	struct cobalt_threadstat stat;
 	int ret;
 
@@ -482,10 +483,74 @@ int threadobj_stat(struct threadobj *thobj, struct threadobj_stat *p) /* thobj->
 	p->pf = stat.pf;
 	p->timeout = stat.timeout;
 	p->schedlock = thobj->schedlock_depth;
+	p->budget_overruns = 0;
+
+	if (thobj->status & __THREAD_S_BUDGET) {
+		ret = cobalt_thread_getbudget(thobj->pid, &budget);
+		if (ret)
+			return __bt(ret);
+		p->budget_overruns = budget.overruns;
+	}
 
 	return 0;
 }
 
+int threadobj_set_budget(struct threadobj *thobj,
+			 const struct timespec *quantum,
+			 struct eventobj *evobj,
+			 unsigned int bits, int signo) /* thobj->lock held */
+{
+	struct cobalt_budget_config config;
+	struct timespec now, idate;
+	struct itimerspec its;
+	int ret;
+
+	__threadobj_check_locked(thobj);
+
+	memset(&config, 0, sizeof(config));
+	config.event = XN_NO_HANDLE;
+
+	if (timespec_scalar(quantum)) {
+		if (!(thobj->status & __THREAD_S_PERIODIC))
+			return -EWOULDBLOCK;
+		/*
+		 * The budget is replenished on the periodic timeline,
+		 * sampling the clock first so that the replenishment
+		 * never lags the release point.
+		 */
+		__RT(clock_gettime(CLOCK_COPPERPLATE, &now));
+		ret = __RT(timer_gettime(thobj->periodic_timer, &its));
+		if (ret)
+			return __bt(-errno);
+		timespec_add(&idate, &now, &its.it_value);
+		config.quantum = timespec_scalar(quantum);
+		config.idate = timespec_scalar(&idate);
+		config.period = timespec_scalar(&its.it_interval);
+		config.clock = CLOCK_COPPERPLATE;
+		config.signo = signo;
+		if (evobj) {
+			config.event = evobj->core.event.handle;
+			config.evbits = bits;
+		}
+	}
+
+	ret = cobalt_thread_setbudget(thobj->pid, &config);
+	if (ret)
+		return __bt(ret);
+
+	if (config.quantum)
+		thobj->status |= __THREAD_S_BUDGET;
+	else
+		thobj->status &= ~__THREAD_S_BUDGET;
+
+	return 0;
+}
+
+static inline void threadobj_replenish_corespec(struct threadobj *current)
+{
+	/* The nucleus replenishes the budget. */
+}
+
 #else /* CONFIG_XENO_MERCURY */
 
 static int threadobj_lock_prio;
@@ -591,6 +656,8 @@ static inline int threadobj_init_corespec(struct threadobj *thobj)
 	int ret;
 
 	thobj->core.rr_timer = NULL;
+	thobj->core.budget_timer = NULL;
+	thobj->core.budget_overruns = 0;
 	/*
 	 * Over Mercury, we need an additional per-thread condvar to
 	 * implement the complex monitor for the syncobj abstraction.
@@ -663,6 +730,8 @@ static inline void threadobj_cleanup_corespec(struct threadobj *thobj)
 {
 	if (thobj->core.rr_timer)
 		timer_delete(thobj->core.rr_timer);
+	if (thobj->core.budget_timer)
+		timer_delete(thobj->core.budget_timer);
 }
 
 static inline void threadobj_run_corespec(struct threadobj *thobj)
@@ -901,10 +970,117 @@ int threadobj_stat(struct threadobj *thobj,
 		stat->timeout = 0;
 
 	stat->schedlock = thobj->schedlock_depth;
+	stat->budget_overruns = thobj->core.budget_overruns;
+
+	return 0;
+}
+
+static void budget_overrun_handler(union sigval sv)
+{
+	struct threadobj *thobj = sv.sival_ptr;
+	struct eventobj *evobj;
+	unsigned int bits;
+	int signo;
+
+	if (threadobj_lock(thobj))
+		return;
+
+	if (!(thobj->status & __THREAD_S_BUDGET)) {
+		threadobj_unlock(thobj);
+		return;
+	}
+
+	thobj->core.budget_overruns++;
+	evobj = thobj->core.budget_evobj;
+	bits = thobj->core.budget_bits;
+	signo = thobj->core.budget_signo;
+	threadobj_unlock(thobj);
+
+	if (evobj)
+		eventobj_post(evobj, bits);
+
+	if (signo)
+		copperplate_kill_tid(thobj->pid, signo);
+}
+
+int threadobj_set_budget(struct threadobj *thobj,
+			 const struct timespec *quantum,
+			 struct eventobj *evobj,
+			 unsigned int bits, int signo) /* thobj->lock held */
+{
+	struct itimerspec its;
+	struct sigevent sev;
+	clockid_t clock_id;
+	int ret;
+
+	__threadobj_check_locked(thobj);
+
+	if (!timespec_scalar(quantum)) {
+		thobj->status &= ~__THREAD_S_BUDGET;
+		if (thobj->core.budget_timer) {
+			memset(&its, 0, sizeof(its));
+			timer_settime(thobj->core.budget_timer, 0, &its, NULL);
+		}
+		return 0;
+	}
+
+	if (!(thobj->status & __THREAD_S_PERIODIC))
+		return -EWOULDBLOCK;
+
+	if (signo < 0 || signo > SIGRTMAX)
+		return -EINVAL;
+
+	/*
+	 * There is no kernel support for replenishing a budget over
+	 * Mercury: we track the CPU time of the thread with a regular
+	 * CPU-time clock, which we re-arm on each release point. The
+	 * notification is handled by an ancillary thread, as we may
+	 * not post an event from a signal handler.
+	 */
+	if (thobj->core.budget_timer == NULL) {
+		ret = pthread_getcpuclockid(thobj->ptid, &clock_id);
+		if (ret)
+			return __bt(-ret);
+		memset(&sev, 0, sizeof(sev));
+		sev.sigev_notify = SIGEV_THREAD;
+		sev.sigev_notify_function = budget_overrun_handler;
+		sev.sigev_value.sival_ptr = thobj;
+		if (timer_create(clock_id, &sev, &thobj->core.budget_timer)) {
+			thobj->core.budget_timer = NULL;
+			return __bt(-errno);
+		}
+	}
+
+	thobj->core.budget = *quantum;
+	thobj->core.budget_evobj = evobj;
+	thobj->core.budget_bits = bits;
+	thobj->core.budget_signo = signo;
+	thobj->core.budget_overruns = 0;
+	thobj->status |= __THREAD_S_BUDGET;
+
+	its.it_value = *quantum;
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+	if (timer_settime(thobj->core.budget_timer, 0, &its, NULL))
+		return __bt(-errno);
 
 	return 0;
 }
 
+static inline void threadobj_replenish_corespec(struct threadobj *current)
+{
+	struct itimerspec its;
+
+	if (!(current->status & __THREAD_S_BUDGET))
+		return;
+
+	/* Grant a full budget from this release point on. */
+	its.it_value = current->core.budget;
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+	timer_settime(current->core.budget_timer, 0, &its, NULL);
+}
+
 #ifdef CONFIG_XENO_WORKAROUND_CONDVAR_PI
 
 /*
@@ -1630,6 +1806,12 @@ int threadobj_set_periodic(struct threadobj *thobj,
 
 	__threadobj_check_locked(thobj);
 
+	/* A budget is bound to the timeline we are about to change. */
+	if (thobj->status & __THREAD_S_BUDGET) {
+		memset(&its, 0, sizeof(its));
+		threadobj_set_budget(thobj, &its.it_value, NULL, 0, 0);
+	}
+
 	timer = thobj->periodic_timer;
 	if (!timespec_scalar(idate) && !timespec_scalar(period)) {
 		if (thobj->status & __THREAD_S_PERIODIC) {
@@ -1681,6 +1863,8 @@ int threadobj_wait_period(unsigned long *overruns_r)
 		panic("cannot wait for next period, %s", symerror(-errno));
 	}
 
+	threadobj_replenish_corespec(current);
+
 	if (si.si_overrun) {
 		if (overruns_r)
 			*overruns_r = si.si_overrun;
@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <memory.h>
 #include <boilerplate/ancillaries.h>
 #include <copperplate/threadobj.h>
@@ -137,10 +138,13 @@ u_long rn_create(const char *name, void *saddr, u_long length,
 		sobj_flags = SYNCOBJ_PRIO;
 
 	rn->length = length;
-	rn->usize = usize;	/* Not actually used, just checked. */
+	rn->usize = usize;
+	rn->ushift = ffs(usize) - 1;
 	rn->flags = flags;
 	rn->busynr = 0;
 	rn->usedmem = 0;
+	rn->free_map = 0;
+	memset(rn->free_list, 0, sizeof(rn->free_list));
 	ret = syncobj_init(&rn->sobj, CLOCK_COPPERPLATE, sobj_flags, fnref_null);
 	if (ret) {
 		heapobj_destroy(&rn->hobj);
@@ -215,6 +219,136 @@ u_long rn_ident(const char *name, u_long *rnid_r)
 	return SUCCESS;
 }
 
+/*
+ * Cached segments link to the next one with their first word, and
+ * carry a tag in the second one which tells a segment returned twice
+ * at a glance. Units are 16 bytes at least, so both words fit.
+ */
+#define rn_seg_tag(__seg)	((void *)((uintptr_t)(__seg) ^ 0x5e6f4ee5UL))
+
+static int seg_cached(struct psos_rn *rn, void **seg, int n)
+{
+	void **p;
+
+	/* User data might look like a tag, make sure. */
+	if (seg[1] != rn_seg_tag(seg))
+		return 0;
+
+	for (p = rn->free_list[n]; p; p = *p) {
+		if (p == seg)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Segments are cached by actual block size, which the heap rounds
+ * up. We pick the smallest cached block of [units .. units * 2], so
+ * as not to waste more than the heap would.
+ */
+static void *get_cached(struct psos_rn *rn, u_long size)
+{
+	u_long units, map;
+	void **seg;
+	int n;
+
+	units = (size + rn->usize - 1) >> rn->ushift;
+	if (units == 0 || units > RN_NR_CLASSES)
+		return NULL;
+
+	map = (rn->free_map >> (units - 1)) & ((1UL << (units + 1)) - 1);
+	if (map == 0)
+		return NULL;
+
+	n = ffsl(map) + units - 2;
+	seg = rn->free_list[n];
+	rn->free_list[n] = *seg;
+	if (rn->free_list[n] == NULL)
+		rn->free_map &= ~(1UL << n);
+	seg[1] = NULL;
+
+	return seg;
+}
+
+static void drain_cache(struct psos_rn *rn)
+{
+	void **seg;
+	int n;
+
+	for (n = 0; rn->free_map; n++) {
+		while (rn->free_list[n]) {
+			seg = rn->free_list[n];
+			rn->free_list[n] = *seg;
+			heapobj_free(&rn->hobj, seg);
+		}
+		rn->free_map &= ~(1UL << n);
+	}
+}
+
+/* Region lock held. */
+static void *alloc_seg(struct psos_rn *rn, u_long size)
+{
+	void *seg;
+
+	/*
+	 * The heap manager does not enforce any allocation limit; so
+	 * we have to do it by ourselves.
+	 */
+	if (rn->usedmem + size > rn->length)
+		return NULL;
+
+	seg = get_cached(rn, size);
+	if (seg == NULL) {
+		seg = heapobj_alloc(&rn->hobj, size);
+		if (seg == NULL && rn->free_map) {
+			/* Give cached segments back, then retry. */
+			drain_cache(rn);
+			seg = heapobj_alloc(&rn->hobj, size);
+		}
+		if (seg == NULL)
+			return NULL;
+	}
+
+	rn->busynr++;
+	rn->usedmem += heapobj_validate(&rn->hobj, seg);
+
+	return seg;
+}
+
+/* Region lock held. */
+static int free_seg(struct psos_rn *rn, void **seg)
+{
+	u_long bsize = heapobj_validate(&rn->hobj, seg), units;
+	int n;
+
+	/* Not a busy heap block. */
+	if (bsize == 0)
+		return ERR_SEGADDR;
+
+	units = bsize >> rn->ushift;
+	if ((bsize & (rn->usize - 1)) || units == 0 || units > RN_NR_CLASSES) {
+		rn->usedmem -= bsize;
+		rn->busynr--;
+		heapobj_free(&rn->hobj, seg);
+		return SUCCESS;
+	}
+
+	/* Still a busy heap block, but released already. */
+	n = units - 1;
+	if (seg_cached(rn, seg, n))
+		return ERR_SEGFREE;
+
+	rn->usedmem -= bsize;
+	rn->busynr--;
+	seg[0] = rn->free_list[n];
+	seg[1] = rn_seg_tag(seg);
+	rn->free_list[n] = seg;
+	rn->free_map |= 1UL << n;
+
+	return SUCCESS;
+}
+
 u_long rn_getseg(u_long rnid, u_long size, u_long flags,
 		 u_long timeout, void **segaddr)
 {
@@ -237,22 +371,12 @@ u_long rn_getseg(u_long rnid, u_long size, u_long flags,
 		goto out;
 	}
 
-	/*
-	 * The heap manager does not enforce any allocation limit; so
-	 * we have to do it by ourselves.
-	 */
-	if (rn->usedmem + size > rn->length)
-		goto starve;
-
-	seg = heapobj_alloc(&rn->hobj, size);
+	seg = alloc_seg(rn, size);
 	if (seg) {
 		*segaddr = seg;
-		rn->busynr++;
-		rn->usedmem += heapobj_validate(&rn->hobj, seg);
 		goto done;
 	}
 
-starve:
 	if (flags & RN_NOWAIT) {
 		ret = ERR_NOSEG;
 		goto done;
@@ -295,12 +419,12 @@ out:
 u_long rn_retseg(u_long rnid, void *segaddr)
 {
 	struct threadobj *thobj, *tmp;
+	u_long size, failed = ~0UL;
 	struct psos_rn_wait *wait;
 	struct syncstate syns;
 	struct psos_rn *rn;
 	struct service svc;
 	int ret = SUCCESS;
-	u_long size;
 	void *seg;
 
 	rn = get_rn_from_id(rnid, &ret);
@@ -314,25 +438,30 @@ u_long rn_retseg(u_long rnid, void *segaddr)
 		goto out;
 	}
 
-	rn->usedmem -= heapobj_validate(&rn->hobj, segaddr);
-	heapobj_free(&rn->hobj, segaddr);
-	rn->busynr--;
-
-	if (!syncobj_grant_wait_p(&rn->sobj))
+	ret = free_seg(rn, segaddr);
+	if (ret)
 		goto done;
 
+	/*
+	 * Serve all waiters we can in a single pass, in queuing order
+	 * (i.e. FIFO or priority). Once a request fails, larger ones
+	 * would fail too, so we only look for smaller ones past this
+	 * point.
+	 */
 	syncobj_for_each_grant_waiter_safe(&rn->sobj, thobj, tmp) {
+		if (rn->usedmem >= rn->length)
+			break;
 		wait = threadobj_get_wait(thobj);
 		size = wait->size;
-		if (rn->usedmem + size > rn->length)
+		if (size >= failed)
+			continue;
+		seg = alloc_seg(rn, size);
+		if (seg == NULL) {
+			failed = size;
 			continue;
-		seg = heapobj_alloc(&rn->hobj, size);
-		if (seg) {
-			rn->busynr++;
-			rn->usedmem += heapobj_validate(&rn->hobj, seg);
-			wait->ptr = __moff(seg);
-			syncobj_grant_to(&rn->sobj, thobj);
 		}
+		wait->ptr = __moff(seg);
+		syncobj_grant_to(&rn->sobj, thobj);
 	}
 done:
 	syncobj_unlock(&rn->sobj, &syns);
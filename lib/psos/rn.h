@@ -24,6 +24,12 @@
 #include <copperplate/heapobj.h>
 #include <copperplate/cluster.h>
 
+/*
+ * Released segments of up to RN_NR_CLASSES units are kept on
+ * per-size free lists, for reuse without going through the heap.
+ */
+#define RN_NR_CLASSES	16
+
 struct psos_rn {
 	unsigned int magic;		/* Must be first. */
 	char name[XNOBJECT_NAME_LEN];
@@ -33,6 +39,11 @@ struct psos_rn {
 	u_long usize;
 	u_long busynr;
 	u_long usedmem;
+	int ushift;
+
+	/* Bit #n set means free_list[n] (n + 1 units) is not empty. */
+	u_long free_map;
+	void *free_list[RN_NR_CLASSES];
 
 	struct syncobj sobj;
 	struct heapobj hobj;
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <time.h>
+#include <copperplate/traceobj.h>
+#include <psos/psos.h>
+
+static struct traceobj trobj;
+
+static char churn_mem[262144];
+
+static char wait_mem[16384];
+
+#define NR_SLOTS	128
+#define NR_ROUNDS	200000
+#define NR_WAITERS	5
+
+static void *slots[NR_SLOTS];
+
+static u_long wait_rnid;
+
+static struct {
+	u_long size;
+	u_long ret;
+	void *seg;
+} waiters[NR_WAITERS] = {
+	[0 ... 2] = { .size = 64 },
+	[3] = { .size = 8192 },
+	[4] = { .size = 64 },
+};
+
+static long long churn_ns, nr_ops;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Mostly small segments, some medium, a few large ones. */
+static u_long pick_size(void)
+{
+	int r = random() % 100;
+
+	if (r < 80)
+		return 16 + random() % 240;
+	if (r < 95)
+		return 256 + random() % 1792;
+
+	return 2048 + random() % 14336;
+}
+
+static void churn_task(u_long a1, u_long a2, u_long a3, u_long a4)
+{
+	u_long rnid, asize;
+	long long start;
+	int ret, n, k;
+	void *seg;
+
+	traceobj_enter(&trobj);
+
+	ret = rn_create("CHRN", churn_mem, sizeof(churn_mem),
+			32, RN_FIFO|RN_DEL, &rnid, &asize);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	/* A cached segment must not be returned twice. */
+	ret = rn_getseg(rnid, 64, RN_NOWAIT, 0, &seg);
+	traceobj_assert(&trobj, ret == SUCCESS);
+	ret = rn_retseg(rnid, seg);
+	traceobj_assert(&trobj, ret == SUCCESS);
+	ret = rn_retseg(rnid, seg);
+	traceobj_assert(&trobj, ret == ERR_SEGFREE);
+
+	srandom(0x55667788);
+	start = now_ns();
+
+	for (n = 0; n < NR_ROUNDS; n++) {
+		k = random() % NR_SLOTS;
+		if (slots[k]) {
+			ret = rn_retseg(rnid, slots[k]);
+			traceobj_assert(&trobj, ret == SUCCESS);
+			slots[k] = NULL;
+		} else {
+			ret = rn_getseg(rnid, pick_size(), RN_NOWAIT, 0, &slots[k]);
+			traceobj_assert(&trobj, ret == SUCCESS || ret == ERR_NOSEG);
+			if (ret)
+				slots[k] = NULL;
+		}
+		nr_ops++;
+	}
+
+	churn_ns = now_ns() - start;
+
+	ret = rn_delete(rnid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	traceobj_exit(&trobj);
+}
+
+static void wait_task(u_long a1, u_long a2, u_long a3, u_long a4)
+{
+	traceobj_enter(&trobj);
+
+	waiters[a1].ret = rn_getseg(wait_rnid, waiters[a1].size,
+				    RN_WAIT, 0, &waiters[a1].seg);
+
+	traceobj_exit(&trobj);
+}
+
+static void start_waiter(int n)
+{
+	u_long args[] = { n, 0, 0, 0 }, tid;
+	int ret;
+
+	waiters[n].ret = ~0UL;
+	waiters[n].seg = NULL;
+
+	/* Higher priority than ours, so that it blocks right away. */
+	ret = t_create("WAIT", 30, 0, 0, 0, &tid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+	ret = t_start(tid, 0, wait_task, args);
+	traceobj_assert(&trobj, ret == SUCCESS);
+}
+
+static void main_task(u_long a1, u_long a2, u_long a3, u_long a4)
+{
+	void *chunks[sizeof(wait_mem) / 1024];
+	u_long asize;
+	int ret, n;
+
+	traceobj_enter(&trobj);
+
+	ret = rn_create("WAIT", wait_mem, sizeof(wait_mem),
+			32, RN_FIFO|RN_DEL, &wait_rnid, &asize);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	for (n = 0; n < sizeof(chunks) / sizeof(chunks[0]); n++) {
+		ret = rn_getseg(wait_rnid, 1024, RN_NOWAIT, 0, &chunks[n]);
+		if (ret) {
+			traceobj_assert(&trobj, ret == ERR_NOSEG);
+			break;
+		}
+	}
+	traceobj_assert(&trobj, n > 2);
+
+	/* A single release must serve every small waiter. */
+	for (n = 0; n < 3; n++)
+		start_waiter(n);
+
+	ret = rn_retseg(wait_rnid, chunks[0]);
+	traceobj_assert(&trobj, ret == SUCCESS);
+	tm_wkafter(1);
+
+	for (n = 0; n < 3; n++)
+		traceobj_assert(&trobj, waiters[n].ret == SUCCESS &&
+				waiters[n].seg != NULL);
+
+	/* A large waiter queued first must not block a small one. */
+	start_waiter(3);
+	start_waiter(4);
+
+	ret = rn_retseg(wait_rnid, chunks[1]);
+	traceobj_assert(&trobj, ret == SUCCESS);
+	tm_wkafter(1);
+
+	traceobj_assert(&trobj, waiters[3].ret == ~0UL);
+	traceobj_assert(&trobj, waiters[4].ret == SUCCESS &&
+			waiters[4].seg != NULL);
+
+	ret = rn_delete(wait_rnid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+	tm_wkafter(1);
+
+	traceobj_assert(&trobj, waiters[3].ret == ERR_RNKILLD);
+
+	traceobj_exit(&trobj);
+}
+
+int main(int argc, char *const argv[])
+{
+	u_long args[] = { 1, 2, 3, 4 }, tid;
+	int ret;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	ret = t_create("MAIN", 20, 0, 0, 0, &tid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	ret = t_start(tid, 0, main_task, args);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	ret = t_create("CHRN", 20, 0, 0, 0, &tid);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	ret = t_start(tid, 0, churn_task, args);
+	traceobj_assert(&trobj, ret == SUCCESS);
+
+	traceobj_join(&trobj);
+
+	printf("%s: %lld ns per rn_getseg/rn_retseg call with mixed-size churn\n",
+	       argv[0], churn_ns / nr_ops);
+
+	exit(0);
+}
@@ -17,13 +17,23 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include <boilerplate/lock.h>
+#include <boilerplate/atomic.h>
 #include <copperplate/heapobj.h>
 #include <vxworks/errnoLib.h>
 #include "rngLib.h"
 
 #define ring_magic 0x5432affe
 
+/*
+ * readPos and writePos are free-running counters, only the consumer
+ * updates the former, only the producer the latter, so that a single
+ * reader and a single writer may run concurrently without locking.
+ * The storage size is the capacity rounded up to a power of two,
+ * which turns the position modulo into a mask.
+ */
+
 static struct wind_ring *find_ring_from_id(RING_ID rid)
 {
 	struct wind_ring *ring = mainheap_deref(rid, struct wind_ring);
@@ -39,6 +49,7 @@ RING_ID rngCreate(int nbytes)
 {
 	struct wind_ring *ring;
 	struct service svc;
+	unsigned int size;
 	void *ring_mem;
 	RING_ID rid;
 
@@ -47,9 +58,12 @@ RING_ID rngCreate(int nbytes)
 		return 0;
 	}
 
+	for (size = 1; size < (unsigned int)nbytes; size <<= 1)
+		;
+
 	CANCEL_DEFER(svc);
 
-	ring_mem = xnmalloc(sizeof(*ring) + nbytes + 1);
+	ring_mem = xnmalloc(sizeof(*ring) + size);
 	if (ring_mem == NULL) {
 		rid = 0;
 		errno = errnoSet(S_memLib_NOT_ENOUGH_MEMORY);
@@ -59,6 +73,7 @@ RING_ID rngCreate(int nbytes)
 	ring = ring_mem;
 	ring->magic = ring_magic;
 	ring->bufSize = nbytes;
+	ring->mask = size - 1;
 	ring->readPos = 0;
 	ring->writePos = 0;
 	rid = mainheap_ref(ring, RING_ID);
@@ -85,54 +100,77 @@ void rngFlush(RING_ID rid)
 {
 	struct wind_ring *ring = find_ring_from_id(rid);
 
-	if (ring) {
-		ring->readPos = 0;
-		ring->writePos = 0;
-	}
+	/* Consumer side: drop what was written so far. */
+	if (ring)
+		ACCESS_ONCE(ring->readPos) = ACCESS_ONCE(ring->writePos);
 }
 
 int rngBufGet(RING_ID rid, char *buffer, int maxbytes)
 {
 	struct wind_ring *ring = find_ring_from_id(rid);
-	unsigned int savedWritePos;
-	int j, bytesRead = 0;
+	unsigned int rpos, count, off, len;
 
 	if (ring == NULL)
 		return ERROR;
 
-	savedWritePos = ring->writePos;
+	rpos = ring->readPos;
+	count = ACCESS_ONCE(ring->writePos) - rpos;
+	if (count == 0 || maxbytes <= 0)
+		return 0;
 
-	for (j = 0; j < maxbytes; j++) {
-		if ((ring->readPos) % (ring->bufSize + 1) == savedWritePos)
-			break;
-		buffer[j] = ring->buffer[ring->readPos];
-		++bytesRead;
-		ring->readPos = (ring->readPos + 1) % (ring->bufSize + 1);
-	}
+	/* Acquire, the data was written before writePos. */
+	smp_rmb();
+
+	if (count > (unsigned int)maxbytes)
+		count = maxbytes;
+
+	off = rpos & ring->mask;
+	len = ring->mask + 1 - off;
+	if (len > count)
+		len = count;
+
+	memcpy(buffer, ring->buffer + off, len);
+	memcpy(buffer + len, ring->buffer, count - len);
 
-	return bytesRead;
+	/* Release, done reading before the space is handed back. */
+	smp_mb();
+	ACCESS_ONCE(ring->readPos) = rpos + count;
+
+	return count;
 }
 
 int rngBufPut(RING_ID rid, char *buffer, int nbytes)
 {
 	struct wind_ring *ring = find_ring_from_id(rid);
-	unsigned int savedReadPos;
-	int j, bytesWritten = 0;
+	unsigned int wpos, count, off, len;
 
 	if (ring == NULL)
 		return ERROR;
 
-	savedReadPos = ring->readPos;
+	wpos = ring->writePos;
+	count = ring->bufSize - (wpos - ACCESS_ONCE(ring->readPos));
+	if (count == 0 || nbytes <= 0)
+		return 0;
 
-	for (j = 0; j < nbytes; j++) {
-		if ((ring->writePos + 1) % (ring->bufSize + 1) == savedReadPos)
-			break;
-		ring->buffer[ring->writePos] = buffer[j];
-		++bytesWritten;
-		ring->writePos = (ring->writePos + 1) % (ring->bufSize + 1);
-	}
+	/* Acquire, the consumer is done with the space we reuse. */
+	smp_mb();
+
+	if (count > (unsigned int)nbytes)
+		count = nbytes;
+
+	off = wpos & ring->mask;
+	len = ring->mask + 1 - off;
+	if (len > count)
+		len = count;
 
-	return bytesWritten;
+	memcpy(ring->buffer + off, buffer, len);
+	memcpy(ring->buffer, buffer + len, count - len);
+
+	/* Release, data must be visible before writePos. */
+	smp_wmb();
+	ACCESS_ONCE(ring->writePos) = wpos + count;
+
+	return count;
 }
 
 BOOL rngIsEmpty(RING_ID rid)
@@ -162,29 +200,30 @@ int rngFreeBytes(RING_ID rid)
 	if (ring == NULL)
 		return ERROR;
 
-	return ((ring->bufSize -
-		 (ring->writePos - ring->readPos)) % (ring->bufSize + 1));
+	return ring->bufSize - rngNBytes(rid);
 }
 
 int rngNBytes(RING_ID rid)
 {
 	struct wind_ring *ring = find_ring_from_id(rid);
+	unsigned int rpos;
 
 	if (ring == NULL)
 		return ERROR;
 
-	return ring->bufSize - rngFreeBytes(rid);
+	/* readPos first, so that we never see it past writePos. */
+	rpos = ACCESS_ONCE(ring->readPos);
+	smp_rmb();
+
+	return ACCESS_ONCE(ring->writePos) - rpos;
 }
 
 void rngPutAhead(RING_ID rid, char byte, int offset)
 {
 	struct wind_ring *ring = find_ring_from_id(rid);
-	int where;
 
-	if (ring) {
-		where = (ring->writePos + offset) % (ring->bufSize + 1);
-		ring->buffer[where] = byte;
-	}
+	if (ring)
+		ring->buffer[(ring->writePos + offset) & ring->mask] = byte;
 }
 
 void rngMoveAhead(RING_ID rid, int n)
@@ -192,7 +231,8 @@ void rngMoveAhead(RING_ID rid, int n)
 	struct wind_ring *ring = find_ring_from_id(rid);
 
 	if (ring) {
-		ring->writePos += n;
-		ring->writePos %= (ring->bufSize + 1);
+		/* Publish bytes stored by rngPutAhead(). */
+		smp_wmb();
+		ACCESS_ONCE(ring->writePos) = ring->writePos + n;
 	}
 }
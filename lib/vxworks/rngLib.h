@@ -24,6 +24,7 @@
 struct wind_ring {
 	unsigned int magic;
 	unsigned int bufSize;
+	unsigned int mask;
 	unsigned int readPos;
 	unsigned int writePos;
 	unsigned char buffer[];
@@ -64,6 +64,9 @@ static STATUS xsem_take(struct wind_sem *sem, int timeout)
 	if (threadobj_irq_p())
 		return S_intLib_NOT_ISR_CALLABLE;
 
+	if (syncobj_fast_take(&sem->u.xsem.sobj, &sem->u.xsem.value) == 0)
+		return OK;
+
 	CANCEL_DEFER(svc);
 
 	if (syncobj_lock(&sem->u.xsem.sobj, &syns)) {
@@ -71,11 +74,11 @@ static STATUS xsem_take(struct wind_sem *sem, int timeout)
 		goto out;
 	}
 
-	if (--sem->u.xsem.value >= 0)
+	if (atomic_sub_fetch(&sem->u.xsem.value, 1) >= 0)
 		goto done;
 
 	if (timeout == NO_WAIT) {
-		sem->u.xsem.value++;
+		atomic_add_fetch(&sem->u.xsem.value, 1);
 		ret = S_objLib_OBJ_UNAVAILABLE;
 		goto done;
 	}
@@ -92,7 +95,7 @@ static STATUS xsem_take(struct wind_sem *sem, int timeout)
 		goto out;
 	}
 	if (ret) {
-		sem->u.xsem.value++;
+		atomic_add_fetch(&sem->u.xsem.value, 1);
 		if (ret == -ETIMEDOUT)
 			ret = S_objLib_OBJ_TIMEOUT;
 		else if (ret == -EINTR)
@@ -111,6 +114,11 @@ static STATUS xsem_give(struct wind_sem *sem)
 	struct syncstate syns;
 	struct service svc;
 	STATUS ret = OK;
+	int val, old;
+
+	if (syncobj_fast_give(&sem->u.xsem.sobj, &sem->u.xsem.value,
+			      sem->u.xsem.maxvalue) == 0)
+		return OK;
 
 	CANCEL_DEFER(svc);
 
@@ -119,12 +127,21 @@ static STATUS xsem_give(struct wind_sem *sem)
 		goto out;
 	}
 
-	if (sem->u.xsem.value >= sem->u.xsem.maxvalue) {
-		if (sem->u.xsem.maxvalue == INT_MAX)
-			/* No wrap around. */
-			ret = S_semLib_INVALID_OPERATION;
-	} else if (++sem->u.xsem.value <= 0)
-		syncobj_grant_one(&sem->u.xsem.sobj);
+	/* Takers may still consume units locklessly. */
+	for (val = atomic_read(&sem->u.xsem.value);; val = old) {
+		if (val >= sem->u.xsem.maxvalue) {
+			if (sem->u.xsem.maxvalue == INT_MAX)
+				/* No wrap around. */
+				ret = S_semLib_INVALID_OPERATION;
+			break;
+		}
+		old = atomic_cmpxchg(&sem->u.xsem.value, val, val + 1);
+		if (old == val) {
+			if (val < 0)
+				syncobj_grant_one(&sem->u.xsem.sobj);
+			break;
+		}
+	}
 
 	syncobj_unlock(&sem->u.xsem.sobj, &syns);
 out:
@@ -212,7 +229,7 @@ static SEM_ID alloc_xsem(int options, int initval, int maxval)
 	if (options & SEM_Q_PRIORITY)
 		sobj_flags = SYNCOBJ_PRIO;
 
-	sem->u.xsem.value = initval;
+	atomic_set(&sem->u.xsem.value, initval);
 	sem->u.xsem.maxvalue = maxval;
 	ret = syncobj_init(&sem->u.xsem.sobj, CLOCK_COPPERPLATE, sobj_flags,
 			   fnref_put(libvxworks, sem_finalize));
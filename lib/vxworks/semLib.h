@@ -41,7 +41,7 @@ struct wind_sem {
 	union {
 		struct {
 			struct syncobj sobj;
-			int value;
+			atomic_t value;
 			int maxvalue;
 		} xsem;
 		struct {
@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <copperplate/traceobj.h>
+#include <vxworks/errnoLib.h>
+#include <vxworks/taskLib.h>
+#include <vxworks/semLib.h>
+#include <vxworks/rngLib.h>
+
+static struct traceobj trobj;
+
+#define RING_SIZE	4096
+#define MAX_CHUNK	512
+#define TOTAL_BYTES	(16 * 1024 * 1024)
+
+/*
+ * Stream TOTAL_BYTES through a ring from a producer task to a
+ * consumer task, with varying chunk sizes, checking the data on the
+ * receiving side. The same stream goes through a copy of the former
+ * byte-wise rngLib implementation, for comparing throughputs.
+ */
+
+static struct {
+	unsigned int bufSize;
+	unsigned int readPos;
+	unsigned int writePos;
+	char buffer[RING_SIZE + 1];
+} byte_ring = {
+	.bufSize = RING_SIZE,
+};
+
+static int byte_put(char *buffer, int nbytes)
+{
+	unsigned int savedReadPos = byte_ring.readPos;
+	int j, bytesWritten = 0;
+
+	for (j = 0; j < nbytes; j++) {
+		if ((byte_ring.writePos + 1) % (byte_ring.bufSize + 1) == savedReadPos)
+			break;
+		byte_ring.buffer[byte_ring.writePos] = buffer[j];
+		++bytesWritten;
+		byte_ring.writePos = (byte_ring.writePos + 1) % (byte_ring.bufSize + 1);
+	}
+
+	return bytesWritten;
+}
+
+static int byte_get(char *buffer, int maxbytes)
+{
+	unsigned int savedWritePos = byte_ring.writePos;
+	int j, bytesRead = 0;
+
+	for (j = 0; j < maxbytes; j++) {
+		if ((byte_ring.readPos) % (byte_ring.bufSize + 1) == savedWritePos)
+			break;
+		buffer[j] = byte_ring.buffer[byte_ring.readPos];
+		++bytesRead;
+		byte_ring.readPos = (byte_ring.readPos + 1) % (byte_ring.bufSize + 1);
+	}
+
+	return bytesRead;
+}
+
+static RING_ID rng;
+
+static int rng_put(char *buffer, int nbytes)
+{
+	return rngBufPut(rng, buffer, nbytes);
+}
+
+static int rng_get(char *buffer, int maxbytes)
+{
+	return rngBufGet(rng, buffer, maxbytes);
+}
+
+static int (*put)(char *buffer, int nbytes);
+
+static int (*get)(char *buffer, int maxbytes);
+
+static SEM_ID done;
+
+static int check_data;
+
+static inline char pattern(unsigned int pos)
+{
+	return (char)(pos ^ (pos >> 8) ^ (pos >> 16));
+}
+
+static void producerTask(long arg, ...)
+{
+	unsigned int pos = 0, chunk = 1, n;
+	char buffer[MAX_CHUNK];
+	int ret;
+
+	traceobj_enter(&trobj);
+
+	while (pos < TOTAL_BYTES) {
+		if (chunk > TOTAL_BYTES - pos)
+			chunk = TOTAL_BYTES - pos;
+		for (n = 0; n < chunk; n++)
+			buffer[n] = pattern(pos + n);
+		for (n = 0; n < chunk; n += ret) {
+			ret = put(buffer + n, chunk - n);
+			traceobj_assert(&trobj, ret >= 0);
+			if (ret == 0)
+				taskDelay(0);
+		}
+		pos += chunk;
+		chunk = chunk * 7 % MAX_CHUNK + 1;
+	}
+
+	semGive(done);
+
+	traceobj_exit(&trobj);
+}
+
+static void consumerTask(long arg, ...)
+{
+	unsigned int pos = 0, chunk = 3, n;
+	char buffer[MAX_CHUNK];
+	int ret;
+
+	traceobj_enter(&trobj);
+
+	while (pos < TOTAL_BYTES) {
+		ret = get(buffer, chunk);
+		traceobj_assert(&trobj, ret >= 0 && ret <= (int)chunk);
+		if (ret == 0) {
+			taskDelay(0);
+			continue;
+		}
+		if (check_data) {
+			for (n = 0; n < ret; n++)
+				traceobj_assert(&trobj,
+						buffer[n] == pattern(pos + n));
+		}
+		pos += ret;
+		chunk = chunk * 5 % MAX_CHUNK + 1;
+	}
+
+	semGive(done);
+
+	traceobj_exit(&trobj);
+}
+
+static long long run_stream(void)
+{
+	struct timespec start, end;
+	TASK_ID ptid, ctid;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	ctid = taskSpawn("consumer", 50, 0, 0, consumerTask,
+			 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	traceobj_assert(&trobj, ctid != ERROR);
+
+	ptid = taskSpawn("producer", 50, 0, 0, producerTask,
+			 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	traceobj_assert(&trobj, ptid != ERROR);
+
+	ret = semTake(done, WAIT_FOREVER);
+	traceobj_assert(&trobj, ret == OK);
+	ret = semTake(done, WAIT_FOREVER);
+	traceobj_assert(&trobj, ret == OK);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start.tv_sec) * 1000000000LL +
+		end.tv_nsec - start.tv_nsec;
+}
+
+static long long byte_ns, rng_ns;
+
+static void rootTask(long arg, ...)
+{
+	traceobj_enter(&trobj);
+
+	done = semCCreate(SEM_Q_FIFO, 0);
+	traceobj_assert(&trobj, done != 0);
+
+	rng = rngCreate(RING_SIZE);
+	traceobj_assert(&trobj, rng != 0);
+
+	put = byte_put;
+	get = byte_get;
+	check_data = 0;
+	byte_ns = run_stream();
+
+	put = rng_put;
+	get = rng_get;
+	check_data = 1;
+	rng_ns = run_stream();
+
+	traceobj_assert(&trobj, rngIsEmpty(rng));
+	traceobj_assert(&trobj, rngFreeBytes(rng) == RING_SIZE);
+
+	rngDelete(rng);
+	semDelete(done);
+
+	traceobj_exit(&trobj);
+}
+
+int main(int argc, char *const argv[])
+{
+	TASK_ID tid;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	tid = taskSpawn("rootTask", 50, 0, 0, rootTask,
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	traceobj_assert(&trobj, tid != ERROR);
+
+	traceobj_join(&trobj);
+
+	printf("%s: %d MB through a %d byte ring, %lld MB/s byte-wise, "
+	       "%lld MB/s with rngLib\n", argv[0], TOTAL_BYTES >> 20,
+	       RING_SIZE, (long long)TOTAL_BYTES * 1000 / byte_ns,
+	       (long long)TOTAL_BYTES * 1000 / rng_ns);
+
+	exit(0);
+}
@@ -0,0 +1,249 @@
+/*
+ * Check the waveforms produced by the gpiopwm sequencer, using the
+ * recording backend of the driver (CONFIG_XENO_DRIVERS_GPIOPWM_RECORD).
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <sys/ioctl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <smokey/smokey.h>
+#include <rtdm/gpiopwm.h>
+
+smokey_test_plugin(pwm_sequencer,
+		   SMOKEY_NOARGS,
+   "Check phase alignment and glitch-free updates of the PWM sequencer."
+);
+
+#define PERIOD		1000000ULL
+#define NR_RECORDS	1024
+
+#define MAX_CHANNELS	8
+
+struct pwm_channel {
+	unsigned long long duty;
+	unsigned long long new_duty;
+	unsigned long long phase;
+};
+
+/*
+ * Channels with a new duty time change it while running: #2 stops
+ * wrapping around the period end, #3 starts doing so.
+ */
+static const struct pwm_channel mixed[] = {
+	{ .duty = 250000, .new_duty = 600000, .phase = 0 },
+	{ .duty = 500000, .phase = 250000 },
+	{ .duty = 300000, .new_duty = 150000, .phase = 800000 },
+	{ .duty = 200000, .new_duty = 450000, .phase = 700000 },
+};
+
+/*
+ * The whole group stops wrapping at once, the first period of the
+ * new table then ends every former pulse besides the new ones.
+ */
+static const struct pwm_channel unwrapping[] = {
+	{ .duty = 500000, .new_duty = 40000, .phase = 600000 },
+	{ .duty = 500000, .new_duty = 40000, .phase = 650000 },
+	{ .duty = 500000, .new_duty = 40000, .phase = 700000 },
+	{ .duty = 500000, .new_duty = 40000, .phase = 750000 },
+	{ .duty = 500000, .new_duty = 40000, .phase = 800000 },
+	{ .duty = 500000, .new_duty = 40000, .phase = 850000 },
+	{ .duty = 500000, .new_duty = 40000, .phase = 900000 },
+	{ .duty = 500000, .new_duty = 40000, .phase = 950000 },
+};
+
+static struct gpiopwm_edge_record records[MAX_CHANNELS][NR_RECORDS];
+
+static void sleep_ms(int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = ms * 1000000L;
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+}
+
+/*
+ * Collapse the records to transitions, the sequencer may assert the
+ * current level again when switching edge tables. Returns the count
+ * of transitions, with the first one rising.
+ */
+static int read_transitions(int fd, struct gpiopwm_edge_record *rec)
+{
+	int n, nr, level = 0;
+	ssize_t ret;
+
+	ret = read(fd, rec, sizeof(records[0]));
+	if (ret < 0) {
+		ret = -errno;
+		smokey_warning("read(): %s", symerror(ret));
+		return ret;
+	}
+
+	for (n = 0, nr = 0; n < ret / sizeof(*rec); n++) {
+		if (rec[n].value == level)
+			continue;
+		level = rec[n].value;
+		rec[nr++] = rec[n];
+	}
+
+	return nr;
+}
+
+static int check_channel(struct gpiopwm_edge_record *rec, int nr,
+			 const struct pwm_channel *channels, int chan,
+			 unsigned long long t0)
+{
+	unsigned long long rise, width, duty = channels[chan].duty,
+		new_duty = channels[chan].new_duty;
+	int n, old = 0, new = 0;
+
+	/* Output must be left low, we need a few pulses. */
+	if (!smokey_assert((nr & 1) == 0 && nr >= 8))
+		return -EINVAL;
+
+	/*
+	 * Starting, stopping or updating a channel must neither cut
+	 * a pulse nor emit one out of phase, including those
+	 * wrapping around the period end.
+	 */
+	for (n = 0; n < nr; n += 2) {
+		rise = rec[n].timestamp;
+		width = rec[n + 1].timestamp - rise;
+		if (!smokey_assert(rec[n].value == 1 &&
+				   (rise - t0) % PERIOD == channels[chan].phase))
+			return -EINVAL;
+		if (width == duty) {
+			/* No way back to the former duty time. */
+			if (!smokey_assert(new == 0))
+				return -EINVAL;
+			old++;
+		} else if (smokey_assert(new_duty && width == new_duty))
+			new++;
+		else
+			return -EINVAL;
+	}
+
+	if (new_duty && !smokey_assert(old > 0 && new > 0))
+		return -EINVAL;
+
+	smokey_trace("channel #%d: %d pulses", chan, nr / 2);
+
+	return 0;
+}
+
+static int run_channels(const struct pwm_channel *channels, int nr_channels)
+{
+	int fds[MAX_CHANNELS], nr[MAX_CHANNELS], n, nr_open, ret = 0;
+	unsigned long long duty, t0;
+	struct sched_param param;
+	struct gpiopwm_seq seq;
+	char device[32];
+
+	for (nr_open = 0; nr_open < nr_channels; nr_open++) {
+		snprintf(device, sizeof(device), "/dev/rtdm/gpiopwm%d", nr_open);
+		fds[nr_open] = open(device, O_RDWR);
+		if (fds[nr_open] < 0) {
+			ret = -errno;
+			smokey_note("cannot open %s [%s]", device, symerror(ret));
+			ret = -ENOSYS;
+			goto out;
+		}
+		/* Never drive real GPIOs from here. */
+		if (read(fds[nr_open], records[0], 0) < 0) {
+			smokey_note("gpiopwm recording backend not enabled");
+			nr_open++;
+			ret = -ENOSYS;
+			goto out;
+		}
+	}
+
+	for (n = 0; n < nr_channels; n++) {
+		seq.period = PERIOD;
+		seq.duty = channels[n].duty;
+		seq.phase = channels[n].phase;
+		seq.gpio = n;
+		seq.group = 0;
+		if (!__Terrno(ret, ioctl(fds[n], GPIOPWM_RTIOC_SET_SEQ, &seq)))
+			goto out;
+	}
+
+	param.sched_priority = 10;
+	if (!__T(ret, pthread_setschedparam(pthread_self(),
+					    SCHED_FIFO, &param)))
+		goto out;
+
+	for (n = 0; n < nr_channels; n++) {
+		if (!__Terrno(ret, ioctl(fds[n], GPIOPWM_RTIOC_START)))
+			goto relax;
+	}
+
+	sleep_ms(10);
+
+	/* Back to back, so that all changes land in the same period. */
+	for (n = 0; n < nr_channels; n++) {
+		duty = channels[n].new_duty;
+		if (duty == 0)
+			continue;
+		if (!__Terrno(ret, ioctl(fds[n], GPIOPWM_RTIOC_CHANGE_DUTY_NS,
+					 &duty)))
+			goto relax;
+	}
+
+	sleep_ms(10);
+
+	for (n = 0; n < nr_channels; n++) {
+		if (!__Terrno(ret, ioctl(fds[n], GPIOPWM_RTIOC_STOP)))
+			goto relax;
+	}
+
+	/* Let the pulses wrapping past the last boundary end. */
+	sleep_ms(3);
+
+	for (n = 0; n < nr_channels; n++) {
+		nr[n] = read_transitions(fds[n], records[n]);
+		if (nr[n] < 0) {
+			ret = nr[n];
+			goto relax;
+		}
+	}
+
+	if (!smokey_assert(nr[0] > 0)) {
+		ret = -EINVAL;
+		goto relax;
+	}
+
+	/* The first rise of channel #0 tells where periods begin. */
+	t0 = records[0][0].timestamp - channels[0].phase;
+	for (n = 0; n < nr_channels; n++) {
+		ret = check_channel(records[n], nr[n], channels, n, t0);
+		if (ret)
+			break;
+	}
+relax:
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+out:
+	while (--nr_open >= 0)
+		close(fds[nr_open]);
+
+	return ret;
+}
+
+static int run_pwm_sequencer(struct smokey_test *t, int argc, char *const argv[])
+{
+	int ret;
+
+	ret = run_channels(mixed, sizeof(mixed) / sizeof(mixed[0]));
+	if (ret)
+		return ret;
+
+	return run_channels(unwrapping,
+			    sizeof(unwrapping) / sizeof(unwrapping[0]));
+}
@@ -0,0 +1,354 @@
+/*
+ * Check the block kernels of the analogy library against the scalar
+ * code they replace, and measure their throughput.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <smokey/smokey.h>
+#include <rtdm/analogy.h>
+
+smokey_test_plugin(analogy_math,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(samples),
+			   SMOKEY_INT(loops),
+		   ),
+		   "Check the vectorized analogy kernels against their scalar\n"
+		   "\tcounterparts, and report their throughput.\n"
+		   "\tsamples=<N>, size of the sample blocks (8192)\n"
+		   "\tloops=<N>, number of blocks processed for timing (1000)"
+);
+
+#define PI 3.14159265358979323846
+
+static int nr_samples = 8192, nr_loops = 1000;
+
+static const double ratios[] = {
+	0.5, 0.25, 1.0 / 3, 0.1, 0.0123, 7e-5,
+};
+
+#define NR_RATIOS	(sizeof(ratios) / sizeof(ratios[0]))
+
+/*
+ * Reference implementations, as found in the waveform generator and
+ * the conversion routines before they were vectorized. Ranks are
+ * widened so that the whole unsigned range can be checked.
+ */
+static void ref_sine(double *dst, unsigned int first, int nr,
+		     double ratio, double amplitude, double offset)
+{
+	long long i;
+	int n;
+
+	for (n = 0, i = first; n < nr; n++, i++)
+		dst[n] = offset - amplitude / 2 +
+			0.5 * amplitude * cos(i * 2 * PI * ratio);
+}
+
+static void ref_square(double *dst, unsigned int first, int nr,
+		       double ratio, double amplitude, double offset)
+{
+	long long i, half_period_idx;
+	int n, even;
+
+	for (n = 0, i = first; n < nr; n++, i++) {
+		half_period_idx = (long long)floor(i * 2 * ratio);
+		even = (half_period_idx % 2 == 0);
+		dst[n] = offset - amplitude / 2 + even * amplitude;
+	}
+}
+
+static void ref_triangle(double *dst, unsigned int first, int nr,
+			 double ratio, double amplitude, double offset)
+{
+	long long i, period_idx, half_period_idx;
+	int n;
+
+	for (n = 0, i = first; n < nr; n++, i++) {
+		period_idx = (long long)floor(i * ratio);
+		half_period_idx = (long long)floor(i * 2 * ratio);
+		if (half_period_idx % 2 == 0)
+			dst[n] = offset - amplitude / 2 -
+				2 * period_idx * amplitude +
+				2 * i * ratio * amplitude;
+		else
+			dst[n] = offset - amplitude / 2 +
+				2 * (period_idx + 1) * amplitude -
+				2 * i * ratio * amplitude;
+	}
+}
+
+static void ref_sawtooth(double *dst, unsigned int first, int nr,
+			 double ratio, double amplitude, double offset)
+{
+	long long i, period_idx;
+	int n;
+
+	for (n = 0, i = first; n < nr; n++, i++) {
+		period_idx = (long long)floor(i * ratio);
+		dst[n] = offset - amplitude / 2 -
+			period_idx * amplitude +
+			i * ratio * amplitude;
+	}
+}
+
+static void ref_rawtod(double *dst, const void *src, int size, int nr,
+		       double a, double b)
+{
+	int n;
+
+	for (n = 0; n < nr; n++)
+		dst[n] = a * (size == 2 ?
+			      ((const uint16_t *)src)[n] :
+			      ((const uint32_t *)src)[n]) + b;
+}
+
+typedef void (*wf_gen_t)(double *dst, unsigned int first, unsigned int nr,
+			 double ratio, double amplitude, double offset);
+
+typedef void (*wf_ref_t)(double *dst, unsigned int first, int nr,
+			 double ratio, double amplitude, double offset);
+
+static const struct waveform {
+	const char *name;
+	wf_gen_t gen;
+	wf_ref_t ref;
+	int exact;
+} waveforms[] = {
+	{ "sine", a4l_math_sine, ref_sine, 0 },
+	{ "square", a4l_math_square, ref_square, 1 },
+	{ "triangle", a4l_math_triangle, ref_triangle, 1 },
+	{ "sawtooth", a4l_math_sawtooth, ref_sawtooth, 1 },
+};
+
+#define NR_WAVEFORMS	(sizeof(waveforms) / sizeof(waveforms[0]))
+
+static double *ref, *out, *out2;
+
+static int check_waveform(const struct waveform *wf, unsigned int first,
+			  double ratio, double amplitude, double offset)
+{
+	double tol = 4 * DBL_EPSILON * (fabs(offset) + fabs(amplitude)), phase;
+	int n, chunk;
+
+	wf->ref(ref, first, nr_samples - 1, ratio, amplitude, offset);
+	wf->gen(out, first, nr_samples - 1, ratio, amplitude, offset);
+
+	for (n = 0; n < nr_samples - 1; n++) {
+		if (wf->exact ? out[n] == ref[n] :
+		    fabs(out[n] - ref[n]) <= tol)
+			continue;
+		/* The sine loses accuracy past 10^6 radians. */
+		phase = ((double)first + n) * 2 * PI * ratio;
+		if (!wf->exact && phase > 1e6 && fabs(out[n] - ref[n]) <=
+		    tol + 4 * DBL_EPSILON * fabs(amplitude) * phase)
+			continue;
+		smokey_warning("%s, ratio %g: sample %u is %.17g, expected %.17g",
+			       wf->name, ratio, first + n, out[n], ref[n]);
+		return -EINVAL;
+	}
+
+	/* Regenerating by odd-sized blocks must not change a bit. */
+	for (n = 0; n < nr_samples - 1; n += chunk) {
+		chunk = nr_samples - 1 - n;
+		if (chunk > 7)
+			chunk = 7;
+		wf->gen(out2 + n, first + n, chunk, ratio, amplitude, offset);
+	}
+
+	if (!smokey_assert(memcmp(out, out2, (nr_samples - 1) *
+				  sizeof(double)) == 0))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int check_rawtod(int nb_bits)
+{
+	a4l_rnginfo_t rng = {
+		.min = -10 * A4L_RNG_FACTOR,
+		.max = 10 * A4L_RNG_FACTOR,
+	};
+	a4l_chinfo_t chan = {
+		.nb_bits = nb_bits,
+	};
+	int n, size, ret;
+	double a, b;
+	void *raw;
+
+	size = a4l_sizeof_chan(&chan);
+	raw = malloc(nr_samples * size);
+	if (raw == NULL)
+		return -ENOMEM;
+
+	for (n = 0; n < nr_samples; n++) {
+		if (size == 2)
+			((uint16_t *)raw)[n] = random() & 0xffff;
+		else
+			((uint32_t *)raw)[n] = random() ^ (random() << 1);
+	}
+
+	a = ((double)(rng.max - rng.min)) /
+		(((1ULL << chan.nb_bits) - 1) * A4L_RNG_FACTOR);
+	b = ((double)rng.min) / A4L_RNG_FACTOR;
+	ref_rawtod(ref, raw, size, nr_samples - 1, a, b);
+	ret = a4l_rawtod(&chan, &rng, out, raw, nr_samples - 1);
+	if (!smokey_assert(ret == nr_samples - 1)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = 0;
+	if (!smokey_assert(memcmp(out, ref, (nr_samples - 1) *
+				  sizeof(double)) == 0))
+		ret = -EINVAL;
+out:
+	free(raw);
+
+	return ret;
+}
+
+static int check_statistics(void)
+{
+	double mean, stddev, sum, sum_sq, x;
+	int n;
+
+	for (n = 0; n < nr_samples; n++)
+		ref[n] = 1000 * sin(n) + n;
+
+	/* The summation order differs, not the accuracy. */
+	for (n = 0, sum = 0; n < nr_samples; n++)
+		sum += ref[n];
+
+	a4l_math_mean(&mean, ref, nr_samples);
+	if (!smokey_assert(fabs(mean - sum / nr_samples) <=
+			   1e-12 * fabs(mean)))
+		return -EINVAL;
+
+	for (n = 0, sum = 0, sum_sq = 0; n < nr_samples; n++) {
+		x = ref[n] - mean;
+		sum_sq += x * x;
+		sum += x;
+	}
+	x = sqrt((sum_sq - (sum * sum) / nr_samples) / (nr_samples - 1));
+
+	a4l_math_stddev(&stddev, mean, ref, nr_samples);
+	if (!smokey_assert(fabs(stddev - x) <= 1e-12 * x))
+		return -EINVAL;
+
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void measure(const struct waveform *wf)
+{
+	double t0, t_ref, t_gen;
+	int n;
+
+	t0 = now();
+	for (n = 0; n < nr_loops; n++)
+		wf->ref(ref, n * nr_samples, nr_samples, 0.0123, 2.0, 0.0);
+	t_ref = now() - t0;
+
+	t0 = now();
+	for (n = 0; n < nr_loops; n++)
+		wf->gen(out, n * nr_samples, nr_samples, 0.0123, 2.0, 0.0);
+	t_gen = now() - t0;
+
+	smokey_trace("%-8s scalar %7.1f MS/s, vector %7.1f MS/s",
+		     wf->name,
+		     (double)nr_loops * nr_samples / t_ref / 1e6,
+		     (double)nr_loops * nr_samples / t_gen / 1e6);
+}
+
+static int run_analogy_math(struct smokey_test *t, int argc, char *const argv[])
+{
+	unsigned int n, r, f, firsts[3];
+	int ret = 0;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(*t, samples))
+		nr_samples = SMOKEY_ARG_INT(*t, samples);
+
+	if (SMOKEY_ARG_ISSET(*t, loops))
+		nr_loops = SMOKEY_ARG_INT(*t, loops);
+
+	if (nr_samples < 2 || nr_loops < 1) {
+		smokey_warning("samples must be greater than 1, loops positive");
+		return -EINVAL;
+	}
+
+	ref = malloc(nr_samples * sizeof(double));
+	out = malloc(nr_samples * sizeof(double));
+	out2 = malloc(nr_samples * sizeof(double));
+	if (ref == NULL || out == NULL || out2 == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/*
+	 * Start past zero and use an odd count, so that both the index
+	 * computation and the partial trailing block are exercised.
+	 * Then cross 2^31 and end on the last rank.
+	 */
+	firsts[0] = 3;
+	firsts[1] = 0x80000000U - nr_samples / 2;
+	firsts[2] = UINT_MAX - (nr_samples - 2);
+
+	for (n = 0; n < NR_WAVEFORMS; n++) {
+		for (r = 0; r < NR_RATIOS; r++) {
+			for (f = 0; f < 3; f++) {
+				ret = check_waveform(waveforms + n, firsts[f],
+						     ratios[r], 2.5, 0.3);
+				if (ret)
+					goto out;
+				ret = check_waveform(waveforms + n, firsts[f],
+						     ratios[r], -1.0, 0.0);
+				if (ret)
+					goto out;
+			}
+		}
+	}
+
+	ret = check_rawtod(16);
+	if (ret)
+		goto out;
+
+	ret = check_rawtod(12);
+	if (ret)
+		goto out;
+
+	ret = check_rawtod(32);
+	if (ret)
+		goto out;
+
+	ret = check_statistics();
+	if (ret)
+		goto out;
+
+	for (n = 0; n < NR_WAVEFORMS; n++)
+		measure(waveforms + n);
+out:
+	free(out2);
+	free(out);
+	free(ref);
+
+	return ret;
+}
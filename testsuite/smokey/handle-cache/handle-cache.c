@@ -0,0 +1,181 @@
+/*
+ * Measure the cost of syscalls resolving a synchronization object
+ * from its handle, and check that recycled handles are resolved to
+ * the right objects.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <boilerplate/atomic.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(handle_cache,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Check handle resolution in syscalls on recycled objects,\n"
+		   "\tand report the cost of sem_post() waking up a waiter.\n"
+		   "\tloops=<N>, number of rounds per measurement (1000)"
+);
+
+#define NR_SEMS		32
+
+static int nr_loops = 1000;
+
+static sem_t sems[NR_SEMS];
+
+static int wakeups[NR_SEMS];
+
+static int stop;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *waiter_body(void *arg)
+{
+	int n = (long)arg;
+
+	for (;;) {
+		if (sem_wait(&sems[n]))
+			break;
+		if (stop)
+			break;
+		wakeups[n]++;
+	}
+
+	return NULL;
+}
+
+/*
+ * Each round posts every semaphore once, which wakes up a waiter
+ * of lower priority. Posting to a semaphore with waiters always
+ * enters the kernel, but does not switch context.
+ */
+static int measure_post(long long *avg_r)
+{
+	struct timespec delay = { .tv_sec = 0, .tv_nsec = 100000 };
+	long long start, total = 0;
+	struct sched_param param;
+	pthread_t tids[NR_SEMS];
+	pthread_attr_t attr;
+	int n, loop, ret;
+
+	stop = 0;
+	for (n = 0; n < NR_SEMS; n++) {
+		wakeups[n] = 0;
+		ret = smokey_check_errno(sem_init(&sems[n], 0, 0));
+		if (ret)
+			return ret;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = 1;
+	pthread_attr_setschedparam(&attr, &param);
+
+	for (n = 0; n < NR_SEMS; n++) {
+		ret = smokey_check_status(pthread_create(tids + n, &attr,
+							 waiter_body,
+							 (void *)(long)n));
+		if (ret)
+			break;
+	}
+
+	pthread_attr_destroy(&attr);
+
+	if (ret)
+		goto out;
+
+	for (loop = 0; loop < nr_loops; loop++) {
+		/* Let the waiters block again. */
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, NULL);
+		start = now_ns();
+		for (n = 0; n < NR_SEMS; n++) {
+			ret = smokey_check_errno(sem_post(&sems[n]));
+			if (ret)
+				goto out;
+		}
+		total += now_ns() - start;
+	}
+
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, NULL);
+
+	/* Every post must have reached the waiter of its semaphore. */
+	for (n = 0; n < NR_SEMS; n++) {
+		if (!smokey_assert(wakeups[n] == nr_loops)) {
+			smokey_warning("waiter #%d woke up %d times",
+				       n, wakeups[n]);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	*avg_r = total / (nr_loops * NR_SEMS);
+out:
+	stop = 1;
+	smp_mb();
+	while (--n >= 0) {
+		sem_post(&sems[n]);
+		pthread_join(tids[n], NULL);
+	}
+
+	for (n = 0; n < NR_SEMS; n++)
+		sem_destroy(&sems[n]);
+
+	return ret;
+}
+
+static int run_handle_cache(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct sched_param param;
+	long long first, second;
+	int ret;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(*t, loops))
+		nr_loops = SMOKEY_ARG_INT(*t, loops);
+
+	if (nr_loops < 1) {
+		smokey_warning("loops must be positive");
+		return -EINVAL;
+	}
+
+	param.sched_priority = 2;
+	ret = smokey_check_status(pthread_setschedparam(pthread_self(),
+							SCHED_FIFO, &param));
+	if (ret)
+		return ret;
+
+	/*
+	 * The second round runs with semaphores which likely reuse
+	 * the handles of the ones destroyed by the first round.
+	 */
+	ret = measure_post(&first);
+	if (ret == 0)
+		ret = measure_post(&second);
+
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+	if (ret)
+		return ret;
+
+	smokey_trace("sem_post with waiter: %lld ns, %lld ns with recycled handles",
+		     first, second);
+
+	return 0;
+}
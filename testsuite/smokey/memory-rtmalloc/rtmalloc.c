@@ -0,0 +1,21 @@
+/*
+ * Check the real-time malloc layer.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <smokey/smokey.h>
+
+smokey_test_plugin(memory_rtmalloc,
+		   SMOKEY_NOARGS,
+		   "Check the real-time malloc layer (librtmalloc)."
+);
+
+static int run_memory_rtmalloc(struct smokey_test *t,
+			       int argc, char *const argv[])
+{
+	/*
+	 * librtmalloc replaces the malloc() family of the whole
+	 * process, so the checks run from a separate program.
+	 */
+	return smokey_fork_exec(XENO_TEST_DIR "/rtmalloctest", "rtmalloctest");
+}
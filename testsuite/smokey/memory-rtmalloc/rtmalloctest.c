@@ -0,0 +1,251 @@
+/*
+ * Exercise librtmalloc, which this program is linked against ahead of
+ * libc. Exits with a non-zero status on failure.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <cobalt/sys/cobalt.h>
+#include <cobalt/rtmalloc.h>
+
+#define NR_BLOCKS	64
+/* More than drained at once, too large for caching. */
+#define NR_XFER		24
+#define XFER_SIZE	4096
+
+#define check(__expr)							\
+	do {								\
+		if (!(__expr)) {					\
+			fprintf(stderr, "FAILED %s:%d: %s\n",		\
+				__FILE__, __LINE__, #__expr);		\
+			return -EINVAL;					\
+		}							\
+	} while (0)
+
+static void *blocks[NR_BLOCKS];
+
+static void *xfer[NR_XFER];
+
+static const size_t sizes[] = {
+	0, 1, 15, 16, 17, 100, 200, 496, 497, 1000, 5000,
+};
+
+#define NR_SIZES  (sizeof(sizes) / sizeof(sizes[0]))
+
+static int check_pattern(const unsigned char *p, size_t len, int c)
+{
+	size_t n;
+
+	for (n = 0; n < len; n++) {
+		if (p[n] != (unsigned char)c)
+			return 0;
+	}
+
+	return 1;
+}
+
+static int get_msw(unsigned long long *msw)
+{
+	struct cobalt_threadstat stat;
+	int ret;
+
+	ret = cobalt_thread_stat(0, &stat);
+	if (ret)
+		return ret;
+
+	*msw = stat.msw;
+
+	return 0;
+}
+
+/*
+ * All of the malloc() family must run in primary mode, including
+ * aligned allocations and reallocations.
+ */
+static int check_primary(void)
+{
+	struct rtmalloc_stats s0, s1;
+	unsigned long long msw0, msw1;
+	size_t in_use = 0, size;
+	void *p, *q;
+	int n, loop;
+
+	/* Set up our context, then make sure to run in primary mode. */
+	free(malloc(1));
+	check(rtmalloc_get_stats(&s0) == 0);
+	cobalt_thread_harden();
+	check(get_msw(&msw0) == 0);
+
+	for (loop = 0; loop < 16; loop++) {
+		for (n = 0; n < NR_BLOCKS; n++) {
+			size = sizes[n % NR_SIZES];
+			blocks[n] = malloc(size);
+			check(blocks[n] != NULL);
+			check(((uintptr_t)blocks[n] & 15) == 0);
+			check(malloc_usable_size(blocks[n]) >= size);
+			memset(blocks[n], n, size);
+			in_use += size;
+		}
+		for (n = 0; n < NR_BLOCKS; n++)
+			check(check_pattern(blocks[n], sizes[n % NR_SIZES], n));
+		for (n = 0; n < NR_BLOCKS; n++)
+			free(blocks[n]);
+
+		/* Aligned blocks must never show up in the caches. */
+		p = memalign(64, 40);
+		check(p && ((uintptr_t)p & 63) == 0);
+		memset(p, 0xaa, 40);
+		check(posix_memalign(&q, 4096, 300) == 0);
+		check(((uintptr_t)q & 4095) == 0);
+		memset(q, 0x55, 300);
+		free(p);
+		free(q);
+		p = aligned_alloc(32, 16);
+		check(p && ((uintptr_t)p & 31) == 0);
+		free(p);
+		check(posix_memalign(&q, 3, 16) == EINVAL);
+
+		p = calloc(10, 30);
+		check(p && check_pattern(p, 300, 0));
+		memset(p, 0x11, 300);
+		/* Growing moves the contents, shrinking keeps the block. */
+		q = realloc(p, 3000);
+		check(q && check_pattern(q, 300, 0x11));
+		p = realloc(q, 20);
+		check(p == q);
+		check(realloc(p, 0) == NULL);
+	}
+
+	check(get_msw(&msw1) == 0);
+	check(msw1 == msw0);
+
+	check(rtmalloc_get_stats(&s1) == 0);
+	check(s1.nr_allocs - s0.nr_allocs == 16 * (NR_BLOCKS + 5));
+	check(s1.nr_frees - s0.nr_frees == 16 * (NR_BLOCKS + 5));
+	check(s1.nr_failures == 0);
+	check(s1.in_use == s0.in_use);
+	check(s1.peak >= in_use / 16);
+
+	return 0;
+}
+
+static void *primary_body(void *arg)
+{
+	int n;
+
+	if (check_primary())
+		return (void *)-1L;
+
+	/* Handed over to other threads for releasing. */
+	for (n = 0; n < NR_XFER; n++) {
+		xfer[n] = malloc(XFER_SIZE);
+		if (xfer[n] == NULL)
+			return (void *)-1L;
+	}
+
+	return NULL;
+}
+
+static void *linux_body(void *arg)
+{
+	int n;
+
+	for (n = 0; n < NR_XFER; n++)
+		free(xfer[n]);
+
+	return NULL;
+}
+
+static void *drain_body(void *arg)
+{
+	free(malloc(XFER_SIZE));
+
+	return NULL;
+}
+
+struct find_stats {
+	pthread_t thread;
+	struct rtmalloc_stats stats;
+	int found;
+};
+
+static int match_thread(const struct rtmalloc_stats *stats, void *arg)
+{
+	struct find_stats *f = arg;
+
+	if (!pthread_equal(stats->thread, f->thread))
+		return 0;
+
+	f->stats = *stats;
+	f->found = 1;
+
+	return 1;
+}
+
+static int run_thread(pthread_t *tid, void *(*body)(void *))
+{
+	struct sched_param param;
+	pthread_attr_t attr;
+	void *status;
+	int ret;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = 10;
+	pthread_attr_setschedparam(&attr, &param);
+	ret = __RT(pthread_create(tid, &attr, body, NULL));
+	pthread_attr_destroy(&attr);
+	if (ret)
+		return -ret;
+
+	ret = __RT(pthread_join(*tid, &status));
+	if (ret)
+		return -ret;
+
+	return status ? -EINVAL : 0;
+}
+
+int main(int argc, char *const argv[])
+{
+	struct rtmalloc_arena_stats as0, as1;
+	struct find_stats f;
+	pthread_t tid;
+	int ret;
+
+	check(run_thread(&f.thread, primary_body) == 0);
+
+	f.found = 0;
+	check(rtmalloc_walk_stats(match_thread, &f) == 1 && f.found);
+	check(!f.stats.alive);
+	check(f.stats.in_use == (size_t)NR_XFER * XFER_SIZE);
+
+	/*
+	 * Blocks released by a plain Linux thread are accounted to
+	 * their owner at once, but only go back to the arena when a
+	 * Cobalt thread allocates next. Thread creation may allocate
+	 * a few bytes meanwhile, much less than a transferred block.
+	 */
+	check(rtmalloc_get_arena_stats(&as0) == 0);
+	ret = __STD(pthread_create(&tid, NULL, linux_body, NULL));
+	check(ret == 0);
+	check(__STD(pthread_join(tid, NULL)) == 0);
+
+	f.found = 0;
+	check(rtmalloc_walk_stats(match_thread, &f) == 1 && f.found);
+	check(f.stats.in_use == 0);
+	check(f.stats.nr_frees == f.stats.nr_allocs);
+
+	check(run_thread(&tid, drain_body) == 0);
+	check(rtmalloc_get_arena_stats(&as1) == 0);
+	check(as1.used < as0.used);
+	check(as1.peak >= as0.used);
+
+	return 0;
+}
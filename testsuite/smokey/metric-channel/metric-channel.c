@@ -0,0 +1,209 @@
+/*
+ * Update metrics from a writer thread while a reader samples them
+ * through its own read-only mapping of the channel, checking that
+ * no value is ever observed half-written.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <copperplate/metricobj.h>
+#include <copperplate/tunables.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(metric_channel,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Check concurrent updates and sampling of metric channels.\n"
+		   "\tloops=<N>, number of updates by the writer (1000000)"
+);
+
+#define CHANNEL		"smokey"
+#define NR_BUCKETS	10
+#define BUCKET_WIDTH	100
+
+static int nr_loops = 1000000;
+
+static struct metric_counter *counter;
+
+static struct metric_gauge *gauge;
+
+static struct metric_histogram *histogram;
+
+static int done;
+
+/* Both halves of a gauge value are equal, tearing would break this. */
+static inline int64_t gauge_value(unsigned int n)
+{
+	return (int64_t)(((uint64_t)n << 32) | n);
+}
+
+static void *writer_body(void *arg)
+{
+	int n;
+
+	for (n = 1; n <= nr_loops; n++) {
+		metric_counter_inc(counter);
+		metric_gauge_set(gauge, gauge_value(n));
+		metric_histogram_add(histogram, n % (NR_BUCKETS * BUCKET_WIDTH));
+	}
+
+	ACCESS_ONCE(done) = 1;
+
+	return NULL;
+}
+
+static int check_histogram(struct metric_sample *s)
+{
+	uint64_t total = 0;
+	unsigned int n;
+
+	if (!smokey_assert(s->nr_buckets == NR_BUCKETS + 2 &&
+			   s->buckets[0] == 0 &&
+			   s->buckets[NR_BUCKETS + 1] == 0))
+		return -EINVAL;
+
+	for (n = 0; n < s->nr_buckets; n++)
+		total += s->buckets[n];
+
+	if (!smokey_assert(total == s->count))
+		return -EINVAL;
+
+	if (s->count > 0 &&
+	    !smokey_assert(s->min >= 0 && s->min <= s->max &&
+			   s->max < NR_BUCKETS * BUCKET_WIDTH))
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Sample all metrics once, checking them against the former
+ * samples. Counters and gauges only grow in this test.
+ */
+static int sample_metrics(struct metricobj_reader *reader,
+			  uint64_t *count, int64_t *value,
+			  uint64_t *buckets)
+{
+	struct metric_sample s;
+	int ret;
+
+	ret = metricobj_sample(reader, 0, &s);
+	if (ret)
+		return ret;
+	if (!smokey_assert(s.type == METRIC_COUNTER && s.count >= *count))
+		return -EINVAL;
+	*count = s.count;
+
+	ret = metricobj_sample(reader, 1, &s);
+	if (ret)
+		return ret;
+	if (!smokey_assert(s.type == METRIC_GAUGE &&
+			   (uint32_t)s.value == (uint64_t)s.value >> 32 &&
+			   s.value >= *value))
+		return -EINVAL;
+	*value = s.value;
+
+	s.nr_buckets = NR_BUCKETS + 2;
+	s.buckets = buckets;
+	ret = metricobj_sample(reader, 2, &s);
+	if (ret)
+		return ret;
+	if (!smokey_assert(s.type == METRIC_HISTOGRAM))
+		return -EINVAL;
+
+	return check_histogram(&s);
+}
+
+static int run_metric_channel(struct smokey_test *t,
+			      int argc, char *const argv[])
+{
+	uint64_t count = 0, buckets[NR_BUCKETS + 2];
+	struct metricobj_reader reader;
+	struct metric_sample s;
+	struct metricobj mobj;
+	int64_t value = 0, sum = 0;
+	long nr_samples = 0;
+	pthread_t tid;
+	int ret, n;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(metric_channel, loops))
+		nr_loops = SMOKEY_ARG_INT(metric_channel, loops);
+
+	ret = metricobj_init(&mobj, CHANNEL, 3, 1024);
+	if (ret) {
+		smokey_warning("metricobj_init(): %s", symerror(ret));
+		return ret;
+	}
+
+	if (!__T(ret, metricobj_add_counter(&mobj, "counter", &counter)) ||
+	    !__T(ret, metricobj_add_gauge(&mobj, "gauge", &gauge)) ||
+	    !__T(ret, metricobj_add_histogram(&mobj, "histogram", 0,
+					      BUCKET_WIDTH, NR_BUCKETS,
+					      &histogram)))
+		goto out;
+
+	if (!__T(ret, metricobj_attach(&reader,
+				       get_config_tunable(session_label),
+				       CHANNEL)))
+		goto out;
+
+	if (!smokey_assert(metricobj_count(&reader) == 3)) {
+		ret = -EINVAL;
+		goto detach;
+	}
+
+	done = 0;
+	if (!__T(ret, pthread_create(&tid, NULL, writer_body, NULL)))
+		goto detach;
+
+	while (!ACCESS_ONCE(done)) {
+		ret = sample_metrics(&reader, &count, &value, buckets);
+		/* The writer may hog the histogram for a while. */
+		if (ret == -EAGAIN)
+			continue;
+		if (ret)
+			break;
+		nr_samples++;
+	}
+
+	pthread_join(tid, NULL);
+	if (ret && ret != -EAGAIN)
+		goto detach;
+
+	/* Everything must add up once the writer is done. */
+	ret = sample_metrics(&reader, &count, &value, buckets);
+	if (ret)
+		goto detach;
+
+	for (n = 1; n <= nr_loops; n++)
+		sum += n % (NR_BUCKETS * BUCKET_WIDTH);
+
+	s.nr_buckets = NR_BUCKETS + 2;
+	s.buckets = buckets;
+	ret = metricobj_sample(&reader, 2, &s);
+	if (ret)
+		goto detach;
+
+	if (!smokey_assert(count == (uint64_t)nr_loops &&
+			   value == gauge_value(nr_loops) &&
+			   s.count == (uint64_t)nr_loops && s.sum == sum)) {
+		ret = -EINVAL;
+		goto detach;
+	}
+
+	smokey_trace("%ld consistent samples during %d updates",
+		     nr_samples, nr_loops);
+detach:
+	metricobj_detach(&reader);
+out:
+	metricobj_destroy(&mobj);
+
+	return ret;
+}
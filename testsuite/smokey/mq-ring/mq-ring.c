@@ -0,0 +1,324 @@
+/*
+ * Check message queues backed by a shared ring (MQ_SHRING), and
+ * compare the cost of exchanging messages with regular queues.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <pthread.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(mq_ring,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Check message queues backed by a shared ring, and report\n"
+		   "\tthe cost of a send/receive pair with and without it.\n"
+		   "\tloops=<N>, number of messages per measurement (100000)"
+);
+
+#define MQ_NAME		"/smokey-mq-ring"
+#define MQ_MAXMSG	16
+#define MQ_MSGSIZE	64
+
+static int nr_loops = 100000;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static mqd_t open_queue(int flags)
+{
+	struct mq_attr attr;
+
+	mq_unlink(MQ_NAME);
+
+	memset(&attr, 0, sizeof(attr));
+	attr.mq_flags = flags;
+	attr.mq_maxmsg = MQ_MAXMSG;
+	attr.mq_msgsize = MQ_MSGSIZE;
+
+	return mq_open(MQ_NAME, O_RDWR|O_CREAT|O_EXCL|O_NONBLOCK, 0600, &attr);
+}
+
+static void close_queue(mqd_t mqd)
+{
+	mq_close(mqd);
+	mq_unlink(MQ_NAME);
+}
+
+static int check_nonblocking(mqd_t mqd)
+{
+	char buf[MQ_MSGSIZE];
+	struct mq_attr attr;
+	unsigned int prio;
+	int n, ret;
+
+	if (!smokey_assert(mq_receive(mqd, buf, sizeof(buf), &prio) < 0 &&
+			   errno == EAGAIN))
+		return -EINVAL;
+
+	for (n = 0; n < MQ_MAXMSG; n++) {
+		ret = smokey_check_errno(mq_send(mqd, (char *)&n,
+						 sizeof(n), 0));
+		if (ret)
+			return ret;
+	}
+
+	if (!smokey_assert(mq_send(mqd, (char *)&n, sizeof(n), 0) < 0 &&
+			   errno == EAGAIN))
+		return -EINVAL;
+
+	ret = smokey_check_errno(mq_getattr(mqd, &attr));
+	if (ret)
+		return ret;
+
+	if (!smokey_assert(attr.mq_curmsgs == MQ_MAXMSG))
+		return -EINVAL;
+
+	/* Short buffers are rejected, the message stays queued. */
+	if (!smokey_assert(mq_receive(mqd, buf, sizeof(n), &prio) < 0 &&
+			   errno == EMSGSIZE))
+		return -EINVAL;
+
+	for (n = 0; n < MQ_MAXMSG; n++) {
+		ret = smokey_check_errno(mq_receive(mqd, buf,
+						    sizeof(buf), &prio));
+		if (ret < 0)
+			return ret;
+		if (!smokey_assert(ret == sizeof(n) && prio == 0 &&
+				   memcmp(buf, &n, sizeof(n)) == 0))
+			return -EINVAL;
+	}
+
+	if (!smokey_assert(mq_receive(mqd, buf, sizeof(buf), &prio) < 0 &&
+			   errno == EAGAIN))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int check_priority(mqd_t mqd)
+{
+	char buf[MQ_MSGSIZE];
+	unsigned int prio;
+	int ret;
+
+	ret = smokey_check_errno(mq_send(mqd, "low", 4, 0));
+	if (ret)
+		return ret;
+
+	ret = smokey_check_errno(mq_send(mqd, "high", 5, 5));
+	if (ret)
+		return ret;
+
+	ret = smokey_check_errno(mq_receive(mqd, buf, sizeof(buf), &prio));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(prio == 5 && strcmp(buf, "high") == 0))
+		return -EINVAL;
+
+	ret = smokey_check_errno(mq_receive(mqd, buf, sizeof(buf), &prio));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(prio == 0 && strcmp(buf, "low") == 0))
+		return -EINVAL;
+
+	return 0;
+}
+
+static void *receiver_body(void *arg)
+{
+	mqd_t mqd = (mqd_t)(long)arg;
+	char buf[MQ_MSGSIZE];
+	unsigned int prio;
+	long n, ret = 0;
+
+	/* The sender runs at lower priority, we block every time. */
+	for (n = 0; n < MQ_MAXMSG * 4; n++) {
+		ret = mq_receive(mqd, buf, sizeof(buf), &prio);
+		if (ret < 0) {
+			ret = -errno;
+			break;
+		}
+		if (memcmp(buf, &n, sizeof(n))) {
+			ret = -EPROTO;
+			break;
+		}
+		ret = 0;
+	}
+
+	return (void *)ret;
+}
+
+static int check_blocking(mqd_t mqd)
+{
+	struct mq_attr attr, oattr;
+	struct sched_param param;
+	struct timespec timeout;
+	pthread_attr_t tattr;
+	char buf[MQ_MSGSIZE];
+	unsigned int prio;
+	pthread_t tid;
+	void *status;
+	long n;
+	int ret;
+
+	memset(&attr, 0, sizeof(attr));
+	ret = smokey_check_errno(mq_setattr(mqd, &attr, &oattr));
+	if (ret)
+		return ret;
+
+	clock_gettime(CLOCK_REALTIME, &timeout);
+	timeout.tv_nsec += 10000000;
+	if (timeout.tv_nsec >= 1000000000) {
+		timeout.tv_nsec -= 1000000000;
+		timeout.tv_sec++;
+	}
+
+	if (!smokey_assert(mq_timedreceive(mqd, buf, sizeof(buf),
+					   &prio, &timeout) < 0 &&
+			   errno == ETIMEDOUT))
+		return -EINVAL;
+
+	pthread_attr_init(&tattr);
+	pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&tattr, SCHED_FIFO);
+	param.sched_priority = 2;
+	pthread_attr_setschedparam(&tattr, &param);
+	ret = smokey_check_status(pthread_create(&tid, &tattr, receiver_body,
+						 (void *)(long)mqd));
+	pthread_attr_destroy(&tattr);
+	if (ret)
+		return ret;
+
+	for (n = 0; n < MQ_MAXMSG * 4; n++) {
+		ret = smokey_check_errno(mq_send(mqd, (char *)&n,
+						 sizeof(n), 0));
+		if (ret)
+			break;
+	}
+
+	pthread_join(tid, &status);
+	if (ret)
+		return ret;
+
+	if (!smokey_assert(status == NULL)) {
+		smokey_warning("receiver failed: %s",
+			       strerror(-(int)(long)status));
+		return -EINVAL;
+	}
+
+	return smokey_check_errno(mq_setattr(mqd, &oattr, NULL));
+}
+
+static int measure_pairs(mqd_t mqd, long long *avg_r)
+{
+	char buf[MQ_MSGSIZE];
+	unsigned int prio;
+	long long start;
+	int n, ret;
+
+	start = now_ns();
+
+	for (n = 0; n < nr_loops; n++) {
+		ret = mq_send(mqd, (char *)&n, sizeof(n), 0);
+		if (ret == 0)
+			ret = mq_receive(mqd, buf, sizeof(buf), &prio);
+		if (ret < 0)
+			return smokey_check_errno(ret);
+	}
+
+	*avg_r = (now_ns() - start) / nr_loops;
+
+	return 0;
+}
+
+static int run_mq_ring(struct smokey_test *t, int argc, char *const argv[])
+{
+	long long regular, shring;
+	struct sched_param param;
+	struct mq_attr attr;
+	mqd_t mqd;
+	int ret;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(*t, loops))
+		nr_loops = SMOKEY_ARG_INT(*t, loops);
+
+	if (nr_loops < 1) {
+		smokey_warning("loops must be positive");
+		return -EINVAL;
+	}
+
+	param.sched_priority = 1;
+	ret = smokey_check_status(pthread_setschedparam(pthread_self(),
+							SCHED_FIFO, &param));
+	if (ret)
+		return ret;
+
+	mqd = open_queue(0);
+	if (mqd < 0) {
+		ret = smokey_check_errno(mqd);
+		goto out;
+	}
+
+	ret = measure_pairs(mqd, &regular);
+	close_queue(mqd);
+	if (ret)
+		goto out;
+
+	mqd = open_queue(MQ_SHRING);
+	if (mqd < 0) {
+		ret = smokey_check_errno(mqd);
+		goto out;
+	}
+
+	ret = smokey_check_errno(mq_getattr(mqd, &attr));
+	if (ret)
+		goto close;
+
+	if ((attr.mq_flags & MQ_SHRING) == 0) {
+		smokey_note("shared heap too small for the ring, skipping");
+		ret = -ENOSYS;
+		goto close;
+	}
+
+	ret = check_nonblocking(mqd);
+	if (ret)
+		goto close;
+
+	ret = check_priority(mqd);
+	if (ret)
+		goto close;
+
+	ret = check_blocking(mqd);
+	if (ret)
+		goto close;
+
+	ret = measure_pairs(mqd, &shring);
+	if (ret)
+		goto close;
+
+	smokey_trace("send/receive pair: %lld ns regular, %lld ns shared ring",
+		     regular, shring);
+close:
+	close_queue(mqd);
+out:
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+	return ret;
+}
@@ -276,6 +276,11 @@ static int smokey_net_teardown_rtcfg(const char *intf)
 	return smokey_net_rmmod(MODID_CFG);
 }
 
+int smokey_net_load_rtcfg(void)
+{
+	return smokey_net_modprobe(MODID_CFG);
+}
+
 static int find_peer(const char *intf, void *vpeer)
 {
 	struct sockaddr_in *in_peer = vpeer;
@@ -538,7 +543,7 @@ int smokey_net_teardown(const char *driver, const char *intf, int tested_config)
 	if (tmp >= 0) {
 		fd = tmp;
 
-		if (strcmp(driver, "rt_loopback")) {
+		if (strcmp(driver, "rt_loopback") || modules[MODID_CFG].loaded) {
 			tmp = smokey_net_teardown_rtcfg(intf);
 			if (err == 0)
 				err = tmp;
@@ -48,6 +48,8 @@ int smokey_net_setup(const char *driver, const char *intf, int tested_config,
 int smokey_net_teardown(const char *driver,
 			const char *intf, int tested_config);
 
+int smokey_net_load_rtcfg(void);
+
 int smokey_net_client_run(struct smokey_test *t,
 			struct smokey_net_client *client,
 			int argc, char *const argv[]);
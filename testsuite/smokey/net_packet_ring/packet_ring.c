@@ -0,0 +1,263 @@
+/*
+ * RTnet AF_PACKET memory-mapped ring test
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <unistd.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netpacket/packet.h>
+
+#include <sys/cobalt.h>
+#include <smokey/smokey.h>
+#include <rtdm/net.h>
+#include "smokey_net.h"
+
+smokey_test_plugin(net_packet_ring,
+	SMOKEY_ARGLIST(
+		SMOKEY_INT(rtnet_batch),
+		SMOKEY_INT(rtnet_rounds),
+	),
+	"Check RTnet memory-mapped packet rings over the loopback driver,\n"
+	"\tsending each batch of raw frames from the TX ring with a single\n"
+	"\tsyscall and collecting them from the RX ring with a single one,\n"
+	"\tthe rtnet_batch parameter sets the number of frames per batch\n"
+	"\tthe rtnet_rounds parameter sets the number of batches"
+);
+
+#define RING_PROTO	(ETH_P_802_EX1 + 2)
+#define FRAME_SIZE	2048
+#define RING_FRAMES	64
+
+static int batch = 32, rounds = 1000;
+
+struct ring_payload {
+	unsigned int seq;
+	unsigned int round;
+};
+
+static int check_rx_batch(struct rtnet_packet_frame *rx, unsigned int *rx_head,
+			  unsigned int round)
+{
+	struct rtnet_packet_frame *frame;
+	struct ring_payload *payload;
+	int n;
+
+	for (n = 0; n < batch; n++) {
+		frame = (void *)rx + *rx_head * FRAME_SIZE;
+		if (!(frame->status & RTNET_PACKET_STATUS_USER)) {
+			smokey_warning("frame %d of round %u missing",
+				       n, round);
+			return -EPROTO;
+		}
+		__sync_synchronize();
+
+		payload = (void *)frame + RTNET_PACKET_FRAME_HDRLEN +
+			sizeof(struct ethhdr);
+		if (!smokey_assert(frame->status == RTNET_PACKET_STATUS_USER) ||
+		    !smokey_assert(frame->snaplen == frame->len) ||
+		    !smokey_assert(frame->protocol == htons(RING_PROTO)) ||
+		    !smokey_assert(payload->round == round) ||
+		    !smokey_assert(payload->seq == n))
+			return -EPROTO;
+
+		__sync_synchronize();
+		frame->status = RTNET_PACKET_STATUS_KERNEL;
+		*rx_head = (*rx_head + 1) % RING_FRAMES;
+	}
+
+	return 0;
+}
+
+static void *ring_loop(void *cookie)
+{
+	struct rtnet_packet_ring_req req = {
+		.frame_size = FRAME_SIZE,
+		.rx_frames = RING_FRAMES,
+		.tx_frames = RING_FRAMES,
+	};
+	unsigned int rx_head = 0, tx_head = 0, round;
+	struct rtnet_packet_frame *rx, *tx, *frame;
+	struct sched_param prio = { .sched_priority = 20 };
+	struct timespec start, end;
+	struct sockaddr_ll sll;
+	struct ring_payload *payload;
+	struct ethhdr header;
+	struct msghdr msg;
+	struct ifreq ifr;
+	int64_t timeout = 1000000000;
+	long long elapsed;
+	size_t ring_size;
+	int sock, err, n, got;
+	void *area;
+
+	err = smokey_check_status(
+		pthread_setschedparam(pthread_self(), SCHED_FIFO, &prio));
+	if (err < 0)
+		return (void *)(long)err;
+
+	sock = smokey_check_errno(
+		__RT(socket(PF_PACKET, SOCK_RAW, htons(RING_PROTO))));
+	if (sock < 0)
+		return (void *)(long)sock;
+
+	strcpy(ifr.ifr_name, "rtlo");
+	err = smokey_check_errno(__RT(ioctl(sock, SIOCGIFINDEX, &ifr)));
+	if (err < 0)
+		goto out;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(RING_PROTO);
+	sll.sll_ifindex = ifr.ifr_ifindex;
+	err = smokey_check_errno(
+		__RT(bind(sock, (struct sockaddr *)&sll, sizeof(sll))));
+	if (err < 0)
+		goto out;
+
+	err = smokey_check_errno(__RT(ioctl(sock, SIOCGIFHWADDR, &ifr)));
+	if (err < 0)
+		goto out;
+	memcpy(header.h_dest, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+	memcpy(header.h_source, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+	header.h_proto = htons(RING_PROTO);
+
+	err = smokey_check_errno(
+		__RT(ioctl(sock, RTNET_RTIOC_TIMEOUT, &timeout)));
+	if (err < 0)
+		goto out;
+
+	err = smokey_check_errno(
+		__RT(ioctl(sock, RTNET_RTIOC_PACKET_RING, &req)));
+	if (err < 0)
+		goto out;
+
+	ring_size = 2 * RING_FRAMES * FRAME_SIZE;
+	area = __RT(mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, sock, 0));
+	if (area == MAP_FAILED) {
+		err = smokey_check_errno(-1);
+		goto out;
+	}
+	rx = area;
+	tx = area + RING_FRAMES * FRAME_SIZE;
+
+	memset(&msg, 0, sizeof(msg));
+
+	err = smokey_check_errno(
+		__RT(clock_gettime(CLOCK_MONOTONIC, &start)));
+	if (err < 0)
+		goto unmap;
+
+	for (round = 0; round < rounds; round++) {
+		for (n = 0; n < batch; n++) {
+			frame = (void *)tx + tx_head * FRAME_SIZE;
+			if (!smokey_assert(frame->status ==
+					   RTNET_PACKET_STATUS_AVAILABLE)) {
+				err = -EPROTO;
+				goto unmap;
+			}
+			memcpy((void *)frame + RTNET_PACKET_FRAME_HDRLEN,
+			       &header, sizeof(header));
+			payload = (void *)frame + RTNET_PACKET_FRAME_HDRLEN +
+				sizeof(header);
+			payload->seq = n;
+			payload->round = round;
+			frame->len = ETH_ZLEN;
+			__sync_synchronize();
+			frame->status = RTNET_PACKET_STATUS_SEND_REQUEST;
+			tx_head = (tx_head + 1) % RING_FRAMES;
+		}
+
+		/* One syscall sends the whole batch... */
+		err = smokey_check_errno(__RT(sendmsg(sock, &msg, 0)));
+		if (err < 0)
+			goto unmap;
+		if (!smokey_assert(err == batch * ETH_ZLEN)) {
+			err = -EPROTO;
+			goto unmap;
+		}
+
+		/* ...one (or a few, if the stack lags) collects it. */
+		for (got = 0; got < batch; got += err) {
+			err = smokey_check_errno(
+				__RT(recvmsg(sock, &msg, 0)));
+			if (err < 0)
+				goto unmap;
+		}
+
+		err = check_rx_batch(rx, &rx_head, round);
+		if (err < 0)
+			goto unmap;
+	}
+
+	err = smokey_check_errno(
+		__RT(clock_gettime(CLOCK_MONOTONIC, &end)));
+	if (err < 0)
+		goto unmap;
+
+	elapsed = (end.tv_sec - start.tv_sec) * 1000000000LL +
+		end.tv_nsec - start.tv_nsec;
+	smokey_trace("%d batches of %d frames, %Ld ns per frame round trip",
+		     rounds, batch, elapsed / ((long long)rounds * batch));
+  unmap:
+	munmap(area, ring_size);
+  out:
+	n = smokey_check_errno(__RT(close(sock)));
+	if (err == 0)
+		err = n;
+
+	return (void *)(long)err;
+}
+
+static int run_net_packet_ring(struct smokey_test *t,
+			       int argc, char *const argv[])
+{
+	struct sockaddr_in peer;
+	int err, err_teardown;
+	pthread_t tid;
+	void *status;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(*t, rtnet_batch))
+		batch = SMOKEY_ARG_INT(*t, rtnet_batch);
+
+	if (SMOKEY_ARG_ISSET(*t, rtnet_rounds))
+		rounds = SMOKEY_ARG_INT(*t, rtnet_rounds);
+
+	if (batch <= 0 || batch > RING_FRAMES) {
+		smokey_warning("batch must be within [1-%d]", RING_FRAMES);
+		return -EINVAL;
+	}
+
+	memset(&peer, 0, sizeof(peer));
+	peer.sin_family = AF_INET;
+	peer.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	err = smokey_net_setup("rt_loopback", "rtlo",
+			       _CC_COBALT_NET_AF_PACKET, &peer);
+	if (err < 0)
+		return err;
+
+	err = smokey_check_status(
+		__RT(pthread_create(&tid, NULL, ring_loop, NULL)));
+	if (err == 0) {
+		err = smokey_check_status(pthread_join(tid, &status));
+		if (err == 0)
+			err = (int)(long)status;
+	}
+
+	err_teardown = smokey_net_teardown("rt_loopback", "rtlo",
+					   _CC_COBALT_NET_AF_PACKET);
+	if (err == 0)
+		err = err_teardown;
+
+	return err;
+}
@@ -0,0 +1,649 @@
+/*
+ * RTcfg shared stage 2 transfer test
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netpacket/packet.h>
+
+#include <sys/cobalt.h>
+#include <smokey/smokey.h>
+#include <rtdm/net.h>
+#include <rtcfg_chrdev.h>
+#include "smokey_net.h"
+
+smokey_test_plugin(net_rtcfg,
+	SMOKEY_ARGLIST(
+		SMOKEY_INT(rtnet_clients),
+		SMOKEY_INT(rtnet_size),
+		SMOKEY_INT(rtnet_loss),
+	),
+	"Check shared RTcfg stage 2 transfers over the loopback driver,\n"
+	"\tthe clients loading the same file concurrently are emulated\n"
+	"\ton top of an ETH_P_ALL packet socket,\n"
+	"\tthe rtnet_clients parameter sets the number of clients\n"
+	"\tthe rtnet_size parameter sets the file size in KiB\n"
+	"\tthe rtnet_loss parameter sets the percentage of data frames\n"
+	"\tthe clients drop on reception"
+);
+
+/*
+ * The wire format, see kernel/drivers/net/doc/RTcfg.spec. The frame
+ * identifier occupies the 5 lower bits of the first byte.
+ */
+#define ETH_RTCFG		0x9022
+
+#define ID_STAGE_1_CFG		0
+#define ID_ANNOUNCE_NEW		1
+#define ID_STAGE_2_CFG		3
+#define ID_STAGE_2_CFG_FRAG	4
+#define ID_ACK_CFG		5
+#define ID_STAGE_2_CFG_MC	9
+#define ID_STAGE_2_CFG_MFRAG	10
+#define ID_NACK_CFG		11
+
+#define FRM_FLAG_STAGE_2_DATA	0x01
+#define FRM_FLAG_MCAST		0x04
+
+struct frm_announce {
+	uint8_t id;
+	uint8_t addr_type;
+	uint8_t flags;
+	uint8_t burstrate;
+} __attribute__((packed));
+
+struct frm_stage_2_cfg_mc {
+	uint8_t id;
+	uint8_t flags;
+	uint32_t stations;
+	uint16_t heartbeat_period;
+	uint32_t cfg_len;
+	uint32_t session;
+} __attribute__((packed));
+
+struct frm_stage_2_cfg_mfrag {
+	uint8_t id;
+	uint32_t session;
+	uint32_t frag_offs;
+} __attribute__((packed));
+
+struct frm_ack_cfg {
+	uint8_t id;
+	uint32_t ack_len;
+} __attribute__((packed));
+
+struct frm_nack_cfg {
+	uint8_t id;
+	uint32_t frag_offs;
+	uint32_t frag_len;
+} __attribute__((packed));
+
+#define MAX_CLIENTS	64
+#define BURSTRATE	4
+#define SERVER_PERIOD	100	/* ms */
+
+enum {
+	CLIENT_IDLE,
+	CLIENT_ANNOUNCED,
+	CLIENT_LOADING,
+	CLIENT_DONE,
+};
+
+struct vclient {
+	unsigned char mac[ETH_ALEN];
+	int state;
+	uint32_t session;
+	uint32_t cfg_offs;
+	uint32_t nack_offs;
+	unsigned int unacked;
+	/* fragments received beyond a gap */
+	unsigned int held;
+	uint32_t held_offs[BURSTRATE];
+	uint32_t held_len[BURSTRATE];
+};
+
+static struct vclient clients[MAX_CLIENTS];
+
+static int nr_clients = 16, size_kb = 256, loss;
+
+static unsigned char *file_data;
+
+static size_t file_size;
+
+static unsigned char server_mac[ETH_ALEN];
+
+static int sock;
+
+static unsigned int rand_seed = 1;
+
+static volatile int stop;
+
+static unsigned long data_frames, nacks, frames_dropped;
+
+static int send_frame(struct vclient *c, const void *frm, size_t len)
+{
+	unsigned char buf[ETH_HLEN + 16];
+	struct ethhdr *eth = (struct ethhdr *)buf;
+
+	memcpy(eth->h_dest, server_mac, ETH_ALEN);
+	memcpy(eth->h_source, c->mac, ETH_ALEN);
+	eth->h_proto = htons(ETH_RTCFG);
+	memcpy(buf + ETH_HLEN, frm, len);
+
+	return smokey_check_errno(__RT(send(sock, buf, ETH_HLEN + len, 0)));
+}
+
+static int send_ack(struct vclient *c)
+{
+	struct frm_ack_cfg ack = {
+		.id = ID_ACK_CFG,
+		.ack_len = htonl(c->cfg_offs),
+	};
+
+	c->unacked = 0;
+
+	return send_frame(c, &ack, sizeof(ack));
+}
+
+static int send_nack(struct vclient *c, uint32_t end)
+{
+	struct frm_nack_cfg nack = {
+		.id = ID_NACK_CFG,
+		.frag_offs = htonl(c->cfg_offs),
+		.frag_len = htonl(end - c->cfg_offs),
+	};
+
+	c->nack_offs = c->cfg_offs;
+	nacks++;
+
+	return send_frame(c, &nack, sizeof(nack));
+}
+
+static int check_data(uint32_t offs, const void *data, size_t len)
+{
+	if (!smokey_assert(offs + len <= file_size) ||
+	    !smokey_assert(memcmp(file_data + offs, data, len) == 0)) {
+		smokey_warning("corrupted fragment at offset %u", offs);
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+/* Like the kernel client, acknowledge every burst and the last fragment. */
+static int advance(struct vclient *c, uint32_t len)
+{
+	unsigned int n;
+
+	c->cfg_offs += len;
+	c->unacked++;
+
+	/* Take over the fragments we hold, as far as contiguous. */
+	while (c->held > 0 && c->held_offs[0] <= c->cfg_offs) {
+		if (c->held_offs[0] == c->cfg_offs) {
+			c->cfg_offs += c->held_len[0];
+			c->unacked++;
+		}
+		c->held--;
+		for (n = 0; n < c->held; n++) {
+			c->held_offs[n] = c->held_offs[n + 1];
+			c->held_len[n] = c->held_len[n + 1];
+		}
+	}
+
+	if (c->cfg_offs >= file_size) {
+		c->state = CLIENT_DONE;
+		return send_ack(c);
+	}
+
+	if (c->unacked >= BURSTRATE)
+		return send_ack(c);
+
+	if (c->held > 0 && c->nack_offs != c->cfg_offs)
+		return send_nack(c, c->held_offs[0]);
+
+	return 0;
+}
+
+static int hold(struct vclient *c, uint32_t offs, uint32_t len)
+{
+	unsigned int n, pos;
+
+	for (pos = 0; pos < c->held && c->held_offs[pos] < offs; pos++)
+		;
+
+	/* A repeated fragment reports the gap again. */
+	if (pos < c->held && c->held_offs[pos] == offs)
+		return send_nack(c, c->held_offs[0]);
+
+	if (c->held < BURSTRATE) {
+		for (n = c->held; n > pos; n--) {
+			c->held_offs[n] = c->held_offs[n - 1];
+			c->held_len[n] = c->held_len[n - 1];
+		}
+		c->held_offs[pos] = offs;
+		c->held_len[pos] = len;
+		c->held++;
+	}
+
+	if (c->nack_offs != c->cfg_offs)
+		return send_nack(c, c->held_offs[0]);
+
+	return 0;
+}
+
+static int recv_stage_1(struct vclient *c)
+{
+	struct frm_announce announce = {
+		.id = ID_ANNOUNCE_NEW,
+		.addr_type = RTCFG_ADDR_MAC,
+		.flags = FRM_FLAG_STAGE_2_DATA | FRM_FLAG_MCAST,
+		.burstrate = BURSTRATE,
+	};
+
+	/* Our announcement may have been lost, repeat it. */
+	if (c->state != CLIENT_IDLE && c->state != CLIENT_ANNOUNCED)
+		return 0;
+
+	c->state = CLIENT_ANNOUNCED;
+
+	return send_frame(c, &announce, sizeof(announce));
+}
+
+static int recv_stage_2(struct vclient *c, const void *frm, size_t len)
+{
+	const struct frm_stage_2_cfg_mc *stage_2 = frm;
+	int err;
+
+	if (c->state != CLIENT_ANNOUNCED) {
+		/* repeated, our first ACK got lost */
+		if (c->unacked == 0)
+			return send_ack(c);
+		return 0;
+	}
+
+	if (!smokey_assert(len > sizeof(*stage_2)) ||
+	    !smokey_assert(ntohl(stage_2->cfg_len) == file_size))
+		return -EPROTO;
+
+	len -= sizeof(*stage_2);
+	err = check_data(0, stage_2 + 1, len);
+	if (err)
+		return err;
+
+	c->session = ntohl(stage_2->session);
+	c->state = CLIENT_LOADING;
+
+	return advance(c, len);
+}
+
+static int recv_mfrag(struct vclient *c, const void *frm, size_t len,
+		      int unicast)
+{
+	const struct frm_stage_2_cfg_mfrag *mfrag = frm;
+	uint32_t offs;
+	int err;
+
+	if (c->state < CLIENT_LOADING || ntohl(mfrag->session) != c->session)
+		return 0;
+
+	if (loss && rand_r(&rand_seed) % 100 < loss) {
+		frames_dropped++;
+		return 0;
+	}
+
+	offs = ntohl(mfrag->frag_offs);
+	len -= sizeof(*mfrag);
+
+	err = check_data(offs, mfrag + 1, len);
+	if (err)
+		return err;
+
+	/* The server probes us with a known fragment. */
+	if (offs < c->cfg_offs) {
+		if (unicast && c->unacked == 0)
+			return send_ack(c);
+		return 0;
+	}
+
+	if (!smokey_assert(c->state == CLIENT_LOADING))
+		return -EPROTO;
+
+	if (c->unacked >= BURSTRATE) {
+		smokey_warning("server exceeded the burst rate");
+		return -EPROTO;
+	}
+
+	if (offs == c->cfg_offs)
+		return advance(c, len);
+
+	return hold(c, offs, len);
+}
+
+static struct vclient *find_client(const unsigned char *mac)
+{
+	int n;
+
+	for (n = 0; n < nr_clients; n++)
+		if (memcmp(clients[n].mac, mac, ETH_ALEN) == 0)
+			return clients + n;
+
+	return NULL;
+}
+
+static int dispatch(const unsigned char *buf, size_t len)
+{
+	const struct ethhdr *eth = (const struct ethhdr *)buf;
+	const unsigned char *frm = buf + ETH_HLEN;
+	struct vclient *c;
+	int n, err = 0;
+
+	if (len <= ETH_HLEN || eth->h_proto != htons(ETH_RTCFG) ||
+	    memcmp(eth->h_source, server_mac, ETH_ALEN) ||
+	    find_client(eth->h_source))
+		return 0;
+
+	len -= ETH_HLEN;
+	c = find_client(eth->h_dest);
+
+	switch (frm[0] & 0x1f) {
+	case ID_STAGE_1_CFG:
+		if (c)
+			err = recv_stage_1(c);
+		break;
+
+	case ID_STAGE_2_CFG:
+	case ID_STAGE_2_CFG_FRAG:
+		smokey_warning("server did not use a shared transfer");
+		return -EPROTO;
+
+	case ID_STAGE_2_CFG_MC:
+		data_frames++;
+		if (c)
+			err = recv_stage_2(c, frm, len);
+		break;
+
+	case ID_STAGE_2_CFG_MFRAG:
+		data_frames++;
+		if (!smokey_assert(len > sizeof(struct frm_stage_2_cfg_mfrag)))
+			return -EPROTO;
+		if (c)
+			return recv_mfrag(c, frm, len, 1);
+		for (n = 0; n < nr_clients && err == 0; n++)
+			err = recv_mfrag(clients + n, frm, len, 0);
+		break;
+	}
+
+	return err;
+}
+
+static void *client_loop(void *cookie)
+{
+	struct sched_param prio = { .sched_priority = 20 };
+	unsigned char buf[ETH_FRAME_LEN + ETH_FCS_LEN];
+	int64_t timeout = 100000000;
+	unsigned int pool = 64;
+	struct sockaddr_ll sll;
+	struct ifreq ifr;
+	int err, n;
+
+	err = smokey_check_status(
+		pthread_setschedparam(pthread_self(), SCHED_FIFO, &prio));
+	if (err < 0)
+		return (void *)(long)err;
+
+	strcpy(ifr.ifr_name, "rtlo");
+	err = smokey_check_errno(__RT(ioctl(sock, SIOCGIFINDEX, &ifr)));
+	if (err < 0)
+		return (void *)(long)err;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = ifr.ifr_ifindex;
+	err = smokey_check_errno(
+		__RT(bind(sock, (struct sockaddr *)&sll, sizeof(sll))));
+	if (err < 0)
+		return (void *)(long)err;
+
+	err = smokey_check_errno(__RT(ioctl(sock, RTNET_RTIOC_TIMEOUT,
+					    &timeout)));
+	if (err < 0)
+		return (void *)(long)err;
+
+	/* Clones of bursts sent by the server must fit. */
+	err = smokey_check_errno(__RT(ioctl(sock, RTNET_RTIOC_EXTPOOL, &pool)));
+	if (err < 0)
+		return (void *)(long)err;
+
+	while (!stop) {
+		n = __RT(recv(sock, buf, sizeof(buf), 0));
+		if (n < 0) {
+			if (errno == ETIMEDOUT || errno == EAGAIN)
+				continue;
+			return (void *)(long)smokey_check_errno(n);
+		}
+
+		err = dispatch(buf, n);
+		if (err)
+			return (void *)(long)err;
+	}
+
+	return NULL;
+}
+
+static int rtcfg_ioctl(int fd, unsigned long request, struct rtcfg_cmd *cmd)
+{
+	strcpy(cmd->head.if_name, "rtlo");
+
+	return smokey_check_errno(ioctl(fd, request, cmd));
+}
+
+static int run_transfer(int fd, const char *path)
+{
+	struct timespec start, end;
+	struct rtcfg_cmd cmd;
+	unsigned int frags;
+	int err, n, done;
+	pthread_t tid;
+	void *status;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.args.server.period = SERVER_PERIOD;
+	/* invite all clients at once, windows are negotiated to BURSTRATE */
+	cmd.args.server.burstrate = nr_clients < BURSTRATE ?
+		BURSTRATE : nr_clients;
+	cmd.args.server.threshold = 2;
+	err = rtcfg_ioctl(fd, RTCFG_IOC_SERVER, &cmd);
+	if (err)
+		return err;
+
+	for (n = 0; n < nr_clients; n++) {
+		clients[n].mac[0] = 0x02;	/* locally administered */
+		clients[n].mac[5] = n + 1;
+
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.args.add.addr_type = RTCFG_ADDR_MAC;
+		memcpy(cmd.args.add.mac_addr, clients[n].mac, ETH_ALEN);
+		cmd.args.add.stage2_filename = path;
+		err = rtcfg_ioctl(fd, RTCFG_IOC_ADD, &cmd);
+		if (err)
+			goto out;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	err = smokey_check_status(
+		__RT(pthread_create(&tid, NULL, client_loop, NULL)));
+	if (err)
+		goto out;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.args.wait.timeout = 60000;
+	err = rtcfg_ioctl(fd, RTCFG_IOC_WAIT, &cmd);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	stop = 1;
+	n = smokey_check_status(pthread_join(tid, &status));
+	if (err == 0)
+		err = n ?: (int)(long)status;
+	if (err)
+		goto out;
+
+	for (n = 0, done = 0; n < nr_clients; n++)
+		if (clients[n].state == CLIENT_DONE)
+			done++;
+	if (!smokey_assert(done == nr_clients)) {
+		err = -EPROTO;
+		goto out;
+	}
+
+	frags = (file_size + ETH_DATA_LEN - 1) / ETH_DATA_LEN;
+	smokey_trace("%d clients loaded %zu bytes in %ld ms: "
+		     "%lu data frames for %u fragments per client, "
+		     "%lu NACKs, %lu frames dropped",
+		     nr_clients, file_size,
+		     (end.tv_sec - start.tv_sec) * 1000 +
+		     (end.tv_nsec - start.tv_nsec) / 1000000,
+		     data_frames, frags, nacks, frames_dropped);
+
+	/*
+	 * Without losses, the clients joining together receive the
+	 * same frames: this must cost a fraction of individual
+	 * transfers.
+	 */
+	if (loss == 0 && nr_clients >= 4 &&
+	    !smokey_assert(data_frames < (unsigned long)nr_clients * frags / 2))
+		err = -EPROTO;
+  out:
+	memset(&cmd, 0, sizeof(cmd));
+	n = rtcfg_ioctl(fd, RTCFG_IOC_DETACH, &cmd);
+	if (err == 0)
+		err = n;
+
+	return err;
+}
+
+static int run_net_rtcfg(struct smokey_test *t, int argc, char *const argv[])
+{
+	char path[] = "/tmp/smokey-rtcfg-XXXXXX";
+	int net_config, err, err_teardown, fd, tmp;
+	struct sockaddr_in peer;
+	struct ifreq ifr;
+	size_t n;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(*t, rtnet_clients))
+		nr_clients = SMOKEY_ARG_INT(*t, rtnet_clients);
+
+	if (SMOKEY_ARG_ISSET(*t, rtnet_size))
+		size_kb = SMOKEY_ARG_INT(*t, rtnet_size);
+
+	if (SMOKEY_ARG_ISSET(*t, rtnet_loss))
+		loss = SMOKEY_ARG_INT(*t, rtnet_loss);
+
+	if (nr_clients <= 0 || nr_clients > MAX_CLIENTS) {
+		smokey_warning("clients must be within [1-%d]", MAX_CLIENTS);
+		return -EINVAL;
+	}
+
+	if (size_kb <= 0 || loss < 0 || loss > 90) {
+		smokey_warning("invalid size or loss percentage");
+		return -EINVAL;
+	}
+
+	/* We listen to all frames on rtlo to emulate the clients. */
+	err = cobalt_corectl(_CC_COBALT_GET_NET_CONFIG,
+			     &net_config, sizeof(net_config));
+	if (err == -EINVAL)
+		return -ENOSYS;
+	if (err < 0)
+		return err;
+
+	if ((net_config & (_CC_COBALT_NET_ETH_P_ALL | _CC_COBALT_NET_CFG)) !=
+	    (_CC_COBALT_NET_ETH_P_ALL | _CC_COBALT_NET_CFG))
+		return -ENOSYS;
+
+	file_size = (size_t)size_kb * 1024;
+	file_data = malloc(file_size);
+	if (file_data == NULL)
+		return -ENOMEM;
+
+	for (n = 0; n < file_size; n++)
+		file_data[n] = rand_r(&rand_seed);
+
+	fd = smokey_check_errno(mkstemp(path));
+	if (fd < 0) {
+		free(file_data);
+		return fd;
+	}
+
+	err = smokey_check_errno(write(fd, file_data, file_size));
+	close(fd);
+	if (err >= 0 && !smokey_assert(err == file_size))
+		err = -EIO;
+	if (err < 0)
+		goto out_file;
+
+	memset(&peer, 0, sizeof(peer));
+	peer.sin_family = AF_INET;
+	peer.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	err = smokey_net_setup("rt_loopback", "rtlo",
+			       _CC_COBALT_NET_AF_PACKET, &peer);
+	if (err < 0)
+		goto out_file;
+
+	err = smokey_net_load_rtcfg();
+	if (err < 0)
+		goto out_teardown;
+
+	sock = smokey_check_errno(
+		__RT(socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL))));
+	if (sock < 0) {
+		err = sock;
+		goto out_teardown;
+	}
+
+	strcpy(ifr.ifr_name, "rtlo");
+	err = smokey_check_errno(__RT(ioctl(sock, SIOCGIFHWADDR, &ifr)));
+	if (err < 0)
+		goto out_sock;
+	memcpy(server_mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+
+	fd = smokey_check_errno(open("/dev/rtnet", O_RDWR));
+	if (fd < 0) {
+		err = fd;
+		goto out_sock;
+	}
+
+	err = run_transfer(fd, path);
+
+	close(fd);
+  out_sock:
+	tmp = smokey_check_errno(__RT(close(sock)));
+	if (err == 0)
+		err = tmp;
+  out_teardown:
+	err_teardown = smokey_net_teardown("rt_loopback", "rtlo",
+					   _CC_COBALT_NET_AF_PACKET);
+	if (err == 0)
+		err = err_teardown;
+  out_file:
+	unlink(path);
+	free(file_data);
+
+	return err;
+}
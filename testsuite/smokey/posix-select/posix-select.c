@@ -33,11 +33,16 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/resource.h>
 #include <smokey/smokey.h>
 
 smokey_test_plugin(posix_select,
-		   SMOKEY_NOARGS,
-		   "Check POSIX select service"
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Check POSIX select service, and report its cost as the\n"
+		   "\tnumber of watched descriptors grows from 8 to 1024.\n"
+		   "\tloops=<N>, number of select calls per measurement (1000)"
 );
 
 static const char *tunes[] = {
@@ -61,6 +66,8 @@ static const char *tunes[] = {
 
 static int test_status;
 
+static int nr_loops = 1000;
+
 static void *mq_thread(void *cookie)
 {
 	mqd_t mqd = (mqd_t)(long)cookie;
@@ -102,6 +109,126 @@ static void *mq_thread(void *cookie)
 	return NULL;
 }
 
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Time select() over all message queues numbered below nfds, with a
+ * single one of them readable. The readable queue changes at each
+ * round, so that the kernel has to find the event among the whole
+ * set.
+ */
+static int measure_select(mqd_t *mqs, int nr_mqs, int nfds, long long *avg_r)
+{
+	struct timeval tv = { 0, 0 };
+	fd_set inset, outset;
+	int n, ret, nr, i;
+	long long start;
+	unsigned int prio;
+	char c;
+
+	FD_ZERO(&inset);
+	for (n = 0, nr = 0; n < nr_mqs && mqs[n] < nfds; n++, nr++)
+		FD_SET(mqs[n], &inset);
+
+	/* Bind the new descriptors outside of the measurement. */
+	outset = inset;
+	ret = smokey_check_errno(select(nfds, &outset, NULL, NULL, &tv));
+	if (ret < 0)
+		return ret;
+
+	start = now_ns();
+
+	for (n = 0; n < nr_loops; n++) {
+		i = (n * 7919) % nr;
+		ret = smokey_check_errno(mq_send(mqs[i], "x", 1, 0));
+		if (ret < 0)
+			return ret;
+		outset = inset;
+		ret = smokey_check_errno(select(nfds, &outset, NULL, NULL, NULL));
+		if (ret < 0)
+			return ret;
+		if (!smokey_assert(ret == 1 && FD_ISSET(mqs[i], &outset)))
+			return -EINVAL;
+		ret = smokey_check_errno(mq_receive(mqs[i], &c, 1, &prio));
+		if (ret < 0)
+			return ret;
+	}
+
+	*avg_r = (now_ns() - start) / nr_loops;
+
+	return 0;
+}
+
+static int run_select_bench(void)
+{
+	int n, nr_mqs = 0, nfds, ret = 0;
+	struct rlimit rlim;
+	struct mq_attr qa;
+	long long avg;
+	char name[32];
+	mqd_t *mqs;
+
+	mqs = malloc(FD_SETSIZE * sizeof(mqd_t));
+	if (mqs == NULL)
+		return -ENOMEM;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 && rlim.rlim_cur < FD_SETSIZE) {
+		rlim.rlim_cur = rlim.rlim_max < FD_SETSIZE ?
+			rlim.rlim_max : FD_SETSIZE;
+		setrlimit(RLIMIT_NOFILE, &rlim);
+	}
+
+	qa.mq_maxmsg = 1;
+	qa.mq_msgsize = 1;
+
+	/* Fill the descriptor table with queues, up to FD_SETSIZE. */
+	for (n = 0; n < FD_SETSIZE; n++) {
+		snprintf(name, sizeof(name), "/select_bench_mq%d", n);
+		mq_unlink(name);
+		mqs[nr_mqs] = mq_open(name, O_RDWR | O_CREAT | O_NONBLOCK, 0600, &qa);
+		if (mqs[nr_mqs] < 0)
+			break;
+		mq_unlink(name);
+		if (mqs[nr_mqs] >= FD_SETSIZE) {
+			mq_close(mqs[nr_mqs]);
+			break;
+		}
+		nr_mqs++;
+	}
+
+	if (nr_mqs == 0) {
+		smokey_warning("cannot create any message queue for benchmarking");
+		goto out;
+	}
+
+	for (nfds = 8; nfds <= FD_SETSIZE; nfds *= 2) {
+		if (mqs[0] >= nfds)
+			continue;
+		if (mqs[nr_mqs - 1] < nfds / 2) {
+			smokey_note("posix_select: ran out of descriptors at nfds=%d", nfds);
+			break;
+		}
+		ret = measure_select(mqs, nr_mqs, nfds, &avg);
+		if (ret)
+			break;
+		smokey_trace("select() with nfds=%-4d: %lld ns", nfds, avg);
+	}
+
+	for (n = 0; n < nr_mqs; n++)
+		mq_close(mqs[n]);
+out:
+	free(mqs);
+
+	return ret;
+}
+
 static int run_posix_select(struct smokey_test *t, int argc, char *const argv[])
 {
 	struct mq_attr qa;
@@ -109,6 +236,11 @@ static int run_posix_select(struct smokey_test *t, int argc, char *const argv[])
 	int i, j, ret;
 	mqd_t mq;
 
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(posix_select, loops))
+		nr_loops = SMOKEY_ARG_INT(posix_select, loops);
+
 	mq_unlink("/select_test_mq");
 	qa.mq_maxmsg = 128;
 	qa.mq_msgsize = 128;
@@ -140,6 +272,9 @@ static int run_posix_select(struct smokey_test *t, int argc, char *const argv[])
 	ret = test_status;
 out:
 	pthread_join(tcb, NULL);
-	
+
+	if (ret == 0)
+		ret = run_select_bench();
+
 	return ret;
 }
@@ -0,0 +1,158 @@
+/*
+ * Spawn and join thousands of short-lived threads logging through
+ * rt_printf(), checking that no output is lost while print buffers
+ * are recycled.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <cobalt/stdio.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(print_churn,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(threads),
+			   SMOKEY_INT(batch),
+		   ),
+		   "Check rt_printf() output of short-lived threads.\n"
+		   "\tthreads=<N>, number of threads to spawn (2000)\n"
+		   "\tbatch=<N>, threads alive at once (32)"
+);
+
+#define TAG  "print-churn"
+
+static FILE *out;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *logger_body(void *arg)
+{
+	rt_fprintf(out, TAG " %ld\n", (long)arg);
+
+	return NULL;
+}
+
+static int check_output(int nr_threads)
+{
+	char line[64], *seen;
+	int n, lines = 0, ret = 0;
+	long id;
+
+	seen = calloc(nr_threads, 1);
+	if (seen == NULL)
+		return -ENOMEM;
+
+	fflush(out);
+	rewind(out);
+
+	while (fgets(line, sizeof(line), out)) {
+		if (sscanf(line, TAG " %ld", &id) != 1)
+			continue;
+		if (!smokey_assert(id >= 0 && id < nr_threads && !seen[id])) {
+			ret = -EINVAL;
+			goto out;
+		}
+		seen[id] = 1;
+		lines++;
+	}
+
+	if (lines != nr_threads) {
+		for (n = 0; n < nr_threads; n++) {
+			if (!seen[n]) {
+				smokey_warning("output of thread #%d lost", n);
+				break;
+			}
+		}
+		ret = -EINVAL;
+	}
+out:
+	free(seen);
+
+	return ret;
+}
+
+static int run_print_churn(struct smokey_test *t, int argc, char *const argv[])
+{
+	int nr_threads = 2000, batch = 32, n, k, ret = 0;
+	struct sched_param param;
+	pthread_attr_t tattr;
+	long long start;
+	pthread_t *tids;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(*t, threads))
+		nr_threads = SMOKEY_ARG_INT(*t, threads);
+
+	if (SMOKEY_ARG_ISSET(*t, batch))
+		batch = SMOKEY_ARG_INT(*t, batch);
+
+	if (nr_threads <= 0 || batch <= 0) {
+		smokey_warning("threads and batch must be positive");
+		return -EINVAL;
+	}
+
+	tids = malloc(batch * sizeof(*tids));
+	if (tids == NULL)
+		return -ENOMEM;
+
+	out = tmpfile();
+	if (out == NULL) {
+		ret = -errno;
+		goto out_free;
+	}
+
+	pthread_attr_init(&tattr);
+	pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&tattr, SCHED_FIFO);
+	param.sched_priority = 1;
+	pthread_attr_setschedparam(&tattr, &param);
+
+	start = now_ns();
+
+	for (n = 0; n < nr_threads && ret == 0; n += k) {
+		for (k = 0; k < batch && n + k < nr_threads; k++) {
+			ret = smokey_check_status(
+				pthread_create(&tids[k], &tattr, logger_body,
+					       (void *)(long)(n + k)));
+			if (ret)
+				break;
+		}
+		while (--k >= 0)
+			pthread_join(tids[k], NULL);
+		k = batch;
+		/*
+		 * Compete with the printer for draining, we don't
+		 * want output lost because buffers filled up.
+		 */
+		rt_print_flush_buffers();
+	}
+
+	pthread_attr_destroy(&tattr);
+
+	if (ret)
+		goto out_close;
+
+	smokey_trace("%d logging threads spawned and joined in %lld us",
+		     nr_threads, (now_ns() - start) / 1000);
+
+	ret = check_output(nr_threads);
+out_close:
+	fclose(out);
+out_free:
+	free(tids);
+
+	return ret;
+}
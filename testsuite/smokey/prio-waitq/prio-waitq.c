@@ -0,0 +1,254 @@
+/*
+ * Stress test for long priority-ordered wait queues.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <errno.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(prio_waitq,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(waiters),
+			   SMOKEY_INT(rounds),
+		   ),
+		   "Check ordering and latency impact of long wait queues.\n"
+		   "\twaiters=<N>, number of threads pending on the queue (200)\n"
+		   "\trounds=<N>, number of times the queue is filled (10)"
+);
+
+#define MAX_WAITERS	1000
+#define SAMPLE_PERIOD	100000	/* ns */
+
+struct waiter {
+	pthread_t tid;
+	int prio;
+	int rank;
+};
+
+static struct waiter *waiters;
+
+static int nr_waiters = 200, nr_rounds = 10;
+
+static sem_t sem;
+
+static int wakeups;
+
+static volatile int sampling;
+
+static long long max_lateness;
+
+static void *waiter_body(void *arg)
+{
+	struct waiter *w = arg;
+
+	if (!smokey_assert(sem_wait(&sem) == 0))
+		return (void *)(long)-errno;
+
+	/* We run on the same CPU as everyone else, no race. */
+	w->rank = wakeups++;
+
+	return NULL;
+}
+
+static long long diff_ns(const struct timespec *t1, const struct timespec *t0)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000LL +
+		t1->tv_nsec - t0->tv_nsec;
+}
+
+/*
+ * We have no direct access to the time spent with interrupts off in
+ * the core, but a top priority thread sharing the CPU with the
+ * waiters sees it as timer latency, which is what users care about.
+ */
+static void *sampler_body(void *arg)
+{
+	struct timespec next, now;
+	long long lateness;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (sampling) {
+		next.tv_nsec += SAMPLE_PERIOD;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		lateness = diff_ns(&now, &next);
+		if (lateness > max_lateness)
+			max_lateness = lateness;
+	}
+
+	return NULL;
+}
+
+static int create_thread(pthread_t *tid, int prio,
+			 void *(*body)(void *), void *arg)
+{
+	struct sched_param param = { .sched_priority = prio };
+	pthread_attr_t attr;
+	int ret;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &param);
+	pthread_attr_setstacksize(&attr, PTHREAD_STACK_MIN * 4);
+	ret = pthread_create(tid, &attr, body, arg);
+	pthread_attr_destroy(&attr);
+
+	return ret;
+}
+
+static int run_round(void)
+{
+	struct waiter *w;
+	int n, ret, expected;
+	void *status;
+
+	wakeups = 0;
+
+	/*
+	 * Each waiter preempts us and blocks before we create the next
+	 * one. Priorities are ascending so that every new waiter has to
+	 * be queued ahead of all others, the worst case for a linear
+	 * insertion. Several waiters share each priority level so that
+	 * FIFO ordering within a level is checked as well.
+	 */
+	for (n = 0; n < nr_waiters; n++) {
+		w = waiters + n;
+		w->prio = 2 + n * 96 / nr_waiters;
+		w->rank = -1;
+		ret = smokey_check_status(create_thread(&w->tid, w->prio,
+							waiter_body, w));
+		if (ret)
+			return ret;
+	}
+
+	/* Each post switches to the leading waiter. */
+	for (n = 0; n < nr_waiters; n++) {
+		ret = smokey_check_errno(sem_post(&sem));
+		if (ret)
+			return ret;
+	}
+
+	for (n = 0; n < nr_waiters; n++) {
+		ret = smokey_check_status(pthread_join(waiters[n].tid, &status));
+		if (ret)
+			return ret;
+		if (status)
+			return (int)(long)status;
+	}
+
+	/*
+	 * Highest priority first, then arrival order within a
+	 * level. Waiters were created by ascending priority, so the
+	 * expected rank of each one is the number of waiters in higher
+	 * levels plus the number of waiters which arrived before it
+	 * in the same level.
+	 */
+	for (n = 0; n < nr_waiters; n++) {
+		w = waiters + n;
+		expected = 0;
+		for (ret = 0; ret < nr_waiters; ret++)
+			if (waiters[ret].prio > w->prio ||
+			    (waiters[ret].prio == w->prio && ret < n))
+				expected++;
+		if (!smokey_assert(w->rank == expected)) {
+			smokey_warning("waiter #%d (prio %d) woken up as #%d, "
+				       "expected #%d", n, w->prio, w->rank,
+				       expected);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static int run_prio_waitq(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct sched_param param;
+	cpu_set_t affinity, saved_affinity;
+	pthread_t sampler;
+	int ret, n;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(*t, waiters))
+		nr_waiters = SMOKEY_ARG_INT(*t, waiters);
+
+	if (SMOKEY_ARG_ISSET(*t, rounds))
+		nr_rounds = SMOKEY_ARG_INT(*t, rounds);
+
+	if (nr_waiters <= 0 || nr_waiters > MAX_WAITERS) {
+		smokey_warning("waiters must be within [1-%d]", MAX_WAITERS);
+		return -EINVAL;
+	}
+
+	waiters = calloc(nr_waiters, sizeof(*waiters));
+	if (waiters == NULL)
+		return -ENOMEM;
+
+	ret = smokey_check_errno(sched_getaffinity(0, sizeof(saved_affinity),
+						   &saved_affinity));
+	if (ret)
+		goto out_free;
+
+	/* Our threads inherit this affinity. */
+	CPU_ZERO(&affinity);
+	CPU_SET(0, &affinity);
+	ret = smokey_check_errno(sched_setaffinity(0, sizeof(affinity),
+						   &affinity));
+	if (ret)
+		goto out_free;
+
+	param.sched_priority = 1;
+	ret = smokey_check_status(pthread_setschedparam(pthread_self(),
+							SCHED_FIFO, &param));
+	if (ret)
+		goto out_free;
+
+	ret = smokey_check_errno(sem_init(&sem, 0, 0));
+	if (ret)
+		goto out_sched;
+
+	sampling = 1;
+	ret = smokey_check_status(create_thread(&sampler, 99,
+						sampler_body, NULL));
+	if (ret)
+		goto out_sem;
+
+	for (n = 0; n < nr_rounds; n++) {
+		ret = run_round();
+		if (ret)
+			break;
+	}
+
+	sampling = 0;
+	pthread_join(sampler, NULL);
+
+	if (ret == 0)
+		smokey_trace("%d rounds of %d waiters, max timer lateness %Ld us",
+			     nr_rounds, nr_waiters, max_lateness / 1000);
+out_sem:
+	sem_destroy(&sem);
+out_sched:
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+	sched_setaffinity(0, sizeof(saved_affinity), &saved_affinity);
+out_free:
+	free(waiters);
+
+	return ret;
+}
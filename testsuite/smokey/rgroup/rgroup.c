@@ -0,0 +1,220 @@
+/*
+ * Check periodic threads released by a shared group timer, and
+ * report how many timer shots were needed for the releases.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <cobalt/sys/cobalt.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(rgroup,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(base),
+			   SMOKEY_INT(ticks),
+		   ),
+		   "Check periodic threads sharing a release group timer.\n"
+		   "\tbase=<us>, base period of the group (1000)\n"
+		   "\tticks=<N>, number of base periods to run for (400)"
+);
+
+/* A harmonic task set, with several threads due at the same time. */
+static const int multipliers[] = { 1, 1, 2, 2, 4, 4 };
+
+#define NR_THREADS  (sizeof(multipliers) / sizeof(multipliers[0]))
+
+static long long base_ns = 1000000;
+
+static int nr_ticks = 400;
+
+struct member {
+	pthread_t tid;
+	int mult;
+	long long idate;
+	unsigned long overruns;
+	struct cobalt_period_info info;
+	int ret;
+};
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *member_body(void *arg)
+{
+	struct cobalt_period_config config;
+	struct member *m = arg;
+	unsigned long overruns;
+	int n, ret;
+
+	memset(&config, 0, sizeof(config));
+	config.idate = m->idate;
+	config.period = base_ns * m->mult;
+	config.base = base_ns;
+	config.clock = CLOCK_MONOTONIC;
+	ret = cobalt_thread_setperiodic(0, &config);
+	if (ret)
+		goto out;
+
+	for (n = 0; n < nr_ticks / m->mult; n++) {
+		ret = cobalt_thread_waitperiod(&overruns);
+		if (ret == -ETIMEDOUT) {
+			m->overruns += overruns;
+			continue;
+		}
+		if (ret)
+			goto stop;
+	}
+
+	ret = cobalt_thread_getperiodic(0, &m->info);
+stop:
+	memset(&config, 0, sizeof(config));
+	cobalt_thread_setperiodic(0, &config);
+out:
+	m->ret = ret;
+
+	return NULL;
+}
+
+static int check_errors(void)
+{
+	struct cobalt_period_config config;
+	unsigned long overruns;
+
+	if (!smokey_assert(cobalt_thread_waitperiod(&overruns) == -EWOULDBLOCK))
+		return -EINVAL;
+
+	memset(&config, 0, sizeof(config));
+	config.period = base_ns * 3 / 2;
+	config.base = base_ns;
+	config.clock = CLOCK_MONOTONIC;
+	if (!smokey_assert(cobalt_thread_setperiodic(0, &config) == -EINVAL))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int run_rgroup(struct smokey_test *t, int argc, char *const argv[])
+{
+	unsigned long long expiries = 0, releases = 0, expected = 0;
+	struct member members[NR_THREADS];
+	struct sched_param param;
+	unsigned long overruns = 0;
+	pthread_attr_t tattr;
+	long long idate;
+	int n, ret = 0;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(*t, base))
+		base_ns = SMOKEY_ARG_INT(*t, base) * 1000LL;
+
+	if (SMOKEY_ARG_ISSET(*t, ticks))
+		nr_ticks = SMOKEY_ARG_INT(*t, ticks);
+
+	if (base_ns <= 0 || nr_ticks < 4) {
+		smokey_warning("base must be positive, ticks at least 4");
+		return -EINVAL;
+	}
+
+	param.sched_priority = 1;
+	ret = smokey_check_status(pthread_setschedparam(pthread_self(),
+							SCHED_FIFO, &param));
+	if (ret)
+		return ret;
+
+	ret = check_errors();
+	if (ret)
+		goto out;
+
+	/* Start all members on the same release point. */
+	idate = now_ns() + 20000000;
+	memset(members, 0, sizeof(members));
+
+	pthread_attr_init(&tattr);
+	pthread_attr_setinheritsched(&tattr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&tattr, SCHED_FIFO);
+
+	for (n = 0; n < NR_THREADS; n++) {
+		members[n].mult = multipliers[n];
+		members[n].idate = idate;
+		/* Shorter periods get higher priorities. */
+		param.sched_priority = 20 - multipliers[n];
+		pthread_attr_setschedparam(&tattr, &param);
+		ret = smokey_check_status(pthread_create(&members[n].tid,
+							 &tattr, member_body,
+							 &members[n]));
+		if (ret)
+			break;
+	}
+
+	pthread_attr_destroy(&tattr);
+
+	while (--n >= 0)
+		pthread_join(members[n].tid, NULL);
+
+	if (ret)
+		goto out;
+
+	for (n = 0; n < NR_THREADS; n++) {
+		if (members[n].ret) {
+			ret = members[n].ret;
+			smokey_warning("member #%d failed: %s",
+				       n, strerror(-ret));
+			goto out;
+		}
+		overruns += members[n].overruns;
+		expected += nr_ticks / members[n].mult;
+		/* Counters grow monotonically, keep the latest sample. */
+		if (members[n].info.expiries > expiries) {
+			expiries = members[n].info.expiries;
+			releases = members[n].info.releases;
+		}
+		if (!smokey_assert(members[n].info.base == base_ns &&
+				   members[n].info.period ==
+				   base_ns * members[n].mult)) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	smokey_trace("%llu timer shots for %llu releases (%llu expected), "
+		     "%lu overruns",
+		     expiries, releases, expected, overruns);
+	for (n = 0; n < NR_THREADS; n++) {
+		if (members[n].info.expiries == expiries) {
+			smokey_trace("release lateness: min %lld, avg %lld, "
+				     "max %lld ns",
+				     (long long)members[n].info.jitter_min,
+				     (long long)members[n].info.jitter_avg,
+				     (long long)members[n].info.jitter_max);
+			break;
+		}
+	}
+
+	if (overruns)
+		smokey_warning("%lu periods missed, system too loaded?",
+			       overruns);
+
+	/*
+	 * Each shot releases every member due at this point, so we
+	 * must have needed fewer shots than releases.
+	 */
+	if (!smokey_assert(expiries > 0 && releases > expiries))
+		ret = -EINVAL;
+out:
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+	return ret;
+}
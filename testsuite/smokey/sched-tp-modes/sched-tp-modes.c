@@ -0,0 +1,431 @@
+/*
+ * SCHED_TP schedule switching test.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <errno.h>
+#include <sys/cobalt.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(sched_tp_modes,
+		   SMOKEY_NOARGS,
+		   "Check SCHED_TP mode changes between preloaded schedules"
+);
+
+#define MS		1000000LL
+/* A thread not running for that long was out of its window. */
+#define GAP_NS		(1 * MS)
+#define MAX_JITTER	200000LL
+#define MAX_EARLY	50000LL
+#define MAX_RUNS	1024
+#define NR_PARTS	2
+#define NR_WINDOWS	3
+
+/*
+ * Both partitions are busy all the time, so that each of them runs
+ * from the beginning to the end of every window it is given. Mode
+ * A is loaded into slot #0, mode B into slot #1; the test switches
+ * from A to B then back to A while the time frame is running.
+ */
+static const struct mode {
+	long long frame;
+	struct {
+		long long offset;
+		long long duration;
+		int ptid;
+	} windows[NR_WINDOWS];
+} modes[] = {
+	{
+		.frame = 40 * MS,
+		.windows = {
+			{ 0, 10 * MS, 0 },
+			{ 10 * MS, 10 * MS, 1 },
+			{ 20 * MS, 20 * MS, -1 },
+		},
+	},
+	{
+		.frame = 60 * MS,
+		.windows = {
+			{ 0, 20 * MS, 1 },
+			{ 20 * MS, 5 * MS, 0 },
+			{ 25 * MS, 35 * MS, -1 },
+		},
+	},
+};
+
+static struct {
+	long long start;
+	long long end;
+} runs[NR_PARTS][MAX_RUNS];
+
+static int nr_runs[NR_PARTS];
+
+static volatile int stop;
+
+static sem_t barrier;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *spinner(void *arg)
+{
+	int part = (int)(long)arg, n = 0;
+	struct sched_param_ex param;
+	long long now, last;
+	cpu_set_t affinity;
+	int ret;
+
+	CPU_ZERO(&affinity);
+	CPU_SET(0, &affinity);
+	ret = sched_setaffinity(0, sizeof(affinity), &affinity);
+	if (ret)
+		return (void *)(long)-errno;
+
+	param.sched_priority = 50;
+	param.sched_tp_partition = part;
+	ret = pthread_setschedparam_ex(pthread_self(), SCHED_TP, &param);
+	if (ret)
+		return (void *)(long)-ret;
+
+	sem_wait(&barrier);
+	sem_post(&barrier);
+
+	last = now_ns();
+	runs[part][0].start = last;
+
+	while (!stop) {
+		now = now_ns();
+		if (now - last > GAP_NS) {
+			runs[part][n].end = last;
+			if (++n >= MAX_RUNS)
+				break;
+			runs[part][n].start = now;
+		}
+		last = now;
+	}
+
+	if (n < MAX_RUNS)
+		runs[part][n++].end = last;
+
+	nr_runs[part] = n;
+
+	return NULL;
+}
+
+static int set_schedule(int op, int slot, const struct mode *m)
+{
+	union sched_config *p;
+	size_t len;
+	int ret, n;
+
+	len = sched_tp_confsz(NR_WINDOWS);
+	p = malloc(len);
+	if (p == NULL)
+		return -ENOMEM;
+
+	memset(p, 0, len);
+	p->tp.op = op;
+	p->tp.slot = slot;
+	if (m) {
+		p->tp.nr_windows = NR_WINDOWS;
+		for (n = 0; n < NR_WINDOWS; n++) {
+			p->tp.windows[n].offset.tv_sec = 0;
+			p->tp.windows[n].offset.tv_nsec = m->windows[n].offset;
+			p->tp.windows[n].duration.tv_sec = 0;
+			p->tp.windows[n].duration.tv_nsec = m->windows[n].duration;
+			p->tp.windows[n].ptid = m->windows[n].ptid;
+		}
+	}
+
+	ret = -sched_setconfig_np(0, SCHED_TP, p, len);
+	free(p);
+
+	return ret;
+}
+
+static int get_active_slot(void)
+{
+	union sched_config *p;
+	size_t len;
+	int ret;
+
+	len = sched_tp_confsz(NR_WINDOWS);
+	p = malloc(len);
+	if (p == NULL)
+		return -ENOMEM;
+
+	ret = -sched_getconfig_np(0, SCHED_TP, p, &len);
+	if (ret == 0)
+		ret = p->tp.slot;
+
+	free(p);
+
+	return ret;
+}
+
+/*
+ * Match the runs of a partition against the windows it should have
+ * been given, from the start of the time frame at @origin, the
+ * schedule changing at the first time frame boundary following each
+ * switch request.
+ */
+static int check_partition(int part, long long origin,
+			   const long long *switches, int nr_switches,
+			   long long from, long long to, long long slop,
+			   long long *max_jitter)
+{
+	long long t, start, end, jitter;
+	int mode = 0, next = 0, n = 0, w;
+	const struct mode *m;
+
+	for (t = origin; t < to; t += m->frame) {
+		while (next < nr_switches && switches[next] < t) {
+			mode = !mode;
+			next++;
+		}
+		m = &modes[mode];
+		for (w = 0; w < NR_WINDOWS; w++) {
+			if (m->windows[w].ptid != part)
+				continue;
+			start = t + m->windows[w].offset;
+			end = start + m->windows[w].duration;
+			if (start < from || start >= to)
+				continue;
+			while (n < nr_runs[part] &&
+			       runs[part][n].start < start - MAX_EARLY) {
+				if (runs[part][n].start >= from) {
+					smokey_warning("partition #%d ran out of its windows "
+						       "at %lld us", part,
+						       (runs[part][n].start - origin) / 1000);
+					return -EPROTO;
+				}
+				n++;
+			}
+			if (n == nr_runs[part]) {
+				smokey_warning("partition #%d missed its window at %lld us",
+					       part, (start - origin) / 1000);
+				return -EPROTO;
+			}
+			jitter = runs[part][n].start - start;
+			if (jitter > MAX_JITTER + slop) {
+				smokey_warning("partition #%d started %lld us late "
+					       "in its window at %lld us", part,
+					       jitter / 1000, (start - origin) / 1000);
+				return -EPROTO;
+			}
+			if (runs[part][n].end < end - MAX_JITTER - slop ||
+			    runs[part][n].end > end + MAX_JITTER + slop) {
+				smokey_warning("partition #%d window at %lld us "
+					       "ended at %lld us", part,
+					       (start - origin) / 1000,
+					       (runs[part][n].end - origin) / 1000);
+				return -EPROTO;
+			}
+			if (jitter > *max_jitter)
+				*max_jitter = jitter;
+			n++;
+		}
+	}
+
+	if (n < nr_runs[part] && runs[part][n].start < to) {
+		smokey_warning("partition #%d ran out of its windows at %lld us",
+			       part, (runs[part][n].start - origin) / 1000);
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+/*
+ * Dump the per-window counters, all windows assigned to our busy
+ * partitions must have overrun.
+ */
+static int check_counters(void)
+{
+	unsigned long count, overruns;
+	unsigned long long dummy;
+	int cpu, slot, win, ptid;
+	char buf[256], state;
+	FILE *fp;
+
+	fp = fopen("/proc/xenomai/sched/tp/windows", "r");
+	if (fp == NULL)
+		return 0;
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		smokey_trace("%s", buf);
+		if (sscanf(buf, "%d %d%c %d %d %llu %llu %lu %lu",
+			   &cpu, &slot, &state, &win, &ptid,
+			   &dummy, &dummy, &count, &overruns) != 9)
+			continue;
+		if (cpu != 0 || ptid < 0)
+			continue;
+		if (!smokey_assert(count > 0 && overruns > 0)) {
+			fclose(fp);
+			return -EPROTO;
+		}
+		if (slot == 0 && !smokey_assert(state == '*')) {
+			fclose(fp);
+			return -EPROTO;
+		}
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+static int run_sched_tp_modes(struct smokey_test *t,
+			       int argc, char *const argv[])
+{
+	long long origin = 0, slop = 0, t0, t1, switches[2] = { 0, 0 };
+	long long max_jitter = 0;
+	pthread_t threads[NR_PARTS];
+	struct sched_param param;
+	int ret, n, policies;
+	void *status;
+
+	ret = cobalt_corectl(_CC_COBALT_GET_POLICIES, &policies, sizeof(policies));
+	if (ret || (policies & _CC_COBALT_SCHED_TP) == 0)
+		return -ENOSYS;
+
+	if (!__T(ret, set_schedule(sched_tp_install, 0, &modes[0])))
+		return ret;
+
+	/* Slot #1 is empty yet, there is nothing to switch to. */
+	ret = set_schedule(sched_tp_switch, 1, NULL);
+	if (ret == -EINVAL) {
+		smokey_note("sched_tp_switch: not enough schedule slots");
+		set_schedule(sched_tp_uninstall, 0, NULL);
+		return -ENOSYS;
+	}
+	if (!smokey_assert(ret == -ESRCH))
+		goto fail;
+
+	if (!__T(ret, set_schedule(sched_tp_load, 1, &modes[1])))
+		goto fail;
+
+	/* The active schedule cannot be replaced behind our back. */
+	if (!smokey_assert(set_schedule(sched_tp_load, 0, &modes[1]) == -EBUSY) ||
+	    !smokey_assert(get_active_slot() == 0)) {
+		ret = -EPROTO;
+		goto fail;
+	}
+
+	/*
+	 * Make sure to issue the switch requests without being
+	 * delayed by the partitions, so that we know which time
+	 * frame they apply to.
+	 */
+	param.sched_priority = 10;
+	if (!__T(ret, pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)))
+		goto fail;
+
+	stop = 0;
+	sem_init(&barrier, 0, 0);
+	for (n = 0; n < NR_PARTS; n++) {
+		ret = -pthread_create(&threads[n], NULL, spinner, (void *)(long)n);
+		if (ret)
+			break;
+	}
+
+	if (ret == 0) {
+		/* Give the spinners time to join their partition. */
+		usleep(100000);
+		t0 = now_ns();
+		ret = set_schedule(sched_tp_start, 0, NULL);
+		t1 = now_ns();
+		origin = t0;
+		slop = t1 - t0;
+	}
+
+	sem_post(&barrier);
+
+	if (ret == 0) {
+		usleep(1000000);
+		t0 = now_ns();
+		ret = set_schedule(sched_tp_switch, 1, NULL);
+		t1 = now_ns();
+		switches[0] = t0 + (t1 - t0) / 2;
+	}
+
+	if (ret == 0) {
+		usleep(1000000);
+		t0 = now_ns();
+		ret = set_schedule(sched_tp_switch, 0, NULL);
+		t1 = now_ns();
+		switches[1] = t0 + (t1 - t0) / 2;
+		usleep(1000000);
+	}
+
+	t0 = now_ns();
+	stop = 1;
+	/*
+	 * If the time frame is not running, moving the spinners to
+	 * the RT class is the only way to let them see the stop flag.
+	 */
+	if (ret)
+		set_schedule(sched_tp_uninstall, 0, NULL);
+
+	while (--n >= 0) {
+		pthread_join(threads[n], &status);
+		if (ret == 0)
+			ret = (int)(long)status;
+	}
+
+	sem_destroy(&barrier);
+	set_schedule(sched_tp_stop, 0, NULL);
+
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+	if (ret) {
+		smokey_warning("schedule setup failed: %s", symerror(ret));
+		goto fail;
+	}
+
+	if (smokey_on_vm)
+		goto out;
+
+	/*
+	 * Skip the first time frames which may be disturbed by the
+	 * spinners starting, and the last ones which may be cut by
+	 * the spinners stopping.
+	 */
+	for (n = 0; n < NR_PARTS; n++) {
+		smokey_trace("partition #%d: %d runs", n, nr_runs[n]);
+		ret = check_partition(n, origin, switches, 2,
+				      origin + 2 * modes[1].frame,
+				      t0 - modes[1].frame, slop, &max_jitter);
+		if (ret)
+			goto fail;
+	}
+
+	smokey_trace("worst window start jitter: %lld us", max_jitter / 1000);
+
+	ret = check_counters();
+	if (ret)
+		goto fail;
+out:
+	set_schedule(sched_tp_uninstall, 0, NULL);
+
+	return 0;
+fail:
+	set_schedule(sched_tp_uninstall, 0, NULL);
+
+	return ret ?: -EPROTO;
+}
@@ -0,0 +1,171 @@
+/*
+ * Measure the cost of indexing and looking up Cobalt threads while
+ * the thread count grows.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(thread_index,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(threads),
+			   SMOKEY_INT(loops),
+		   ),
+		   "Check thread lookups with many threads alive, and report\n"
+		   "\tthe cost of thread creation and lookup as the count grows.\n"
+		   "\tthreads=<N>, number of threads to create (4000)\n"
+		   "\tloops=<N>, number of lookups per measurement (10000)"
+);
+
+#define BATCH	100
+
+static int nr_threads = 4000, nr_loops = 10000;
+
+static pthread_t *tids;
+
+static sem_t release;
+
+static void *thread_body(void *arg)
+{
+	sem_wait(&release);
+
+	return NULL;
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Average cost of a lookup by pthread_t, over the given threads. */
+static int measure_lookup(int nr, long long *avg_r)
+{
+	struct sched_param param;
+	int n, ret, policy;
+	long long start;
+
+	start = now_ns();
+
+	for (n = 0; n < nr_loops; n++) {
+		ret = pthread_getschedparam(tids[(n * 7919) % nr],
+					    &policy, &param);
+		if (ret)
+			return -ret;
+	}
+
+	*avg_r = (now_ns() - start) / nr_loops;
+
+	return 0;
+}
+
+static int run_thread_index(struct smokey_test *t, int argc, char *const argv[])
+{
+	long long start, t_create, first_create = 0, last_create = 0,
+		few_lookup = 0, many_lookup;
+	struct sched_param param;
+	int n, ret, nr, policy;
+	pthread_attr_t attr;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(*t, threads))
+		nr_threads = SMOKEY_ARG_INT(*t, threads);
+
+	if (SMOKEY_ARG_ISSET(*t, loops))
+		nr_loops = SMOKEY_ARG_INT(*t, loops);
+
+	if (nr_threads < 2 * BATCH || nr_loops < 1) {
+		smokey_warning("threads must be at least %d, loops positive",
+			       2 * BATCH);
+		return -EINVAL;
+	}
+
+	tids = malloc(nr_threads * sizeof(pthread_t));
+	if (tids == NULL)
+		return -ENOMEM;
+
+	ret = smokey_check_errno(sem_init(&release, 0, 0));
+	if (ret)
+		goto out;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = 1;
+	pthread_attr_setschedparam(&attr, &param);
+	pthread_attr_setstacksize(&attr, PTHREAD_STACK_MIN * 4);
+
+	/*
+	 * The core heap may not hold as many threads as requested;
+	 * measure with what we could get then.
+	 */
+	for (nr = 0, t_create = 0; nr < nr_threads; nr++) {
+		start = now_ns();
+		ret = pthread_create(tids + nr, &attr, thread_body, NULL);
+		if (ret) {
+			smokey_warning("could only create %d threads (%s)",
+				       nr, strerror(ret));
+			break;
+		}
+		t_create += now_ns() - start;
+		if (nr == BATCH - 1) {
+			first_create = t_create / BATCH;
+			ret = measure_lookup(nr + 1, &few_lookup);
+			if (ret)
+				goto release;
+		}
+		if (nr % BATCH == BATCH - 1) {
+			last_create = t_create / BATCH;
+			t_create = 0;
+		}
+	}
+
+	pthread_attr_destroy(&attr);
+
+	ret = nr < 2 * BATCH ? -ENOMEM : 0;
+	if (ret)
+		goto release;
+
+	/* Every thread must still be found after the index grew. */
+	for (n = 0; n < nr; n++) {
+		ret = pthread_getschedparam(tids[n], &policy, &param);
+		if (!smokey_assert(ret == 0 && policy == SCHED_FIFO &&
+				   param.sched_priority == 1)) {
+			ret = -EINVAL;
+			goto release;
+		}
+	}
+
+	ret = measure_lookup(nr, &many_lookup);
+	if (ret)
+		goto release;
+
+	smokey_trace("create: %lld ns with %d threads, %lld ns with %d threads",
+		     first_create, BATCH, last_create, nr);
+	smokey_trace("lookup: %lld ns with %d threads, %lld ns with %d threads",
+		     few_lookup, BATCH, many_lookup, nr);
+release:
+	for (n = 0; n < nr; n++)
+		sem_post(&release);
+
+	for (n = 0; n < nr; n++)
+		pthread_join(tids[n], NULL);
+
+	sem_destroy(&release);
+out:
+	free(tids);
+
+	return ret;
+}
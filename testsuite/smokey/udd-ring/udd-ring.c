@@ -0,0 +1,195 @@
+/*
+ * Check the UDD event ring, both mapped and drained by read(2),
+ * including overflow accounting. Requires the uddtest driver.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <smokey/smokey.h>
+#include <rtdm/udd.h>
+#include <rtdm/testing.h>
+
+smokey_test_plugin(udd_ring,
+		   SMOKEY_NOARGS,
+		   "Check the UDD event ring."
+);
+
+#define UDDTEST_DEVICE	"/dev/rtdm/uddtest"
+#define UDDTEST_RING	"/dev/rtdm/uddtest,mapper5"
+
+/* Must match the uddtest driver. */
+#define NR_EVENTS	64
+
+static struct udd_event events[NR_EVENTS];
+
+static const volatile struct udd_event_ring *ring;
+
+static int fire(int fd, unsigned int count, __u32 head)
+{
+	struct rttst_udd_burst burst;
+	struct timespec ts;
+	int ret, n;
+
+	burst.count = count;
+	burst.period_ns = 20000;
+	if (!__Terrno(ret, ioctl(fd, RTTST_RTIOC_UDD_BURST, &burst)))
+		return ret;
+
+	/* Wait for the whole burst to be posted, up to a second. */
+	ts.tv_sec = 0;
+	ts.tv_nsec = 1000000;
+	for (n = 0; n < 1000; n++) {
+		if (ring->head == head + count)
+			return 0;
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+	}
+
+	smokey_warning("burst incomplete, head=%u, expected %u",
+		       ring->head, head + count);
+
+	return -ETIMEDOUT;
+}
+
+static int drain(int fd, __u32 first, int expected)
+{
+	ssize_t ret;
+	int n;
+
+	ret = read(fd, events, sizeof(events));
+	if (ret < 0) {
+		ret = -errno;
+		smokey_warning("read(): %s", symerror(ret));
+		return ret;
+	}
+
+	if (!smokey_assert(ret == expected * sizeof(events[0])))
+		return -EINVAL;
+
+	for (n = 0; n < expected; n++) {
+		if (!smokey_assert(events[n].seq == first + n))
+			return -EINVAL;
+		if (n == 0)
+			continue;
+		if (!smokey_assert(events[n].status == events[n - 1].status + 1))
+			return -EINVAL;
+		if (!smokey_assert(events[n].timestamp >= events[n - 1].timestamp))
+			return -EINVAL;
+	}
+
+	/* The mapped ring must agree with what read(2) returned. */
+	n = expected - 1;
+	if (!smokey_assert(ring->entries[events[n].seq & ring->mask].seq ==
+			   events[n].seq &&
+			   ring->entries[events[n].seq & ring->mask].status ==
+			   events[n].status))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int run_udd_ring(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct udd_event_stat stat;
+	struct sched_param param;
+	int fd, mfd, ret;
+	size_t map_len;
+	__u32 head, lost;
+	void *p;
+
+	fd = open(UDDTEST_DEVICE, O_RDWR);
+	if (fd < 0) {
+		ret = -errno;
+		if (ret == -ENOENT) {
+			smokey_note("uddtest driver not loaded");
+			return -ENOSYS;
+		}
+		smokey_warning("cannot open %s [%s]",
+			       UDDTEST_DEVICE, symerror(ret));
+		return ret;
+	}
+
+	mfd = open(UDDTEST_RING, O_RDONLY);
+	if (mfd < 0) {
+		ret = -errno;
+		smokey_warning("cannot open %s [%s]",
+			       UDDTEST_RING, symerror(ret));
+		goto out;
+	}
+
+	map_len = sizeof(*ring) + NR_EVENTS * sizeof(struct udd_event);
+	map_len = (map_len + getpagesize() - 1) & ~(getpagesize() - 1);
+
+	p = mmap(NULL, map_len, PROT_READ, MAP_SHARED, mfd, 0);
+	if (!__Fassert(p == MAP_FAILED)) {
+		ret = -EINVAL;
+		goto close_map;
+	}
+
+	ring = p;
+	if (!smokey_assert(ring->mask == NR_EVENTS - 1)) {
+		ret = -EINVAL;
+		goto unmap;
+	}
+
+	param.sched_priority = 10;
+	if (!__T(ret, pthread_setschedparam(pthread_self(),
+					    SCHED_FIFO, &param)))
+		goto unmap;
+
+	/* Catch up with events left by previous runs. */
+	if (!__Terrno(ret, ioctl(fd, UDD_RTIOC_EVSTAT, &stat)))
+		goto relax;
+	if (stat.head != stat.seq && read(fd, events, sizeof(events)) < 0) {
+		ret = -errno;
+		goto relax;
+	}
+	if (!__Terrno(ret, ioctl(fd, UDD_RTIOC_EVSTAT, &stat)))
+		goto relax;
+	head = stat.head;
+
+	/* A burst fitting in the ring, nothing lost. */
+	ret = fire(fd, 40, head);
+	if (ret)
+		goto relax;
+	ret = drain(fd, head + 1, 40);
+	if (ret)
+		goto relax;
+	head += 40;
+
+	/* Overflow, only the latest events must be kept. */
+	ret = fire(fd, 200, head);
+	if (ret)
+		goto relax;
+	ret = drain(fd, head + 200 - NR_EVENTS + 1, NR_EVENTS);
+	if (ret)
+		goto relax;
+	head += 200;
+
+	lost = stat.lost;
+	if (!__Terrno(ret, ioctl(fd, UDD_RTIOC_EVSTAT, &stat)))
+		goto relax;
+	if (!smokey_assert(stat.seq == head && stat.head == head &&
+			   stat.lost - lost == 200 - NR_EVENTS))
+		ret = -EINVAL;
+relax:
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+unmap:
+	munmap(p, map_len);
+close_map:
+	close(mfd);
+out:
+	close(fd);
+
+	return ret;
+}
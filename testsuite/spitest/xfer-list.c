@@ -0,0 +1,320 @@
+/*
+ * Check and time SPI transfer lists, scanning a set of slaves in a
+ * single call.
+ *
+ * Released under the terms of GPLv2.
+ */
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <smokey/smokey.h>
+#include <linux/spi/spidev.h>
+#include <rtdm/spi.h>
+
+smokey_test_plugin(spi_xfer_list,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_STRING(device),
+			   SMOKEY_INT(segments),
+			   SMOKEY_INT(loops),
+		   ),
+   "Check and time SPI transfer lists.\n"
+   "\tdevice=<device-path>\n"
+   "\tsegments=<N>, segments per scan (12)\n"
+   "\tloops=<N>, number of scans to time (1000)"
+);
+
+/* Typical ADC sample: command byte, two data bytes. */
+#define SEG_LEN		3
+/* Long enough for the loopback master to use its DMA path. */
+#define DMA_LEN		128
+
+static unsigned char *i_area, *o_area;
+
+static size_t area_len, half_len;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void build_scan(struct rtdm_spi_segment *segs, int nr, int flags)
+{
+	int n;
+
+	memset(segs, 0, sizeof(*segs) * nr);
+	for (n = 0; n < nr; n++) {
+		segs[n].i_offset = n * SEG_LEN;
+		segs[n].o_offset = n * SEG_LEN;
+		segs[n].len = SEG_LEN;
+		segs[n].flags = flags;
+	}
+}
+
+static int run_list(int fd, struct rtdm_spi_segment *segs, int nr)
+{
+	struct rtdm_spi_xfer_list list;
+
+	list.segments = (unsigned long)segs;
+	list.nr_segments = nr;
+	list.__pad = 0;
+
+	return ioctl(fd, SPI_RTIOC_TRANSFER_LIST, &list) ? -errno : 0;
+}
+
+/*
+ * The loopback master returns the count of bytes exchanged since
+ * chip select was asserted, unless SPI_LOOP is set.
+ */
+static int check_counters(int fd, struct rtdm_spi_segment *segs, int nr)
+{
+	int n, k, ret;
+
+	/* Chip select toggled after each segment. */
+	build_scan(segs, nr, SPI_SEG_CS_CHANGE);
+	memset(i_area, 0xff, area_len);
+	if (!__T(ret, run_list(fd, segs, nr)))
+		return ret;
+
+	for (n = 0; n < nr; n++)
+		for (k = 0; k < SEG_LEN; k++)
+			if (!smokey_assert(i_area[n * SEG_LEN + k] == k))
+				return -EINVAL;
+
+	/* Chip select held across the whole scan. */
+	build_scan(segs, nr, 0);
+	memset(i_area, 0xff, area_len);
+	if (!__T(ret, run_list(fd, segs, nr)))
+		return ret;
+
+	for (n = 0; n < nr * SEG_LEN; n++)
+		if (!smokey_assert(i_area[n] == (unsigned char)n))
+			return -EINVAL;
+
+	/* Alternate slave0 and slave1, chip select changes each time. */
+	for (n = 0; n < nr; n++) {
+		segs[n].flags = SPI_SEG_SLAVE;
+		segs[n].chip_select = n & 1;
+	}
+	memset(i_area, 0xff, area_len);
+	ret = run_list(fd, segs, nr);
+	if (ret == -ENODEV) {
+		smokey_trace("no slave0/slave1 pair, skipping multi-slave check");
+		return 0;
+	}
+	if (ret) {
+		smokey_warning("multi-slave scan: %s", symerror(ret));
+		return ret;
+	}
+
+	for (n = 0; n < nr; n++)
+		for (k = 0; k < SEG_LEN; k++)
+			if (!smokey_assert(i_area[n * SEG_LEN + k] == k))
+				return -EINVAL;
+
+	return 0;
+}
+
+static int check_loop(int fd, struct rtdm_spi_config *config)
+{
+	struct rtdm_spi_segment seg;
+	int n, ret;
+
+	config->mode |= SPI_LOOP;
+	if (!__Terrno(ret, ioctl(fd, SPI_RTIOC_SET_CONFIG, config)))
+		return ret;
+
+	for (n = 0; n < DMA_LEN; n++)
+		o_area[n] = n ^ 0x5a;
+	memset(i_area, 0, DMA_LEN);
+
+	memset(&seg, 0, sizeof(seg));
+	seg.len = DMA_LEN;
+	if (!__T(ret, run_list(fd, &seg, 1)))
+		return ret;
+
+	if (!smokey_assert(memcmp(i_area, o_area, DMA_LEN) == 0))
+		return -EINVAL;
+
+	config->mode &= ~SPI_LOOP;
+
+	return __Terrno(ret, ioctl(fd, SPI_RTIOC_SET_CONFIG, config));
+}
+
+static int check_errors(int fd, struct rtdm_spi_segment *segs)
+{
+	int ret;
+
+	build_scan(segs, 1, 0);
+	segs[0].i_offset = half_len;
+	if (!smokey_assert(run_list(fd, segs, 1) == -EINVAL))
+		return -EINVAL;
+
+	build_scan(segs, 1, 0);
+	segs[0].len = 0;
+	if (!smokey_assert(run_list(fd, segs, 1) == -EINVAL))
+		return -EINVAL;
+
+	build_scan(segs, 1, SPI_SEG_SLAVE);
+	segs[0].chip_select = 255;
+	ret = run_list(fd, segs, 1);
+	if (!smokey_assert(ret == -ENODEV))
+		return -EINVAL;
+
+	if (!smokey_assert(run_list(fd, segs, SPI_XFER_LIST_MAX + 1) == -EINVAL))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int time_scans(int fd, struct rtdm_spi_segment *segs, int nr,
+		      int loops)
+{
+	long long start, t_read, t_list;
+	unsigned char buf[SEG_LEN];
+	int n, k, ret;
+
+	build_scan(segs, nr, SPI_SEG_CS_CHANGE);
+
+	start = now_ns();
+	for (n = 0; n < loops; n++) {
+		for (k = 0; k < nr; k++) {
+			ret = read(fd, buf, sizeof(buf));
+			if (ret != sizeof(buf)) {
+				ret = ret < 0 ? -errno : -EIO;
+				smokey_warning("read(): %s", strerror(-ret));
+				return ret;
+			}
+		}
+	}
+	t_read = now_ns() - start;
+
+	start = now_ns();
+	for (n = 0; n < loops; n++) {
+		if (!__T(ret, run_list(fd, segs, nr)))
+			return ret;
+	}
+	t_list = now_ns() - start;
+
+	smokey_trace("%d segments/scan: %lld ns/scan with read(), "
+		     "%lld ns/scan with a transfer list",
+		     nr, t_read / loops, t_list / loops);
+
+	return 0;
+}
+
+static int run_spi_xfer_list(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct rtdm_spi_segment segs[SPI_XFER_LIST_MAX + 1];
+	int fd, ret, nr = 12, loops = 1000;
+	struct rtdm_spi_config config;
+	struct rtdm_spi_iobufs iobufs;
+	struct rtdm_device_info info;
+	struct sched_param param;
+	const char *device;
+	void *p;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(spi_xfer_list, segments))
+		nr = SMOKEY_ARG_INT(spi_xfer_list, segments);
+
+	if (SMOKEY_ARG_ISSET(spi_xfer_list, loops))
+		loops = SMOKEY_ARG_INT(spi_xfer_list, loops);
+
+	if (nr < 2 || nr > SPI_XFER_LIST_MAX || loops < 1) {
+		smokey_warning("segments must be in [2..%d], loops positive",
+			       SPI_XFER_LIST_MAX);
+		return -EINVAL;
+	}
+
+	if (!SMOKEY_ARG_ISSET(spi_xfer_list, device)) {
+		smokey_warning("missing device= specification");
+		return -EINVAL;
+	}
+
+	device = SMOKEY_ARG_STRING(spi_xfer_list, device);
+	fd = open(device, O_RDWR);
+	if (fd < 0) {
+		ret = -errno;
+		smokey_warning("cannot open device %s [%s]",
+			       device, symerror(ret));
+		return ret;
+	}
+
+	if (!__Terrno(ret, ioctl(fd, RTIOC_DEVICE_INFO, &info)))
+		goto out;
+
+	area_len = nr * SEG_LEN;
+	if (area_len < DMA_LEN)
+		area_len = DMA_LEN;
+
+	iobufs.io_len = area_len;
+	if (!__Terrno(ret, ioctl(fd, SPI_RTIOC_SET_IOBUFS, &iobufs)))
+		goto out;
+
+	p = mmap(NULL, iobufs.map_len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (!__Fassert(p == MAP_FAILED)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	i_area = p + iobufs.i_offset;
+	o_area = p + iobufs.o_offset;
+	half_len = iobufs.o_offset - iobufs.i_offset;
+	memset(o_area, 0, area_len);
+
+	config.mode = SPI_MODE_0;
+	config.bits_per_word = 8;
+	config.speed_hz = 10000000;
+	if (!__Terrno(ret, ioctl(fd, SPI_RTIOC_SET_CONFIG, &config)))
+		goto unmap;
+
+	param.sched_priority = 10;
+	if (!__T(ret, pthread_setschedparam(pthread_self(),
+					    SCHED_FIFO, &param)))
+		goto unmap;
+
+	ret = run_list(fd, segs, 0);
+	if (ret == -ENOSYS || ret == -EINVAL) {
+		smokey_note("no transfer list support on %s", device);
+		ret = -ENOSYS;
+		goto relax;
+	}
+
+	ret = check_errors(fd, segs);
+	if (ret)
+		goto relax;
+
+	if (info.device_sub_class == RTDM_SUBCLASS_SPI_LOOPBACK) {
+		ret = check_counters(fd, segs, nr);
+		if (ret)
+			goto relax;
+		ret = check_loop(fd, &config);
+		if (ret)
+			goto relax;
+	} else
+		smokey_trace("not a loopback master, data left unchecked");
+
+	ret = time_scans(fd, segs, nr, loops);
+relax:
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+unmap:
+	munmap(p, iobufs.map_len);
+out:
+	close(fd);
+
+	return ret;
+}
@@ -23,83 +23,40 @@
 #include <assert.h>
 #include <errno.h>
 #include <math.h>
+#include <rtdm/analogy.h>
 
 #include "wf_facilities.h"
 
-#ifndef PI
-#define PI 3.14159265358979323846
-#endif
-
 void a4l_wf_init_sine(struct waveform_config *config, double *values)
 {
-	int i;
-
 	double ratio = config->wf_frequency / config->spl_frequency;
 
-	for (i = 0; i < config->spl_count; i++) {
-
-		values[i] = config->wf_offset -
-			config->wf_amplitude / 2 +
-			0.5 * config->wf_amplitude * cos(i * 2 * PI * ratio);
-	}
+	a4l_math_sine(values, 0, config->spl_count, ratio,
+		      config->wf_amplitude, config->wf_offset);
 }
 
 void a4l_wf_init_sawtooth(struct waveform_config *config, double *values)
 {
-	int i;
-
 	double ratio = config->wf_frequency / config->spl_frequency;
 
-	for (i = 0; i < config->spl_count; i++) {
-
-		int period_idx = (int)floor(i * ratio);
-
-		values[i] = config->wf_offset -
-			config->wf_amplitude / 2 -
-			period_idx * config->wf_amplitude +
-			i * ratio * config->wf_amplitude;
-	}
+	a4l_math_sawtooth(values, 0, config->spl_count, ratio,
+			  config->wf_amplitude, config->wf_offset);
 }
 
 void a4l_wf_init_triangular(struct waveform_config *config, double *values)
 {
-	int i;
-
 	double ratio = config->wf_frequency / config->spl_frequency;
 
-	for (i = 0; i < config->spl_count; i++) {
-
-		int period_idx = (int)floor(i * ratio);
-		int half_period_idx = (int)floor(i * 2 * ratio);
-		int rise = ((half_period_idx % 2) == 0) ? 1 : 0;
-
-		if (rise) {
-			values[i] = config->wf_offset -
-				config->wf_amplitude / 2 -
-				2 * period_idx * config->wf_amplitude +
-				2 * i * ratio * config->wf_amplitude;
-		} else {
-			values[i] = config->wf_offset -
-				config->wf_amplitude / 2 +
-				2 * (period_idx + 1) * config->wf_amplitude -
-				2 * i * ratio * config->wf_amplitude;
-		}
-	}
+	a4l_math_triangle(values, 0, config->spl_count, ratio,
+			  config->wf_amplitude, config->wf_offset);
 }
 
 void a4l_wf_init_steps(struct waveform_config *config, double *values)
 {
-	int i;
-
 	double ratio = config->wf_frequency / config->spl_frequency;
 
-	for (i = 0; i < config->spl_count; i++) {
-		int half_period_idx = (int)floor(i * 2 * ratio);
-		int even = (half_period_idx % 2 == 0);
-
-		values[i] = config->wf_offset -
-			config->wf_amplitude / 2 + even * config->wf_amplitude;
-	}
+	a4l_math_square(values, 0, config->spl_count, ratio,
+			config->wf_amplitude, config->wf_offset);
 }
 
 void a4l_wf_set_sample_count(struct waveform_config *config)
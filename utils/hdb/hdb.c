@@ -25,6 +25,8 @@
 #include <error.h>
 #include <fcntl.h>
 #include <copperplate/cluster.h>
+#include <copperplate/metricobj.h>
+#include <copperplate/tunables.h>
 #include <xenomai/init.h>
 
 static const struct option options[] = {
@@ -33,6 +35,11 @@ static const struct option options[] = {
 		.name = "dump-cluster",
 		.has_arg = required_argument,
 	},
+	{
+#define dump_metrics_opt	1
+		.name = "dump-metrics",
+		.has_arg = required_argument,
+	},
 	{ /* Sentinel */ }
 };
 
@@ -40,6 +47,7 @@ void application_usage(void)
 {
         fprintf(stderr, "usage: %s <option>:\n", get_program_name());
 	fprintf(stderr, "--dump-cluster <name>		dump cluster <name>\n");
+	fprintf(stderr, "--dump-metrics <name>		dump metric channel <name>\n");
 }
 
 static int check_shared_heap(const char *cmd)
@@ -113,9 +121,75 @@ static int dump_cluster(const char *name)
 	return cluster_walk(&cluster, walk_cluster);
 }
 
+static void dump_histogram(const struct metric_sample *s)
+{
+	unsigned int n, last = s->nr_buckets - 1;
+	long long lo;
+
+	printf("%-24s histogram  count=%llu min=%lld max=%lld avg=%lld\n",
+	       s->name, (unsigned long long)s->count,
+	       (long long)s->min, (long long)s->max,
+	       s->count ? (long long)(s->sum / (int64_t)s->count) : 0LL);
+
+	for (n = 0; n <= last; n++) {
+		if (s->buckets[n] == 0)
+			continue;
+		lo = s->base + (long long)(n - 1) * s->width;
+		if (n == 0)
+			printf("%26s< %lld: %llu\n", "", (long long)s->base,
+			       (unsigned long long)s->buckets[n]);
+		else if (n == last)
+			printf("%26s>= %lld: %llu\n", "", lo,
+			       (unsigned long long)s->buckets[n]);
+		else
+			printf("%26s[%lld, %lld): %llu\n", "", lo,
+			       lo + (long long)s->width,
+			       (unsigned long long)s->buckets[n]);
+	}
+}
+
+static int dump_metrics(const char *name)
+{
+	struct metricobj_reader reader;
+	static uint64_t buckets[65536 + 2];
+	struct metric_sample s;
+	int ret, n, nr;
+
+	ret = metricobj_attach(&reader, get_config_tunable(session_label),
+			       name);
+	if (ret)
+		return ret;
+
+	nr = metricobj_count(&reader);
+	for (n = 0; n < nr; n++) {
+		s.buckets = buckets;
+		s.nr_buckets = sizeof(buckets) / sizeof(buckets[0]);
+		ret = metricobj_sample(&reader, n, &s);
+		if (ret)
+			break;
+		switch (s.type) {
+		case METRIC_COUNTER:
+			printf("%-24s counter    %llu\n", s.name,
+			       (unsigned long long)s.count);
+			break;
+		case METRIC_GAUGE:
+			printf("%-24s gauge      %lld\n", s.name,
+			       (long long)s.value);
+			break;
+		case METRIC_HISTOGRAM:
+			dump_histogram(&s);
+			break;
+		}
+	}
+
+	metricobj_detach(&reader);
+
+	return ret;
+}
+
 int main(int argc, char *const argv[])
 {
-	const char *cluster_name = NULL;
+	const char *cluster_name = NULL, *metrics_name = NULL;
 	int lindex, c, ret = 0;
 
 	for (;;) {
@@ -133,6 +207,9 @@ int main(int argc, char *const argv[])
 		case dump_cluster_opt:
 			cluster_name = optarg;
 			break;
+		case dump_metrics_opt:
+			metrics_name = optarg;
+			break;
 		default:
 			return EINVAL;
 		}
@@ -140,6 +217,8 @@ int main(int argc, char *const argv[])
 
 	if (cluster_name)
 		ret = dump_cluster(cluster_name);
+	else if (metrics_name)
+		ret = dump_metrics(metrics_name);
 
 	if (ret)
 		error(1, -ret, "hdb");
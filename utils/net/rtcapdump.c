@@ -0,0 +1,404 @@
+/***
+ *
+ *  tools/rtcapdump.c
+ *  Dumps the RTcap capture rings to a pcap-ng file
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+
+#include <rtnet_chrdev.h>
+#include <rtcap_ring.h>
+
+
+#define PCAPNG_SHB              0x0A0D0D0A
+#define PCAPNG_IDB              0x00000001
+#define PCAPNG_EPB              0x00000006
+#define PCAPNG_BYTE_ORDER       0x1A2B3C4D
+#define PCAPNG_LINKTYPE_ETHER   1
+
+#define OPT_ENDOFOPT            0
+#define OPT_IF_NAME             2
+#define OPT_IF_TSRESOL          9
+#define OPT_EPB_FLAGS           2
+
+#define MAX_IFINDEX             32
+
+
+static FILE                 *out;
+static int                  f;
+static unsigned char        *area;
+static struct rtcap_info    info;
+static int                  if_id[MAX_IFINDEX];
+static int                  if_count;
+static int                  use_rtmac_stamps;
+static volatile int         terminate;
+
+
+static void help(void)
+{
+    fprintf(stderr, "Usage:\n"
+        "\trtcapdump [-w <file>] [-i <dev>]... [-e <ethertype>] "
+            "[-d rx|tx]\n"
+        "\t          [-s <snaplen>] [-c <count>] [-m]\n"
+        "\n"
+        "\t-m: stamp frames delayed by RTmac with their enqueuing time\n");
+
+    exit(1);
+}
+
+
+
+static int getintopt(int argc, int pos, char *argv[], int min)
+{
+    int result;
+
+
+    if (pos >= argc)
+        help();
+    if ((sscanf(argv[pos], "%i", &result) != 1) || (result < min)) {
+        fprintf(stderr, "invalid parameter: %s %s\n", argv[pos-1], argv[pos]);
+        exit(1);
+    }
+
+    return result;
+}
+
+
+
+static int query_device(struct rtnet_core_cmd *cmd)
+{
+    int rtnet;
+    int ret;
+
+
+    rtnet = open("/dev/rtnet", O_RDWR);
+    if (rtnet < 0)
+        return -1;
+
+    ret = ioctl(rtnet, IOC_RT_IFINFO, cmd);
+    close(rtnet);
+
+    return ret;
+}
+
+
+
+static void write_block(uint32_t type, const void *body, uint32_t len)
+{
+    uint32_t total = 12 + len;
+
+
+    fwrite(&type, 4, 1, out);
+    fwrite(&total, 4, 1, out);
+    fwrite(body, len, 1, out);
+    fwrite(&total, 4, 1, out);
+}
+
+
+
+static void write_section_header(void)
+{
+    struct {
+        uint32_t    magic;
+        uint16_t    major;
+        uint16_t    minor;
+        int64_t     section_len;
+        uint32_t    endofopt;
+    } __attribute__((packed)) shb = {
+        .magic          = PCAPNG_BYTE_ORDER,
+        .major          = 1,
+        .minor          = 0,
+        .section_len    = -1,
+        .endofopt       = OPT_ENDOFOPT,
+    };
+
+
+    write_block(PCAPNG_SHB, &shb, sizeof(shb));
+}
+
+
+
+/* Interfaces are described lazily, when their first frame shows up. */
+static int interface_id(unsigned int ifindex)
+{
+    struct rtnet_core_cmd   cmd;
+    uint32_t                idb[16];
+    uint16_t                *opt;
+    unsigned int            name_len;
+
+
+    if (ifindex >= MAX_IFINDEX)
+        ifindex = 0;
+    if (if_id[ifindex] != 0)
+        return if_id[ifindex] - 1;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.args.info.ifindex = ifindex;
+    if (ifindex == 0 || query_device(&cmd) < 0)
+        snprintf(cmd.head.if_name, IFNAMSIZ, "rtif%u", ifindex);
+    name_len = strnlen(cmd.head.if_name, IFNAMSIZ - 1);
+
+    memset(idb, 0, sizeof(idb));
+    *(uint16_t *)&idb[0] = PCAPNG_LINKTYPE_ETHER;
+    idb[1] = info.snaplen;
+
+    /* options are padded to 32 bits */
+    opt = (uint16_t *)&idb[2];
+    opt[0] = OPT_IF_NAME;
+    opt[1] = name_len;
+    memcpy(&opt[2], cmd.head.if_name, name_len);
+
+    opt = (uint16_t *)&idb[3 + (name_len + 3) / 4];
+    opt[0] = OPT_IF_TSRESOL;
+    opt[1] = 1;
+    *(uint8_t *)&opt[2] = 9;    /* nanoseconds */
+    /* opt_endofopt follows as zeros */
+
+    write_block(PCAPNG_IDB, idb,
+                (3 + (name_len + 3) / 4 + 2 + 1) * sizeof(uint32_t));
+
+    if_id[ifindex] = ++if_count;
+
+    return if_count - 1;
+}
+
+
+
+static void write_packet(const struct rtcap_record *rec)
+{
+    struct {
+        uint32_t    interface;
+        uint32_t    ts_high;
+        uint32_t    ts_low;
+        uint32_t    caplen;
+        uint32_t    len;
+    } epb;
+    struct {
+        uint16_t    code;
+        uint16_t    len;
+        uint32_t    flags;
+        uint32_t    endofopt;
+    } opts = {
+        .code       = OPT_EPB_FLAGS,
+        .len        = 4,
+        .flags      = (rec->flags & RTCAP_F_TX) ? 2 : 1,
+        .endofopt   = OPT_ENDOFOPT,
+    };
+    uint64_t        stamp = rec->timestamp;
+    static const uint8_t zeros[4];
+    uint32_t        type = PCAPNG_EPB;
+    uint32_t        pad = (4 - (rec->caplen & 3)) & 3;
+    uint32_t        total;
+
+
+    if (use_rtmac_stamps && (rec->flags & RTCAP_F_RTMAC_STAMP))
+        stamp = rec->rtmac_stamp;
+
+    epb.interface = interface_id(rec->ifindex);
+    epb.ts_high   = stamp >> 32;
+    epb.ts_low    = (uint32_t)stamp;
+    epb.caplen    = rec->caplen;
+    epb.len       = rec->len;
+
+    total = 12 + sizeof(epb) + rec->caplen + pad + sizeof(opts);
+
+    fwrite(&type, 4, 1, out);
+    fwrite(&total, 4, 1, out);
+    fwrite(&epb, sizeof(epb), 1, out);
+    fwrite(rec + 1, rec->caplen, 1, out);
+    fwrite(zeros, pad, 1, out);
+    fwrite(&opts, sizeof(opts), 1, out);
+    fwrite(&total, 4, 1, out);
+}
+
+
+
+static unsigned long drain_ring(struct rtcap_ring_hdr *hdr, unsigned long max)
+{
+    const unsigned char         *data = (unsigned char *)hdr + hdr->data_offset;
+    const struct rtcap_record   *rec;
+    unsigned long               packets = 0;
+    uint32_t                    head, tail, pos;
+
+
+    tail = hdr->tail;
+    head = hdr->head;
+    /* Read the records only after head. */
+    __sync_synchronize();
+
+    while (tail != head && packets < max) {
+        pos = tail & (hdr->size - 1);
+        if (hdr->size - pos < sizeof(*rec)) {
+            tail += hdr->size - pos;
+            continue;
+        }
+
+        rec = (const struct rtcap_record *)(data + pos);
+        if (rec->type == RTCAP_REC_PACKET) {
+            write_packet(rec);
+            packets++;
+        }
+        tail += rec->reclen;
+    }
+
+    /* Release the space only after we are done with the records. */
+    __sync_synchronize();
+    hdr->tail = tail;
+
+    return packets;
+}
+
+
+
+static void terminate_handler(int sig)
+{
+    terminate = 1;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    struct rtcap_filter     filter;
+    struct rtnet_core_cmd   cmd;
+    struct rtcap_ring_hdr   *hdr;
+    unsigned long           count = 0, packets = 0, got;
+    unsigned long long      dropped = 0, filtered = 0;
+    const char              *file = NULL;
+    unsigned int            i;
+    int                     timeout;
+
+
+    memset(&filter, 0, sizeof(filter));
+
+    for (i = 1; i < (unsigned int)argc; i++) {
+        if (strcmp(argv[i], "-w") == 0) {
+            if (++i >= (unsigned int)argc)
+                help();
+            file = argv[i];
+        } else if (strcmp(argv[i], "-i") == 0) {
+            if (++i >= (unsigned int)argc)
+                help();
+            memset(&cmd, 0, sizeof(cmd));
+            strncpy(cmd.head.if_name, argv[i], IFNAMSIZ - 1);
+            if (query_device(&cmd) < 0) {
+                perror(argv[i]);
+                exit(1);
+            }
+            if (cmd.args.info.ifindex >= 32) {
+                fprintf(stderr, "%s: cannot be filtered\n", argv[i]);
+                exit(1);
+            }
+            filter.ifmask |= 1U << cmd.args.info.ifindex;
+        } else if (strcmp(argv[i], "-e") == 0)
+            filter.ethertype = htons(getintopt(argc, ++i, argv, 1));
+        else if (strcmp(argv[i], "-d") == 0) {
+            if (++i >= (unsigned int)argc)
+                help();
+            if (strcmp(argv[i], "rx") == 0)
+                filter.directions = RTCAP_F_RX;
+            else if (strcmp(argv[i], "tx") == 0)
+                filter.directions = RTCAP_F_TX;
+            else
+                help();
+        } else if (strcmp(argv[i], "-s") == 0)
+            filter.snaplen = getintopt(argc, ++i, argv, 0);
+        else if (strcmp(argv[i], "-c") == 0)
+            count = getintopt(argc, ++i, argv, 1);
+        else if (strcmp(argv[i], "-m") == 0)
+            use_rtmac_stamps = 1;
+        else
+            help();
+    }
+
+    f = open("/dev/rtdm/rtcap", O_RDWR);
+    if (f < 0) {
+        perror("/dev/rtdm/rtcap (RTcap loaded with rtcap_ring_size?)");
+        exit(1);
+    }
+
+    if (ioctl(f, RTCAP_RTIOC_SET_FILTER, &filter) < 0 ||
+        ioctl(f, RTCAP_RTIOC_GET_INFO, &info) < 0) {
+        perror("ioctl");
+        exit(1);
+    }
+
+    area = mmap(NULL, info.map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                f, 0);
+    if (area == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+
+    if (file != NULL) {
+        out = fopen(file, "w");
+        if (out == NULL) {
+            perror(file);
+            exit(1);
+        }
+    } else
+        out = stdout;
+
+    signal(SIGINT, terminate_handler);
+    signal(SIGTERM, terminate_handler);
+
+    write_section_header();
+
+    while (!terminate && (count == 0 || packets < count)) {
+        got = 0;
+        for (i = 0; i < info.cpus; i++)
+            got += drain_ring((struct rtcap_ring_hdr *)
+                                (area + i * info.ring_stride),
+                              count ? count - packets - got : ~0UL);
+        packets += got;
+
+        if (got == 0) {
+            fflush(out);
+            timeout = 500;
+            if (ioctl(f, RTCAP_RTIOC_WAIT, &timeout) < 0 &&
+                errno != ETIMEDOUT && errno != EINTR) {
+                perror("ioctl");
+                break;
+            }
+        }
+    }
+
+    fclose(out);
+
+    for (i = 0; i < info.cpus; i++) {
+        hdr = (struct rtcap_ring_hdr *)(area + i * info.ring_stride);
+        dropped  += hdr->dropped;
+        filtered += hdr->filtered;
+    }
+    fprintf(stderr, "%lu packets captured, %llu dropped, %llu filtered\n",
+            packets, dropped, filtered);
+
+    munmap(area, info.map_size);
+    close(f);
+
+    return 0;
+}